@@ -18,6 +18,7 @@
 #define LOG_TAG "CursorWindow"
 
 #include "AndroidfwCursorWindow.h"
+#include "StringTranscoder.h"
 #include "android_database_SQLiteCommon.h"
 
 #include <sys/mman.h>
@@ -82,6 +83,17 @@ CursorWindow::CursorWindow(void* data, size_t size, bool readOnly) :
         return OK;
     }
 
+    status_t CursorWindow::restore(const void* snapshot, size_t size) {
+        if (mReadOnly) {
+            return INVALID_OPERATION;
+        }
+        if (size < sizeof(Header) || size > mSize) {
+            return NO_MEMORY;
+        }
+        memcpy(mData, snapshot, size);
+        return OK;
+    }
+
     status_t CursorWindow::setNumColumns(uint32_t numColumns) {
         if (mReadOnly) {
             return INVALID_OPERATION;
@@ -97,6 +109,11 @@ CursorWindow::CursorWindow(void* data, size_t size, bool readOnly) :
     }
 
     status_t CursorWindow::allocRow() {
+        FieldSlot* fieldDir;
+        return allocRow(&fieldDir);
+    }
+
+    status_t CursorWindow::allocRow(FieldSlot** outFieldDir) {
         if (mReadOnly) {
             return INVALID_OPERATION;
         }
@@ -122,6 +139,7 @@ CursorWindow::CursorWindow(void* data, size_t size, bool readOnly) :
         LOG_WINDOW("Allocated row %u, rowSlot is at offset %u, fieldDir is %d bytes at offset %u\n",
                    mHeader->numRows - 1, offsetFromPtr(rowSlot), fieldDirSize, fieldDirOffset);
         rowSlot->offset = fieldDirOffset;
+        *outFieldDir = fieldDir;
         return OK;
     }
 
@@ -217,6 +235,38 @@ CursorWindow::CursorWindow(void* data, size_t size, bool readOnly) :
         return putBlobOrString(row, column, value, sizeIncludingNull, FIELD_TYPE_STRING);
     }
 
+    status_t CursorWindow::putStringUtf16(uint32_t row, uint32_t column, const KChar* value,
+                                          size_t length) {
+        if (mReadOnly) {
+            return INVALID_OPERATION;
+        }
+
+        FieldSlot* fieldSlot = getFieldSlot(row, column);
+        if (!fieldSlot) {
+            return BAD_VALUE;
+        }
+
+        // Encode in a single pass when the worst case (3 bytes per unit) fits. This is the most
+        // recent allocation, so whatever it did not use goes straight back to the free space.
+        size_t worstCase = length * 3 + 1;
+        bool measured = worstCase > freeSpace();
+        size_t reserve = measured ? Utf8LengthOfUtf16(value, length) + 1 : worstCase;
+        uint32_t offset = alloc(reserve);
+        if (!offset) {
+            return NO_MEMORY;
+        }
+
+        char* dest = static_cast<char*>(offsetToPtr(offset));
+        size_t size = Utf16ToUtf8(value, length, dest);
+        dest[size] = '\0';
+        mHeader->freeOffset = offset + size + 1;
+
+        fieldSlot->type = FIELD_TYPE_STRING;
+        fieldSlot->data.buffer.offset = offset;
+        fieldSlot->data.buffer.size = size + 1;
+        return OK;
+    }
+
     status_t CursorWindow::putBlobOrString(uint32_t row, uint32_t column,
                                            const void* value, size_t size, int32_t type) {
         if (mReadOnly) {
@@ -228,6 +278,11 @@ CursorWindow::CursorWindow(void* data, size_t size, bool readOnly) :
             return BAD_VALUE;
         }
 
+        return putBlobOrStringAt(fieldSlot, value, size, type);
+    }
+
+    status_t CursorWindow::putBlobOrStringAt(FieldSlot* fieldSlot, const void* value, size_t size,
+                                             int32_t type) {
         uint32_t offset = alloc(size);
         if (!offset) {
             return NO_MEMORY;
@@ -67,6 +67,8 @@ namespace android {
             FIELD_TYPE_FLOAT = 2,
             FIELD_TYPE_STRING = 3,
             FIELD_TYPE_BLOB = 4,
+            /* Column left out of the fill by a column mask. Never read back by the cursor. */
+            FIELD_TYPE_UNFETCHED = 5,
         };
 
         /* Opaque type that describes a field slot. */
@@ -97,19 +99,65 @@ namespace android {
         status_t clear();
         status_t setNumColumns(uint32_t numColumns);
 
+        /**
+         * The bytes in use, from the start of the window. A copy of them is a snapshot of its
+         * contents, which restore() can put back into any window at least as big.
+         */
+        inline const void* data() { return mData; }
+        inline size_t usedSize() { return mHeader->freeOffset; }
+        status_t restore(const void* snapshot, size_t size);
+
         /**
          * Allocate a row slot and its directory.
          * The row is initialized will null entries for each field.
          */
         status_t allocRow();
+        /**
+         * Same as allocRow, but also hands back the row's field directory so a caller filling
+         * the whole row can write each slot without looking the row up again.
+         */
+        status_t allocRow(FieldSlot** outFieldDir);
         status_t freeLastRow();
 
         status_t putBlob(uint32_t row, uint32_t column, const void* value, size_t size);
         status_t putString(uint32_t row, uint32_t column, const char* value, size_t sizeIncludingNull);
+        /**
+         * Encodes UTF-16 text straight into the window as NUL-terminated UTF-8.
+         */
+        status_t putStringUtf16(uint32_t row, uint32_t column, const KChar* value, size_t length);
         status_t putLong(uint32_t row, uint32_t column, KLong value);
         status_t putDouble(uint32_t row, uint32_t column, KDouble value);
         status_t putNull(uint32_t row, uint32_t column);
 
+        /*
+         * Slot writers for rows that are still being filled. The slot must come from allocRow
+         * on this (writable) window.
+         */
+        status_t putBlobOrStringAt(FieldSlot* fieldSlot, const void* value, size_t size,
+                                   int32_t type);
+
+        inline void putLongAt(FieldSlot* fieldSlot, int64_t value) {
+            fieldSlot->type = FIELD_TYPE_INTEGER;
+            fieldSlot->data.l = value;
+        }
+
+        inline void putDoubleAt(FieldSlot* fieldSlot, double value) {
+            fieldSlot->type = FIELD_TYPE_FLOAT;
+            fieldSlot->data.d = value;
+        }
+
+        inline void putUnfetchedAt(FieldSlot* fieldSlot) {
+            fieldSlot->type = FIELD_TYPE_UNFETCHED;
+            fieldSlot->data.buffer.offset = 0;
+            fieldSlot->data.buffer.size = 0;
+        }
+
+        inline void putNullAt(FieldSlot* fieldSlot) {
+            fieldSlot->type = FIELD_TYPE_NULL;
+            fieldSlot->data.buffer.offset = 0;
+            fieldSlot->data.buffer.size = 0;
+        }
+
         /**
          * Gets the field slot at the specified row and column.
          * Returns null if the requested row or column is not in the window.
@@ -40,7 +40,7 @@
 #include "Porting.h"
 #include "Types.h"
 
-#include "utf8.h"
+#include "StringTranscoder.h"
 
 #include <dispatch/dispatch.h>
 
@@ -48,12 +48,12 @@ extern "C" {
 //TODO: Review everything that uses this and make sure we need
 char *CreateCStringFromStringWithSize(KString kstring, size_t *utf8Size) {
     const KChar *utf16 = CharArrayAddressOfElementAt(kstring, 0);
-    KStdString utf8;
-    utf8::unchecked::utf16to8(utf16, utf16 + kstring->count_, back_inserter(utf8));
-    char *result = reinterpret_cast<char *>(konan::calloc(1, utf8.size() + 1));
-    ::memcpy(result, utf8.c_str(), utf8.size());
+    size_t length = kstring->count_;
+    size_t size = Utf8LengthOfUtf16(utf16, length);
+    char *result = reinterpret_cast<char *>(konan::calloc(1, size + 1));
+    Utf16ToUtf8(utf16, length, result);
 
-    *utf8Size = utf8.size();
+    *utf8Size = size;
 
     return result;
 }
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteChangeTracker.h"
+
+#include <string.h>
+
+namespace android {
+
+void TableChange::addRow(KLong rowid) {
+    rows++;
+    size_t count = ranges.size() / 2;
+
+    // Inserts mostly come in rowid order and just extend the last range.
+    if (count > 0 && ranges[2 * count - 1] + 1 == rowid) {
+        ranges[2 * count - 1] = rowid;
+        return;
+    }
+
+    size_t i = 0;
+    while (i < count && ranges[2 * i + 1] + 1 < rowid)
+        i++;
+    if (i < count && ranges[2 * i] <= rowid + 1) {
+        if (rowid < ranges[2 * i])
+            ranges[2 * i] = rowid;
+        if (rowid > ranges[2 * i + 1]) {
+            ranges[2 * i + 1] = rowid;
+            // Now touching the next range.
+            if (i + 1 < count && ranges[2 * i + 2] <= rowid + 1) {
+                ranges[2 * i + 1] = ranges[2 * i + 3];
+                ranges.erase(ranges.begin() + 2 * i + 2, ranges.begin() + 2 * i + 4);
+            }
+        }
+        return;
+    }
+
+    KLong range[] = { rowid, rowid };
+    ranges.insert(ranges.begin() + 2 * i, range, range + 2);
+    if (ranges.size() / 2 > MAX_RANGES) {
+        KLong first = ranges.front();
+        KLong last = ranges.back();
+        ranges.clear();
+        ranges.push_back(first);
+        ranges.push_back(last);
+    }
+}
+
+ChangeSubscription::ChangeSubscription(size_t capacity) :
+        capacity(capacity), slots(new ChangeBatch*[capacity]), head(0), tail(0), missed(false),
+        closed(false), refs(2) {
+}
+
+ChangeSubscription::~ChangeSubscription() {
+    ChangeBatch* batch;
+    while ((batch = poll()) != NULL)
+        batch->release();
+    delete[] slots;
+}
+
+void ChangeSubscription::push(ChangeBatch* batch) {
+    size_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail - head.load(std::memory_order_acquire) == capacity) {
+        missed.store(true, std::memory_order_release);
+        return;
+    }
+    batch->refs.fetch_add(1, std::memory_order_relaxed);
+    slots[currentTail % capacity] = batch;
+    tail.store(currentTail + 1, std::memory_order_release);
+}
+
+void ChangeSubscription::close() {
+    closed.store(true, std::memory_order_release);
+}
+
+ChangeBatch* ChangeSubscription::poll() {
+    size_t currentHead = head.load(std::memory_order_relaxed);
+    if (currentHead != tail.load(std::memory_order_acquire)) {
+        ChangeBatch* batch = slots[currentHead % capacity];
+        head.store(currentHead + 1, std::memory_order_release);
+        return batch;
+    }
+
+    // Only once the ring is empty, so that the gap is reported after what came before it.
+    if (missed.exchange(false, std::memory_order_acq_rel)) {
+        auto gap = new ChangeBatch();
+        gap->sequence = -1;
+        gap->complete = false;
+        gap->refs.store(1, std::memory_order_relaxed);
+        return gap;
+    }
+    return NULL;
+}
+
+void ChangeSubscription::release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
+}
+
+ChangeTracker::ChangeTracker() :
+        writer(NULL), lastChange(0), changedRows(0), totalChangesAtStart(0), sequence(0),
+        committingComplete(true), batchPending(false) {
+    pthread_mutex_init(&mutex, NULL);
+}
+
+ChangeTracker::~ChangeTracker() {
+    for (auto subscription : subscriptions) {
+        subscription->close();
+        subscription->release();
+    }
+    pthread_mutex_destroy(&mutex);
+}
+
+ChangeSubscription* ChangeTracker::subscribe(size_t capacity) {
+    auto subscription = new ChangeSubscription(capacity > 0 ? capacity : 1);
+    pthread_mutex_lock(&mutex);
+    subscriptions.push_back(subscription);
+    pthread_mutex_unlock(&mutex);
+    return subscription;
+}
+
+void ChangeTracker::start(sqlite3* db) {
+    writer = db;
+    totalChangesAtStart = sqlite3_total_changes(db);
+}
+
+void ChangeTracker::rowChanged(int operation, const char* dbName, const char* table,
+        sqlite3_int64 rowid) {
+    changedRows++;
+
+    // Bulk writes mostly hit the same table with the same operation over and over.
+    TableChange* change = NULL;
+    if (lastChange < pending.size()) {
+        TableChange& last = pending[lastChange];
+        if (last.operation == operation && last.table == table && last.database == dbName)
+            change = &last;
+    }
+    for (size_t i = 0; change == NULL && i < pending.size(); i++) {
+        TableChange& candidate = pending[i];
+        if (candidate.operation == operation && candidate.table == table
+                && candidate.database == dbName) {
+            change = &candidate;
+            lastChange = i;
+        }
+    }
+    if (change == NULL) {
+        pending.push_back(TableChange());
+        change = &pending.back();
+        change->database = dbName;
+        change->table = table;
+        change->operation = operation;
+        change->rows = 0;
+        lastChange = pending.size() - 1;
+    }
+    change->addRow(rowid);
+}
+
+void ChangeTracker::committing() {
+    KLong totalChanges = sqlite3_total_changes(writer);
+    if (totalChanges - totalChangesAtStart != changedRows)
+        committingComplete = false;
+    totalChangesAtStart = totalChanges;
+    changedRows = 0;
+
+    if (committingChanges.empty())
+        committingChanges.swap(pending);
+    else
+        committingChanges.insert(committingChanges.end(), pending.begin(), pending.end());
+    batchPending = true;
+    pending.clear();
+    lastChange = 0;
+}
+
+void ChangeTracker::committed() {
+    if (!batchPending)
+        return;
+
+    pthread_mutex_lock(&mutex);
+    for (size_t i = 0; i < subscriptions.size();) {
+        if (subscriptions[i]->isClosed()) {
+            subscriptions[i]->release();
+            subscriptions.erase(subscriptions.begin() + i);
+        } else {
+            i++;
+        }
+    }
+    if (!subscriptions.empty() && (!committingChanges.empty() || !committingComplete)) {
+        auto batch = new ChangeBatch();
+        batch->sequence = ++sequence;
+        batch->complete = committingComplete;
+        batch->changes.swap(committingChanges);
+        batch->refs.store(1, std::memory_order_relaxed);
+        for (auto subscription : subscriptions)
+            subscription->push(batch);
+        batch->release();
+    }
+    pthread_mutex_unlock(&mutex);
+
+    committingChanges.clear();
+    committingComplete = true;
+    batchPending = false;
+}
+
+void ChangeTracker::rolledBack() {
+    pending.clear();
+    lastChange = 0;
+    changedRows = 0;
+    totalChangesAtStart = sqlite3_total_changes(writer);
+
+    committingChanges.clear();
+    committingComplete = true;
+    batchPending = false;
+}
+
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITECHANGETRACKER_H
+#define KNARCH_SQLITECHANGETRACKER_H
+
+#include <atomic>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "Types.h"
+
+namespace android {
+
+/*
+ * The rows one transaction changed in one table with one kind of operation (SQLITE_INSERT,
+ * SQLITE_UPDATE or SQLITE_DELETE). Rowids are kept as sorted, merged inclusive ranges; past
+ * MAX_RANGES they collapse into a single range from the lowest to the highest.
+ */
+struct TableChange {
+    static const size_t MAX_RANGES = 32;
+
+    KStdString database;
+    KStdString table;
+    int operation;
+    KLong rows;
+    KStdVector<KLong> ranges;
+
+    void addRow(KLong rowid);
+};
+
+/*
+ * Everything one committed transaction changed. Not complete when the transaction changed rows
+ * the update hook doesn't report, such as in WITHOUT ROWID tables, or when the subscriber fell
+ * behind and commits were dropped; the subscriber then has to assume anything changed.
+ */
+struct ChangeBatch {
+    KLong sequence;
+    bool complete;
+    KStdVector<TableChange> changes;
+    std::atomic<int> refs;
+
+    void release() {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+};
+
+/*
+ * One subscriber's queue of batches: a lock-free ring with the writer's thread as its only
+ * producer and the subscriber as its only consumer. When the ring is full, the commit is dropped
+ * and the subscriber's next poll after the ring empties reports an incomplete batch.
+ */
+class ChangeSubscription {
+public:
+    explicit ChangeSubscription(size_t capacity);
+
+    // Producer side.
+    void push(ChangeBatch* batch);
+
+    // Ends the subscription, from either side.
+    void close();
+
+    // Consumer side. Returns NULL when there is nothing new. The batch must be released.
+    ChangeBatch* poll();
+    bool isClosed() const {
+        return closed.load(std::memory_order_acquire);
+    }
+
+    // Once by the tracker and once by the subscriber.
+    void release();
+
+private:
+    ~ChangeSubscription();
+
+    const size_t capacity;
+    ChangeBatch** slots;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<bool> missed;
+    std::atomic<bool> closed;
+    std::atomic<int> refs;
+};
+
+/*
+ * Collects the changes of the writer's transactions from its update hook and hands each
+ * committed transaction to every subscription as one batch. The commit hook runs before the
+ * commit is written, so the batch is only set aside there and published by committed(), once the
+ * commit has finished; a rollback drops it. Calls come from the writer's thread only.
+ */
+class ChangeTracker {
+public:
+    ChangeTracker();
+
+    // Closes the subscriptions still open.
+    ~ChangeTracker();
+
+    // The subscriber releases the subscription when done with it, which the tracker notices on
+    // the next commit.
+    ChangeSubscription* subscribe(size_t capacity);
+
+    void start(sqlite3* writer);
+    void rowChanged(int operation, const char* dbName, const char* table, sqlite3_int64 rowid);
+    void committing();
+    void committed();
+    void rolledBack();
+
+private:
+    sqlite3* writer;
+
+    // Only touched from the writer's thread.
+    KStdVector<TableChange> pending;
+    size_t lastChange;
+    KLong changedRows;
+    KLong totalChangesAtStart;
+    KLong sequence;
+    // Set aside by committing() until committed() or rolledBack(). Also holds an earlier try
+    // when a commit fails and is retried.
+    KStdVector<TableChange> committingChanges;
+    bool committingComplete;
+    bool batchPending;
+
+    pthread_mutex_t mutex;
+    // Guarded by mutex.
+    KStdVector<ChangeSubscription*> subscriptions;
+};
+
+}
+
+#endif // KNARCH_SQLITECHANGETRACKER_H
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteCheckpointer.h"
+
+#include <string.h>
+#include <sys/time.h>
+
+#include "Porting.h"
+
+namespace android {
+
+// A WAL that readers have kept from being copied back for this many times the trigger size is
+// truncated, which waits for those readers to finish.
+static const int TRUNCATE_AFTER_FRAMES_FACTOR = 4;
+
+// How long a TRUNCATE checkpoint waits on readers and the writer before giving up until next time.
+static const int TRUNCATE_BUSY_TIMEOUT_MS = 100;
+
+// SQLite's own default, for when the writer's setting can't be read.
+static const int DEFAULT_AUTOCHECKPOINT_FRAMES = 1000;
+
+WalCheckpointer::WalCheckpointer(sqlite3* writer, const CheckpointPolicy& policy) :
+        writer(writer), policy(policy), db(NULL),
+        autoCheckpointFrames(DEFAULT_AUTOCHECKPOINT_FRAMES), threadStarted(false), stopping(false),
+        pendingFrames(0), triggerFrames(policy.walFrames), commits(0), quietSinceUs(0),
+        lastCheckpointedFrames(0) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&wake, NULL);
+    memset(stats, 0, sizeof(stats));
+}
+
+WalCheckpointer::~WalCheckpointer() {
+    if (threadStarted) {
+        // Replaces the hook, so the thread gets no more wake-ups from the writer.
+        sqlite3_wal_autocheckpoint(writer, autoCheckpointFrames);
+        pthread_mutex_lock(&mutex);
+        stopping = true;
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&mutex);
+        pthread_join(thread, NULL);
+    }
+    if (db != NULL)
+        sqlite3_close(db);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&mutex);
+}
+
+int WalCheckpointer::start(const char* path) {
+    sqlite3_stmt* pragma;
+    if (sqlite3_prepare_v2(writer, "PRAGMA wal_autocheckpoint", -1, &pragma, NULL) == SQLITE_OK) {
+        if (sqlite3_step(pragma) == SQLITE_ROW)
+            autoCheckpointFrames = sqlite3_column_int(pragma, 0);
+        sqlite3_finalize(pragma);
+    }
+
+    int err = sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE, NULL);
+    if (err == SQLITE_OK)
+        err = sqlite3_busy_timeout(db, TRUNCATE_BUSY_TIMEOUT_MS);
+    if (err == SQLITE_OK && pthread_create(&thread, NULL, &threadMain, this) != 0)
+        err = SQLITE_ERROR;
+    if (err != SQLITE_OK) {
+        sqlite3_close(db);
+        db = NULL;
+        return err;
+    }
+    threadStarted = true;
+
+    // Replaces the auto-checkpoint hook, which is what turns auto-checkpointing off.
+    sqlite3_wal_hook(writer, &walHookCallback, this);
+    return SQLITE_OK;
+}
+
+// Runs on the writer's thread after each commit, with frames the size of the WAL.
+int WalCheckpointer::walHookCallback(void* context, sqlite3*, const char* dbName, int frames) {
+    auto checkpointer = static_cast<WalCheckpointer*>(context);
+    if (strcmp(dbName, "main") != 0)
+        return SQLITE_OK;
+
+    pthread_mutex_lock(&checkpointer->mutex);
+    KLong pending = frames - checkpointer->lastCheckpointedFrames;
+    checkpointer->pendingFrames = pending > 0 ? pending : 0;
+    checkpointer->commits++;
+    checkpointer->quietSinceUs = konan::getTimeMicros();
+    checkpointer->stats[CHECKPOINT_STAT_WAL_FRAMES] = frames;
+    if (checkpointer->pendingFrames >= checkpointer->triggerFrames)
+        pthread_cond_signal(&checkpointer->wake);
+    pthread_mutex_unlock(&checkpointer->mutex);
+    return SQLITE_OK;
+}
+
+void* WalCheckpointer::threadMain(void* context) {
+    static_cast<WalCheckpointer*>(context)->run();
+    return NULL;
+}
+
+void WalCheckpointer::run() {
+    uint64_t idleUs = static_cast<uint64_t>(policy.idleMs > 0 ? policy.idleMs : 1) * 1000;
+
+    pthread_mutex_lock(&mutex);
+    while (!stopping) {
+        if (pendingFrames >= triggerFrames) {
+            checkpoint(false);
+            continue;
+        }
+        if (pendingFrames == 0) {
+            pthread_cond_wait(&wake, &mutex);
+            continue;
+        }
+
+        uint64_t now = konan::getTimeMicros();
+        uint64_t quietUs = now - quietSinceUs;
+        if (quietUs >= idleUs) {
+            checkpoint(true);
+            continue;
+        }
+
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        uint64_t deadlineUs = static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec
+                + (idleUs - quietUs);
+        struct timespec deadline;
+        deadline.tv_sec = static_cast<time_t>(deadlineUs / 1000000);
+        deadline.tv_nsec = static_cast<long>(deadlineUs % 1000000) * 1000;
+        pthread_cond_timedwait(&wake, &mutex, &deadline);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * Called and returns with mutex held, which is let go of while checkpointing. The PASSIVE pass
+ * copies back what it can without waiting on anyone. TRUNCATE follows when the writer has gone
+ * quiet and everything was copied, or when readers have held the WAL for too long.
+ */
+void WalCheckpointer::checkpoint(bool idle) {
+    KLong commitsBefore = commits;
+    int checkpointedBefore = lastCheckpointedFrames;
+    pthread_mutex_unlock(&mutex);
+
+    uint64_t startUs = konan::getTimeMicros();
+    int logFrames = 0;
+    int checkpointed = 0;
+    int mode = SQLITE_CHECKPOINT_PASSIVE;
+    bool truncateFailed = false;
+    int err = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_PASSIVE,
+            &logFrames, &checkpointed);
+    KLong copied = checkpointed > checkpointedBefore ? checkpointed - checkpointedBefore : 0;
+
+    if (err == SQLITE_OK && logFrames > 0) {
+        bool copiedBack = checkpointed == logFrames;
+        bool pinned = !copiedBack
+                && logFrames >= static_cast<KLong>(policy.walFrames) * TRUNCATE_AFTER_FRAMES_FACTOR;
+        if ((copiedBack && idle) || pinned) {
+            int truncatedLog = 0;
+            int truncatedCheckpointed = 0;
+            mode = SQLITE_CHECKPOINT_TRUNCATE;
+            truncateFailed = sqlite3_wal_checkpoint_v2(db, "main", SQLITE_CHECKPOINT_TRUNCATE,
+                    &truncatedLog, &truncatedCheckpointed) != SQLITE_OK;
+            // A failed TRUNCATE leaves what the PASSIVE pass did in place.
+            if (!truncateFailed) {
+                copied += logFrames - checkpointed;
+                logFrames = truncatedLog;
+                checkpointed = truncatedCheckpointed;
+            }
+        }
+    }
+    uint64_t endUs = konan::getTimeMicros();
+    KLong elapsedUs = static_cast<KLong>(endUs - startUs);
+
+    pthread_mutex_lock(&mutex);
+    stats[mode == SQLITE_CHECKPOINT_PASSIVE ? CHECKPOINT_STAT_PASSIVE : CHECKPOINT_STAT_TRUNCATE]++;
+    stats[CHECKPOINT_STAT_FRAMES_CHECKPOINTED] += copied;
+    stats[CHECKPOINT_STAT_TOTAL_US] += elapsedUs;
+    stats[CHECKPOINT_STAT_LAST_US] = elapsedUs;
+    if (elapsedUs > stats[CHECKPOINT_STAT_MAX_US])
+        stats[CHECKPOINT_STAT_MAX_US] = elapsedUs;
+    quietSinceUs = endUs;
+
+    bool finished = err == SQLITE_OK && checkpointed == logFrames;
+    if (!finished || truncateFailed)
+        stats[CHECKPOINT_STAT_BUSY]++;
+
+    if (err != SQLITE_OK) {
+        // Try again once more frames are waiting, or the next time things go quiet.
+        triggerFrames = pendingFrames + policy.walFrames;
+        return;
+    }
+
+    // Once all of it is copied back, the writer starts the WAL over on its next commit.
+    lastCheckpointedFrames = finished ? 0 : checkpointed;
+    triggerFrames = finished ? policy.walFrames : (logFrames - checkpointed) + policy.walFrames;
+    if (commits == commitsBefore) {
+        pendingFrames = logFrames - checkpointed;
+        stats[CHECKPOINT_STAT_WAL_FRAMES] = logFrames;
+    }
+}
+
+void WalCheckpointer::getStats(KLong* outStats) {
+    pthread_mutex_lock(&mutex);
+    memcpy(outStats, stats, sizeof(stats));
+    pthread_mutex_unlock(&mutex);
+}
+
+}
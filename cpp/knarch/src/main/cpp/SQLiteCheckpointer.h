@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITECHECKPOINTER_H
+#define KNARCH_SQLITECHECKPOINTER_H
+
+#include <pthread.h>
+#include <sqlite3.h>
+#include <stdint.h>
+
+#include "Types.h"
+
+namespace android {
+
+/*
+ * When the background checkpointer runs. A checkpoint starts once walFrames frames are waiting in
+ * the WAL, or once the writer has been idle for idleMs with anything waiting at all.
+ */
+struct CheckpointPolicy {
+    KInt walFrames;
+    KInt idleMs;
+};
+
+/* Slots of the LongArray filled by nativeGetCheckpointStats. Must match SQLiteConnection.kt. */
+enum {
+    CHECKPOINT_STAT_WAL_FRAMES = 0,
+    CHECKPOINT_STAT_PASSIVE = 1,
+    CHECKPOINT_STAT_TRUNCATE = 2,
+    CHECKPOINT_STAT_BUSY = 3,
+    CHECKPOINT_STAT_FRAMES_CHECKPOINTED = 4,
+    CHECKPOINT_STAT_TOTAL_US = 5,
+    CHECKPOINT_STAT_MAX_US = 6,
+    CHECKPOINT_STAT_LAST_US = 7,
+    CHECKPOINT_STAT_SIZE = 8,
+};
+
+/*
+ * Checkpoints a writer's WAL on a thread of its own, so that no commit pays for one.
+ *
+ * Installing the WAL hook on the writer turns off SQLite's auto-checkpoint; the hook only records
+ * how big the WAL has grown and wakes the thread. The thread checkpoints through a separate
+ * connection to the same file. It runs PASSIVE checkpoints, which never wait on readers or the
+ * writer, and escalates to TRUNCATE when the writer is idle and the WAL fully copied back, to give
+ * the disk space back, or when readers have kept the WAL from being copied back for
+ * TRUNCATE_AFTER_FRAMES_FACTOR times the trigger size.
+ *
+ * Only the main database is checkpointed in the background. Attached databases are checkpointed
+ * when they are closed.
+ */
+class WalCheckpointer {
+public:
+    WalCheckpointer(sqlite3* writer, const CheckpointPolicy& policy);
+
+    // Stops the thread, closes its connection and gives the writer back the auto-checkpoint it had
+    // before start(), so that its WAL doesn't grow without bound. Call on the writer's thread,
+    // before closing it.
+    ~WalCheckpointer();
+
+    // Opens the checkpoint connection and starts the thread. On failure returns the SQLite error
+    // and leaves the writer's auto-checkpoint as it was.
+    int start(const char* path);
+
+    void getStats(KLong* outStats);
+
+private:
+    static int walHookCallback(void* context, sqlite3* writer, const char* dbName, int frames);
+    static void* threadMain(void* context);
+
+    void run();
+    void checkpoint(bool idle);
+
+    sqlite3* const writer;
+    const CheckpointPolicy policy;
+    sqlite3* db;
+    // The writer's wal_autocheckpoint before start().
+    int autoCheckpointFrames;
+
+    pthread_t thread;
+    bool threadStarted;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    bool stopping;
+
+    // Guarded by mutex. pendingFrames are frames not yet copied back into the database, as of the
+    // last commit or checkpoint. A checkpoint that readers keep from finishing raises
+    // triggerFrames so that the thread waits for more to copy instead of retrying straight away.
+    KLong pendingFrames;
+    KLong triggerFrames;
+    KLong commits;
+    uint64_t quietSinceUs;
+    int lastCheckpointedFrames;
+    KLong stats[CHECKPOINT_STAT_SIZE];
+};
+
+}
+
+#endif // KNARCH_SQLITECHECKPOINTER_H
@@ -0,0 +1,426 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteCollation.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "SQLiteNativeFunctions.h"
+
+extern "C" KChar Kotlin_Char_toLowerCase(KChar ch);
+
+namespace android {
+
+namespace {
+
+enum {
+    PRIMARY = 0,
+    SECONDARY = 1,
+    TERTIARY = 2,
+    LEVELS = 3,
+};
+
+// A weight of 0 is ignored at its level.
+struct CollationElement {
+    uint32_t weights[LEVELS];
+};
+
+const uint32_t BASE_SECONDARY = 1;
+const uint32_t LOWER = 1;
+const uint32_t UPPER = 2;
+
+// Primaries are three bytes, none starting with 0, so that sort keys can end a level with 0.
+// The table's come first and every other character's follow, by code point.
+const uint32_t TABLE_PRIMARY = 0x010000;
+const uint32_t CODE_POINT_PRIMARY = 0x020000;
+
+const uint32_t WHITESPACE_PRIMARY = TABLE_PRIMARY + 0x0010;
+const uint32_t PUNCTUATION_PRIMARY = TABLE_PRIMARY + 0x0020;
+const uint32_t SYMBOL_PRIMARY = TABLE_PRIMARY + 0x0080;
+const uint32_t CURRENCY_PRIMARY = TABLE_PRIMARY + 0x0100;
+const uint32_t DIGIT_PRIMARY = TABLE_PRIMARY + 0x0200;
+// Two apart, to fit þ after z and ŋ after n.
+const uint32_t LETTER_PRIMARY = TABLE_PRIMARY + 0x0300;
+
+const char WHITESPACE[] = "\t\n\v\f\r ";
+const char PUNCTUATION[] = "_-,;:!?.'\"()[]{}@*/\\&#%`^+<=>|~";
+
+// Marks are combining characters, whose secondaries follow their code points. These two aren't.
+const uint16_t LIGATURE = 0x0380;
+const uint16_t VARIANT = 0x0381;
+
+inline uint32_t markSecondary(uint32_t mark) {
+    return mark - 0x0300 + 2;
+}
+
+inline uint32_t letterPrimary(char lower) {
+    return LETTER_PRIMARY + 2 * (lower - 'a');
+}
+
+struct AsciiWeights {
+    CollationElement elements[128];
+
+    // Control characters are left ignorable.
+    AsciiWeights() {
+        memset(elements, 0, sizeof(elements));
+        for (size_t i = 0; i < sizeof(WHITESPACE) - 1; i++)
+            set(WHITESPACE[i], WHITESPACE_PRIMARY + i, LOWER);
+        for (size_t i = 0; i < sizeof(PUNCTUATION) - 1; i++)
+            set(PUNCTUATION[i], PUNCTUATION_PRIMARY + i, LOWER);
+        set('$', CURRENCY_PRIMARY, LOWER);
+        for (char c = '0'; c <= '9'; c++)
+            set(c, DIGIT_PRIMARY + (c - '0'), LOWER);
+        for (char c = 'a'; c <= 'z'; c++) {
+            set(c, letterPrimary(c), LOWER);
+            set(c - 'a' + 'A', letterPrimary(c), UPPER);
+        }
+    }
+
+    void set(char c, uint32_t primary, uint32_t tertiary) {
+        CollationElement& element = elements[static_cast<uint8_t>(c)];
+        element.weights[PRIMARY] = primary;
+        element.weights[SECONDARY] = BASE_SECONDARY;
+        element.weights[TERTIARY] = tertiary;
+    }
+};
+
+const AsciiWeights ASCII_WEIGHTS;
+
+/*
+ * U+00A0 to U+017F. Letters sort as their base letters, then their mark. Symbols sort in code
+ * point order between ASCII's and the currency sign, and the rest by code point.
+ */
+struct LatinEntry {
+    const char* base;
+    uint16_t mark;
+};
+
+#define SYMBOL {NULL, 1}
+#define OWN {NULL, 0}
+
+const uint32_t LATIN_FIRST = 0x00A0;
+const uint32_t LATIN_END = 0x0180;
+
+const LatinEntry LATIN[LATIN_END - LATIN_FIRST] = {
+    /* 00A0 */ {" ", 0}, SYMBOL, SYMBOL, SYMBOL,
+    /* 00A4 */ SYMBOL, SYMBOL, SYMBOL, SYMBOL,
+    /* 00A8 */ SYMBOL, SYMBOL, {"a", 0}, SYMBOL,
+    /* 00AC */ SYMBOL, SYMBOL, SYMBOL, SYMBOL,
+    /* 00B0 */ SYMBOL, SYMBOL, {"2", 0}, {"3", 0},
+    /* 00B4 */ SYMBOL, OWN, SYMBOL, SYMBOL,
+    /* 00B8 */ SYMBOL, {"1", 0}, {"o", 0}, SYMBOL,
+    /* 00BC */ SYMBOL, SYMBOL, SYMBOL, SYMBOL,
+    /* 00C0 */ {"A", 0x0300}, {"A", 0x0301}, {"A", 0x0302}, {"A", 0x0303},
+    /* 00C4 */ {"A", 0x0308}, {"A", 0x030A}, {"AE", LIGATURE}, {"C", 0x0327},
+    /* 00C8 */ {"E", 0x0300}, {"E", 0x0301}, {"E", 0x0302}, {"E", 0x0308},
+    /* 00CC */ {"I", 0x0300}, {"I", 0x0301}, {"I", 0x0302}, {"I", 0x0308},
+    /* 00D0 */ {"D", 0x0335}, {"N", 0x0303}, {"O", 0x0300}, {"O", 0x0301},
+    /* 00D4 */ {"O", 0x0302}, {"O", 0x0303}, {"O", 0x0308}, SYMBOL,
+    /* 00D8 */ {"O", 0x0338}, {"U", 0x0300}, {"U", 0x0301}, {"U", 0x0302},
+    /* 00DC */ {"U", 0x0308}, {"Y", 0x0301}, OWN, {"ss", LIGATURE},
+    /* 00E0 */ {"a", 0x0300}, {"a", 0x0301}, {"a", 0x0302}, {"a", 0x0303},
+    /* 00E4 */ {"a", 0x0308}, {"a", 0x030A}, {"ae", LIGATURE}, {"c", 0x0327},
+    /* 00E8 */ {"e", 0x0300}, {"e", 0x0301}, {"e", 0x0302}, {"e", 0x0308},
+    /* 00EC */ {"i", 0x0300}, {"i", 0x0301}, {"i", 0x0302}, {"i", 0x0308},
+    /* 00F0 */ {"d", 0x0335}, {"n", 0x0303}, {"o", 0x0300}, {"o", 0x0301},
+    /* 00F4 */ {"o", 0x0302}, {"o", 0x0303}, {"o", 0x0308}, SYMBOL,
+    /* 00F8 */ {"o", 0x0338}, {"u", 0x0300}, {"u", 0x0301}, {"u", 0x0302},
+    /* 00FC */ {"u", 0x0308}, {"y", 0x0301}, OWN, {"y", 0x0308},
+    /* 0100 */ {"A", 0x0304}, {"a", 0x0304}, {"A", 0x0306}, {"a", 0x0306},
+    /* 0104 */ {"A", 0x0328}, {"a", 0x0328}, {"C", 0x0301}, {"c", 0x0301},
+    /* 0108 */ {"C", 0x0302}, {"c", 0x0302}, {"C", 0x0307}, {"c", 0x0307},
+    /* 010C */ {"C", 0x030C}, {"c", 0x030C}, {"D", 0x030C}, {"d", 0x030C},
+    /* 0110 */ {"D", 0x0335}, {"d", 0x0335}, {"E", 0x0304}, {"e", 0x0304},
+    /* 0114 */ {"E", 0x0306}, {"e", 0x0306}, {"E", 0x0307}, {"e", 0x0307},
+    /* 0118 */ {"E", 0x0328}, {"e", 0x0328}, {"E", 0x030C}, {"e", 0x030C},
+    /* 011C */ {"G", 0x0302}, {"g", 0x0302}, {"G", 0x0306}, {"g", 0x0306},
+    /* 0120 */ {"G", 0x0307}, {"g", 0x0307}, {"G", 0x0327}, {"g", 0x0327},
+    /* 0124 */ {"H", 0x0302}, {"h", 0x0302}, {"H", 0x0335}, {"h", 0x0335},
+    /* 0128 */ {"I", 0x0303}, {"i", 0x0303}, {"I", 0x0304}, {"i", 0x0304},
+    /* 012C */ {"I", 0x0306}, {"i", 0x0306}, {"I", 0x0328}, {"i", 0x0328},
+    /* 0130 */ {"I", 0x0307}, {"i", VARIANT}, {"IJ", LIGATURE}, {"ij", LIGATURE},
+    /* 0134 */ {"J", 0x0302}, {"j", 0x0302}, {"K", 0x0327}, {"k", 0x0327},
+    /* 0138 */ {"q", VARIANT}, {"L", 0x0301}, {"l", 0x0301}, {"L", 0x0327},
+    /* 013C */ {"l", 0x0327}, {"L", 0x030C}, {"l", 0x030C}, {"L", VARIANT},
+    /* 0140 */ {"l", VARIANT}, {"L", 0x0338}, {"l", 0x0338}, {"N", 0x0301},
+    /* 0144 */ {"n", 0x0301}, {"N", 0x0327}, {"n", 0x0327}, {"N", 0x030C},
+    /* 0148 */ {"n", 0x030C}, {"n", VARIANT}, OWN, OWN,
+    /* 014C */ {"O", 0x0304}, {"o", 0x0304}, {"O", 0x0306}, {"o", 0x0306},
+    /* 0150 */ {"O", 0x030B}, {"o", 0x030B}, {"OE", LIGATURE}, {"oe", LIGATURE},
+    /* 0154 */ {"R", 0x0301}, {"r", 0x0301}, {"R", 0x0327}, {"r", 0x0327},
+    /* 0158 */ {"R", 0x030C}, {"r", 0x030C}, {"S", 0x0301}, {"s", 0x0301},
+    /* 015C */ {"S", 0x0302}, {"s", 0x0302}, {"S", 0x0327}, {"s", 0x0327},
+    /* 0160 */ {"S", 0x030C}, {"s", 0x030C}, {"T", 0x0327}, {"t", 0x0327},
+    /* 0164 */ {"T", 0x030C}, {"t", 0x030C}, {"T", 0x0335}, {"t", 0x0335},
+    /* 0168 */ {"U", 0x0303}, {"u", 0x0303}, {"U", 0x0304}, {"u", 0x0304},
+    /* 016C */ {"U", 0x0306}, {"u", 0x0306}, {"U", 0x030A}, {"u", 0x030A},
+    /* 0170 */ {"U", 0x030B}, {"u", 0x030B}, {"U", 0x0328}, {"u", 0x0328},
+    /* 0174 */ {"W", 0x0302}, {"w", 0x0302}, {"Y", 0x0302}, {"y", 0x0302},
+    /* 0178 */ {"Y", 0x0308}, {"Z", 0x0301}, {"z", 0x0301}, {"Z", 0x0307},
+    /* 017C */ {"z", 0x0307}, {"Z", 0x030C}, {"z", 0x030C}, {"s", VARIANT},
+};
+
+#undef SYMBOL
+#undef OWN
+
+const uint32_t REPLACEMENT = 0xFFFD;
+
+/*
+ * The collation elements of UTF-8 text, one level at a time. Every character maps to its own
+ * elements whatever surrounds it, which the comparison relies on.
+ */
+class CollationElements {
+public:
+    CollationElements(const void* text, size_t size) :
+            p(static_cast<const uint8_t*>(text)), end(p + size), pending(0), pendingCount(0),
+            ascii(true) {
+    }
+
+    // The next weight at level that isn't ignored.
+    bool next(int level, uint32_t* outWeight) {
+        for (;;) {
+            uint32_t weight;
+            if (pending < pendingCount) {
+                weight = expansion[pending++].weights[level];
+            } else if (p == end) {
+                return false;
+            } else if (*p < 0x80) {
+                weight = ASCII_WEIGHTS.elements[*p++].weights[level];
+            } else {
+                ascii = false;
+                expand(decodeUtf8());
+                continue;
+            }
+            if (weight != 0) {
+                *outWeight = weight;
+                return true;
+            }
+        }
+    }
+
+    bool sawOnlyAscii() const {
+        return ascii;
+    }
+
+private:
+    // Malformed bytes come out one at a time as U+FFFD.
+    uint32_t decodeUtf8() {
+        uint8_t lead = *p;
+        size_t extra;
+        uint32_t codePoint;
+        uint32_t min;
+        if (lead >= 0xF0 && lead <= 0xF4) {
+            extra = 3;
+            codePoint = lead & 0x07;
+            min = 0x10000;
+        } else if (lead >= 0xE0 && lead < 0xF0) {
+            extra = 2;
+            codePoint = lead & 0x0F;
+            min = 0x800;
+        } else if (lead >= 0xC2 && lead < 0xE0) {
+            extra = 1;
+            codePoint = lead & 0x1F;
+            min = 0x80;
+        } else {
+            p++;
+            return REPLACEMENT;
+        }
+        if (static_cast<size_t>(end - p) <= extra) {
+            p++;
+            return REPLACEMENT;
+        }
+        for (size_t i = 1; i <= extra; i++) {
+            if ((p[i] & 0xC0) != 0x80) {
+                p++;
+                return REPLACEMENT;
+            }
+            codePoint = (codePoint << 6) | (p[i] & 0x3F);
+        }
+        if (codePoint < min || codePoint > 0x10FFFF
+                || (codePoint >= 0xD800 && codePoint < 0xE000)) {
+            p++;
+            return REPLACEMENT;
+        }
+        p += extra + 1;
+        return codePoint;
+    }
+
+    void add(uint32_t primary, uint32_t secondary, uint32_t tertiary) {
+        CollationElement& element = expansion[pendingCount++];
+        element.weights[PRIMARY] = primary;
+        element.weights[SECONDARY] = secondary;
+        element.weights[TERTIARY] = tertiary;
+    }
+
+    void expand(uint32_t codePoint) {
+        pending = 0;
+        pendingCount = 0;
+
+        // Combining marks only add an accent to what they follow.
+        if (codePoint >= 0x0300 && codePoint < 0x0370) {
+            add(0, markSecondary(codePoint), 0);
+            return;
+        }
+
+        if (codePoint >= LATIN_FIRST && codePoint < LATIN_END) {
+            const LatinEntry& entry = LATIN[codePoint - LATIN_FIRST];
+            if (entry.base != NULL) {
+                for (const char* c = entry.base; *c != '\0'; c++) {
+                    const CollationElement& base =
+                            ASCII_WEIGHTS.elements[static_cast<uint8_t>(*c)];
+                    add(base.weights[PRIMARY], base.weights[SECONDARY], base.weights[TERTIARY]);
+                }
+                if (entry.mark != 0)
+                    add(0, markSecondary(entry.mark), 0);
+                return;
+            }
+            if (entry.mark != 0) {
+                if (codePoint >= 0x00A2 && codePoint <= 0x00A5) {
+                    add(CURRENCY_PRIMARY + (codePoint - 0x00A1), BASE_SECONDARY, LOWER);
+                } else {
+                    add(SYMBOL_PRIMARY + (codePoint - LATIN_FIRST), BASE_SECONDARY, LOWER);
+                }
+                return;
+            }
+            switch (codePoint) {
+                case 0x00DE:
+                case 0x00FE:
+                    add(letterPrimary('z') + 1, BASE_SECONDARY,
+                            codePoint == 0x00DE ? UPPER : LOWER);
+                    return;
+                case 0x014A:
+                case 0x014B:
+                    add(letterPrimary('n') + 1, BASE_SECONDARY,
+                            codePoint == 0x014A ? UPPER : LOWER);
+                    return;
+            }
+        }
+
+        // Only the BMP is case folded.
+        uint32_t lower = codePoint < 0x10000
+                ? Kotlin_Char_toLowerCase(static_cast<KChar>(codePoint)) : codePoint;
+        add(CODE_POINT_PRIMARY + lower, BASE_SECONDARY, lower != codePoint ? UPPER : LOWER);
+    }
+
+    const uint8_t* p;
+    const uint8_t* const end;
+    CollationElement expansion[3];
+    int pending;
+    int pendingCount;
+    bool ascii;
+};
+
+int compareLevel(const uint8_t* text1, size_t size1, const uint8_t* text2, size_t size2, int level,
+        bool* outAscii) {
+    CollationElements elements1(text1, size1);
+    CollationElements elements2(text2, size2);
+    for (;;) {
+        uint32_t weight1;
+        uint32_t weight2;
+        bool has1 = elements1.next(level, &weight1);
+        bool has2 = elements2.next(level, &weight2);
+        if (!has1 || !has2) {
+            *outAscii = elements1.sawOnlyAscii() && elements2.sawOnlyAscii();
+            return has1 ? 1 : has2 ? -1 : 0;
+        }
+        if (weight1 != weight2)
+            return weight1 < weight2 ? -1 : 1;
+    }
+}
+
+inline bool isContinuation(const uint8_t* text, size_t size, size_t i) {
+    return i < size && (text[i] & 0xC0) == 0x80;
+}
+
+int collateUnicode(void*, int size1, const void* text1, int size2, const void* text2) {
+    return compareUnicode(text1, static_cast<size_t>(size1), text2, static_cast<size_t>(size2));
+}
+
+void unicodeSortKeyFunction(sqlite3_context* context, FunctionText text) {
+    KStdString key;
+    appendUnicodeSortKey(text.data, text.size, &key);
+    sqlite3_result_blob(context, key.data(), static_cast<int>(key.size()), SQLITE_TRANSIENT);
+}
+
+}
+
+int compareUnicode(const void* text1, size_t size1, const void* text2, size_t size2) {
+    auto bytes1 = static_cast<const uint8_t*>(text1);
+    auto bytes2 = static_cast<const uint8_t*>(text2);
+
+    // A common prefix of whole characters weighs the same at every level, so it can't decide.
+    size_t common = 0;
+    size_t shorter = size1 < size2 ? size1 : size2;
+    while (common < shorter && bytes1[common] == bytes2[common])
+        common++;
+    while (common > 0 && (isContinuation(bytes1, size1, common)
+            || isContinuation(bytes2, size2, common)))
+        common--;
+    bytes1 += common;
+    bytes2 += common;
+    size1 -= common;
+    size2 -= common;
+
+    bool ascii;
+    int result = compareLevel(bytes1, size1, bytes2, size2, PRIMARY, &ascii);
+    if (result != 0)
+        return result;
+    // ASCII has no accents.
+    if (!ascii) {
+        result = compareLevel(bytes1, size1, bytes2, size2, SECONDARY, &ascii);
+        if (result != 0)
+            return result;
+    }
+    result = compareLevel(bytes1, size1, bytes2, size2, TERTIARY, &ascii);
+    if (result != 0)
+        return result;
+
+    result = memcmp(bytes1, bytes2, size1 < size2 ? size1 : size2);
+    if (result != 0)
+        return result;
+    return size1 < size2 ? -1 : size1 > size2 ? 1 : 0;
+}
+
+void appendUnicodeSortKey(const void* text, size_t size, KStdString* key) {
+    key->reserve(key->size() + 4 * size + LEVELS);
+    for (int level = PRIMARY; level < LEVELS; level++) {
+        CollationElements elements(text, size);
+        uint32_t weight;
+        while (elements.next(level, &weight)) {
+            if (level == PRIMARY) {
+                key->push_back(static_cast<char>(weight >> 16));
+                key->push_back(static_cast<char>(weight >> 8));
+            }
+            key->push_back(static_cast<char>(weight));
+        }
+        key->push_back('\0');
+    }
+    key->append(static_cast<const char*>(text), size);
+}
+
+int installUnicodeCollation(sqlite3* db, bool localized) {
+    int err = sqlite3_create_collation_v2(db, "UNICODE", SQLITE_UTF8, NULL, &collateUnicode, NULL);
+    // There are no tailorings, so the locale's order is the root order.
+    if (err == SQLITE_OK && localized)
+        err = sqlite3_create_collation_v2(db, "LOCALIZED", SQLITE_UTF8, NULL, &collateUnicode,
+                NULL);
+    if (err == SQLITE_OK)
+        err = registerScalarFunction(db, "unicode_sort_key", &unicodeSortKeyFunction);
+    return err;
+}
+
+}
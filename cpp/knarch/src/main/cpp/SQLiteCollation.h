@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITECOLLATION_H
+#define KNARCH_SQLITECOLLATION_H
+
+#include <stddef.h>
+#include <sqlite3.h>
+
+#include "Types.h"
+
+/*
+ * The UNICODE collation: a compact take on the root locale's order, compared natively.
+ *
+ * Strings compare by letters first, ignoring accents and case; then by accents; then by case,
+ * lower before upper; and finally by code point, so only identical strings are equal. Whitespace
+ * sorts before punctuation and symbols, which sort before digits, which sort before letters.
+ * Latin-1 and Latin Extended-A letters sort with their base letters, decomposed text sorts next
+ * to composed, and other characters sort by code point after the Latin letters, with case
+ * folded through the Kotlin runtime for the first three levels. There are no locale tailorings.
+ *
+ * unicode_sort_key(text) returns a blob that sorts bytewise the same way, for an index or column
+ * that ORDER BY can use without comparing through the collation.
+ */
+
+namespace android {
+
+// Registers UNICODE and unicode_sort_key(), and LOCALIZED as the same collation when localized.
+int installUnicodeCollation(sqlite3* db, bool localized);
+
+// Same order as the UNICODE collation.
+int compareUnicode(const void* text1, size_t size1, const void* text2, size_t size2);
+
+// Appends the sort key of UTF-8 text. Keys compare with memcmp in collation order.
+void appendUnicodeSortKey(const void* text, size_t size, KStdString* key);
+
+}
+
+#endif // KNARCH_SQLITECOLLATION_H
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteContention.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Porting.h"
+
+namespace android {
+
+/*
+ * Busy timeout in milliseconds.
+ * If another connection (possibly in another process) has the database locked for
+ * longer than this amount of time then SQLite will generate a SQLITE_BUSY error.
+ * The SQLITE_BUSY error is then raised as a SQLiteDatabaseLockedException.
+ *
+ * In ordinary usage, busy timeouts are quite rare.  Most databases only ever
+ * have a single open connection at a time unless they are using WAL.  When using
+ * WAL, a timeout could occur if one connection is busy performing an auto-checkpoint
+ * operation.  The busy timeout needs to be long enough to tolerate slow I/O write
+ * operations but not so long as to cause the application to hang indefinitely if
+ * there is a problem acquiring a database lock.
+ */
+const BusyPolicy DEFAULT_BUSY_POLICY = { 2500, 100, 50 * 1000 };
+
+ContentionMonitor::ContentionMonitor(sqlite3* db) :
+        db(db), policy(DEFAULT_BUSY_POLICY), busyStartUs(0), unlockStartUs(0) {
+    // Any nonzero seed will do, as long as connections don't share it.
+    jitterState = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this) >> 4)
+            ^ static_cast<uint32_t>(konan::getTimeMicros());
+    if (jitterState == 0)
+        jitterState = 1;
+    memset(stats, 0, sizeof(stats));
+}
+
+int ContentionMonitor::setBusyPolicy(const BusyPolicy& newPolicy) {
+    policy = newPolicy;
+    return sqlite3_busy_handler(db, &busyCallback, this);
+}
+
+KLong ContentionMonitor::nextBackoffUs(int attempt) {
+    KLong delay = policy.initialBackoffUs > 0 ? policy.initialBackoffUs : 1;
+    while (attempt-- > 0 && delay < policy.maxBackoffUs)
+        delay *= 2;
+    if (delay > policy.maxBackoffUs)
+        delay = policy.maxBackoffUs;
+
+    // xorshift32
+    jitterState ^= jitterState << 13;
+    jitterState ^= jitterState >> 17;
+    jitterState ^= jitterState << 5;
+    KLong half = delay / 2;
+    return delay - half + static_cast<KLong>(jitterState % static_cast<uint32_t>(half + 1));
+}
+
+// Sleeps for the next backoff interval, cut short at the timeout. False once the timeout has passed.
+bool ContentionMonitor::sleepBackoff(int attempt, uint64_t startUs) {
+    uint64_t timeoutUs = static_cast<uint64_t>(policy.timeoutMs > 0 ? policy.timeoutMs : 0) * 1000;
+    uint64_t elapsedUs = konan::getTimeMicros() - startUs;
+    if (elapsedUs >= timeoutUs)
+        return false;
+
+    uint64_t delayUs = static_cast<uint64_t>(nextBackoffUs(attempt));
+    if (delayUs > timeoutUs - elapsedUs)
+        delayUs = timeoutUs - elapsedUs;
+    usleep(static_cast<useconds_t>(delayUs));
+    return true;
+}
+
+int ContentionMonitor::busyCallback(void* context, int count) {
+    auto monitor = static_cast<ContentionMonitor*>(context);
+    KLong* stats = monitor->stats;
+    if (count == 0) {
+        monitor->busyStartUs = konan::getTimeMicros();
+        stats[CONTENTION_STAT_BUSY_WAITS]++;
+    }
+
+    uint64_t before = konan::getTimeMicros();
+    if (!monitor->sleepBackoff(count, monitor->busyStartUs)) {
+        stats[CONTENTION_STAT_BUSY_TIMEOUTS]++;
+        return 0;
+    }
+    stats[CONTENTION_STAT_BUSY_RETRIES]++;
+    stats[CONTENTION_STAT_BUSY_WAIT_US] += konan::getTimeMicros() - before;
+    return 1;
+}
+
+#ifdef SQLITE_ENABLE_UNLOCK_NOTIFY
+
+namespace {
+
+struct UnlockNotification {
+    bool fired;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+// Called by SQLite on the thread that released the lock, possibly for several waiters at once.
+void unlockNotifyCallback(void** args, int count) {
+    for (int i = 0; i < count; i++) {
+        auto notification = static_cast<UnlockNotification*>(args[i]);
+        pthread_mutex_lock(&notification->mutex);
+        notification->fired = true;
+        pthread_cond_signal(&notification->cond);
+        pthread_mutex_unlock(&notification->mutex);
+    }
+}
+
+}
+
+int ContentionMonitor::waitForUnlock(int attempt) {
+    uint64_t before = konan::getTimeMicros();
+    if (attempt == 0)
+        unlockStartUs = before;
+    stats[CONTENTION_STAT_UNLOCK_WAITS]++;
+
+    // The policy's timeout counts from the statement's first wait, like the busy handler's.
+    uint64_t timeoutUs = static_cast<uint64_t>(policy.timeoutMs > 0 ? policy.timeoutMs : 0) * 1000;
+    uint64_t elapsedUs = before - unlockStartUs;
+    if (elapsedUs >= timeoutUs)
+        return SQLITE_BUSY;
+
+    UnlockNotification notification;
+    notification.fired = false;
+    pthread_mutex_init(&notification.mutex, NULL);
+    pthread_cond_init(&notification.cond, NULL);
+
+    // Fails with SQLITE_LOCKED when the lock holder is itself waiting on us.
+    int rc = sqlite3_unlock_notify(db, &unlockNotifyCallback, &notification);
+    if (rc == SQLITE_OK) {
+        // pthread_cond_timedwait takes the wall clock.
+        struct timeval now;
+        gettimeofday(&now, NULL);
+        uint64_t deadlineUs = static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_usec
+                + (timeoutUs - elapsedUs);
+        struct timespec deadline;
+        deadline.tv_sec = static_cast<time_t>(deadlineUs / 1000000);
+        deadline.tv_nsec = static_cast<long>(deadlineUs % 1000000) * 1000;
+
+        pthread_mutex_lock(&notification.mutex);
+        int waited = 0;
+        while (!notification.fired && waited != ETIMEDOUT)
+            waited = pthread_cond_timedwait(&notification.cond, &notification.mutex, &deadline);
+        bool fired = notification.fired;
+        pthread_mutex_unlock(&notification.mutex);
+
+        if (!fired) {
+            // SQLite calls back under its own mutex, which cancelling takes too, so once this
+            // returns the notification can't fire any more.
+            sqlite3_unlock_notify(db, NULL, NULL);
+            rc = SQLITE_BUSY;
+        }
+    }
+
+    pthread_cond_destroy(&notification.cond);
+    pthread_mutex_destroy(&notification.mutex);
+    stats[CONTENTION_STAT_UNLOCK_WAIT_US] += konan::getTimeMicros() - before;
+    return rc;
+}
+
+#else
+
+int ContentionMonitor::waitForUnlock(int attempt) {
+    uint64_t before = konan::getTimeMicros();
+    if (attempt == 0) {
+        unlockStartUs = before;
+        stats[CONTENTION_STAT_UNLOCK_WAITS]++;
+    }
+
+    bool waited = sleepBackoff(attempt, unlockStartUs);
+    stats[CONTENTION_STAT_UNLOCK_WAIT_US] += konan::getTimeMicros() - before;
+    return waited ? SQLITE_OK : SQLITE_BUSY;
+}
+
+#endif
+
+void ContentionMonitor::getStats(KLong* outStats) const {
+    memcpy(outStats, stats, sizeof(stats));
+}
+
+}
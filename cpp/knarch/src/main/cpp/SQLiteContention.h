@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITECONTENTION_H
+#define KNARCH_SQLITECONTENTION_H
+
+#include <sqlite3.h>
+#include <stdint.h>
+
+#include "Types.h"
+
+namespace android {
+
+/*
+ * How long a connection waits for a lock held elsewhere, and how it waits. Sleeps start at
+ * initialBackoffUs and double up to maxBackoffUs, each one randomly shortened by up to half so
+ * that connections contending for the same lock don't keep waking up together.
+ */
+struct BusyPolicy {
+    KInt timeoutMs;
+    KInt initialBackoffUs;
+    KInt maxBackoffUs;
+};
+
+/* Slots of the LongArray filled by nativeGetContentionStats. Must match SQLiteConnection.kt. */
+enum {
+    CONTENTION_STAT_BUSY_WAITS = 0,
+    CONTENTION_STAT_BUSY_RETRIES = 1,
+    CONTENTION_STAT_BUSY_TIMEOUTS = 2,
+    CONTENTION_STAT_BUSY_WAIT_US = 3,
+    CONTENTION_STAT_UNLOCK_WAITS = 4,
+    CONTENTION_STAT_UNLOCK_WAIT_US = 5,
+    CONTENTION_STAT_SIZE = 6,
+};
+
+/*
+ * Waits out lock contention for one connection and counts what it cost. Two kinds of wait:
+ *
+ * - SQLITE_BUSY, another connection holding the file lock. SQLite calls the busy handler installed
+ *   here, which backs off per the BusyPolicy.
+ * - SQLITE_LOCKED_SHAREDCACHE, another connection in the same shared cache holding a table lock.
+ *   SQLite never retries those itself; waitForUnlock blocks until the holder finishes, using
+ *   sqlite3_unlock_notify when SQLite was built with it and backing off otherwise.
+ *
+ * Only used by the thread running statements on the connection.
+ */
+class ContentionMonitor {
+public:
+    explicit ContentionMonitor(sqlite3* db);
+
+    // Installs the busy handler, replacing any busy timeout.
+    int setBusyPolicy(const BusyPolicy& policy);
+
+    const BusyPolicy& busyPolicy() const {
+        return policy;
+    }
+
+    // Waits for the shared cache lock that made the last step fail with SQLITE_LOCKED_SHAREDCACHE.
+    // attempt counts from 0 for each statement. Returns SQLITE_OK once the statement is worth
+    // retrying, SQLITE_LOCKED if waiting would deadlock, or SQLITE_BUSY once the policy's timeout
+    // has passed.
+    int waitForUnlock(int attempt);
+
+    void getStats(KLong* outStats) const;
+
+private:
+    static int busyCallback(void* context, int count);
+
+    KLong nextBackoffUs(int attempt);
+    bool sleepBackoff(int attempt, uint64_t startUs);
+
+    sqlite3* const db;
+    BusyPolicy policy;
+    uint64_t busyStartUs;
+    uint64_t unlockStartUs;
+    uint32_t jitterState;
+    KLong stats[CONTENTION_STAT_SIZE];
+};
+
+// Default policy, used until the connection is configured.
+extern const BusyPolicy DEFAULT_BUSY_POLICY;
+
+}
+
+#endif // KNARCH_SQLITECONTENTION_H
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteMemory.h"
+
+#include <atomic>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+
+namespace android {
+
+static pthread_mutex_t gLimitsLock = PTHREAD_MUTEX_INITIALIZER;
+// Guarded by gLimitsLock.
+static KLong gSoftLimit = 0;
+static KLong gHardLimit = 0;
+
+static std::atomic<KLong> gWindowBytes(0);
+// Whether the windows count against the soft limit, which they only do once setHeapLimits set
+// one. Written with gLimitsLock held.
+static std::atomic<bool> gWindowsLimited(false);
+
+// Call with gLimitsLock held. SQLite frees page cache right away when it is over the new limit.
+static void applySoftLimit() {
+    KLong limit = gSoftLimit;
+    if (limit > 0 && gWindowsLimited.load(std::memory_order_relaxed)) {
+        limit -= gWindowBytes.load(std::memory_order_relaxed);
+        if (limit < gSoftLimit / 4)
+            limit = gSoftLimit / 4;
+    }
+    sqlite3_soft_heap_limit64(limit);
+}
+
+void setHeapLimits(KLong softBytes, KLong hardBytes) {
+    pthread_mutex_lock(&gLimitsLock);
+    gSoftLimit = softBytes > 0 ? softBytes : 0;
+    gHardLimit = hardBytes > 0 ? hardBytes : 0;
+    gWindowsLimited.store(gSoftLimit > 0, std::memory_order_release);
+#if SQLITE_VERSION_NUMBER >= 3031000
+    sqlite3_hard_heap_limit64(gHardLimit);
+#endif
+    applySoftLimit();
+    pthread_mutex_unlock(&gLimitsLock);
+}
+
+void setDefaultSoftHeapLimit(KLong softBytes) {
+    pthread_mutex_lock(&gLimitsLock);
+    gSoftLimit = softBytes > 0 ? softBytes : 0;
+    gWindowsLimited.store(false, std::memory_order_release);
+    applySoftLimit();
+    pthread_mutex_unlock(&gLimitsLock);
+}
+
+int releasableMemory() {
+    pthread_mutex_lock(&gLimitsLock);
+    KLong limit = gSoftLimit;
+    pthread_mutex_unlock(&gLimitsLock);
+    return limit > 0 && limit < INT_MAX ? static_cast<int>(limit) : INT_MAX;
+}
+
+// Without a limit from setHeapLimits, a window only adds to the count.
+static void windowBytesChanged(KLong delta) {
+    gWindowBytes.fetch_add(delta, std::memory_order_relaxed);
+    if (gWindowsLimited.load(std::memory_order_acquire)) {
+        pthread_mutex_lock(&gLimitsLock);
+        applySoftLimit();
+        pthread_mutex_unlock(&gLimitsLock);
+    }
+}
+
+void cursorWindowCreated(size_t size) {
+    windowBytesChanged(static_cast<KLong>(size));
+}
+
+void cursorWindowDisposed(size_t size) {
+    windowBytesChanged(-static_cast<KLong>(size));
+}
+
+int setPageCacheBudget(sqlite3* db, KLong bytes) {
+    // Negative sizes are in KiB rather than pages, so the budget holds whatever the page size.
+    char sql[64];
+    snprintf(sql, sizeof(sql), "PRAGMA cache_size = -%lld",
+            static_cast<long long>((bytes + 1023) / 1024));
+    return sqlite3_exec(db, sql, NULL, NULL, NULL);
+}
+
+// Each status has a current value and a highwater mark, and which one means what depends on it.
+static KLong dbStatus(sqlite3* db, int op, bool highwater, bool reset) {
+    int current = 0;
+    int max = 0;
+    if (sqlite3_db_status(db, op, &current, &max, reset) != SQLITE_OK)
+        return -1;
+    return highwater ? max : current;
+}
+
+void getDbStatus(sqlite3* db, bool reset, KLong* outStatus) {
+    // The maximum first, as resetting LOOKASIDE_USED resets it.
+    outStatus[DB_STATUS_LOOKASIDE_USED_MAX] =
+            dbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_USED, true, false);
+    outStatus[DB_STATUS_LOOKASIDE_USED] =
+            dbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_USED, false, reset);
+    outStatus[DB_STATUS_LOOKASIDE_HITS] = dbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_HIT, true, reset);
+    outStatus[DB_STATUS_LOOKASIDE_MISSES_SIZE] =
+            dbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, true, reset);
+    outStatus[DB_STATUS_LOOKASIDE_MISSES_FULL] =
+            dbStatus(db, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, true, reset);
+    outStatus[DB_STATUS_CACHE_USED] = dbStatus(db, SQLITE_DBSTATUS_CACHE_USED, false, false);
+#ifdef SQLITE_DBSTATUS_CACHE_USED_SHARED
+    outStatus[DB_STATUS_CACHE_USED_SHARED] =
+            dbStatus(db, SQLITE_DBSTATUS_CACHE_USED_SHARED, false, false);
+#else
+    outStatus[DB_STATUS_CACHE_USED_SHARED] = -1;
+#endif
+    outStatus[DB_STATUS_CACHE_HITS] = dbStatus(db, SQLITE_DBSTATUS_CACHE_HIT, false, reset);
+    outStatus[DB_STATUS_CACHE_MISSES] = dbStatus(db, SQLITE_DBSTATUS_CACHE_MISS, false, reset);
+    outStatus[DB_STATUS_CACHE_WRITES] = dbStatus(db, SQLITE_DBSTATUS_CACHE_WRITE, false, reset);
+#ifdef SQLITE_DBSTATUS_CACHE_SPILL
+    outStatus[DB_STATUS_CACHE_SPILLS] = dbStatus(db, SQLITE_DBSTATUS_CACHE_SPILL, false, reset);
+#else
+    outStatus[DB_STATUS_CACHE_SPILLS] = -1;
+#endif
+    outStatus[DB_STATUS_SCHEMA_USED] = dbStatus(db, SQLITE_DBSTATUS_SCHEMA_USED, false, false);
+    outStatus[DB_STATUS_STATEMENTS_USED] = dbStatus(db, SQLITE_DBSTATUS_STMT_USED, false, false);
+    outStatus[DB_STATUS_DEFERRED_FKS] = dbStatus(db, SQLITE_DBSTATUS_DEFERRED_FKS, false, false);
+}
+
+static KLong status(int op, bool highwater, bool reset) {
+    sqlite3_int64 current = 0;
+    sqlite3_int64 max = 0;
+    if (sqlite3_status64(op, &current, &max, reset) != SQLITE_OK)
+        return -1;
+    return highwater ? max : current;
+}
+
+void getMemoryStatus(bool reset, KLong* outStatus) {
+    outStatus[MEMORY_STATUS_USED_MAX] = status(SQLITE_STATUS_MEMORY_USED, true, reset);
+    outStatus[MEMORY_STATUS_USED] = status(SQLITE_STATUS_MEMORY_USED, false, false);
+    outStatus[MEMORY_STATUS_ALLOCATIONS] = status(SQLITE_STATUS_MALLOC_COUNT, false, false);
+    outStatus[MEMORY_STATUS_LARGEST_ALLOCATION] = status(SQLITE_STATUS_MALLOC_SIZE, true, reset);
+    outStatus[MEMORY_STATUS_PAGECACHE_USED] = status(SQLITE_STATUS_PAGECACHE_USED, false, false);
+    outStatus[MEMORY_STATUS_PAGECACHE_OVERFLOW_MAX] =
+            status(SQLITE_STATUS_PAGECACHE_OVERFLOW, true, reset);
+    outStatus[MEMORY_STATUS_PAGECACHE_OVERFLOW] =
+            status(SQLITE_STATUS_PAGECACHE_OVERFLOW, false, false);
+    outStatus[MEMORY_STATUS_LARGEST_PAGE] = status(SQLITE_STATUS_PAGECACHE_SIZE, true, reset);
+
+    pthread_mutex_lock(&gLimitsLock);
+    outStatus[MEMORY_STATUS_CURSOR_WINDOWS] = gWindowBytes.load(std::memory_order_relaxed);
+    outStatus[MEMORY_STATUS_SOFT_HEAP_LIMIT] = gSoftLimit;
+    outStatus[MEMORY_STATUS_HARD_HEAP_LIMIT] = gHardLimit;
+    pthread_mutex_unlock(&gLimitsLock);
+}
+
+}
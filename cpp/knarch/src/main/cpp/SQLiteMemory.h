@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITEMEMORY_H
+#define KNARCH_SQLITEMEMORY_H
+
+#include <sqlite3.h>
+
+#include "Types.h"
+
+namespace android {
+
+/*
+ * Slots of the LongArray filled by nativeGetDbStatus, per connection, from sqlite3_db_status.
+ * Must match SQLiteConnection.kt. Memory is in bytes. Counters and maximums add up since the
+ * connection opened or they were last reset.
+ */
+enum {
+    DB_STATUS_LOOKASIDE_USED = 0,
+    DB_STATUS_LOOKASIDE_USED_MAX = 1,
+    DB_STATUS_LOOKASIDE_HITS = 2,
+    DB_STATUS_LOOKASIDE_MISSES_SIZE = 3,
+    DB_STATUS_LOOKASIDE_MISSES_FULL = 4,
+    DB_STATUS_CACHE_USED = 5,
+    DB_STATUS_CACHE_USED_SHARED = 6,
+    DB_STATUS_CACHE_HITS = 7,
+    DB_STATUS_CACHE_MISSES = 8,
+    DB_STATUS_CACHE_WRITES = 9,
+    DB_STATUS_CACHE_SPILLS = 10,
+    DB_STATUS_SCHEMA_USED = 11,
+    DB_STATUS_STATEMENTS_USED = 12,
+    DB_STATUS_DEFERRED_FKS = 13,
+    DB_STATUS_SIZE = 14,
+};
+
+/*
+ * Slots of the LongArray filled by nativeGetMemoryStatus, for the whole process, from
+ * sqlite3_status64. Must match SQLiteGlobal.kt.
+ */
+enum {
+    MEMORY_STATUS_USED = 0,
+    MEMORY_STATUS_USED_MAX = 1,
+    MEMORY_STATUS_ALLOCATIONS = 2,
+    MEMORY_STATUS_LARGEST_ALLOCATION = 3,
+    MEMORY_STATUS_PAGECACHE_USED = 4,
+    MEMORY_STATUS_PAGECACHE_OVERFLOW = 5,
+    MEMORY_STATUS_PAGECACHE_OVERFLOW_MAX = 6,
+    MEMORY_STATUS_LARGEST_PAGE = 7,
+    MEMORY_STATUS_CURSOR_WINDOWS = 8,
+    MEMORY_STATUS_SOFT_HEAP_LIMIT = 9,
+    MEMORY_STATUS_HARD_HEAP_LIMIT = 10,
+    MEMORY_STATUS_SIZE = 11,
+};
+
+// Only from the thread using db. Resets the counters and maximums once read when reset is set.
+void getDbStatus(sqlite3* db, bool reset, KLong* outStatus);
+
+// Resets the maximums once read when reset is set.
+void getMemoryStatus(bool reset, KLong* outStatus);
+
+/*
+ * Process-wide limits on memory, in bytes, 0 for none. The soft limit is a budget for SQLite's
+ * heap and the cursor windows together: SQLite is held to what the windows leave of it, down to
+ * a quarter of it, and gives back page cache to stay under. The hard limit makes SQLite's own
+ * allocations fail with SQLITE_NOMEM past it, and needs SQLite 3.31.
+ */
+void setHeapLimits(KLong softBytes, KLong hardBytes);
+
+// The soft limit SQLite gets until setHeapLimits is called, for its heap alone: the windows
+// don't count against it.
+void setDefaultSoftHeapLimit(KLong softBytes);
+
+// For sqlite3_release_memory: the soft limit, or everything without one.
+int releasableMemory();
+
+// Counts a cursor window's buffer while it exists, and against the soft limit if setHeapLimits
+// set one.
+void cursorWindowCreated(size_t size);
+void cursorWindowDisposed(size_t size);
+
+// Sets the connection's page cache to about bytes, with PRAGMA cache_size.
+int setPageCacheBudget(sqlite3* db, KLong bytes);
+
+}
+
+#endif // KNARCH_SQLITEMEMORY_H
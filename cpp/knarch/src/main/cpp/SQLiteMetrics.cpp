@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteMetrics.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+
+namespace android {
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+void LatencyHistogram::reset() {
+    count = 0;
+    total = 0;
+    max = 0;
+    memset(buckets, 0, sizeof(buckets));
+}
+
+int LatencyHistogram::bucketOf(uint64_t micros) {
+    const uint64_t subBuckets = 1 << SUB_BUCKET_BITS;
+    if (micros < subBuckets)
+        return static_cast<int>(micros);
+    int magnitude = 63 - __builtin_clzll(micros);
+    if (magnitude > MAX_MAGNITUDE)
+        return BUCKETS - 1;
+    int shift = magnitude - SUB_BUCKET_BITS;
+    return static_cast<int>(subBuckets * (shift + 1) + ((micros >> shift) & (subBuckets - 1)));
+}
+
+uint64_t LatencyHistogram::bucketTop(int bucket) {
+    const int subBuckets = 1 << SUB_BUCKET_BITS;
+    if (bucket < subBuckets)
+        return static_cast<uint64_t>(bucket);
+    int shift = bucket / subBuckets - 1;
+    uint64_t bottom = static_cast<uint64_t>(subBuckets + bucket % subBuckets) << shift;
+    return bottom + (static_cast<uint64_t>(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+    count++;
+    total += micros;
+    if (micros > max)
+        max = micros;
+    buckets[bucketOf(micros)]++;
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+    if (count == 0)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(fraction * count);
+    if (rank >= count)
+        rank = count - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > rank)
+            return std::min(bucketTop(i), max);
+    }
+    return max;
+}
+
+void LatencyHistogram::summarize(KLong* outStats) const {
+    outStats[LATENCY_STAT_COUNT] = static_cast<KLong>(count);
+    outStats[LATENCY_STAT_TOTAL_US] = static_cast<KLong>(total);
+    outStats[LATENCY_STAT_MAX_US] = static_cast<KLong>(max);
+    outStats[LATENCY_STAT_P50_US] = static_cast<KLong>(percentile(0.5));
+    outStats[LATENCY_STAT_P90_US] = static_cast<KLong>(percentile(0.9));
+    outStats[LATENCY_STAT_P99_US] = static_cast<KLong>(percentile(0.99));
+    outStats[LATENCY_STAT_P999_US] = static_cast<KLong>(percentile(0.999));
+}
+
+bool isSqlIdentifierChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$'
+            || static_cast<unsigned char>(c) >= 0x80;
+}
+
+const char* skipSqlQuoted(const char* p, char close) {
+    for (p++; *p != '\0'; p++) {
+        if (*p == close) {
+            if (p[1] != close)
+                return p + 1;
+            p++;
+        }
+    }
+    return p;
+}
+
+KStdString normalizeSql(const char* sql) {
+    KStdString normalized;
+    bool space = false;
+    const char* p = sql;
+    while (*p != '\0') {
+        char c = *p;
+        const char* next;
+        bool literal = false;
+        if (isspace(static_cast<unsigned char>(c))) {
+            space = true;
+            p++;
+            continue;
+        } else if (c == '-' && p[1] == '-') {
+            next = strchr(p, '\n');
+            p = next != NULL ? next : p + strlen(p);
+            space = true;
+            continue;
+        } else if (c == '/' && p[1] == '*') {
+            next = strstr(p + 2, "*/");
+            p = next != NULL ? next + 2 : p + strlen(p);
+            space = true;
+            continue;
+        }
+
+        bool afterIdentifier = !normalized.empty() && !space
+                && isSqlIdentifierChar(normalized.back());
+        if (c == '\'') {
+            next = skipSqlQuoted(p, '\'');
+            literal = true;
+        } else if ((c == 'x' || c == 'X') && p[1] == '\'' && !afterIdentifier) {
+            next = skipSqlQuoted(p + 1, '\'');
+            literal = true;
+        } else if (c == '"' || c == '`') {
+            next = skipSqlQuoted(p, c);
+        } else if (c == '[') {
+            next = strchr(p, ']');
+            next = next != NULL ? next + 1 : p + strlen(p);
+        } else if (c == '?') {
+            // Numbered parameters stay as they are.
+            next = p + 1;
+            while (isdigit(static_cast<unsigned char>(*next)))
+                next++;
+        } else if ((isdigit(static_cast<unsigned char>(c))
+                || (c == '.' && isdigit(static_cast<unsigned char>(p[1])))) && !afterIdentifier) {
+            next = p + 1;
+            while (isSqlIdentifierChar(*next) || *next == '.'
+                    || ((*next == '+' || *next == '-') && (next[-1] == 'e' || next[-1] == 'E')))
+                next++;
+            literal = true;
+        } else {
+            next = p + 1;
+        }
+
+        if (space && !normalized.empty())
+            normalized.push_back(' ');
+        space = false;
+        if (literal) {
+            normalized.push_back('?');
+        } else {
+            normalized.append(p, next - p);
+        }
+        p = next;
+    }
+    return normalized;
+}
+
+QueryMetrics::QueryMetrics() : other(NULL) {
+    pthread_mutex_init(&mutex, NULL);
+}
+
+QueryMetrics::~QueryMetrics() {
+    for (auto& entry : queries)
+        delete entry.second;
+    delete other;
+    pthread_mutex_destroy(&mutex);
+}
+
+QueryMetrics::Query* QueryMetrics::newQuery(const KStdString& sql) {
+    auto query = new Query();
+    query->sql = sql;
+    memset(query->counters, 0, sizeof(query->counters));
+    return query;
+}
+
+QueryMetrics::Query* QueryMetrics::queryFor(const char* sql) {
+    auto found = known.find(sql);
+    if (found != known.end() && found->second.text == sql)
+        return found->second.query;
+
+    // Statements come and go, and their SQL may move.
+    if (known.size() >= 4 * MAX_QUERIES)
+        known.clear();
+
+    KStdString key = normalizeSql(sql);
+    Query* query;
+    auto existing = queries.find(key);
+    if (existing != queries.end()) {
+        query = existing->second;
+    } else if (queries.size() < MAX_QUERIES) {
+        query = newQuery(key);
+        queries[key] = query;
+    } else {
+        if (other == NULL)
+            other = newQuery("(other)");
+        query = other;
+    }
+    KnownSql& entry = known[sql];
+    entry.text = sql;
+    entry.query = query;
+    return query;
+}
+
+void QueryMetrics::record(sqlite3_stmt* statement, QueryPhase phase, uint64_t micros) {
+    const char* sql = sqlite3_sql(statement);
+    if (sql == NULL)
+        return;
+    pthread_mutex_lock(&mutex);
+    queryFor(sql)->phases[phase].record(micros);
+    pthread_mutex_unlock(&mutex);
+}
+
+void QueryMetrics::recordRun(sqlite3_stmt* statement, uint64_t micros) {
+    const char* sql = sqlite3_sql(statement);
+    if (sql == NULL)
+        return;
+
+    // Taken and cleared on the statement itself, so each run only adds what it did.
+    KLong counters[STATEMENT_STAT_SIZE];
+    counters[STATEMENT_STAT_RUNS] = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_RUN, 1);
+    counters[STATEMENT_STAT_VM_STEPS] =
+            sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_VM_STEP, 1);
+    counters[STATEMENT_STAT_FULLSCAN_STEPS] =
+            sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    counters[STATEMENT_STAT_SORTS] = sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_SORT, 1);
+    counters[STATEMENT_STAT_AUTOINDEX_ROWS] =
+            sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+    counters[STATEMENT_STAT_REPREPARES] =
+            sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_REPREPARE, 1);
+    counters[STATEMENT_STAT_MAX_MEMORY] =
+            sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_MEMUSED, 0);
+
+    pthread_mutex_lock(&mutex);
+    Query* query = queryFor(sql);
+    query->phases[QUERY_PHASE_STEP].record(micros);
+    for (int i = 0; i < STATEMENT_STAT_MAX_MEMORY; i++)
+        query->counters[i] += counters[i];
+    if (counters[STATEMENT_STAT_MAX_MEMORY] > query->counters[STATEMENT_STAT_MAX_MEMORY])
+        query->counters[STATEMENT_STAT_MAX_MEMORY] = counters[STATEMENT_STAT_MAX_MEMORY];
+    pthread_mutex_unlock(&mutex);
+}
+
+void QueryMetrics::clear(Query* query) {
+    for (auto& histogram : query->phases)
+        histogram.reset();
+    memset(query->counters, 0, sizeof(query->counters));
+}
+
+void QueryMetrics::reset() {
+    pthread_mutex_lock(&mutex);
+    for (auto& entry : queries)
+        clear(entry.second);
+    if (other != NULL)
+        clear(other);
+    pthread_mutex_unlock(&mutex);
+}
+
+static KLong totalTime(const QueryStats& stats) {
+    KLong total = 0;
+    for (int phase = 0; phase < QUERY_PHASE_COUNT; phase++)
+        total += stats.latencies[phase * LATENCY_STAT_SIZE + LATENCY_STAT_TOTAL_US];
+    return total;
+}
+
+static bool moreTime(const QueryStats& a, const QueryStats& b) {
+    return totalTime(a) > totalTime(b);
+}
+
+static bool moreCost(const QueryStats& a, const QueryStats& b) {
+    if (a.counters[STATEMENT_STAT_VM_STEPS] != b.counters[STATEMENT_STAT_VM_STEPS])
+        return a.counters[STATEMENT_STAT_VM_STEPS] > b.counters[STATEMENT_STAT_VM_STEPS];
+    return a.counters[STATEMENT_STAT_FULLSCAN_STEPS] > b.counters[STATEMENT_STAT_FULLSCAN_STEPS];
+}
+
+KStdVector<QueryStats>* QueryMetrics::snapshot(int order) {
+    auto result = new KStdVector<QueryStats>();
+    pthread_mutex_lock(&mutex);
+    result->reserve(queries.size() + 1);
+    auto add = [result](const Query* query) {
+        bool empty = query->counters[STATEMENT_STAT_RUNS] == 0;
+        for (auto& histogram : query->phases)
+            empty = empty && histogram.isEmpty();
+        if (empty)
+            return;
+        result->push_back(QueryStats());
+        QueryStats& stats = result->back();
+        stats.sql = query->sql;
+        for (int phase = 0; phase < QUERY_PHASE_COUNT; phase++)
+            query->phases[phase].summarize(stats.latencies + phase * LATENCY_STAT_SIZE);
+        memcpy(stats.counters, query->counters, sizeof(stats.counters));
+    };
+    for (auto& entry : queries)
+        add(entry.second);
+    if (other != NULL)
+        add(other);
+    pthread_mutex_unlock(&mutex);
+
+    std::sort(result->begin(), result->end(), order == SNAPSHOT_BY_COST ? &moreCost : &moreTime);
+    return result;
+}
+
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITEMETRICS_H
+#define KNARCH_SQLITEMETRICS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sqlite3.h>
+
+#include "Porting.h"
+#include "Types.h"
+
+namespace android {
+
+// What a latency was spent on. Must match SQLiteConnection.kt.
+enum QueryPhase {
+    QUERY_PHASE_PREPARE = 0,
+    // Running the statement, as SQLite's profile events report it.
+    QUERY_PHASE_STEP = 1,
+    // Filling a cursor window, including the steps it takes.
+    QUERY_PHASE_FILL = 2,
+    QUERY_PHASE_COUNT = 3,
+};
+
+/* Slots of each phase's summary filled by nativeMetricsStats. Must match SQLiteConnection.kt. */
+enum {
+    LATENCY_STAT_COUNT = 0,
+    LATENCY_STAT_TOTAL_US = 1,
+    LATENCY_STAT_MAX_US = 2,
+    LATENCY_STAT_P50_US = 3,
+    LATENCY_STAT_P90_US = 4,
+    LATENCY_STAT_P99_US = 5,
+    LATENCY_STAT_P999_US = 6,
+    LATENCY_STAT_SIZE = 7,
+};
+
+/*
+ * Slots of the sqlite3_stmt_status counters kept per query, filled by nativeMetricsCounters. Must
+ * match SQLiteConnection.kt. All are totals over the query's runs but the memory, which is the
+ * most any one statement used.
+ */
+enum {
+    STATEMENT_STAT_RUNS = 0,
+    STATEMENT_STAT_VM_STEPS = 1,
+    STATEMENT_STAT_FULLSCAN_STEPS = 2,
+    STATEMENT_STAT_SORTS = 3,
+    STATEMENT_STAT_AUTOINDEX_ROWS = 4,
+    STATEMENT_STAT_REPREPARES = 5,
+    STATEMENT_STAT_MAX_MEMORY = 6,
+    STATEMENT_STAT_SIZE = 7,
+};
+
+// Orders of QueryMetrics::snapshot(). Must match SQLiteConnection.kt.
+enum {
+    // By total time across phases.
+    SNAPSHOT_BY_TIME = 0,
+    // By VM steps, the work SQLite did, then by full scan steps.
+    SNAPSHOT_BY_COST = 1,
+};
+
+/*
+ * Latencies in microseconds, counted in buckets an eighth of a power of two wide, so that any
+ * percentile is within 12.5% of the true value. Up to 2^40us; longer ones count as that.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t micros);
+    void reset();
+
+    bool isEmpty() const {
+        return count == 0;
+    }
+
+    // Fills LATENCY_STAT_SIZE slots. Percentiles are the top of their bucket, at most the max.
+    void summarize(KLong* outStats) const;
+
+private:
+    static const int SUB_BUCKET_BITS = 3;
+    static const int MAX_MAGNITUDE = 39;
+    static const int BUCKETS = (1 << SUB_BUCKET_BITS) * (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2);
+
+    static int bucketOf(uint64_t micros);
+    static uint64_t bucketTop(int bucket);
+    uint64_t percentile(double fraction) const;
+
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint32_t buckets[BUCKETS];
+};
+
+// What was kept for one normalized SQL string, as copied out by QueryMetrics::snapshot().
+struct QueryStats {
+    KStdString sql;
+    KLong latencies[QUERY_PHASE_COUNT * LATENCY_STAT_SIZE];
+    KLong counters[STATEMENT_STAT_SIZE];
+};
+
+/*
+ * Latency histograms and sqlite3_stmt_status counters for each statement a writer and its readers
+ * run, kept per normalized SQL: literals replaced with ?, comments dropped and whitespace
+ * collapsed. Recording holds a mutex for a lookup and a count. Past MAX_QUERIES, new SQL counts as
+ * "(other)".
+ *
+ * The status counters are read, and cleared, in the SQLITE_TRACE_PROFILE event that ends each run,
+ * rather than per entry of the DatabaseInfo statement cache when it resets one. That cache only
+ * holds the writer's statements, so collecting there would miss the readers and the batch and
+ * stream statements, and split one query's counts across connections.
+ */
+class QueryMetrics {
+public:
+    static const size_t MAX_QUERIES = 256;
+
+    QueryMetrics();
+    ~QueryMetrics();
+
+    void record(sqlite3_stmt* statement, QueryPhase phase, uint64_t micros);
+
+    // Records a run of the statement that has just finished, with the status counters it moved.
+    void recordRun(sqlite3_stmt* statement, uint64_t micros);
+
+    void reset();
+
+    // Most first, in the given SNAPSHOT_BY_ order. Leaves out queries with nothing recorded.
+    KStdVector<QueryStats>* snapshot(int order);
+
+private:
+    struct Query {
+        KStdString sql;
+        LatencyHistogram phases[QUERY_PHASE_COUNT];
+        KLong counters[STATEMENT_STAT_SIZE];
+    };
+
+    // SQL text as SQLite keeps it for a statement, which stays put while the statement lives.
+    struct KnownSql {
+        KStdString text;
+        Query* query;
+    };
+
+    static Query* newQuery(const KStdString& sql);
+    static void clear(Query* query);
+
+    // Call with mutex held.
+    Query* queryFor(const char* sql);
+
+    pthread_mutex_t mutex;
+    // Guarded by mutex.
+    KStdUnorderedMap<KStdString, Query*> queries;
+    KStdUnorderedMap<const char*, KnownSql> known;
+    Query* other;
+};
+
+// Normalizes SQL the way QueryMetrics keys it.
+KStdString normalizeSql(const char* sql);
+
+bool isSqlIdentifierChar(char c);
+
+// Skips a quoted string or identifier, doubled quotes included, returning what follows it.
+const char* skipSqlQuoted(const char* p, char close);
+
+/*
+ * Records the time from construction to destruction, when there are metrics and a statement
+ * by then.
+ */
+class PhaseTimer {
+public:
+    PhaseTimer(QueryMetrics* metrics, QueryPhase phase, sqlite3_stmt* const* statement) :
+            metrics(metrics), phase(phase), statement(statement),
+            start(metrics != NULL ? konan::getTimeMicros() : 0) {
+    }
+
+    ~PhaseTimer() {
+        if (metrics != NULL && *statement != NULL)
+            metrics->record(*statement, phase, konan::getTimeMicros() - start);
+    }
+
+private:
+    QueryMetrics* const metrics;
+    const QueryPhase phase;
+    sqlite3_stmt* const* const statement;
+    const uint64_t start;
+};
+
+}
+
+#endif // KNARCH_SQLITEMETRICS_H
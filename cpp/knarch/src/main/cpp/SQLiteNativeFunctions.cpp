@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteNativeFunctions.h"
+
+#include <pthread.h>
+#include <regex.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "StringTranscoder.h"
+
+// From the Kotlin runtime, which has the Unicode case tables Char.toLowerCase() uses.
+extern "C" KChar Kotlin_Char_toLowerCase(KChar ch);
+
+namespace android {
+
+static pthread_mutex_t gInstallersLock = PTHREAD_MUTEX_INITIALIZER;
+static KStdVector<FunctionInstaller> gInstallers;
+
+void addFunctionInstaller(FunctionInstaller installer) {
+    pthread_mutex_lock(&gInstallersLock);
+    gInstallers.push_back(installer);
+    pthread_mutex_unlock(&gInstallersLock);
+}
+
+bool AddedFunctions::contains(const char* name) const {
+    if (!known)
+        return true;
+    for (auto& added : names) {
+        if (strcasecmp(added.c_str(), name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// The functions on db that aren't built into SQLite. False when SQLite can't list them.
+static bool listApplicationFunctions(sqlite3* db, KStdVector<KStdString>* outNames) {
+    sqlite3_stmt* statement;
+    if (sqlite3_prepare_v2(db, "SELECT DISTINCT name FROM pragma_function_list WHERE builtin = 0",
+            -1, &statement, NULL) != SQLITE_OK)
+        return false;
+    int err;
+    while ((err = sqlite3_step(statement)) == SQLITE_ROW) {
+        outNames->push_back(KStdString(
+                reinterpret_cast<const char*>(sqlite3_column_text(statement, 0))));
+    }
+    sqlite3_finalize(statement);
+    return err == SQLITE_DONE;
+}
+
+int installFunctions(sqlite3* db, AddedFunctions* outAdded) {
+    int err = installBuiltinFunctions(db);
+    if (err != SQLITE_OK)
+        return err;
+
+    pthread_mutex_lock(&gInstallersLock);
+    KStdVector<FunctionInstaller> installers(gInstallers);
+    pthread_mutex_unlock(&gInstallersLock);
+    if (installers.empty())
+        return SQLITE_OK;
+
+    KStdVector<KStdString> before;
+    bool listed = outAdded != NULL && listApplicationFunctions(db, &before);
+    for (auto installer : installers) {
+        err = installer(db);
+        if (err != SQLITE_OK)
+            return err;
+    }
+
+    if (outAdded != NULL) {
+        KStdVector<KStdString> after;
+        outAdded->known = listed && listApplicationFunctions(db, &after);
+        outAdded->names.clear();
+        for (auto& name : after) {
+            bool existed = false;
+            for (auto& builtin : before) {
+                if (builtin == name) {
+                    existed = true;
+                    break;
+                }
+            }
+            if (!existed)
+                outAdded->names.push_back(name);
+        }
+    }
+    return SQLITE_OK;
+}
+
+static void freeRegex(void* data) {
+    auto regex = static_cast<regex_t*>(data);
+    regfree(regex);
+    delete regex;
+}
+
+// The pattern is compiled once per statement, not once per row.
+static void regexpFunction(sqlite3_context* context, FunctionText pattern, FunctionText text) {
+    auto regex = static_cast<regex_t*>(sqlite3_get_auxdata(context, 0));
+    if (regex != NULL) {
+        sqlite3_result_int(context, regexec(regex, text.data, 0, NULL, 0) == 0);
+        return;
+    }
+
+    regex = new regex_t;
+    int err = regcomp(regex, pattern.data, REG_EXTENDED | REG_NOSUB);
+    if (err != 0) {
+        char message[128];
+        regerror(err, regex, message, sizeof(message));
+        delete regex;
+        sqlite3_result_error(context, message, -1);
+        return;
+    }
+    sqlite3_result_int(context, regexec(regex, text.data, 0, NULL, 0) == 0);
+    // When set_auxdata can't keep it, it frees it right away and the next row compiles it again.
+    sqlite3_set_auxdata(context, 0, regex, &freeRegex);
+}
+
+static KStdString unicodeLowerFunction(sqlite3_context*, FunctionText text) {
+    KStdString lower(text.data, text.size);
+    bool ascii = true;
+    for (auto& c : lower) {
+        if (static_cast<unsigned char>(c) >= 0x80) {
+            ascii = false;
+            break;
+        }
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c + ('a' - 'A'));
+    }
+    if (ascii)
+        return lower;
+
+    // Characters outside the BMP come through as surrogates, which stay as they are.
+    KStdVector<KChar> utf16(Utf16LengthOfUtf8(text.data, text.size));
+    size_t length = Utf8ToUtf16(text.data, text.size, utf16.data());
+    for (size_t i = 0; i < length; i++) {
+        utf16[i] = Kotlin_Char_toLowerCase(utf16[i]);
+    }
+    lower.resize(Utf8LengthOfUtf16(utf16.data(), length));
+    lower.resize(Utf16ToUtf8(utf16.data(), length, &lower[0]));
+    return lower;
+}
+
+static uint64_t fnv1a(const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Text hashes its UTF-8 bytes, numbers their text.
+static KLong hashFunction(sqlite3_context*, FunctionBlob bytes) {
+    return static_cast<KLong>(fnv1a(bytes.data, bytes.size));
+}
+
+class HashSum {
+public:
+    HashSum() : sum(0) { }
+
+    void step(FunctionBlob bytes) {
+        sum += fnv1a(bytes.data, bytes.size);
+    }
+
+    void inverse(FunctionBlob bytes) {
+        sum -= fnv1a(bytes.data, bytes.size);
+    }
+
+    KLong value() {
+        return static_cast<KLong>(sum);
+    }
+
+    KLong finish() {
+        return value();
+    }
+
+private:
+    // Unsigned, so that it wraps.
+    uint64_t sum;
+};
+
+int installBuiltinFunctions(sqlite3* db) {
+    int err = registerScalarFunction(db, "regexp", &regexpFunction);
+    if (err == SQLITE_OK)
+        err = registerScalarFunction(db, "unicode_lower", &unicodeLowerFunction);
+    if (err == SQLITE_OK)
+        err = registerScalarFunction(db, "hash", &hashFunction);
+    if (err == SQLITE_OK) {
+#if SQLITE_VERSION_NUMBER >= 3025000
+        err = registerWindowFunction<HashSum>(db, "hash_sum");
+#else
+        err = registerAggregateFunction<HashSum>(db, "hash_sum");
+#endif
+    }
+    return err;
+}
+
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITENATIVEFUNCTIONS_H
+#define KNARCH_SQLITENATIVEFUNCTIONS_H
+
+#include <stddef.h>
+#include <exception>
+#include <new>
+#include <sqlite3.h>
+
+#include "Types.h"
+
+/*
+ * SQL functions implemented in C++ and registered on every connection the library opens, the
+ * writer and its readers alike. They run on the connection's thread inside the statement, with
+ * no call back into Kotlin.
+ *
+ * Functions are plain C++ with typed arguments and results, which the adapters below convert from
+ * and to sqlite3_value. Argument types are KLong, double, FunctionText and FunctionBlob; results
+ * can also be KStdString, returned as text. Scalar functions take the sqlite3_context first, for
+ * sqlite3_result_error and auxdata, and are strict: a NULL argument makes the result NULL without
+ * calling them. Aggregates are classes with step() and finish(), and window functions add
+ * inverse() and value(); rows with a NULL argument are skipped, like the built-in sum() does.
+ * Functions may throw: std::bad_alloc becomes SQLITE_NOMEM, anything else an error with its
+ * message.
+ *
+ * To add functions, pass an installer to addFunctionInstaller() before opening databases.
+ */
+
+namespace android {
+
+// Text argument, UTF-8 and NUL-terminated. Only valid during the call.
+struct FunctionText {
+    const char* data;
+    size_t size;
+};
+
+// Blob argument. data is NULL for an empty blob. Only valid during the call.
+struct FunctionBlob {
+    const void* data;
+    size_t size;
+};
+
+// Registers functions on a newly opened connection. Returns an SQLite result code.
+typedef int (*FunctionInstaller)(sqlite3* db);
+
+// Adds an installer to run on every connection opened from now on, after the built-in ones.
+void addFunctionInstaller(FunctionInstaller installer);
+
+/*
+ * The functions the added installers registered on a connection, which nothing can assume to be
+ * deterministic. When SQLite can't list them, known is false and any function may be one.
+ */
+struct AddedFunctions {
+    AddedFunctions() : known(true) { }
+
+    bool known;
+    KStdVector<KStdString> names;
+
+    bool contains(const char* name) const;
+};
+
+// Runs the built-in and added installers on db, naming what the added ones registered in
+// outAdded unless it is NULL.
+int installFunctions(sqlite3* db, AddedFunctions* outAdded = NULL);
+
+// The built-ins: regexp(pattern, text), also used by "text REGEXP pattern", with POSIX extended
+// syntax; unicode_lower(text); hash(x), the 64-bit FNV-1a of text or blob bytes; and hash_sum(x),
+// an aggregate and window function summing hash(x) over the rows, which doesn't depend on their
+// order.
+int installBuiltinFunctions(sqlite3* db);
+
+namespace functions {
+
+template<typename T> struct Value;
+
+template<> struct Value<KLong> {
+    static KLong get(sqlite3_value* value) { return sqlite3_value_int64(value); }
+    static void result(sqlite3_context* context, KLong result) {
+        sqlite3_result_int64(context, result);
+    }
+};
+
+template<> struct Value<double> {
+    static double get(sqlite3_value* value) { return sqlite3_value_double(value); }
+    static void result(sqlite3_context* context, double result) {
+        sqlite3_result_double(context, result);
+    }
+};
+
+template<> struct Value<FunctionText> {
+    static FunctionText get(sqlite3_value* value) {
+        // Text first, since asking for bytes first can leave the text unconverted.
+        FunctionText text;
+        text.data = reinterpret_cast<const char*>(sqlite3_value_text(value));
+        text.size = static_cast<size_t>(sqlite3_value_bytes(value));
+        return text;
+    }
+    static void result(sqlite3_context* context, const FunctionText& result) {
+        sqlite3_result_text(context, result.data, static_cast<int>(result.size), SQLITE_TRANSIENT);
+    }
+};
+
+template<> struct Value<FunctionBlob> {
+    static FunctionBlob get(sqlite3_value* value) {
+        FunctionBlob blob;
+        blob.data = sqlite3_value_blob(value);
+        blob.size = static_cast<size_t>(sqlite3_value_bytes(value));
+        return blob;
+    }
+    static void result(sqlite3_context* context, const FunctionBlob& result) {
+        sqlite3_result_blob(context, result.data, static_cast<int>(result.size), SQLITE_TRANSIENT);
+    }
+};
+
+template<> struct Value<KStdString> {
+    static void result(sqlite3_context* context, const KStdString& result) {
+        sqlite3_result_text(context, result.data(), static_cast<int>(result.size()),
+                SQLITE_TRANSIENT);
+    }
+};
+
+template<typename T> struct Value<const T&> : Value<T> { };
+
+// C++11 has no std::index_sequence.
+template<size_t... I> struct Indices { };
+template<size_t N, size_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> { };
+template<size_t... I> struct MakeIndices<0, I...> {
+    typedef Indices<I...> type;
+};
+
+inline bool anyNull(int argc, sqlite3_value** argv) {
+    for (int i = 0; i < argc; i++) {
+        if (sqlite3_value_type(argv[i]) == SQLITE_NULL)
+            return true;
+    }
+    return false;
+}
+
+// Exceptions can't unwind through SQLite, so whatever call throws becomes the result.
+template<typename Call>
+void guarded(sqlite3_context* context, Call call) {
+    try {
+        call();
+    } catch (const std::bad_alloc&) {
+        sqlite3_result_error_nomem(context);
+    } catch (const std::exception& e) {
+        sqlite3_result_error(context, e.what(), -1);
+    } catch (...) {
+        sqlite3_result_error(context, "Native function failed", -1);
+    }
+}
+
+template<typename R, typename... Args>
+struct Scalar {
+    typedef R (*Function)(sqlite3_context*, Args...);
+
+    static void call(sqlite3_context* context, int argc, sqlite3_value** argv) {
+        if (anyNull(argc, argv)) {
+            sqlite3_result_null(context);
+            return;
+        }
+        auto function = reinterpret_cast<Function>(sqlite3_user_data(context));
+        guarded(context, [&]() {
+            invoke(function, context, argv, typename MakeIndices<sizeof...(Args)>::type());
+        });
+    }
+
+    template<size_t... I>
+    static void invoke(Function function, sqlite3_context* context, sqlite3_value** argv,
+            Indices<I...>) {
+        Value<R>::result(context, function(context, Value<Args>::get(argv[I])...));
+    }
+};
+
+// Functions that set their own result, or an error.
+template<typename... Args>
+struct Scalar<void, Args...> {
+    typedef void (*Function)(sqlite3_context*, Args...);
+
+    static void call(sqlite3_context* context, int argc, sqlite3_value** argv) {
+        if (anyNull(argc, argv)) {
+            sqlite3_result_null(context);
+            return;
+        }
+        auto function = reinterpret_cast<Function>(sqlite3_user_data(context));
+        guarded(context, [&]() {
+            invoke(function, context, argv, typename MakeIndices<sizeof...(Args)>::type());
+        });
+    }
+
+    template<size_t... I>
+    static void invoke(Function function, sqlite3_context* context, sqlite3_value** argv,
+            Indices<I...>) {
+        function(context, Value<Args>::get(argv[I])...);
+    }
+};
+
+// The instance lives in the aggregate context as a pointer, created on the first row.
+template<typename Aggregate>
+Aggregate* aggregateOf(sqlite3_context* context, bool create) {
+    auto slot = static_cast<Aggregate**>(
+            sqlite3_aggregate_context(context, create ? sizeof(Aggregate*) : 0));
+    if (slot == NULL)
+        return NULL;
+    if (*slot == NULL && create)
+        *slot = new Aggregate();
+    return *slot;
+}
+
+template<typename Aggregate, typename Method> struct Rows;
+
+template<typename Aggregate, typename... Args>
+struct Rows<Aggregate, void (Aggregate::*)(Args...)> {
+    static const int ARGUMENT_COUNT = sizeof...(Args);
+
+    static void step(sqlite3_context* context, int argc, sqlite3_value** argv) {
+        apply(&Aggregate::step, context, argc, argv);
+    }
+
+    static void inverse(sqlite3_context* context, int argc, sqlite3_value** argv) {
+        apply(&Aggregate::inverse, context, argc, argv);
+    }
+
+    static void apply(void (Aggregate::*method)(Args...), sqlite3_context* context, int argc,
+            sqlite3_value** argv) {
+        if (anyNull(argc, argv))
+            return;
+        guarded(context, [&]() {
+            Aggregate* aggregate = aggregateOf<Aggregate>(context, true);
+            if (aggregate == NULL) {
+                sqlite3_result_error_nomem(context);
+                return;
+            }
+            invoke(aggregate, method, argv, typename MakeIndices<sizeof...(Args)>::type());
+        });
+    }
+
+    template<size_t... I>
+    static void invoke(Aggregate* aggregate, void (Aggregate::*method)(Args...),
+            sqlite3_value** argv, Indices<I...>) {
+        (aggregate->*method)(Value<Args>::get(argv[I])...);
+    }
+};
+
+template<typename Aggregate>
+struct Results {
+    static void final(sqlite3_context* context) {
+        Aggregate* aggregate = aggregateOf<Aggregate>(context, false);
+        guarded(context, [&]() {
+            if (aggregate == NULL) {
+                // No rows, or none without a NULL.
+                Aggregate empty;
+                Value<decltype(empty.finish())>::result(context, empty.finish());
+                return;
+            }
+            Value<decltype(aggregate->finish())>::result(context, aggregate->finish());
+        });
+        delete aggregate;
+    }
+
+    static void value(sqlite3_context* context) {
+        Aggregate* aggregate = aggregateOf<Aggregate>(context, false);
+        guarded(context, [&]() {
+            if (aggregate == NULL) {
+                Aggregate empty;
+                Value<decltype(empty.value())>::result(context, empty.value());
+                return;
+            }
+            Value<decltype(aggregate->value())>::result(context, aggregate->value());
+        });
+    }
+};
+
+}
+
+const int DEFAULT_FUNCTION_FLAGS = SQLITE_UTF8 | SQLITE_DETERMINISTIC;
+
+template<typename R, typename... Args>
+int registerScalarFunction(sqlite3* db, const char* name, R (*function)(sqlite3_context*, Args...),
+        int flags = DEFAULT_FUNCTION_FLAGS) {
+    return sqlite3_create_function_v2(db, name, sizeof...(Args), flags,
+            reinterpret_cast<void*>(function), &functions::Scalar<R, Args...>::call, NULL, NULL,
+            NULL);
+}
+
+// Aggregate needs a default constructor, void step(Args...) and finish().
+template<typename Aggregate>
+int registerAggregateFunction(sqlite3* db, const char* name, int flags = DEFAULT_FUNCTION_FLAGS) {
+    typedef functions::Rows<Aggregate, decltype(&Aggregate::step)> Rows;
+    return sqlite3_create_function_v2(db, name, Rows::ARGUMENT_COUNT, flags, NULL, NULL,
+            &Rows::step, &functions::Results<Aggregate>::final, NULL);
+}
+
+#if SQLITE_VERSION_NUMBER >= 3025000
+// Aggregate also needs void inverse(Args...), taking a row back out, and value(), the result so
+// far. It can still be used as a plain aggregate.
+template<typename Aggregate>
+int registerWindowFunction(sqlite3* db, const char* name, int flags = DEFAULT_FUNCTION_FLAGS) {
+    typedef functions::Rows<Aggregate, decltype(&Aggregate::step)> Rows;
+    return sqlite3_create_window_function(db, name, Rows::ARGUMENT_COUNT, flags, NULL,
+            &Rows::step, &functions::Results<Aggregate>::final,
+            &functions::Results<Aggregate>::value, &Rows::inverse, NULL);
+}
+#endif
+
+}
+
+#endif // KNARCH_SQLITENATIVEFUNCTIONS_H
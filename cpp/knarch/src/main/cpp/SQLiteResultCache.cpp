@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteResultCache.h"
+
+#include <ctype.h>
+#include <string.h>
+
+namespace android {
+
+// Built-in functions whose results can change between runs with the same arguments.
+static const char* const VOLATILE_FUNCTIONS[] = {
+    "random", "randomblob", "changes", "total_changes", "last_insert_rowid",
+    "date", "time", "datetime", "julianday", "strftime", "unixepoch", "timediff",
+    "current_date", "current_time", "current_timestamp",
+};
+
+// An entry bigger than this share of the cache would push out too much to be worth keeping.
+static const size_t MAX_ENTRY_SHARE = 4;
+
+static KStdString tableKey(const char* dbName, const char* table) {
+    KStdString key(dbName != NULL ? dbName : "main");
+    key.push_back('.');
+    key.append(table);
+    for (auto& c : key) {
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    return key;
+}
+
+static bool isVolatileFunction(const char* name) {
+    for (auto function : VOLATILE_FUNCTIONS) {
+        if (strcasecmp(name, function) == 0)
+            return true;
+    }
+    return false;
+}
+
+int DependencyCollector::install(sqlite3* db) {
+    return sqlite3_set_authorizer(db, &authorize, this);
+}
+
+void DependencyCollector::begin() {
+    current.cacheable = true;
+    current.changesSchema = false;
+    current.tables.clear();
+    active = true;
+}
+
+void DependencyCollector::end(StatementDependencies* outDependencies) {
+    active = false;
+    outDependencies->cacheable = current.cacheable;
+    outDependencies->changesSchema = current.changesSchema;
+    outDependencies->tables.swap(current.tables);
+}
+
+int DependencyCollector::authorize(void* context, int action, const char* arg1, const char* arg2,
+        const char* dbName, const char*) {
+    auto collector = static_cast<DependencyCollector*>(context);
+    if (!collector->active)
+        return SQLITE_OK;
+
+    StatementDependencies& current = collector->current;
+    switch (action) {
+        case SQLITE_SELECT:
+        case SQLITE_RECURSIVE:
+            break;
+        case SQLITE_READ: {
+            KStdString table = tableKey(dbName, arg1);
+            bool found = false;
+            for (auto& existing : current.tables) {
+                if (existing == table) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                current.tables.push_back(table);
+            break;
+        }
+        case SQLITE_FUNCTION:
+            if (isVolatileFunction(arg2) || collector->addedFunctions.contains(arg2))
+                current.cacheable = false;
+            break;
+        case SQLITE_CREATE_INDEX:
+        case SQLITE_CREATE_TABLE:
+        case SQLITE_CREATE_TEMP_INDEX:
+        case SQLITE_CREATE_TEMP_TABLE:
+        case SQLITE_CREATE_TEMP_TRIGGER:
+        case SQLITE_CREATE_TEMP_VIEW:
+        case SQLITE_CREATE_TRIGGER:
+        case SQLITE_CREATE_VIEW:
+        case SQLITE_CREATE_VTABLE:
+        case SQLITE_DROP_INDEX:
+        case SQLITE_DROP_TABLE:
+        case SQLITE_DROP_TEMP_INDEX:
+        case SQLITE_DROP_TEMP_TABLE:
+        case SQLITE_DROP_TEMP_TRIGGER:
+        case SQLITE_DROP_TEMP_VIEW:
+        case SQLITE_DROP_TRIGGER:
+        case SQLITE_DROP_VIEW:
+        case SQLITE_DROP_VTABLE:
+        case SQLITE_ALTER_TABLE:
+        case SQLITE_ATTACH:
+        case SQLITE_DETACH:
+            current.changesSchema = true;
+            current.cacheable = false;
+            break;
+        default:
+            current.cacheable = false;
+            break;
+    }
+    return SQLITE_OK;
+}
+
+ResultCache::ResultCache(size_t maxBytes, size_t maxStatements) :
+        maxBytes(maxBytes), maxStatements(maxStatements), writer(NULL), epoch(0), schemaPending(false), committingEpoch(false),
+        bytes(0), changedRows(0), totalChangesAtStart(0) {
+    pthread_mutex_init(&mutex, NULL);
+    memset(stats, 0, sizeof(stats));
+}
+
+ResultCache::~ResultCache() {
+    pthread_mutex_destroy(&mutex);
+}
+
+void ResultCache::start(sqlite3* db) {
+    writer = db;
+    totalChangesAtStart = sqlite3_total_changes(db);
+}
+
+void ResultCache::rowChanged(const char* dbName, const char* table) {
+    changedRows++;
+
+    // Bulk writes mostly hit one table over and over.
+    KStdString key = tableKey(dbName, table);
+    if (!changedTables.empty() && changedTables.back() == key)
+        return;
+    for (auto& existing : changedTables) {
+        if (existing == key)
+            return;
+    }
+    changedTables.push_back(key);
+}
+
+// Runs before the transaction's changes become visible to the readers, so no reader can fill
+// from them under the old versions.
+void ResultCache::committing() {
+    KLong totalChanges = sqlite3_total_changes(writer);
+    bool unreported = totalChanges - totalChangesAtStart != changedRows;
+
+    pthread_mutex_lock(&mutex);
+    for (auto& table : changedTables) {
+        tableVersions[table]++;
+        committingTables.push_back(table);
+    }
+    if (unreported || schemaPending) {
+        epoch++;
+        schemaPending = false;
+        committingEpoch = true;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    changedTables.clear();
+    changedRows = 0;
+    totalChangesAtStart = totalChanges;
+}
+
+// A reader can take a ticket after committing() and still start reading before the commit is
+// visible, so whatever committing() moved is moved again, and that ticket can't be stored.
+void ResultCache::committed() {
+    pthread_mutex_lock(&mutex);
+    for (auto& table : committingTables) {
+        tableVersions[table]++;
+    }
+    if (committingEpoch) {
+        epoch++;
+        committingEpoch = false;
+    }
+    committingTables.clear();
+    pthread_mutex_unlock(&mutex);
+}
+
+// Nothing was committed, so fills from before the rollback are still good.
+void ResultCache::rolledBack() {
+    changedTables.clear();
+    changedRows = 0;
+    totalChangesAtStart = sqlite3_total_changes(writer);
+
+    pthread_mutex_lock(&mutex);
+    schemaPending = false;
+    committingTables.clear();
+    committingEpoch = false;
+    pthread_mutex_unlock(&mutex);
+}
+
+void ResultCache::setDependencies(const char* sql, const StatementDependencies& statementDependencies) {
+    pthread_mutex_lock(&mutex);
+    if (statementDependencies.changesSchema) {
+        // ATTACH and DETACH take effect without a commit.
+        epoch++;
+        schemaPending = true;
+    }
+
+    KStdString key(sql);
+    auto found = statementsBySql.find(key);
+    if (found != statementsBySql.end()) {
+        statements.erase(found->second);
+        statementsBySql.erase(found);
+    }
+    while (!statements.empty() && statements.size() >= maxStatements) {
+        statementsBySql.erase(statements.back().sql);
+        statements.pop_back();
+    }
+    statements.push_front(Statement());
+    statements.front().sql = key;
+    statements.front().dependencies = statementDependencies;
+    statementsBySql[key] = statements.begin();
+    pthread_mutex_unlock(&mutex);
+}
+
+bool ResultCache::hasDependencies(const char* sql) {
+    pthread_mutex_lock(&mutex);
+    bool found = statementsBySql.find(KStdString(sql)) != statementsBySql.end();
+    pthread_mutex_unlock(&mutex);
+    return found;
+}
+
+KLong ResultCache::versionOf(const KStdString& table) {
+    auto found = tableVersions.find(table);
+    return found == tableVersions.end() ? 0 : found->second;
+}
+
+bool ResultCache::isCurrent(KLong entryEpoch, const KStdVector<KStdString>& tables,
+        const KStdVector<KLong>& versions) {
+    if (entryEpoch != epoch)
+        return false;
+    for (size_t i = 0; i < tables.size(); i++) {
+        if (versionOf(tables[i]) != versions[i])
+            return false;
+    }
+    return true;
+}
+
+void ResultCache::erase(EntryIterator entry) {
+    bytes -= entry->key.size() + entry->snapshot.size();
+    entriesByKey.erase(entry->key);
+    entries.erase(entry);
+}
+
+bool ResultCache::lookup(const KStdString& key, const char* sql, CursorWindow* window,
+        KLong* outResult, Ticket* outTicket) {
+    pthread_mutex_lock(&mutex);
+    auto statement = statementsBySql.find(KStdString(sql));
+    outTicket->cacheable = statement != statementsBySql.end()
+            && statement->second->dependencies.cacheable;
+    if (!outTicket->cacheable) {
+        pthread_mutex_unlock(&mutex);
+        return false;
+    }
+    statements.splice(statements.begin(), statements, statement->second);
+
+    auto found = entriesByKey.find(key);
+    if (found != entriesByKey.end()) {
+        EntryIterator entry = found->second;
+        if (isCurrent(entry->epoch, entry->tables, entry->versions)
+                && window->restore(entry->snapshot.data(), entry->snapshot.size()) == OK) {
+            entries.splice(entries.begin(), entries, entry);
+            *outResult = entry->result;
+            stats[RESULT_CACHE_STAT_HITS]++;
+            pthread_mutex_unlock(&mutex);
+            return true;
+        }
+        erase(entry);
+        stats[RESULT_CACHE_STAT_INVALIDATED]++;
+    }
+    stats[RESULT_CACHE_STAT_MISSES]++;
+
+    outTicket->epoch = epoch;
+    outTicket->tables = statement->second->dependencies.tables;
+    outTicket->versions.clear();
+    for (auto& table : outTicket->tables) {
+        outTicket->versions.push_back(versionOf(table));
+    }
+    pthread_mutex_unlock(&mutex);
+    return false;
+}
+
+void ResultCache::store(const KStdString& key, const Ticket& ticket, CursorWindow* window,
+        KLong result) {
+    size_t size = key.size() + window->usedSize();
+    if (size > maxBytes / MAX_ENTRY_SHARE)
+        return;
+
+    pthread_mutex_lock(&mutex);
+    // Whatever changed while the query ran may or may not be in the window.
+    if (!isCurrent(ticket.epoch, ticket.tables, ticket.versions)) {
+        pthread_mutex_unlock(&mutex);
+        return;
+    }
+
+    auto found = entriesByKey.find(key);
+    if (found != entriesByKey.end())
+        erase(found->second);
+    while (!entries.empty() && bytes + size > maxBytes) {
+        erase(--entries.end());
+        stats[RESULT_CACHE_STAT_EVICTED]++;
+    }
+
+    entries.push_front(Entry());
+    Entry& entry = entries.front();
+    entry.key = key;
+    entry.snapshot.assign(static_cast<const char*>(window->data()), window->usedSize());
+    entry.result = result;
+    entry.epoch = ticket.epoch;
+    entry.tables = ticket.tables;
+    entry.versions = ticket.versions;
+    entriesByKey[key] = entries.begin();
+    bytes += size;
+    stats[RESULT_CACHE_STAT_STORES]++;
+    pthread_mutex_unlock(&mutex);
+}
+
+void ResultCache::clear() {
+    pthread_mutex_lock(&mutex);
+    entries.clear();
+    entriesByKey.clear();
+    statements.clear();
+    statementsBySql.clear();
+    bytes = 0;
+    epoch++;
+    pthread_mutex_unlock(&mutex);
+}
+
+void ResultCache::getStats(KLong* outStats) {
+    pthread_mutex_lock(&mutex);
+    stats[RESULT_CACHE_STAT_ENTRIES] = static_cast<KLong>(entries.size());
+    stats[RESULT_CACHE_STAT_BYTES] = static_cast<KLong>(bytes);
+    memcpy(outStats, stats, sizeof(stats));
+    pthread_mutex_unlock(&mutex);
+}
+
+}
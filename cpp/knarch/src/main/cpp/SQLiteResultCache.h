@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITERESULTCACHE_H
+#define KNARCH_SQLITERESULTCACHE_H
+
+#include <pthread.h>
+#include <sqlite3.h>
+
+#include "Types.h"
+#include "AndroidfwCursorWindow.h"
+#include "SQLiteNativeFunctions.h"
+
+namespace android {
+
+/* Slots of the LongArray filled by nativeGetResultCacheStats. Must match SQLiteConnection.kt. */
+enum {
+    RESULT_CACHE_STAT_HITS = 0,
+    RESULT_CACHE_STAT_MISSES = 1,
+    RESULT_CACHE_STAT_STORES = 2,
+    RESULT_CACHE_STAT_INVALIDATED = 3,
+    RESULT_CACHE_STAT_EVICTED = 4,
+    RESULT_CACHE_STAT_ENTRIES = 5,
+    RESULT_CACHE_STAT_BYTES = 6,
+    RESULT_CACHE_STAT_SIZE = 7,
+};
+
+/*
+ * What a statement's results depend on, as its connection's authorizer saw it being prepared.
+ * Tables are "schema.table", lower case. A statement that does anything but read tables with
+ * deterministic built-in functions isn't cacheable, nor is one calling a function added through
+ * addFunctionInstaller().
+ */
+struct StatementDependencies {
+    bool cacheable;
+    bool changesSchema;
+    KStdVector<KStdString> tables;
+};
+
+/*
+ * Collects the dependencies of the statements prepared on one connection, through the
+ * connection's authorizer. Only used by the thread preparing statements on the connection.
+ */
+class DependencyCollector {
+public:
+    DependencyCollector() : active(false) { }
+
+    int install(sqlite3* db);
+
+    // The functions installFunctions() found the added installers to register on the connection.
+    void setAddedFunctions(const AddedFunctions& added) {
+        addedFunctions = added;
+    }
+
+    // Brackets a prepare. end() hands back what the authorizer saw in between.
+    void begin();
+    void end(StatementDependencies* outDependencies);
+
+private:
+    static int authorize(void* context, int action, const char* arg1, const char* arg2,
+            const char* dbName, const char* trigger);
+
+    bool active;
+    StatementDependencies current;
+    AddedFunctions addedFunctions;
+};
+
+/*
+ * Window fills kept for queries that run again with the same arguments, shared by a writer and
+ * its readers. An entry is a snapshot of the filled window, which a hit copies into the caller's
+ * window in place of running the query.
+ *
+ * Every table has a version that moves when a transaction changed it, as reported by the update
+ * hook: once in the writer's commit hook, and again once the commit has finished, since a reader
+ * starting in between still reads from before it. An entry remembers the versions of the tables
+ * it read, taken before its query ran, and is only used while they still hold. Changes the update hook doesn't
+ * report, such as to WITHOUT ROWID tables, show up as a difference between the rows it reported
+ * and sqlite3_total_changes, and move the epoch instead, which every entry depends on. So do
+ * statements that change the schema.
+ *
+ * Only changes made through the writer are seen, so the cache is no use on a database that other
+ * connections write to.
+ */
+class ResultCache {
+public:
+    /*
+     * What a lookup found the entry to depend on, for store() to check once the query has run.
+     */
+    struct Ticket {
+        bool cacheable;
+        KLong epoch;
+        KStdVector<KStdString> tables;
+        KStdVector<KLong> versions;
+    };
+
+    // maxStatements bounds the statements whose dependencies are kept. It should cover the
+    // statement caches of the writer and its readers, as a statement still cached after its
+    // dependencies were dropped has to be prepared again to collect them.
+    ResultCache(size_t maxBytes, size_t maxStatements);
+    ~ResultCache();
+
+    // Called from the update, commit and rollback hooks of the connection all writes go through,
+    // on its thread, after start() with that connection. committed() follows once the transaction
+    // committing() saw has ended.
+    void start(sqlite3* writer);
+    void rowChanged(const char* dbName, const char* table);
+    void committing();
+    void committed();
+    void rolledBack();
+
+    // Records the dependencies of a statement that has just been prepared. Only the most recently
+    // used maxStatements are kept, and clear() drops them all.
+    void setDependencies(const char* sql, const StatementDependencies& dependencies);
+    bool hasDependencies(const char* sql);
+
+    // Copies the entry for key into the window. On a miss, fills in the ticket for store().
+    bool lookup(const KStdString& key, const char* sql, CursorWindow* window, KLong* outResult,
+            Ticket* outTicket);
+
+    void store(const KStdString& key, const Ticket& ticket, CursorWindow* window, KLong result);
+
+    void clear();
+
+    void getStats(KLong* outStats);
+
+private:
+    struct Entry {
+        KStdString key;
+        KStdString snapshot;
+        KLong result;
+        KLong epoch;
+        KStdVector<KStdString> tables;
+        KStdVector<KLong> versions;
+    };
+
+    typedef KStdList<Entry>::iterator EntryIterator;
+
+    struct Statement {
+        KStdString sql;
+        StatementDependencies dependencies;
+    };
+
+    typedef KStdList<Statement>::iterator StatementIterator;
+
+    // Call with mutex held.
+    KLong versionOf(const KStdString& table);
+    bool isCurrent(KLong epoch, const KStdVector<KStdString>& tables,
+            const KStdVector<KLong>& versions);
+    void erase(EntryIterator entry);
+
+    const size_t maxBytes;
+    const size_t maxStatements;
+    sqlite3* writer;
+
+    pthread_mutex_t mutex;
+
+    // Guarded by mutex. Entries are kept most recently used first.
+    KStdList<Entry> entries;
+    KStdUnorderedMap<KStdString, EntryIterator> entriesByKey;
+    // Statements are kept most recently used first.
+    KStdList<Statement> statements;
+    KStdUnorderedMap<KStdString, StatementIterator> statementsBySql;
+    KStdUnorderedMap<KStdString, KLong> tableVersions;
+    KLong epoch;
+    bool schemaPending;
+    // What committing() moved, for committed() to move again.
+    KStdVector<KStdString> committingTables;
+    bool committingEpoch;
+    size_t bytes;
+    KLong stats[RESULT_CACHE_STAT_SIZE];
+
+    // Only touched by the writer's hooks, on the writer's thread.
+    KStdVector<KStdString> changedTables;
+    KLong changedRows;
+    KLong totalChangesAtStart;
+};
+
+}
+
+#endif // KNARCH_SQLITERESULTCACHE_H
@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteSlowQueryLog.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <utility>
+
+#include "SQLiteCollation.h"
+#include "SQLiteContention.h"
+#include "SQLiteMetrics.h"
+#include "SQLiteNativeFunctions.h"
+
+namespace android {
+
+// By SQLITE_INTEGER through SQLITE_NULL, less one.
+static const char* const TYPE_NAMES[] = { "INTEGER", "REAL", "TEXT", "BLOB", "NULL" };
+
+// Finds the next parameter in raw SQL the way SQLite's tokenizer does, setting its length.
+static const char* findParameter(const char* p, size_t* outLength) {
+    while (*p != '\0') {
+        char c = *p;
+        const char* next;
+        if (c == '\'' || c == '"' || c == '`') {
+            next = skipSqlQuoted(p, c);
+        } else if (c == '[') {
+            next = strchr(p, ']');
+            next = next != NULL ? next + 1 : p + strlen(p);
+        } else if (c == '-' && p[1] == '-') {
+            next = strchr(p, '\n');
+            next = next != NULL ? next : p + strlen(p);
+        } else if (c == '/' && p[1] == '*') {
+            next = strstr(p + 2, "*/");
+            next = next != NULL ? next + 2 : p + strlen(p);
+        } else if (c == '?') {
+            next = p + 1;
+            while (isdigit(static_cast<unsigned char>(*next)))
+                next++;
+            *outLength = next - p;
+            return p;
+        } else if ((c == ':' || c == '@' || c == '$') && isSqlIdentifierChar(p[1])) {
+            next = p + 1;
+            while (isSqlIdentifierChar(*next))
+                next++;
+            *outLength = next - p;
+            return p;
+        } else if (isSqlIdentifierChar(c)) {
+            // Identifiers can have $ in them, and numbers letters.
+            next = p + 1;
+            while (isSqlIdentifierChar(*next))
+                next++;
+        } else {
+            next = p + 1;
+        }
+        p = next;
+    }
+    *outLength = 0;
+    return p;
+}
+
+// Skips a value as sqlite3_expanded_sql writes it, returning its type.
+static int skipValue(const char** p) {
+    const char* value = *p;
+    if (strncmp(value, "NULL", 4) == 0) {
+        *p = value + 4;
+        return SQLITE_NULL;
+    }
+    if (*value == '\'') {
+        *p = skipSqlQuoted(value, '\'');
+        // Text cut short by SQLITE_TRACE_SIZE_LIMIT.
+        if (strncmp(*p, "/*+", 3) == 0) {
+            const char* end = strstr(*p, "*/");
+            *p = end != NULL ? end + 2 : *p + strlen(*p);
+        }
+        return SQLITE_TEXT;
+    }
+    if (*value == 'x' && value[1] == '\'') {
+        *p = skipSqlQuoted(value + 1, '\'');
+        return SQLITE_BLOB;
+    }
+    if (strncmp(value, "zeroblob(", 9) == 0) {
+        const char* end = strchr(value, ')');
+        *p = end != NULL ? end + 1 : value + strlen(value);
+        return SQLITE_BLOB;
+    }
+    // Integers are digits, reals anything else %!.15g writes: a point, an exponent, Inf or NaN.
+    const char* end = *value == '-' ? value + 1 : value;
+    bool integer = *end != '\0';
+    for (; isalnum(static_cast<unsigned char>(*end)) || *end == '.'
+            || ((*end == '+' || *end == '-') && (end[-1] == 'e' || end[-1] == 'E')); end++) {
+        integer = integer && isdigit(static_cast<unsigned char>(*end));
+    }
+    *p = end;
+    return integer ? SQLITE_INTEGER : SQLITE_FLOAT;
+}
+
+// There is no API for the types of bound arguments, so they are read back from the expanded SQL,
+// which is the raw SQL with each parameter replaced by its value.
+KStdString argumentTypesOf(sqlite3_stmt* statement) {
+    int count = sqlite3_bind_parameter_count(statement);
+    if (count == 0)
+        return KStdString();
+    char* expanded = sqlite3_expanded_sql(statement);
+    if (expanded == NULL)
+        return KStdString();
+
+    KStdVector<int> types(count, SQLITE_NULL);
+    const char* raw = sqlite3_sql(statement);
+    const char* value = expanded;
+    int nextIndex = 1;
+    bool matched = true;
+    while (matched) {
+        size_t length;
+        const char* parameter = findParameter(raw, &length);
+        if (length == 0)
+            break;
+        // The text in between is copied as it is.
+        size_t between = parameter - raw;
+        matched = strncmp(raw, value, between) == 0;
+        value += matched ? between : 0;
+
+        // Numbered the way sqlite3_expanded_sql numbers them.
+        int index;
+        if (*parameter == '?') {
+            index = length > 1 ? atoi(parameter + 1) : nextIndex;
+        } else {
+            KStdString name(parameter, length);
+            index = sqlite3_bind_parameter_index(statement, name.c_str());
+        }
+        matched = matched && index >= 1 && index <= count;
+        if (matched) {
+            types[index - 1] = skipValue(&value);
+            nextIndex = index + 1 > nextIndex ? index + 1 : nextIndex;
+        }
+        raw = parameter + length;
+    }
+    sqlite3_free(expanded);
+    if (!matched)
+        return KStdString();
+
+    KStdString result;
+    for (int type : types) {
+        if (!result.empty())
+            result.push_back(',');
+        result.append(TYPE_NAMES[type - 1]);
+    }
+    return result;
+}
+
+SlowQueryLog::SlowQueryLog(const char* path, bool localizedCollation, uint64_t thresholdMicros,
+        size_t capacity) :
+        path(path), localizedCollation(localizedCollation), thresholdMicros(thresholdMicros),
+        capacity(capacity > 0 ? capacity : 1), planner(NULL), next(0), nextId(0) {
+    pthread_mutex_init(&planMutex, NULL);
+    pthread_mutex_init(&mutex, NULL);
+}
+
+SlowQueryLog::~SlowQueryLog() {
+    sqlite3_close(planner);
+    pthread_mutex_destroy(&planMutex);
+    pthread_mutex_destroy(&mutex);
+}
+
+bool SlowQueryLog::openPlanner(KStdString* outError) {
+    if (path.empty() || path == ":memory:") {
+        *outError = "in-memory database";
+        return false;
+    }
+    sqlite3* db = NULL;
+    int err = sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, NULL);
+    // Statements may call the functions and collations every connection has.
+    if (err == SQLITE_OK)
+        err = installFunctions(db);
+    if (err == SQLITE_OK)
+        err = installUnicodeCollation(db, localizedCollation);
+    // Reading the schema waits out a writer the way the connections do.
+    if (err == SQLITE_OK)
+        err = sqlite3_busy_timeout(db, DEFAULT_BUSY_POLICY.timeoutMs);
+    if (err != SQLITE_OK) {
+        *outError = db != NULL ? sqlite3_errmsg(db) : sqlite3_errstr(err);
+        sqlite3_close(db);
+        return false;
+    }
+    planner = db;
+    return true;
+}
+
+KStdString SlowQueryLog::explain(const char* sql) {
+    KStdString error;
+    if (planner == NULL && !openPlanner(&error))
+        return "unavailable: " + error;
+
+    KStdString explainSql("EXPLAIN QUERY PLAN ");
+    explainSql.append(sql);
+    sqlite3_stmt* statement = NULL;
+    int err = sqlite3_prepare_v2(planner, explainSql.c_str(), -1, &statement, NULL);
+    if (err != SQLITE_OK)
+        return KStdString("unavailable: ") + sqlite3_errmsg(planner);
+
+    KStdString plan;
+    // Steps come after their parents.
+    KStdVector<std::pair<int, int>> depths;
+    while ((err = sqlite3_step(statement)) == SQLITE_ROW) {
+        if (!plan.empty())
+            plan.push_back('\n');
+#if SQLITE_VERSION_NUMBER >= 3024000
+        int id = sqlite3_column_int(statement, 0);
+        int parent = sqlite3_column_int(statement, 1);
+        int depth = 0;
+        for (auto& entry : depths) {
+            if (entry.first == parent)
+                depth = entry.second + 1;
+        }
+        depths.push_back(std::make_pair(id, depth));
+        plan.append(2 * depth, ' ');
+#endif
+        auto detail = reinterpret_cast<const char*>(sqlite3_column_text(statement, 3));
+        plan.append(detail != NULL ? detail : "");
+    }
+    if (err != SQLITE_DONE)
+        plan = KStdString("unavailable: ") + sqlite3_errmsg(planner);
+    sqlite3_finalize(statement);
+    return plan;
+}
+
+void SlowQueryLog::record(sqlite3_stmt* statement, uint64_t micros) {
+    const char* sql = sqlite3_sql(statement);
+    if (sql == NULL)
+        return;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    Entry entry;
+    entry.query.sql = normalizeSql(sql);
+    entry.query.argumentTypes = argumentTypesOf(statement);
+    entry.query.micros = static_cast<KLong>(micros);
+    entry.query.finishedMillis = static_cast<KLong>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+    entry.pendingSql = sql;
+
+    pthread_mutex_lock(&mutex);
+    entry.id = nextId++;
+    if (ring.size() < capacity) {
+        ring.push_back(entry);
+    } else {
+        ring[next] = entry;
+    }
+    next = (next + 1) % capacity;
+    pthread_mutex_unlock(&mutex);
+}
+
+void SlowQueryLog::clear() {
+    pthread_mutex_lock(&mutex);
+    ring.clear();
+    next = 0;
+    pthread_mutex_unlock(&mutex);
+}
+
+KStdVector<SlowQuery>* SlowQueryLog::snapshot() {
+    KStdVector<Entry> entries;
+    pthread_mutex_lock(&mutex);
+    size_t oldest = ring.size() < capacity ? 0 : next;
+    entries.reserve(ring.size());
+    for (size_t i = 0; i < ring.size(); i++) {
+        entries.push_back(ring[(oldest + i) % ring.size()]);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    // Outside of mutex, so that runs can still be recorded meanwhile.
+    bool planned = false;
+    pthread_mutex_lock(&planMutex);
+    for (auto& entry : entries) {
+        if (!entry.pendingSql.empty()) {
+            entry.query.plan = explain(entry.pendingSql.c_str());
+            planned = true;
+        }
+    }
+    pthread_mutex_unlock(&planMutex);
+
+    // Keeps the plans for the entries not replaced in the meantime.
+    if (planned) {
+        pthread_mutex_lock(&mutex);
+        for (auto& entry : entries) {
+            if (entry.pendingSql.empty())
+                continue;
+            for (auto& kept : ring) {
+                if (kept.id == entry.id) {
+                    kept.query.plan = entry.query.plan;
+                    kept.pendingSql.clear();
+                    break;
+                }
+            }
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+
+    auto result = new KStdVector<SlowQuery>();
+    result->reserve(entries.size());
+    for (auto& entry : entries) {
+        result->push_back(entry.query);
+    }
+    return result;
+}
+
+}
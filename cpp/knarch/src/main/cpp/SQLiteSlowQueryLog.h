@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITESLOWQUERYLOG_H
+#define KNARCH_SQLITESLOWQUERYLOG_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sqlite3.h>
+
+#include "Types.h"
+
+namespace android {
+
+// Slots of the LongArray filled by nativeSlowQueryTimes. Must match SQLiteConnection.kt.
+enum {
+    SLOW_QUERY_TIME_MICROS = 0,
+    SLOW_QUERY_TIME_FINISHED_MILLIS = 1,
+    SLOW_QUERY_TIME_SIZE = 2,
+};
+
+// One run of a statement that took at least the log's threshold.
+struct SlowQuery {
+    // Normalized as for QueryMetrics.
+    KStdString sql;
+    // The types of the bound arguments in parameter order, such as "INTEGER,TEXT". Never values.
+    KStdString argumentTypes;
+    // EXPLAIN QUERY PLAN, one line per step indented under its parent, or why there is none.
+    KStdString plan;
+    KLong micros;
+    // Wall clock time the run finished at.
+    KLong finishedMillis;
+};
+
+/*
+ * The last runs of statements that took at least a threshold, for a writer and its readers, kept
+ * in a ring of a fixed size.
+ *
+ * Recording a run only copies its SQL, argument types and timing, so it adds next to nothing to
+ * the profile callback. Plans are taken when the log is read, on a read-only connection of the
+ * log's own, opened the first time one is needed, so the connection that ran the statement is
+ * left as it was. The plan is what SQLite would do for the SQL then, which is what it did unless
+ * the schema or statistics changed in between, and nothing records whether they did. It can't be
+ * had for in-memory databases, or for SQL that uses temp tables, attached databases or functions
+ * registered on the connection after it was opened, none of which the log's connection sees.
+ */
+class SlowQueryLog {
+public:
+    SlowQueryLog(const char* path, bool localizedCollation, uint64_t thresholdMicros,
+            size_t capacity);
+    ~SlowQueryLog();
+
+    uint64_t threshold() const { return thresholdMicros; }
+
+    // Called from the profile callback of the connection that ran the statement.
+    void record(sqlite3_stmt* statement, uint64_t micros);
+
+    void clear();
+
+    // Oldest first. Takes the plans not taken yet.
+    KStdVector<SlowQuery>* snapshot();
+
+private:
+    struct Entry {
+        SlowQuery query;
+        // The SQL as it ran, kept until its plan has been taken.
+        KStdString pendingSql;
+        KLong id;
+    };
+
+    // Call with planMutex held.
+    KStdString explain(const char* sql);
+    bool openPlanner(KStdString* outError);
+
+    const KStdString path;
+    const bool localizedCollation;
+    const uint64_t thresholdMicros;
+    const size_t capacity;
+
+    pthread_mutex_t planMutex;
+    // Guarded by planMutex.
+    sqlite3* planner;
+
+    pthread_mutex_t mutex;
+    // Guarded by mutex. Once full, next is the oldest entry.
+    KStdVector<Entry> ring;
+    size_t next;
+    KLong nextId;
+};
+
+// The types of the arguments bound to the statement, as kept by SlowQueryLog.
+KStdString argumentTypesOf(sqlite3_stmt* statement);
+
+}
+
+#endif // KNARCH_SQLITESLOWQUERYLOG_H
@@ -7,7 +7,7 @@
 #include <pthread.h>
 #include "Types.h"
 #include "Natives.h"
-#include "utf8.h"
+#include "StringTranscoder.h"
 
 extern "C" {
 void finalizeStmt(KLong connectionPtr, KNativePtr ptr);
@@ -16,10 +16,7 @@ void finalizeStmt(KLong connectionPtr, KNativePtr ptr);
 namespace {
 
     KStdString makeStdString(KString kstring) {
-        const KChar *utf16 = CharArrayAddressOfElementAt(kstring, 0);
-        KStdString utf8;
-        utf8::unchecked::utf16to8(utf16, utf16 + kstring->count_, back_inserter(utf8));
-        return utf8;
+        return Utf8StdStringFromKString(kstring);
     }
 
     class Locker {
@@ -42,13 +39,28 @@ namespace {
 
         }
 
-        void putStmt(KString kstring, KRef stmtRef) {
+        /**
+         * Finalizes whatever is still cached or queued. The connection must still be open, as
+         * SQLite refuses to close one while statements are left.
+         */
+        void finalizeAll(KLong openConnectionPtr) {
+            evictAll();
+            for (auto stmtPtr : reclaimQueue) {
+                finalizeStmt(openConnectionPtr, stmtPtr);
+                DisposeStablePointer(stmtPtr);
+            }
+            reclaimQueue.clear();
+        }
+
+        bool putStmt(KString kstring, KRef stmtRef) {
             KStdString utf8 = makeStdString(kstring);
             KNativePtr stmt = CreateStablePointer(stmtRef);
             KNativePtr removedPair = stmtCache.put(utf8, stmt);
             if (removedPair != nullptr) {
                 removeStmt(removedPair);
+                return true;
             }
+            return false;
         }
 
         void evictAll() {
@@ -61,12 +73,22 @@ namespace {
             stmtCache.removeAll();
         }
 
-        void remove(KString sql) {
+        bool remove(KString sql) {
             auto key = makeStdString(sql);
             if (stmtCache.exists(key)) {
                 removeStmt(stmtCache.get(key));
                 stmtCache.remove(key);
+                return true;
             }
+            return false;
+        }
+
+        /**
+         * Hands over every statement waiting to be finalized. The caller owns the stable
+         * pointers afterwards and is expected to finalize them outside of the state lock.
+         */
+        void takeReclaimed(KStdVector<KNativePtr>& out) {
+            out.swap(reclaimQueue);
         }
 
         KRef getStmt(KString sql) {
@@ -103,18 +125,23 @@ namespace {
             dbConfig = nullptr;
         }
 
-        KLong connectionPtr;
+        KLong connectionPtr = 0;
+
+        // Threads using the connection's readers without holding the session lock.
+        KInt readerAccess = 0;
 
 
     private:
+        // Finalizing can be slow, and we're called with the global state lock held, so
+        // evicted statements are only queued here, for drainReclaimed to finalize.
         void removeStmt(KNativePtr stmtPtr) {
-            finalizeStmt(connectionPtr, stmtPtr);
-            DisposeStablePointer(stmtPtr);
+            reclaimQueue.push_back(stmtPtr);
         }
 
         KNativePtr transaction = nullptr;
         KNativePtr dbConfig = nullptr;
         cache::lru_cache<KStdString, KNativePtr> stmtCache;
+        KStdVector<KNativePtr> reclaimQueue;
     };
 
 
@@ -122,16 +149,18 @@ namespace {
     public:
         SQLiteState() {
             pthread_mutex_init(&lock_, nullptr);
+            pthread_cond_init(&readerAccessDone_, nullptr);
         }
 
         ~SQLiteState() {
+            pthread_cond_destroy(&readerAccessDone_);
             pthread_mutex_destroy(&lock_);
         }
 
-        void putStmt(KInt dataId, KString sql, KRef stmt) {
+        bool putStmt(KInt dataId, KString sql, KRef stmt) {
             Locker locker(&lock_);
             auto it = data_.find(dataId);
-            it->second->putStmt(sql, stmt);
+            return it->second->putStmt(sql, stmt);
         }
 
         KRef getStmt(KInt dataId, KString sql) {
@@ -191,16 +220,68 @@ namespace {
                 return it->second->connectionPtr;
         }
 
-        void evictAll(KInt dataId) {
+        /**
+         * Returns the connection for use by a reader, or 0 once it is closing. The connection
+         * stays open until the matching releaseReaderAccess.
+         */
+        KLong acquireReaderAccess(KInt dataId) {
             Locker locker(&lock_);
             auto it = data_.find(dataId);
-            it->second->evictAll();
+            if (it == data_.end() || it->second->connectionPtr == 0)
+                return 0l;
+            it->second->readerAccess++;
+            return it->second->connectionPtr;
         }
 
-        void remove(KInt dataId, KString sql) {
+        void releaseReaderAccess(KInt dataId) {
             Locker locker(&lock_);
             auto it = data_.find(dataId);
-            it->second->remove(sql);
+            if (it != data_.end() && --it->second->readerAccess == 0)
+                pthread_cond_broadcast(&readerAccessDone_);
+        }
+
+        /**
+         * Stops handing the connection out to readers and waits for the ones using it, so that
+         * it can be closed.
+         */
+        void detachConnection(KInt dataId) {
+            Locker locker(&lock_);
+            auto it = data_.find(dataId);
+            if (it == data_.end()) return;
+            it->second->connectionPtr = 0;
+            while (it->second->readerAccess > 0) {
+                pthread_cond_wait(&readerAccessDone_, &lock_);
+                it = data_.find(dataId);
+                if (it == data_.end()) return;
+            }
+        }
+
+        bool remove(KInt dataId, KString sql) {
+            Locker locker(&lock_);
+            auto it = data_.find(dataId);
+            return it->second->remove(sql);
+        }
+
+        /**
+         * Finalizes statements evicted from the cache. Only the hand-off happens under the
+         * lock, so a connection closing with a full cache doesn't stall every other database.
+         * Must be called by the thread that currently owns the connection.
+         */
+        void drainReclaimed(KInt dataId) {
+            KStdVector<KNativePtr> reclaimed;
+            KLong connectionPtr;
+            {
+                Locker locker(&lock_);
+                auto it = data_.find(dataId);
+                if (it == data_.end()) return;
+                it->second->takeReclaimed(reclaimed);
+                connectionPtr = it->second->connectionPtr;
+            }
+
+            for (auto stmtPtr : reclaimed) {
+                finalizeStmt(connectionPtr, stmtPtr);
+                DisposeStablePointer(stmtPtr);
+            }
         }
 
         KInt nextDataId() {
@@ -213,13 +294,21 @@ namespace {
             data_[dataId] = new DatabaseInfo(maxCacheSize);
         }
 
-        void removeDataStore(KInt dataId) {
-            Locker locker(&lock_);
-
-            auto it = data_.find(dataId);
-            if (it == data_.end()) return;
-            DatabaseInfo* removing = it->second;
-            data_.erase(dataId);
+        /**
+         * Drops the store, first finalizing its statements against the connection, which the
+         * caller closes afterwards.
+         */
+        void removeDataStore(KInt dataId, KLong connectionPtr) {
+            DatabaseInfo* removing;
+            {
+                Locker locker(&lock_);
+                auto it = data_.find(dataId);
+                if (it == data_.end()) return;
+                removing = it->second;
+                data_.erase(it);
+            }
+            // Outside the lock, as finalizing can be slow.
+            removing->finalizeAll(connectionPtr);
             delete removing;
         }
 
@@ -257,6 +346,7 @@ namespace {
         }
 
         pthread_mutex_t lock_;
+        pthread_cond_t readerAccessDone_;
         KStdUnorderedMap<KInt, DatabaseInfo *> data_;
         KStdUnorderedMap<KInt, KNativePtr> helperData_;
         KInt currentDataId_;
@@ -297,8 +387,8 @@ KLong SQLiteSupport_getConnectionPtr(KInt dataId) {
     return dataState()->getConnectionPtr(dataId);
 }
 
-void SQLiteSupport_putStmt(KInt dataId, KString sql, KRef stmt) {
-    dataState()->putStmt(dataId, sql, stmt);
+KBoolean SQLiteSupport_putStmt(KInt dataId, KString sql, KRef stmt) {
+    return dataState()->putStmt(dataId, sql, stmt);
 }
 
 OBJ_GETTER(SQLiteSupport_getStmt, KInt dataId, KString sql) {
@@ -333,12 +423,24 @@ void SQLiteSupport_removeDbConfig(KInt dataId) {
     dataState()->removeDbConfig(dataId);
 }
 
-void SQLiteSupport_evictAll(KInt dataId) {
-    return dataState()->evictAll(dataId);
+KBoolean SQLiteSupport_remove(KInt dataId, KString sql) {
+    return dataState()->remove(dataId, sql);
 }
 
-void SQLiteSupport_remove(KInt dataId, KString sql) {
-    return dataState()->remove(dataId, sql);
+KLong SQLiteSupport_acquireReaderAccess(KInt dataId) {
+    return dataState()->acquireReaderAccess(dataId);
+}
+
+void SQLiteSupport_releaseReaderAccess(KInt dataId) {
+    dataState()->releaseReaderAccess(dataId);
+}
+
+void SQLiteSupport_detachConnection(KInt dataId) {
+    dataState()->detachConnection(dataId);
+}
+
+void SQLiteSupport_drainReclaimed(KInt dataId) {
+    dataState()->drainReclaimed(dataId);
 }
 
 KInt SQLiteSupport_nextDataId(){
@@ -348,8 +450,8 @@ void SQLiteSupport_createDataStore(KInt dataId, KInt maxCacheSize) {
     return dataState()->createDataStore(dataId, maxCacheSize);
 }
 
-void SQLiteSupport_removeDataStore(KInt dataId) {
-    return dataState()->removeDataStore(dataId);
+void SQLiteSupport_removeDataStore(KInt dataId, KLong connectionPtr) {
+    return dataState()->removeDataStore(dataId, connectionPtr);
 }
 
 void SQLiteSupport_putHelperInfo(KInt dataId, KRef helperInfo) {
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SQLiteWorkerPool.h"
+
+#include "android_database_SQLiteCommon.h"
+
+namespace android {
+
+WorkerPool::WorkerPool(int threadCount) : stopping(false) {
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&available, NULL);
+    for (int i = 0; i < threadCount; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &threadMain, this) == 0)
+            threads.push_back(thread);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    KStdDeque<WorkerTask*> unstarted;
+    unstarted.swap(queue);
+    pthread_cond_broadcast(&available);
+    pthread_mutex_unlock(&mutex);
+
+    for (auto task : unstarted)
+        task->cancel();
+    for (auto thread : threads)
+        pthread_join(thread, NULL);
+
+    pthread_cond_destroy(&available);
+    pthread_mutex_destroy(&mutex);
+}
+
+void WorkerPool::submit(WorkerTask* task) {
+    pthread_mutex_lock(&mutex);
+    if (stopping) {
+        pthread_mutex_unlock(&mutex);
+        task->cancel();
+        return;
+    }
+    queue.push_back(task);
+    pthread_cond_signal(&available);
+    pthread_mutex_unlock(&mutex);
+}
+
+void* WorkerPool::threadMain(void* context) {
+    DeferredErrorScope deferErrors;
+    static_cast<WorkerPool*>(context)->run();
+    return NULL;
+}
+
+void WorkerPool::run() {
+    pthread_mutex_lock(&mutex);
+    while (true) {
+        while (!stopping && queue.empty())
+            pthread_cond_wait(&available, &mutex);
+        if (stopping)
+            break;
+
+        WorkerTask* task = queue.front();
+        queue.pop_front();
+        pthread_mutex_unlock(&mutex);
+        task->run();
+        pthread_mutex_lock(&mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+}
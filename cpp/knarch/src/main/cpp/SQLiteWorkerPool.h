@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_SQLITEWORKERPOOL_H
+#define KNARCH_SQLITEWORKERPOOL_H
+
+#include <pthread.h>
+
+#include "Types.h"
+
+namespace android {
+
+/*
+ * Work handed to a WorkerPool. Exactly one of run() or cancel() is called, on a worker thread
+ * or on the thread destroying the pool respectively. Neither may touch Kotlin objects, and
+ * SQLite errors raised inside run() arrive as DeferredSQLiteError.
+ */
+class WorkerTask {
+public:
+    virtual ~WorkerTask() { }
+
+    virtual void run() = 0;
+    virtual void cancel() = 0;
+};
+
+/*
+ * A fixed set of native threads running tasks in the order they were submitted.
+ */
+class WorkerPool {
+public:
+    explicit WorkerPool(int threadCount);
+
+    // Cancels whatever hasn't started and waits for running tasks to finish.
+    ~WorkerPool();
+
+    void submit(WorkerTask* task);
+
+private:
+    static void* threadMain(void* context);
+
+    void run();
+
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+    bool stopping;
+    KStdDeque<WorkerTask*> queue;
+    KStdVector<pthread_t> threads;
+};
+
+}
+
+#endif // KNARCH_SQLITEWORKERPOOL_H
@@ -0,0 +1,581 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#include "Natives.h"
+#include "Porting.h"
+#include "StringTranscoder.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define TRANSCODE_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TRANSCODE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const uint32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+// After a kernel stops, the scalar loop handles this many units before handing back, so text with
+// scattered non-ASCII does not bounce between the two on every character.
+const size_t SCALAR_SPAN = 32;
+
+/*
+ * Vector kernels. Each one converts (or measures) leading ASCII in whole blocks and returns how
+ * many units it consumed, stopping at the first block that holds anything else.
+ */
+struct TranscodeKernels {
+    size_t (*narrowAscii)(const KChar* src, size_t length, char* dest);
+    size_t (*widenAscii)(const uint8_t* src, size_t length, KChar* dest);
+    // Adds the UTF-8 size of what it consumed to *bytes. May consume non-ASCII blocks too.
+    size_t (*countUtf8)(const KChar* src, size_t length, size_t* bytes);
+    size_t (*asciiPrefix8)(const uint8_t* src, size_t length);
+};
+
+// Scalar
+
+size_t narrowAsciiScalar(const KChar* src, size_t length, char* dest) {
+    size_t i = 0;
+    while (i < length && src[i] < 0x80) {
+        dest[i] = static_cast<char>(src[i]);
+        i++;
+    }
+    return i;
+}
+
+size_t widenAsciiScalar(const uint8_t* src, size_t length, KChar* dest) {
+    size_t i = 0;
+    while (i < length && src[i] < 0x80) {
+        dest[i] = src[i];
+        i++;
+    }
+    return i;
+}
+
+size_t countUtf8Scalar(const KChar* src, size_t length, size_t* bytes) {
+    size_t i = 0;
+    while (i < length && src[i] < 0x80)
+        i++;
+    *bytes += i;
+    return i;
+}
+
+size_t asciiPrefix8Scalar(const uint8_t* src, size_t length) {
+    size_t i = 0;
+    while (i < length && src[i] < 0x80)
+        i++;
+    return i;
+}
+
+const TranscodeKernels scalarKernels = {
+    narrowAsciiScalar, widenAsciiScalar, countUtf8Scalar, asciiPrefix8Scalar
+};
+
+#if TRANSCODE_X86
+
+// SSE2 is part of the x86-64 baseline, and 32-bit builds only get here when compiled for it, so
+// these need no check.
+
+size_t narrowAsciiSse2(const KChar* src, size_t length, char* dest) {
+    const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+        __m128i high = _mm_and_si128(_mm_or_si128(a, b), nonAscii);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, zero)) != 0xFFFF)
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_packus_epi16(a, b));
+    }
+    return i;
+}
+
+size_t widenAsciiSse2(const uint8_t* src, size_t length, KChar* dest) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(v) != 0)
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+    return i;
+}
+
+// Each unit takes 1 byte, plus one if >= 0x80, plus one if >= 0x800. Surrogates do not follow that
+// rule, so a block holding one is left to the scalar loop.
+size_t countUtf8Sse2(const KChar* src, size_t length, size_t* bytes) {
+    const __m128i mask80 = _mm_set1_epi16(static_cast<short>(0xFF80));
+    const __m128i mask800 = _mm_set1_epi16(static_cast<short>(0xF800));
+    const __m128i surrogate = _mm_set1_epi16(static_cast<short>(0xD800));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    size_t total = 0;
+    for (; i + 8 <= length; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i top5 = _mm_and_si128(v, mask800);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(top5, surrogate)) != 0)
+            break;
+        int ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, mask80), zero));
+        int belowTwoK = _mm_movemask_epi8(_mm_cmpeq_epi16(top5, zero));
+        // movemask yields two bits per 16-bit lane.
+        total += 8 + (8 - __builtin_popcount(ascii) / 2) + (8 - __builtin_popcount(belowTwoK) / 2);
+    }
+    *bytes += total;
+    return i;
+}
+
+size_t asciiPrefix8Sse2(const uint8_t* src, size_t length) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(v) != 0)
+            break;
+    }
+    return i;
+}
+
+const TranscodeKernels sse2Kernels = {
+    narrowAsciiSse2, widenAsciiSse2, countUtf8Sse2, asciiPrefix8Sse2
+};
+
+__attribute__((target("avx2")))
+size_t narrowAsciiAvx2(const KChar* src, size_t length, char* dest) {
+    const __m256i nonAscii = _mm256_set1_epi16(static_cast<short>(0xFF80));
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 16));
+        if (!_mm256_testz_si256(_mm256_or_si256(a, b), nonAscii))
+            break;
+        // packus works within 128-bit lanes; put the quadwords back in order.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), packed);
+    }
+    return i + narrowAsciiSse2(src + i, length - i, dest + i);
+}
+
+__attribute__((target("avx2")))
+size_t widenAsciiAvx2(const uint8_t* src, size_t length, KChar* dest) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        if (_mm256_movemask_epi8(v) != 0)
+            break;
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i),
+                            _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i + 16),
+                            _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+    }
+    return i + widenAsciiSse2(src + i, length - i, dest + i);
+}
+
+__attribute__((target("avx2")))
+size_t countUtf8Avx2(const KChar* src, size_t length, size_t* bytes) {
+    const __m256i mask80 = _mm256_set1_epi16(static_cast<short>(0xFF80));
+    const __m256i mask800 = _mm256_set1_epi16(static_cast<short>(0xF800));
+    const __m256i surrogate = _mm256_set1_epi16(static_cast<short>(0xD800));
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    size_t total = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i top5 = _mm256_and_si256(v, mask800);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(top5, surrogate)) != 0)
+            break;
+        unsigned ascii = _mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(v, mask80), zero));
+        unsigned belowTwoK = _mm256_movemask_epi8(_mm256_cmpeq_epi16(top5, zero));
+        total += 16 + (16 - __builtin_popcount(ascii) / 2) + (16 - __builtin_popcount(belowTwoK) / 2);
+    }
+    *bytes += total;
+    return i + countUtf8Sse2(src + i, length - i, bytes);
+}
+
+__attribute__((target("avx2")))
+size_t asciiPrefix8Avx2(const uint8_t* src, size_t length) {
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        if (_mm256_movemask_epi8(v) != 0)
+            break;
+    }
+    return i + asciiPrefix8Sse2(src + i, length - i);
+}
+
+const TranscodeKernels avx2Kernels = {
+    narrowAsciiAvx2, widenAsciiAvx2, countUtf8Avx2, asciiPrefix8Avx2
+};
+
+bool cpuHasAvx2() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    if ((ecx & bit_OSXSAVE) == 0 || (ecx & bit_AVX) == 0)
+        return false;
+    // The OS must also be saving the YMM registers across context switches.
+    unsigned int xcrLow, xcrHigh;
+    __asm__ volatile("xgetbv" : "=a"(xcrLow), "=d"(xcrHigh) : "c"(0));
+    if ((xcrLow & 0x6) != 0x6)
+        return false;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ebx & bit_AVX2) != 0;
+}
+
+#endif // TRANSCODE_X86
+
+#if TRANSCODE_NEON
+
+// NEON is always present on the ARM devices we build for. Works on both armv7 and arm64.
+
+inline bool anyBitSet(uint8x16_t v) {
+    uint64x2_t wide = vreinterpretq_u64_u8(v);
+    return (vgetq_lane_u64(wide, 0) | vgetq_lane_u64(wide, 1)) != 0;
+}
+
+size_t narrowAsciiNeon(const KChar* src, size_t length, char* dest) {
+    const uint16x8_t nonAscii = vdupq_n_u16(0xFF80);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint16x8_t a = vld1q_u16(src + i);
+        uint16x8_t b = vld1q_u16(src + i + 8);
+        if (anyBitSet(vreinterpretq_u8_u16(vandq_u16(vorrq_u16(a, b), nonAscii))))
+            break;
+        vst1q_u8(reinterpret_cast<uint8_t*>(dest + i), vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
+    }
+    return i;
+}
+
+size_t widenAsciiNeon(const uint8_t* src, size_t length, KChar* dest) {
+    const uint8x16_t highBit = vdupq_n_u8(0x80);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        if (anyBitSet(vandq_u8(v, highBit)))
+            break;
+        vst1q_u16(dest + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(dest + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+    return i;
+}
+
+size_t countUtf8Neon(const KChar* src, size_t length, size_t* bytes) {
+    const uint16x8_t nonAscii = vdupq_n_u16(0xFF80);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint16x8_t either = vorrq_u16(vld1q_u16(src + i), vld1q_u16(src + i + 8));
+        if (anyBitSet(vreinterpretq_u8_u16(vandq_u16(either, nonAscii))))
+            break;
+    }
+    *bytes += i;
+    return i;
+}
+
+size_t asciiPrefix8Neon(const uint8_t* src, size_t length) {
+    const uint8x16_t highBit = vdupq_n_u8(0x80);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        if (anyBitSet(vandq_u8(vld1q_u8(src + i), highBit)))
+            break;
+    }
+    return i;
+}
+
+const TranscodeKernels neonKernels = {
+    narrowAsciiNeon, widenAsciiNeon, countUtf8Neon, asciiPrefix8Neon
+};
+
+#endif // TRANSCODE_NEON
+
+const TranscodeKernels* selectKernels() {
+#if TRANSCODE_X86
+    return cpuHasAvx2() ? &avx2Kernels : &sse2Kernels;
+#elif TRANSCODE_NEON
+    return &neonKernels;
+#else
+    return &scalarKernels;
+#endif
+}
+
+std::atomic<const TranscodeKernels*> selectedKernels(nullptr);
+
+const TranscodeKernels* kernels() {
+    // Threads racing here all select, and store, the same pointer.
+    const TranscodeKernels* selected = selectedKernels.load(std::memory_order_acquire);
+    if (selected == nullptr) {
+        selected = selectKernels();
+        selectedKernels.store(selected, std::memory_order_release);
+    }
+    return selected;
+}
+
+// Scalar code point handling shared by the length and conversion loops so they always agree.
+
+inline uint32_t nextCodePoint16(const KChar* src, size_t& i, size_t length) {
+    uint32_t unit = src[i++];
+    if (unit < 0xD800 || unit > 0xDFFF)
+        return unit;
+    if (unit <= 0xDBFF && i < length && src[i] >= 0xDC00 && src[i] <= 0xDFFF) {
+        uint32_t low = src[i++];
+        return 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+    }
+    return REPLACEMENT_CHARACTER;
+}
+
+inline size_t utf8Width(uint32_t codePoint) {
+    return codePoint < 0x80 ? 1 : codePoint < 0x800 ? 2 : codePoint < 0x10000 ? 3 : 4;
+}
+
+inline char* appendUtf8(uint32_t codePoint, char* out) {
+    if (codePoint < 0x80) {
+        *out++ = static_cast<char>(codePoint);
+    } else if (codePoint < 0x800) {
+        *out++ = static_cast<char>(0xC0 | (codePoint >> 6));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        *out++ = static_cast<char>(0xE0 | (codePoint >> 12));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+    } else {
+        *out++ = static_cast<char>(0xF0 | (codePoint >> 18));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+        *out++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    return out;
+}
+
+inline bool isContinuation(uint8_t byte) {
+    return (byte & 0xC0) == 0x80;
+}
+
+// Decodes one code point, rejecting overlong forms, surrogates and values past U+10FFFF.
+// A bad sequence yields U+FFFD and consumes a single byte.
+inline uint32_t nextCodePoint8(const uint8_t* src, size_t& i, size_t length) {
+    uint8_t lead = src[i];
+    if (lead < 0x80) {
+        i++;
+        return lead;
+    }
+    size_t remaining = length - i;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        if (remaining >= 2 && isContinuation(src[i + 1])) {
+            uint32_t cp = ((lead & 0x1F) << 6) | (src[i + 1] & 0x3F);
+            i += 2;
+            return cp;
+        }
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        if (remaining >= 3 && isContinuation(src[i + 1]) && isContinuation(src[i + 2])) {
+            uint32_t cp = ((lead & 0x0F) << 12) | ((src[i + 1] & 0x3F) << 6) | (src[i + 2] & 0x3F);
+            if (cp >= 0x800 && (cp < 0xD800 || cp > 0xDFFF)) {
+                i += 3;
+                return cp;
+            }
+        }
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        if (remaining >= 4 && isContinuation(src[i + 1]) && isContinuation(src[i + 2])
+                && isContinuation(src[i + 3])) {
+            uint32_t cp = ((lead & 0x07) << 18) | ((src[i + 1] & 0x3F) << 12)
+                    | ((src[i + 2] & 0x3F) << 6) | (src[i + 3] & 0x3F);
+            if (cp >= 0x10000 && cp <= 0x10FFFF) {
+                i += 4;
+                return cp;
+            }
+        }
+    }
+    i++;
+    return REPLACEMENT_CHARACTER;
+}
+
+inline size_t minSize(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+/*
+ * Per-thread scratch buffer. Small strings are encoded in one pass against the worst case of three
+ * bytes per unit; larger ones are measured first so the buffer does not grow to three times their
+ * size. A buffer grown past SCRATCH_RETAIN_LIMIT is given back on the next small request.
+ */
+const size_t SCRATCH_MIN_CAPACITY = 256;
+const size_t SCRATCH_WORST_CASE_LIMIT = 64 * 1024;
+const size_t SCRATCH_RETAIN_LIMIT = 256 * 1024;
+
+struct ScratchArena {
+    char* data;
+    size_t capacity;
+};
+
+pthread_key_t scratchKey;
+pthread_once_t scratchKeyOnce = PTHREAD_ONCE_INIT;
+
+void disposeScratchArena(void* value) {
+    auto arena = static_cast<ScratchArena*>(value);
+    free(arena->data);
+    free(arena);
+}
+
+void createScratchKey() {
+    pthread_key_create(&scratchKey, disposeScratchArena);
+}
+
+ScratchArena* scratchArena() {
+    pthread_once(&scratchKeyOnce, createScratchKey);
+    auto arena = static_cast<ScratchArena*>(pthread_getspecific(scratchKey));
+    if (arena == nullptr) {
+        arena = static_cast<ScratchArena*>(malloc(sizeof(ScratchArena)));
+        if (arena == nullptr)
+            return nullptr;
+        arena->data = nullptr;
+        arena->capacity = 0;
+        pthread_setspecific(scratchKey, arena);
+    }
+    return arena;
+}
+
+// Returns null, with the arena left empty, if a big enough buffer can't be allocated.
+
+char* scratchBuffer(ScratchArena* arena, size_t size) {
+    if (arena->capacity >= size && (arena->capacity <= SCRATCH_RETAIN_LIMIT || size > SCRATCH_RETAIN_LIMIT / 2))
+        return arena->data;
+    size_t capacity = size < SCRATCH_MIN_CAPACITY ? SCRATCH_MIN_CAPACITY : size;
+    if (size > arena->capacity && size <= SCRATCH_RETAIN_LIMIT) {
+        // Grow geometrically while the buffer is small enough to keep.
+        size_t doubled = minSize(arena->capacity * 2, SCRATCH_RETAIN_LIMIT);
+        if (doubled > capacity)
+            capacity = doubled;
+    }
+    // Nothing in the old contents is kept, and the new buffer needs no zeroing.
+    free(arena->data);
+    arena->data = static_cast<char*>(malloc(capacity));
+    arena->capacity = arena->data != nullptr ? capacity : 0;
+    return arena->data;
+}
+
+} // namespace
+
+size_t Utf8LengthOfUtf16(const KChar* utf16, size_t length) {
+    const TranscodeKernels* k = kernels();
+    size_t bytes = 0;
+    size_t i = 0;
+    while (i < length) {
+        i += k->countUtf8(utf16 + i, length - i, &bytes);
+        size_t stop = minSize(i + SCALAR_SPAN, length);
+        while (i < stop)
+            bytes += utf8Width(nextCodePoint16(utf16, i, length));
+    }
+    return bytes;
+}
+
+size_t Utf16ToUtf8(const KChar* utf16, size_t length, char* dest) {
+    const TranscodeKernels* k = kernels();
+    char* out = dest;
+    size_t i = 0;
+    while (i < length) {
+        size_t ascii = k->narrowAscii(utf16 + i, length - i, out);
+        i += ascii;
+        out += ascii;
+        size_t stop = minSize(i + SCALAR_SPAN, length);
+        while (i < stop)
+            out = appendUtf8(nextCodePoint16(utf16, i, length), out);
+    }
+    return out - dest;
+}
+
+size_t Utf16LengthOfUtf8(const char* utf8, size_t length) {
+    const TranscodeKernels* k = kernels();
+    auto src = reinterpret_cast<const uint8_t*>(utf8);
+    size_t units = 0;
+    size_t i = 0;
+    while (i < length) {
+        size_t ascii = k->asciiPrefix8(src + i, length - i);
+        i += ascii;
+        units += ascii;
+        size_t stop = minSize(i + SCALAR_SPAN, length);
+        while (i < stop)
+            units += nextCodePoint8(src, i, length) >= 0x10000 ? 2 : 1;
+    }
+    return units;
+}
+
+size_t Utf8ToUtf16(const char* utf8, size_t length, KChar* dest) {
+    const TranscodeKernels* k = kernels();
+    auto src = reinterpret_cast<const uint8_t*>(utf8);
+    KChar* out = dest;
+    size_t i = 0;
+    while (i < length) {
+        size_t ascii = k->widenAscii(src + i, length - i, out);
+        i += ascii;
+        out += ascii;
+        size_t stop = minSize(i + SCALAR_SPAN, length);
+        while (i < stop) {
+            uint32_t cp = nextCodePoint8(src, i, length);
+            if (cp >= 0x10000) {
+                cp -= 0x10000;
+                *out++ = static_cast<KChar>(0xD800 + (cp >> 10));
+                *out++ = static_cast<KChar>(0xDC00 + (cp & 0x3FF));
+            } else {
+                *out++ = static_cast<KChar>(cp);
+            }
+        }
+    }
+    return out - dest;
+}
+
+const char* Utf8ScratchFromUtf16(const KChar* utf16, size_t length, size_t* utf8Size) {
+    ScratchArena* arena = scratchArena();
+    if (arena == nullptr)
+        return nullptr;
+    size_t worstCase = length * 3 + 1;
+    char* dest;
+    if (worstCase <= arena->capacity || worstCase <= SCRATCH_WORST_CASE_LIMIT) {
+        dest = scratchBuffer(arena, worstCase);
+    } else {
+        dest = scratchBuffer(arena, Utf8LengthOfUtf16(utf16, length) + 1);
+    }
+    if (dest == nullptr)
+        return nullptr;
+    size_t size = Utf16ToUtf8(utf16, length, dest);
+    dest[size] = '\0';
+    *utf8Size = size;
+    return dest;
+}
+
+KStdString Utf8StdStringFromKString(KString kstring) {
+    const KChar* utf16 = CharArrayAddressOfElementAt(kstring, 0);
+    size_t length = kstring->count_;
+    KStdString utf8;
+    utf8.resize(Utf8LengthOfUtf16(utf16, length));
+    if (!utf8.empty())
+        Utf16ToUtf8(utf16, length, &utf8[0]);
+    return utf8;
+}
+
+OBJ_GETTER(CreateKStringFromUtf8, const char* utf8, size_t length) {
+    size_t units = Utf16LengthOfUtf8(utf8, length);
+    ArrayHeader* result = AllocArrayInstance(theStringTypeInfo, units, OBJ_RESULT)->array();
+    Utf8ToUtf16(utf8, length, CharArrayAddressOfElementAt(result, 0));
+    RETURN_OBJ(result->obj());
+}
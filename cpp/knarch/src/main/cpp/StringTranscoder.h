@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef KNARCH_STRINGTRANSCODER_H
+#define KNARCH_STRINGTRANSCODER_H
+
+#include <stddef.h>
+
+#include "Memory.h"
+#include "Types.h"
+
+/*
+ * UTF-8 <-> UTF-16 conversion shared by everything that moves strings between Kotlin and SQLite.
+ *
+ * Runs of ASCII are converted with vector kernels (SSE2, AVX2 when the CPU has it, NEON) and
+ * everything else falls back to a scalar loop. Malformed input never reads out of bounds: unpaired
+ * surrogates and invalid UTF-8 bytes come out as U+FFFD. The length functions agree exactly with
+ * what the conversions write.
+ */
+
+// Number of UTF-8 bytes needed to encode the UTF-16 text.
+size_t Utf8LengthOfUtf16(const KChar* utf16, size_t length);
+
+// Encodes UTF-16 as UTF-8. dest must hold Utf8LengthOfUtf16 bytes. No terminator is written.
+// Returns the number of bytes written.
+size_t Utf16ToUtf8(const KChar* utf16, size_t length, char* dest);
+
+// Number of UTF-16 units needed to decode the UTF-8 text.
+size_t Utf16LengthOfUtf8(const char* utf8, size_t length);
+
+// Decodes UTF-8 into UTF-16. dest must hold Utf16LengthOfUtf8 units. Returns the units written.
+size_t Utf8ToUtf16(const char* utf8, size_t length, KChar* dest);
+
+// Encodes UTF-16 as NUL-terminated UTF-8 into a buffer owned by the calling thread, so nothing is
+// allocated once the buffer has grown. The result is valid until the same thread asks for scratch
+// again. *utf8Size excludes the terminator. Returns null if the buffer could not be grown.
+const char* Utf8ScratchFromUtf16(const KChar* utf16, size_t length, size_t* utf8Size);
+
+// UTF-8 copy of a Kotlin string.
+KStdString Utf8StdStringFromKString(KString kstring);
+
+// New Kotlin string from UTF-8 text, which need not be terminated.
+OBJ_GETTER(CreateKStringFromUtf8, const char* utf8, size_t length);
+
+#endif // KNARCH_STRINGTRANSCODER_H
@@ -25,7 +25,7 @@
 #include "Porting.h"
 #include "Types.h"
 
-#include "utf8.h"
+#include "StringTranscoder.h"
 
 #include "UtilsErrors.h"
 
@@ -34,6 +34,7 @@
 #include <unistd.h>
 
 #include "AndroidfwCursorWindow.h"
+#include "SQLiteMemory.h"
 
 #include "android_database_SQLiteCommon.h"
 
@@ -79,6 +80,7 @@ static KLong nativeCreate(KInt cursorWindowSize, KRef dataArray) {
     }
 
     LOG_WINDOW("nativeInitializeEmpty: window = %p", window);
+    cursorWindowCreated(window->size());
     return reinterpret_cast<KLong>(window);
 }
 
@@ -104,6 +106,7 @@ static void nativeDispose(KLong windowPtr) {
     CursorWindow *window = reinterpret_cast<CursorWindow *>(windowPtr);
     if (window) {
         LOG_WINDOW("Closing window %p", window);
+        cursorWindowDisposed(window->size());
         delete window;
     }
 }
@@ -230,22 +233,22 @@ OBJ_GETTER(Android_Database_CursorWindow_nativeGetString, KRef thiz, KLong windo
         const char *value = window->getFieldSlotValueString(fieldSlot, &sizeIncludingNull);
         //TODO: Figure this out
         if (sizeIncludingNull <= 1) {
-            RETURN_RESULT_OF(CreateStringFromUtf8, "", 0);
+            RETURN_RESULT_OF(CreateKStringFromUtf8, "", 0);
         }
         // Convert to UTF-16 here instead of calling NewStringUTF.  NewStringUTF
         // doesn't like UTF-8 strings with high codepoints.  It actually expects
         // Modified UTF-8 with encoded surrogate pairs.
-        RETURN_RESULT_OF(CreateStringFromUtf8, value, sizeIncludingNull - 1);
+        RETURN_RESULT_OF(CreateKStringFromUtf8, value, sizeIncludingNull - 1);
     } else if (type == CursorWindow::FIELD_TYPE_INTEGER) {
         int64_t value = window->getFieldSlotValueLong(fieldSlot);
         char buf[32];
         int size = snprintf(buf, sizeof(buf), "%" PRId64, value);
-        RETURN_RESULT_OF(CreateStringFromUtf8, buf, size);
+        RETURN_RESULT_OF(CreateKStringFromUtf8, buf, size);
     } else if (type == CursorWindow::FIELD_TYPE_FLOAT) {
         double value = window->getFieldSlotValueDouble(fieldSlot);
         char buf[32];
         int size = snprintf(buf, sizeof(buf), "%g", value);
-        RETURN_RESULT_OF(CreateStringFromUtf8, buf, size);
+        RETURN_RESULT_OF(CreateKStringFromUtf8, buf, size);
     } else if (type == CursorWindow::FIELD_TYPE_NULL) {
         return NULL;
     } else if (type == CursorWindow::FIELD_TYPE_BLOB) {
@@ -430,22 +433,15 @@ static KBoolean nativePutBlob(KLong windowPtr, KConstRef valueObj, KInt row, KIn
 static KBoolean nativePutString(KLong windowPtr, KString valueObj, KInt row, KInt column) {
     CursorWindow *window = reinterpret_cast<CursorWindow *>(windowPtr);
 
-    size_t sizeIncludingNull;
-
-    char *strBytes = CreateCStringFromStringWithSize(valueObj, &sizeIncludingNull);
-    //Size from method doesn't have null
-    sizeIncludingNull++;
-
-    status_t status = window->putString(row, column, (const char *) strBytes, sizeIncludingNull);
-
-    DisposeCStringHelper(strBytes);
+    status_t status = window->putStringUtf16(row, column,
+            CharArrayAddressOfElementAt(valueObj, 0), valueObj->count_);
 
     if (status) {
         LOG_WINDOW("Failed to put string. error=%d", status);
         return false;
     }
 
-    LOG_WINDOW("%d,%d is TEXT with %u bytes", row, column, sizeIncludingNull);
+    LOG_WINDOW("%d,%d is TEXT with %u UTF-16 units", row, column, valueObj->count_);
     return true;
 }
 
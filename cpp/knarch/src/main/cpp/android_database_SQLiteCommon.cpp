@@ -16,11 +16,43 @@
 
 #include "android_database_SQLiteCommon.h"
 #include <cstdio>
+#include <pthread.h>
 #include <string>
 #include "KonanHelper.h"
 
 namespace android {
 
+namespace {
+
+pthread_key_t deferErrorsKey;
+pthread_once_t deferErrorsKeyOnce = PTHREAD_ONCE_INIT;
+
+void createDeferErrorsKey() {
+    pthread_key_create(&deferErrorsKey, NULL);
+}
+
+bool deferringErrors() {
+    pthread_once(&deferErrorsKeyOnce, createDeferErrorsKey);
+    return pthread_getspecific(deferErrorsKey) != NULL;
+}
+
+}
+
+DeferredErrorScope::DeferredErrorScope() {
+    pthread_once(&deferErrorsKeyOnce, createDeferErrorsKey);
+    previous = pthread_getspecific(deferErrorsKey);
+    pthread_setspecific(deferErrorsKey, this);
+}
+
+DeferredErrorScope::~DeferredErrorScope() {
+    pthread_setspecific(deferErrorsKey, previous);
+}
+
+void DeferredSQLiteError::rethrow() const {
+    throw_sqlite3_exception(errcode, hasSqlite3Message ? sqlite3Message.c_str() : NULL,
+            message.empty() ? NULL : message.c_str());
+}
+
 /* throw a SQLiteException with a message appropriate for the error in handle */
 void throw_sqlite3_exception(sqlite3* handle) {
     throw_sqlite3_exception(handle, NULL);
@@ -61,6 +93,15 @@ void throw_sqlite3_exception_errcode(int errcode, const char* message) {
  */
 void throw_sqlite3_exception(int errcode,
                              const char* sqlite3Message, const char* message) {
+    if (deferringErrors()) {
+        DeferredSQLiteError error;
+        error.errcode = errcode;
+        error.hasSqlite3Message = sqlite3Message != NULL;
+        error.sqlite3Message = sqlite3Message ? sqlite3Message : "";
+        error.message = message ? message : "";
+        throw error;
+    }
+
     const char* exceptionClass;
     switch (errcode & 0xff) { /* mask off extended error code */
         case SQLITE_IOERR:
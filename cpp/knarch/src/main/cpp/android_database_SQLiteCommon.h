@@ -19,6 +19,7 @@
 
 #include <sqlite3.h>
 #include <stddef.h>
+#include <string>
 #include "Types.h"
 #include "Porting.h"
 #include "KString.h"
@@ -56,6 +57,30 @@ namespace android {
     void throw_sqlite3_exception(int errcode,
                                  const char *sqlite3Message, const char *message);
 
+/*
+ * Threads started natively have no Kotlin runtime to create exceptions with. While a
+ * DeferredErrorScope is alive on such a thread, the functions above throw a DeferredSQLiteError
+ * holding what they were given instead, and rethrow() raises the real exception later, from a
+ * Kotlin thread.
+ */
+    struct DeferredSQLiteError {
+        int errcode;
+        bool hasSqlite3Message;
+        std::string sqlite3Message;
+        std::string message;
+
+        void rethrow() const;
+    };
+
+    class DeferredErrorScope {
+    public:
+        DeferredErrorScope();
+        ~DeferredErrorScope();
+
+    private:
+        void* previous;
+    };
+
 }
 
 #endif // _ANDROID_DATABASE_SQLITE_COMMON_H
@@ -33,29 +33,36 @@
 #include "KonanHelper.h"
 
 #include "AndroidfwCursorWindow.h"
-
+#include "SQLiteChangeTracker.h"
+#include "SQLiteCheckpointer.h"
+#include "SQLiteCollation.h"
+#include "SQLiteContention.h"
+#include "SQLiteMemory.h"
+#include "SQLiteMetrics.h"
+#include "SQLiteNativeFunctions.h"
+#include "SQLiteResultCache.h"
+#include "SQLiteSlowQueryLog.h"
+#include "SQLiteWorkerPool.h"
+#include "StringTranscoder.h"
+
+#include <pthread.h>
 #include <sqlite3.h>
 
 #include "android_database_SQLiteCommon.h"
+#include "lrucache.hpp"
 
 // Set to 1 to use UTF16 storage for localized indexes.
 #define UTF16_STORAGE 0
 
 namespace android {
 
-/* Busy timeout in milliseconds.
- * If another connection (possibly in another process) has the database locked for
- * longer than this amount of time then SQLite will generate a SQLITE_BUSY error.
- * The SQLITE_BUSY error is then raised as a SQLiteDatabaseLockedException.
- *
- * In ordinary usage, busy timeouts are quite rare.  Most databases only ever
- * have a single open connection at a time unless they are using WAL.  When using
- * WAL, a timeout could occur if one connection is busy performing an auto-checkpoint
- * operation.  The busy timeout needs to be long enough to tolerate slow I/O write
- * operations but not so long as to cause the application to hang indefinitely if
- * there is a problem acquiring a database lock.
- */
-static const int BUSY_TIMEOUT_MS = 2500;
+/* Slots of the LongArray filled by nativePrepareStatementWithInfo. Must match SQLiteConnection.kt. */
+enum {
+    PREPARE_INFO_STATEMENT_PTR = 0,
+    PREPARE_INFO_NUM_PARAMETERS = 1,
+    PREPARE_INFO_READ_ONLY = 2,
+    PREPARE_INFO_SIZE = 3,
+};
 
 /*static struct {
     jfieldID name;
@@ -67,6 +74,31 @@ static const int BUSY_TIMEOUT_MS = 2500;
     jclass clazz;
 } gStringClassInfo;*/
 
+/*
+ * What a cached row count depends on, as seen by the connection that ran the query. data_version
+ * moves when another connection commits, total_changes when this one writes rows, and
+ * schema_version on DDL from anyone. None of them move back on ROLLBACK, so counts are neither
+ * kept nor used inside a transaction.
+ */
+struct DataStamp {
+    KLong dataVersion;
+    KLong schemaVersion;
+    KLong totalChanges;
+
+    bool operator==(const DataStamp& other) const {
+        return dataVersion == other.dataVersion && schemaVersion == other.schemaVersion
+                && totalChanges == other.totalChanges;
+    }
+};
+
+struct CachedRowCount {
+    DataStamp stamp;
+    int rows;
+};
+
+class ReaderPool;
+struct SQLiteStream;
+
 struct SQLiteConnection {
     // Open flags.
     // Must be kept in sync with the constants defined in SQLiteDatabase.java.
@@ -85,29 +117,290 @@ struct SQLiteConnection {
 
     volatile bool canceled;
 
+    ContentionMonitor contention;
+
+    // Kotlin arrays bound with SQLITE_STATIC, kept alive until their statement's bindings are cleared.
+    KStdUnorderedMap<sqlite3_stmt*, KStdVector<KNativePtr>> pinnedBindings;
+
+    // Row counts from earlier countAllRows fills, keyed by SQL with its arguments expanded.
+    // Empty and unused while rowCountCacheSize is 0.
+    KStdUnorderedMap<KStdString, CachedRowCount> rowCountCache;
+    size_t rowCountCacheSize;
+    // Reads the DataStamp versions in one step. Prepared on first use, finalized before closing.
+    sqlite3_stmt* dataStampStatement;
+
+    // Page cache budget in bytes, applied to the readers too. 0 keeps SQLite's default.
+    KInt pageCacheBytes;
+
+    // Read-only WAL connections that SELECTs run on outside of transactions. Null when disabled.
+    ReaderPool* readers;
+
+    // Threads running asynchronous fills on the readers, one per reader. Null without readers.
+    WorkerPool* workers;
+
+    // Streams opened from this connection and not closed yet. Guarded by gStreamsLock.
+    KStdVector<SQLiteStream*> streams;
+
+    // Checkpoints the WAL in the background in place of auto-checkpoint. Null when disabled.
+    WalCheckpointer* checkpointer;
+
+    // Window fills kept for repeat queries. Owned by the writer and shared with its readers.
+    // Null when disabled.
+    ResultCache* resultCache;
+
+    // What the statements prepared here read, for the result cache.
+    DependencyCollector dependencies;
+
+    // Hands each committed transaction's changes to subscribers. Null until the first subscribes.
+    ChangeTracker* changes;
+
+    // Set by the commit hook until finishCommit() sees the transaction end. Writer only.
+    bool commitPending;
+
+    // Latency histograms per query. Owned by the writer and shared with its readers.
+    QueryMetrics* metrics;
+
+    // Runs of statements over a threshold, with their plans. Owned by the writer and shared with
+    // its readers. Null when disabled.
+    SlowQueryLog* slowQueries;
+
+    // Whether profile events are also logged.
+    bool logProfile;
+
     SQLiteConnection(sqlite3* db, int openFlags, char* path, char* label) :
-        db(db), openFlags(openFlags), path(path), label(label), canceled(false) { }
+        db(db), openFlags(openFlags), path(path), label(label), canceled(false),
+        contention(db), rowCountCacheSize(0), dataStampStatement(NULL), pageCacheBytes(0),
+        readers(NULL), workers(NULL), checkpointer(NULL), resultCache(NULL), changes(NULL),
+        commitPending(false), metrics(NULL), slowQueries(NULL), logProfile(false) { }
 
         ~SQLiteConnection(){
         if(path != nullptr)
             DisposeCStringHelper(path);
         if(label != nullptr)
             DisposeCStringHelper(label);
+        for (auto& entry : pinnedBindings) {
+            for (auto pin : entry.second)
+                DisposeStablePointer(pin);
+        }
     }
 };
 
-// Called each time a statement begins execution, when tracing is enabled.
-static void sqliteTraceCallback(void *data, const char *sql) {
-    SQLiteConnection* connection = static_cast<SQLiteConnection*>(data);
-    ALOGV("%s: \"%s\"\n",
-            connection->label, sql);
+static void pinBinding(SQLiteConnection* connection, sqlite3_stmt* statement, KConstRef object) {
+    connection->pinnedBindings[statement].push_back(CreateStablePointer(const_cast<KRef>(object)));
+}
+
+// Call only once the statement no longer refers to the pinned arrays: bindings cleared or finalized.
+static void releasePinnedBindings(SQLiteConnection* connection, sqlite3_stmt* statement) {
+    if (connection->pinnedBindings.empty())
+        return;
+    auto it = connection->pinnedBindings.find(statement);
+    if (it == connection->pinnedBindings.end())
+        return;
+    for (auto pin : it->second)
+        DisposeStablePointer(pin);
+    connection->pinnedBindings.erase(it);
+}
+
+/*
+ * Steps a statement that has not produced any rows yet. A shared cache table lock held by another
+ * connection is waited out and the statement restarted, which SQLite won't do by itself. Plain
+ * SQLITE_BUSY has already been through the busy handler by the time step returns it.
+ */
+static int stepFirst(SQLiteConnection* connection, sqlite3_stmt* statement) {
+    int err = sqlite3_step(statement);
+    for (int attempt = 0; err == SQLITE_LOCKED
+            && sqlite3_extended_errcode(connection->db) == SQLITE_LOCKED_SHAREDCACHE; attempt++) {
+        if (connection->contention.waitForUnlock(attempt) != SQLITE_OK) {
+            break;
+        }
+        sqlite3_reset(statement);
+        err = sqlite3_step(statement);
+    }
+    return err;
+}
+
+/*
+ * Read-only connections to the same WAL database as a writer. With WAL, each one reads from its own
+ * snapshot and runs alongside the writer and the other readers. A reader is leased to one thread
+ * at a time, together with the statements it has prepared.
+ */
+struct ReaderConnection {
+    SQLiteConnection* connection;
+    cache::lru_cache<KStdString, sqlite3_stmt*> statements;
+
+    ReaderConnection(SQLiteConnection* connection, size_t maxStatements) :
+        connection(connection), statements(maxStatements) { }
+};
+
+static const size_t READER_STATEMENT_CACHE_SIZE = 16;
+
+class ReaderPool {
+public:
+    ReaderPool() {
+        pthread_mutex_init(&lock_, NULL);
+    }
+
+    // Only once no reader is leased.
+    ~ReaderPool() {
+        for (auto reader : all_) {
+            for (auto& entry : reader->statements.allEntries())
+                sqlite3_finalize(entry.second);
+            sqlite3_finalize(reader->connection->dataStampStatement);
+            sqlite3_close(reader->connection->db);
+            delete reader->connection;
+            delete reader;
+        }
+        pthread_mutex_destroy(&lock_);
+    }
+
+    void add(ReaderConnection* reader) {
+        all_.push_back(reader);
+        idle_.push_back(reader);
+    }
+
+    size_t size() const {
+        return all_.size();
+    }
+
+    const KStdVector<ReaderConnection*>& all() const {
+        return all_;
+    }
+
+    // Returns NULL when every reader is leased. Streams hold their lease until the cursor closes, so
+    // callers fall back to the writer rather than wait for one.
+    ReaderConnection* tryAcquire() {
+        pthread_mutex_lock(&lock_);
+        ReaderConnection* reader = NULL;
+        if (!idle_.empty()) {
+            reader = idle_.back();
+            idle_.pop_back();
+        }
+        pthread_mutex_unlock(&lock_);
+        return reader;
+    }
+
+    void release(ReaderConnection* reader) {
+        pthread_mutex_lock(&lock_);
+        idle_.push_back(reader);
+        pthread_mutex_unlock(&lock_);
+    }
+
+    // Calls f with each reader not leased, holding them back from tryAcquire() until it returns.
+    template<typename F>
+    void forEachIdle(F f) {
+        pthread_mutex_lock(&lock_);
+        for (auto reader : idle_)
+            f(reader);
+        pthread_mutex_unlock(&lock_);
+    }
+
+private:
+    pthread_mutex_t lock_;
+    KStdVector<ReaderConnection*> all_;
+    KStdVector<ReaderConnection*> idle_;
+};
+
+// Finalizes the statements of every stream still open on the connection, leaving the streams closed.
+static void closeStreams(SQLiteConnection* connection);
+
+static void closeReaders(SQLiteConnection* connection) {
+    delete connection->workers;
+    connection->workers = NULL;
+    delete connection->readers;
+    connection->readers = NULL;
+}
+
+// The writer's update, commit and rollback hooks, shared by the result cache and change tracker.
+static void writerUpdateHook(void* data, int operation, const char* dbName, const char* table,
+        sqlite3_int64 rowid) {
+    auto connection = static_cast<SQLiteConnection*>(data);
+    if (connection->resultCache != NULL) {
+        connection->resultCache->rowChanged(dbName, table);
+    }
+    if (connection->changes != NULL) {
+        connection->changes->rowChanged(operation, dbName, table, rowid);
+    }
+}
+
+static int writerCommitHook(void* data) {
+    auto connection = static_cast<SQLiteConnection*>(data);
+    connection->commitPending = true;
+    if (connection->resultCache != NULL) {
+        connection->resultCache->committing();
+    }
+    if (connection->changes != NULL) {
+        connection->changes->committing();
+    }
+    return 0;
+}
+
+static void writerRollbackHook(void* data) {
+    auto connection = static_cast<SQLiteConnection*>(data);
+    connection->commitPending = false;
+    if (connection->resultCache != NULL) {
+        connection->resultCache->rolledBack();
+    }
+    if (connection->changes != NULL) {
+        connection->changes->rolledBack();
+    }
+}
+
+/*
+ * The commit hook runs before the commit is written, and the commit can still fail after it. Once
+ * the writer is back in autocommit mode without the rollback hook having run, the transaction the
+ * commit hook saw is committed and visible to the readers. Called after each statement run on the
+ * writer finishes or is reset.
+ */
+static void finishCommit(SQLiteConnection* connection) {
+    if (!connection->commitPending || !sqlite3_get_autocommit(connection->db)) {
+        return;
+    }
+    connection->commitPending = false;
+    if (connection->resultCache != NULL) {
+        connection->resultCache->committed();
+    }
+    if (connection->changes != NULL) {
+        connection->changes->committed();
+    }
+}
+
+// Installs the hooks while anything needs them, and removes them otherwise.
+static void updateWriterHooks(SQLiteConnection* connection) {
+    if (connection->resultCache != NULL || connection->changes != NULL) {
+        sqlite3_update_hook(connection->db, &writerUpdateHook, connection);
+        sqlite3_commit_hook(connection->db, &writerCommitHook, connection);
+        sqlite3_rollback_hook(connection->db, &writerRollbackHook, connection);
+    } else {
+        sqlite3_update_hook(connection->db, NULL, NULL);
+        sqlite3_commit_hook(connection->db, NULL, NULL);
+        sqlite3_rollback_hook(connection->db, NULL, NULL);
+    }
 }
 
-// Called each time a statement finishes execution, when profiling is enabled.
-static void sqliteProfileCallback(void *data, const char *sql, sqlite3_uint64 tm) {
+// Called each time a statement begins execution, when tracing is enabled, and each time one
+// finishes, for the metrics and finishCommit(). A run finishes when the statement is done, reset or finalized, so its
+// status counters are taken here rather than at every place statements are reset.
+static int sqliteTraceCallback(unsigned type, void* data, void* p, void* x) {
     SQLiteConnection* connection = static_cast<SQLiteConnection*>(data);
-    ALOGV("%s: \"%s\" took %0.3f ms\n",
-            connection->label, sql, tm * 0.000001f);
+    if (type == SQLITE_TRACE_STMT) {
+        ALOGV("%s: \"%s\"\n",
+                connection->label, static_cast<const char*>(x));
+    } else if (type == SQLITE_TRACE_PROFILE) {
+        auto statement = static_cast<sqlite3_stmt*>(p);
+        sqlite3_int64 nanos = *static_cast<sqlite3_int64*>(x);
+        uint64_t micros = nanos / 1000;
+        finishCommit(connection);
+        connection->metrics->recordRun(statement, micros);
+        SlowQueryLog* slowQueries = connection->slowQueries;
+        if (slowQueries != NULL && micros >= slowQueries->threshold()) {
+            slowQueries->record(statement, micros);
+        }
+        if (connection->logProfile) {
+            ALOGV("%s: \"%s\" took %0.3f ms\n",
+                    connection->label, sqlite3_sql(statement), nanos * 0.000001f);
+        }
+    }
+    return 0;
 }
 
 // Called after each SQLite VM instruction when cancelation is enabled.
@@ -117,9 +410,19 @@ static int sqliteProgressHandlerCallback(void* data) {
 }
 
 
+/*
+ * Closes a connection that couldn't be set up and throws its error, which closing discards.
+ */
+static void closeAndThrow(sqlite3* db, const char* message) {
+    int errcode = sqlite3_extended_errcode(db);
+    KStdString errmsg(sqlite3_errmsg(db));
+    sqlite3_close(db);
+    throw_sqlite3_exception(errcode, errmsg.c_str(), message);
+}
+
 static KLong nativeOpen(KString pathStr, KInt openFlags,
         KString labelStr, KBoolean enableTrace, KBoolean enableProfile, KInt lookasideSz,
-        KInt lookasideCnt) {
+        KInt lookasideCnt, KInt pageCacheBytes) {
 
     RuntimeAssert(pathStr->type_info() == theStringTypeInfo, "Must use a string");
     RuntimeAssert(labelStr->type_info() == theStringTypeInfo, "Must use a string");
@@ -138,9 +441,16 @@ static KLong nativeOpen(KString pathStr, KInt openFlags,
     char * label = CreateCStringFromStringWithSize(labelStr, &utf8Size);
 
     sqlite3* db;
+    // Throwing doesn't return, so everything opened so far goes first.
+    auto fail = [&](const char* message) {
+        DisposeCStringHelper(path);
+        DisposeCStringHelper(label);
+        closeAndThrow(db, message);
+    };
+
     int err = sqlite3_open_v2(path, &db, sqliteFlags, NULL);
     if (err != SQLITE_OK) {
-        throw_sqlite3_exception_errcode(err, "Could not open database");
+        fail("Could not open database");
         return 0;
     }
 
@@ -148,47 +458,57 @@ static KLong nativeOpen(KString pathStr, KInt openFlags,
         int err = sqlite3_db_config(db, SQLITE_DBCONFIG_LOOKASIDE, NULL, lookasideSz, lookasideCnt);
         if (err != SQLITE_OK) {
             ALOGE("sqlite3_db_config(..., %d, %d) failed: %d", lookasideSz, lookasideCnt, err);
-            throw_sqlite3_exception(db, "Cannot set lookaside");
-            sqlite3_close(db);
+            fail("Cannot set lookaside");
+            return 0;
+        }
+    }
+
+    if (pageCacheBytes > 0) {
+        err = setPageCacheBudget(db, pageCacheBytes);
+        if (err != SQLITE_OK) {
+            fail("Cannot set page cache size");
             return 0;
         }
     }
 
     // Check that the database is really read/write when that is what we asked for.
     if ((sqliteFlags & SQLITE_OPEN_READWRITE) && sqlite3_db_readonly(db, NULL)) {
-        throw_sqlite3_exception( db, "Could not open the database in read/write mode.");
-        sqlite3_close(db);
+        fail("Could not open the database in read/write mode.");
         return 0;
     }
 
-    // Set the default busy handler to retry automatically before returning SQLITE_BUSY.
-    err = sqlite3_busy_timeout(db, BUSY_TIMEOUT_MS);
+    // Register the native SQL functions and collations.
+    AddedFunctions addedFunctions;
+    err = installFunctions(db, &addedFunctions);
+    if (err == SQLITE_OK) {
+        err = installUnicodeCollation(db,
+                !(openFlags & SQLiteConnection::NO_LOCALIZED_COLLATORS));
+    }
     if (err != SQLITE_OK) {
-        throw_sqlite3_exception( db, "Could not set busy timeout");
-        sqlite3_close(db);
+        fail("Could not register SQL functions.");
         return 0;
     }
 
-    /* No custom fumnctions
-    // Register custom Android functions.
-    err = register_android_functions(db, UTF16_STORAGE);
-    if (err) {
-        throw_sqlite3_exception(env, db, "Could not register Android SQL functions.");
-        sqlite3_close(db);
-        return 0;
-    }
-    */
     // Create wrapper object.
     SQLiteConnection* connection = new SQLiteConnection(db, openFlags, path, label);
+    connection->pageCacheBytes = pageCacheBytes;
+    connection->dependencies.setAddedFunctions(addedFunctions);
 
-    // Enable tracing and profiling if requested.
-    if (enableTrace) {
-        sqlite3_trace(db, &sqliteTraceCallback, connection);
-    }
-    if (enableProfile) {
-        sqlite3_profile(db, &sqliteProfileCallback, connection);
+    // Set the default busy handler to retry automatically before returning SQLITE_BUSY.
+    err = connection->contention.setBusyPolicy(DEFAULT_BUSY_POLICY);
+    if (err != SQLITE_OK) {
+        delete connection;
+        sqlite3_close(db);
+        throw_sqlite3_exception_errcode(err, "Could not set busy handler");
+        return 0;
     }
 
+    // Profile events always feed the metrics. Enable tracing and logging them if requested.
+    connection->metrics = new QueryMetrics();
+    connection->logProfile = enableProfile;
+    sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE | (enableTrace ? SQLITE_TRACE_STMT : 0),
+            &sqliteTraceCallback, connection);
+
     ALOGV("Opened connection %p with label '%s'", db, label);
     return reinterpret_cast<KLong>(connection);
 }
@@ -198,6 +518,22 @@ static void nativeClose(KLong connectionPtr) {
 
     if (connection) {
         ALOGV("Closing connection %p", connection->db);
+        delete connection->checkpointer;
+        connection->checkpointer = NULL;
+        closeStreams(connection);
+        closeReaders(connection);
+        delete connection->resultCache;
+        connection->resultCache = NULL;
+        delete connection->changes;
+        connection->changes = NULL;
+        updateWriterHooks(connection);
+        sqlite3_trace_v2(connection->db, 0, NULL, NULL);
+        delete connection->metrics;
+        connection->metrics = NULL;
+        delete connection->slowQueries;
+        connection->slowQueries = NULL;
+        sqlite3_finalize(connection->dataStampStatement);
+        connection->dataStampStatement = NULL;
         int err = sqlite3_close(connection->db);
         if (err != SQLITE_OK) {
             // This can happen if sub-objects aren't closed first.  Make sure the caller knows.
@@ -302,6 +638,38 @@ static void nativeRegisterLocalizedCollators(JNIEnv* env, jclass clazz, jlong co
 }
 */
 
+/*
+ * Runs prepare, which must set *statement, and records how long it took and, when the connection
+ * has a result cache, what the statement reads.
+ */
+template <typename Prepare>
+static int prepareTracked(SQLiteConnection* connection, Prepare prepare, sqlite3_stmt** statement) {
+    PhaseTimer timer(connection->metrics, QUERY_PHASE_PREPARE, statement);
+    if (connection->resultCache == NULL) {
+        return prepare();
+    }
+    connection->dependencies.begin();
+    int err = prepare();
+    StatementDependencies dependencies;
+    connection->dependencies.end(&dependencies);
+    if (err == SQLITE_OK && *statement != NULL) {
+        connection->resultCache->setDependencies(sqlite3_sql(*statement), dependencies);
+    }
+    return err;
+}
+
+/*
+ * Collects the dependencies of a statement prepared earlier, which the result cache has since
+ * dropped, by preparing its SQL again.
+ */
+static void collectDependencies(SQLiteConnection* connection, sqlite3_stmt* statement) {
+    sqlite3_stmt* probe = NULL;
+    prepareTracked(connection, [&]() {
+        return sqlite3_prepare_v2(connection->db, sqlite3_sql(statement), -1, &probe, NULL);
+    }, &probe);
+    sqlite3_finalize(probe);
+}
+
 static KLong nativePrepareStatement(KLong connectionPtr, KString sqlString) {
 
     RuntimeAssert(sqlString->type_info() == theStringTypeInfo, "Must use a string");
@@ -313,8 +681,9 @@ static KLong nativePrepareStatement(KLong connectionPtr, KString sqlString) {
     const KChar* sql = CharArrayAddressOfElementAt(sqlString, 0);
 
     sqlite3_stmt* statement;
-    int err = sqlite3_prepare16_v2(connection->db,
-            sql, sqlLength * sizeof(KChar), &statement, NULL);
+    int err = prepareTracked(connection, [&]() {
+        return sqlite3_prepare16_v2(connection->db, sql, sqlLength * sizeof(KChar), &statement, NULL);
+    }, &statement);
 
     if (err != SQLITE_OK) {
         // Error messages like 'near ")": syntax error' are not
@@ -324,11 +693,11 @@ static KLong nativePrepareStatement(KLong connectionPtr, KString sqlString) {
         std::string str;
 
         size_t utf8size;
-        str.append(", while compiling: ");
-
-        char* hardString = CreateCStringFromStringWithSize(sqlString, &utf8size);
-        str.append(const_cast<const char *>(hardString));
-        DisposeCStringHelper(hardString);
+        const char* utf8 = Utf8ScratchFromUtf16(sql, sqlLength, &utf8size);
+        if (utf8 != NULL) {
+            str.append(", while compiling: ");
+            str.append(utf8, utf8size);
+        }
 
         throw_sqlite3_exception(connection->db, str.c_str());
         return 0;
@@ -345,26 +714,19 @@ static void nativeFinalizeStatement(KLong connectionPtr, KLong statementPtr) {
     // We ignore the result of sqlite3_finalize because it is really telling us about
     // whether any errors occurred while executing the statement.  The statement itself
     // is always finalized regardless.
-    ALOGV("Finalized statement %p on connection %p", statement, connection->db);
+    ALOGV("Finalized statement %p", statement);
     sqlite3_finalize(statement);
+    // Null once detached for closing, and its pins go with it.
+    if (connection != NULL)
+        releasePinnedBindings(connection, statement);
 }
 
-static KInt nativeGetParameterCount(KLong connectionPtr, KLong statementPtr) {
-    auto statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
-
-    return sqlite3_bind_parameter_count(statement);
-}
-
-static KBoolean nativeIsReadOnly(KLong connectionPtr, KLong statementPtr) {
+static KBoolean nativeWasReprepared(KLong connectionPtr, KLong statementPtr) {
     auto statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
 
-    return sqlite3_stmt_readonly(statement) != 0;
-}
-
-static KInt nativeGetColumnCount(KLong connectionPtr, KLong statementPtr) {
-    auto * statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
-
-    return sqlite3_column_count(statement);
+    // SQLite quietly prepares a statement again when it finds the schema changed, after which
+    // its result columns may no longer match the ones read when it was first prepared.
+    return sqlite3_stmt_status(statement, SQLITE_STMTSTATUS_REPREPARE, 0) != 0;
 }
 
 static size_t lengthOfString(const KChar* wstr)
@@ -379,63 +741,251 @@ static size_t lengthOfString(const KChar* wstr)
     return len;
 }
 
-static void nativeBindNull(KLong connectionPtr, KLong statementPtr, KInt index) {
-    auto * connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-    auto * statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+static OBJ_GETTER(createStringFromUtf16, const KChar* text) {
+    size_t size = lengthOfString(text);
+    ArrayHeader* result = AllocArrayInstance(
+            theStringTypeInfo, size, OBJ_RESULT)->array();
 
-    int err = sqlite3_bind_null(statement, index);
-    if (err != SQLITE_OK) {
-        throw_sqlite3_exception( connection->db, NULL);
-    }
+    memcpy(CharArrayAddressOfElementAt(result, 0),
+           text,
+           size * sizeof(KChar));
+
+    RETURN_OBJ(result->obj());
 }
 
-static void nativeBindLong(KLong connectionPtr, KLong statementPtr, KInt index, KLong value) {
-    auto * connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-    auto * statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+/* Type tags understood by nativeBindArguments. Same values as Cursor.FIELD_TYPE_*. */
+enum {
+    BIND_TYPE_NULL = 0,
+    BIND_TYPE_INTEGER = 1,
+    BIND_TYPE_FLOAT = 2,
+    BIND_TYPE_STRING = 3,
+    BIND_TYPE_BLOB = 4,
+    // Large values bound with SQLITE_STATIC instead of being copied by SQLite. The object must stay
+    // alive until the binding is cleared. Text comes already encoded as a UTF-8 ByteArray.
+    BIND_TYPE_STRING_UTF8_STATIC = 5,
+    BIND_TYPE_BLOB_STATIC = 6,
+};
 
-    int err = sqlite3_bind_int64(statement, index, value);
-    if (err != SQLITE_OK) {
-        throw_sqlite3_exception( connection->db, NULL);
-    }
+static bool isStaticBinding(KByte type) {
+    return type == BIND_TYPE_STRING_UTF8_STATIC || type == BIND_TYPE_BLOB_STATIC;
 }
 
-static void nativeBindDouble(KLong connectionPtr, KLong statementPtr, KInt index, KDouble value) {
-    auto * connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-    auto * statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+/**
+ * Binds a single packed value. destructor applies to plain strings and blobs; callers that keep the
+ * object alive for as long as it stays bound may pass SQLITE_STATIC.
+ */
+static int bindValue(sqlite3_stmt* statement, int index, KByte type, KLong value, KConstRef object,
+        sqlite3_destructor_type destructor) {
+    switch (type) {
+        case BIND_TYPE_INTEGER:
+            return sqlite3_bind_int64(statement, index, value);
+        case BIND_TYPE_FLOAT: {
+            KDouble doubleValue;
+            memcpy(&doubleValue, &value, sizeof(doubleValue));
+            return sqlite3_bind_double(statement, index, doubleValue);
+        }
+        case BIND_TYPE_STRING: {
+            const ArrayHeader* valueString = object->array();
+            if (destructor == SQLITE_TRANSIENT) {
+                size_t utf8Size;
+                const char* utf8 = Utf8ScratchFromUtf16(CharArrayAddressOfElementAt(valueString, 0),
+                        valueString->count_, &utf8Size);
+                // SQLite would quietly bind a null pointer as NULL.
+                if (utf8 == NULL)
+                    return SQLITE_NOMEM;
+                return sqlite3_bind_text(statement, index, utf8, utf8Size, SQLITE_TRANSIENT);
+            }
+            return sqlite3_bind_text16(statement, index,
+                    CharArrayAddressOfElementAt(valueString, 0),
+                    valueString->count_ * sizeof(KChar), destructor);
+        }
+        case BIND_TYPE_BLOB: {
+            const ArrayHeader* valueBlob = object->array();
+            return sqlite3_bind_blob(statement, index,
+                    ByteArrayAddressOfElementAt(valueBlob, 0),
+                    valueBlob->count_, destructor);
+        }
+        case BIND_TYPE_STRING_UTF8_STATIC: {
+            const ArrayHeader* valueUtf8 = object->array();
+            return sqlite3_bind_text(statement, index,
+                    reinterpret_cast<const char*>(ByteArrayAddressOfElementAt(valueUtf8, 0)),
+                    valueUtf8->count_, SQLITE_STATIC);
+        }
+        case BIND_TYPE_BLOB_STATIC: {
+            const ArrayHeader* valueBlob = object->array();
+            return sqlite3_bind_blob(statement, index,
+                    ByteArrayAddressOfElementAt(valueBlob, 0),
+                    valueBlob->count_, SQLITE_STATIC);
+        }
+        default:
+            return sqlite3_bind_null(statement, index);
+    }
+}
 
-    int err = sqlite3_bind_double(statement, index, value);
-    if (err != SQLITE_OK) {
-        throw_sqlite3_exception( connection->db, NULL);
+/**
+ * Binds every parameter of the statement in one pass. types holds one tag per parameter. Integers
+ * and the raw bits of doubles come from values, strings and blobs from objects, both at the same
+ * index as the tag. Stops at the first failure and reports its 1-based index. Static bindings are
+ * pinned when pinStatic is set; callers that clear the bindings before they return, while the
+ * arrays are still referenced, can skip that.
+ */
+static void bindArgumentArrays(SQLiteConnection* connection, sqlite3_stmt* statement,
+        KConstRef typesArray, KConstRef valuesArray, KConstRef objectsArray, bool pinStatic) {
+    const ArrayHeader* typesHeader = typesArray->array();
+    const ArrayHeader* valuesHeader = valuesArray->array();
+    const ArrayHeader* objectsHeader = objectsArray->array();
+
+    uint32_t count = typesHeader->count_;
+    RuntimeAssert(valuesHeader->count_ >= count && objectsHeader->count_ >= count,
+            "Bind arrays shorter than type array");
+
+    const KByte* types = ByteArrayAddressOfElementAt(typesHeader, 0);
+    const KLong* values = PrimitiveArrayAddressOfElementAt<KLong>(valuesHeader, 0);
+    const KRef* objects = ArrayAddressOfElementAt(objectsHeader, 0);
+
+    for (uint32_t i = 0; i < count; i++) {
+        int index = static_cast<int>(i) + 1;
+        int err = bindValue(statement, index, types[i], values[i], objects[i], SQLITE_TRANSIENT);
+        if (err == SQLITE_OK && pinStatic && isStaticBinding(types[i])) {
+            pinBinding(connection, statement, objects[i]);
+        }
+        if (err != SQLITE_OK) {
+            char message[64];
+            snprintf(message, sizeof(message), "while binding parameter %d", index);
+            // Running out of scratch space leaves nothing on the connection to report.
+            if (err == SQLITE_NOMEM)
+                throw_sqlite3_exception_errcode(err, message);
+            throw_sqlite3_exception(connection->db, message);
+        }
     }
 }
 
-static void nativeBindString(KLong connectionPtr, KLong statementPtr, KInt index, KString valueString) {
+static void nativeBindArguments(KLong connectionPtr, KLong statementPtr,
+        KConstRef typesArray, KConstRef valuesArray, KConstRef objectsArray) {
     auto * connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
     auto * statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
 
-    KInt valueLength = valueString->count_;
+    bindArgumentArrays(connection, statement, typesArray, valuesArray, objectsArray, true);
+}
+
+/* Column layouts understood by nativeExecuteBatch. Must match SQLiteConnection.kt. */
+enum {
+    BATCH_COLUMN_LONG = 0,      // LongArray
+    BATCH_COLUMN_DOUBLE = 1,    // DoubleArray
+    BATCH_COLUMN_PACKED = 2,    // Array of [types, values, objects] as for nativeBindArguments
+};
 
-    const KChar* value = CharArrayAddressOfElementAt(valueString, 0);
-    int err = sqlite3_bind_text16(statement, index, value, valueLength * sizeof(KChar),
-            SQLITE_TRANSIENT);
+static const char* const BATCH_SAVEPOINT = "SAVEPOINT knarch_batch";
+static const char* const BATCH_RELEASE = "RELEASE knarch_batch";
+static const char* const BATCH_ROLLBACK = "ROLLBACK TO knarch_batch; RELEASE knarch_batch";
 
-    if (err != SQLITE_OK) {
-        throw_sqlite3_exception( connection->db, NULL);
-    }
+/**
+ * Resets the statement, rolls back whatever the batch wrote and throws for the error that stopped it.
+ * The error is captured first, since resetting and rolling back overwrite the connection's error state.
+ */
+static void failBatch(SQLiteConnection* connection, sqlite3_stmt* statement, bool ownTransaction,
+        int row, const char* what) {
+    int errcode = sqlite3_extended_errcode(connection->db);
+    std::string errmsg(sqlite3_errmsg(connection->db));
+
+    sqlite3_reset(statement);
+    sqlite3_clear_bindings(statement);
+    releasePinnedBindings(connection, statement);
+    sqlite3_exec(connection->db, ownTransaction ? "ROLLBACK" : BATCH_ROLLBACK, NULL, NULL, NULL);
+
+    char message[96];
+    snprintf(message, sizeof(message), "while %s batch row %d", what, row);
+    throw_sqlite3_exception(errcode, errmsg.c_str(), message);
 }
 
-static void nativeBindBlob(KLong connectionPtr, KLong statementPtr, KInt index, KConstRef valueArray) {
+/**
+ * Executes the statement once per row of columnar input, all inside one transaction. columns holds
+ * one entry per bind parameter laid out as described by kinds. For each row the number of changed
+ * rows, or the last inserted row id (-1 if nothing was inserted) when returnRowIds is set, is
+ * written to outResults.
+ *
+ * If the connection is in autocommit mode the batch runs in its own IMMEDIATE transaction,
+ * otherwise in a savepoint of the caller's. Either way a failure leaves nothing of the batch behind.
+ *
+ * The columns are referenced by the caller for the whole call, so strings and blobs are bound with
+ * SQLITE_STATIC. Every exit path clears the bindings before returning.
+ */
+static void nativeExecuteBatch(KLong connectionPtr, KLong statementPtr, KConstRef kindsArray,
+        KConstRef columnsArray, KInt rowCount, KBoolean returnRowIds, KRef outResults) {
     auto * connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
     auto * statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
 
-    const ArrayHeader* array = valueArray->array();
+    const ArrayHeader* kindsHeader = kindsArray->array();
+    const ArrayHeader* columnsHeader = columnsArray->array();
+    uint32_t columnCount = kindsHeader->count_;
+    RuntimeAssert(columnsHeader->count_ == columnCount, "One column per kind");
+    RuntimeAssert(outResults->array()->count_ >= static_cast<uint32_t>(rowCount), "Result array too small");
 
-    KInt valueLength = array->count_;
-    const auto * value = ByteArrayAddressOfElementAt(array, 0);
-    int err = sqlite3_bind_blob(statement, index, value, valueLength, SQLITE_TRANSIENT);
+    const KByte* kinds = ByteArrayAddressOfElementAt(kindsHeader, 0);
+    const KRef* columns = ArrayAddressOfElementAt(columnsHeader, 0);
+    KLong* results = PrimitiveArrayAddressOfElementAt<KLong>(outResults->array(), 0);
 
-    if (err != SQLITE_OK) {
-        throw_sqlite3_exception( connection->db, NULL);
+    bool ownTransaction = sqlite3_get_autocommit(connection->db) != 0;
+    if (sqlite3_exec(connection->db, ownTransaction ? "BEGIN IMMEDIATE" : BATCH_SAVEPOINT,
+            NULL, NULL, NULL) != SQLITE_OK) {
+        throw_sqlite3_exception(connection->db, "while beginning batch");
+    }
+
+    for (KInt row = 0; row < rowCount; row++) {
+        for (uint32_t c = 0; c < columnCount; c++) {
+            const ArrayHeader* column = columns[c]->array();
+            int index = static_cast<int>(c) + 1;
+            int err;
+            switch (kinds[c]) {
+                case BATCH_COLUMN_LONG:
+                    err = sqlite3_bind_int64(statement, index,
+                            *PrimitiveArrayAddressOfElementAt<KLong>(column, row));
+                    break;
+                case BATCH_COLUMN_DOUBLE:
+                    err = sqlite3_bind_double(statement, index,
+                            *PrimitiveArrayAddressOfElementAt<KDouble>(column, row));
+                    break;
+                default: {
+                    const KRef* packed = ArrayAddressOfElementAt(column, 0);
+                    err = bindValue(statement, index,
+                            *ByteArrayAddressOfElementAt(packed[0]->array(), row),
+                            *PrimitiveArrayAddressOfElementAt<KLong>(packed[1]->array(), row),
+                            *ArrayAddressOfElementAt(packed[2]->array(), row),
+                            SQLITE_STATIC);
+                    break;
+                }
+            }
+            if (err != SQLITE_OK) {
+                failBatch(connection, statement, ownTransaction, row, "binding");
+            }
+        }
+
+        int err = stepFirst(connection, statement);
+        if (err != SQLITE_DONE) {
+            if (err == SQLITE_ROW) {
+                sqlite3_reset(statement);
+                sqlite3_clear_bindings(statement);
+                sqlite3_exec(connection->db, ownTransaction ? "ROLLBACK" : BATCH_ROLLBACK, NULL, NULL, NULL);
+                throw_sqlite3_exception(
+                        "Queries can be performed using SQLiteDatabase query or rawQuery methods only.");
+            }
+            failBatch(connection, statement, ownTransaction, row, "executing");
+        }
+
+        int changes = sqlite3_changes(connection->db);
+        if (returnRowIds) {
+            results[row] = changes > 0 ? sqlite3_last_insert_rowid(connection->db) : -1;
+        } else {
+            results[row] = changes;
+        }
+        sqlite3_reset(statement);
+    }
+    sqlite3_clear_bindings(statement);
+    releasePinnedBindings(connection, statement);
+
+    if (sqlite3_exec(connection->db, ownTransaction ? "COMMIT" : BATCH_RELEASE,
+            NULL, NULL, NULL) != SQLITE_OK) {
+        failBatch(connection, statement, ownTransaction, rowCount, "committing");
     }
 }
 
@@ -444,16 +994,19 @@ static void nativeResetStatementAndClearBindings(KLong connectionPtr, KLong stat
     auto * statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
 
     int err = sqlite3_reset(statement);
+    // A statement reset before it was done ends its autocommit transaction here.
+    finishCommit(connection);
     if (err == SQLITE_OK) {
         err = sqlite3_clear_bindings(statement);
     }
     if (err != SQLITE_OK) {
         throw_sqlite3_exception( connection->db, NULL);
     }
+    releasePinnedBindings(connection, statement);
 }
 
 static int executeNonQuery(SQLiteConnection* connection, sqlite3_stmt* statement) {
-    int err = sqlite3_step(statement);
+    int err = stepFirst(connection, statement);
     if (err == SQLITE_ROW) {
         throw_sqlite3_exception(
                 "Queries can be performed using SQLiteDatabase query or rawQuery methods only.");
@@ -488,7 +1041,7 @@ static KLong nativeExecuteForLastInsertedRowId(KLong connectionPtr, KLong statem
 }
 
 static int executeOneRowQuery(SQLiteConnection* connection, sqlite3_stmt* statement) {
-    int err = sqlite3_step(statement);
+    int err = stepFirst(connection, statement);
     if (err != SQLITE_ROW) {
         throw_sqlite3_exception(connection->db);
     }
@@ -514,15 +1067,7 @@ extern "C" OBJ_GETTER(Android_Database_SQLiteConnection_nativeExecuteForString,
     if (err == SQLITE_ROW && sqlite3_column_count(statement) >= 1) {
         auto text = static_cast<const KChar*>(sqlite3_column_text16(statement, 0));
         if (text) {
-            size_t size = lengthOfString(text);
-            ArrayHeader* result = AllocArrayInstance(
-                    theStringTypeInfo, size, OBJ_RESULT)->array();
-
-            memcpy(CharArrayAddressOfElementAt(result, 0),
-                   text,
-                   size * sizeof(KChar));
-
-            RETURN_OBJ(result->obj());
+            RETURN_RESULT_OF(createStringFromUtf16, text);
         }
     }
     RETURN_OBJ(nullptr);
@@ -588,10 +1133,117 @@ enum CopyRowResult {
     CPR_ERROR,
 };
 
-static CopyRowResult copyRow(CursorWindow* window,
-        sqlite3_stmt* statement, int numColumns, int startPos, int addedRows) {
-    // Allocate a new field directory for the row.
-    status_t status = window->allocRow();
+enum FieldWriteResult {
+    FWR_OK,
+    FWR_FULL,
+    FWR_MISMATCH,
+};
+
+/*
+ * Column writers for copyRow. Each column of a fill keeps the writer for the type it held last, so
+ * the common case of a column that always has the same storage class goes straight to a
+ * specialized writer. A writer only reports FWR_MISMATCH when the value's type differs from what
+ * it was specialized for, and copyRow then switches that column over to the right writer.
+ */
+typedef CursorWindow::FieldSlot FieldSlot;
+typedef FieldWriteResult (*FieldWriter)(CursorWindow* window, FieldSlot* fieldSlot,
+        sqlite3_stmt* statement, int column);
+
+template <int Type>
+static FieldWriteResult writeField(CursorWindow* window, FieldSlot* fieldSlot,
+        sqlite3_stmt* statement, int column);
+
+template <>
+FieldWriteResult writeField<SQLITE_INTEGER>(CursorWindow* window, FieldSlot* fieldSlot,
+        sqlite3_stmt* statement, int column) {
+    if (sqlite3_column_type(statement, column) != SQLITE_INTEGER) {
+        return FWR_MISMATCH;
+    }
+    window->putLongAt(fieldSlot, sqlite3_column_int64(statement, column));
+    return FWR_OK;
+}
+
+template <>
+FieldWriteResult writeField<SQLITE_FLOAT>(CursorWindow* window, FieldSlot* fieldSlot,
+        sqlite3_stmt* statement, int column) {
+    if (sqlite3_column_type(statement, column) != SQLITE_FLOAT) {
+        return FWR_MISMATCH;
+    }
+    window->putDoubleAt(fieldSlot, sqlite3_column_double(statement, column));
+    return FWR_OK;
+}
+
+template <>
+FieldWriteResult writeField<SQLITE_TEXT>(CursorWindow* window, FieldSlot* fieldSlot,
+        sqlite3_stmt* statement, int column) {
+    if (sqlite3_column_type(statement, column) != SQLITE_TEXT) {
+        return FWR_MISMATCH;
+    }
+    const char* text = reinterpret_cast<const char*>(sqlite3_column_text(statement, column));
+    // SQLite does not include the NULL terminator in size, but does
+    // ensure all strings are NULL terminated, so increase size by
+    // one to make sure we store the terminator.
+    size_t sizeIncludingNull = sqlite3_column_bytes(statement, column) + 1;
+    if (window->putBlobOrStringAt(fieldSlot, text, sizeIncludingNull,
+            CursorWindow::FIELD_TYPE_STRING)) {
+        LOG_WINDOW("Failed allocating %u bytes for text in column %d", sizeIncludingNull, column);
+        return FWR_FULL;
+    }
+    return FWR_OK;
+}
+
+template <>
+FieldWriteResult writeField<SQLITE_BLOB>(CursorWindow* window, FieldSlot* fieldSlot,
+        sqlite3_stmt* statement, int column) {
+    if (sqlite3_column_type(statement, column) != SQLITE_BLOB) {
+        return FWR_MISMATCH;
+    }
+    const void* blob = sqlite3_column_blob(statement, column);
+    size_t size = sqlite3_column_bytes(statement, column);
+    if (window->putBlobOrStringAt(fieldSlot, blob, size, CursorWindow::FIELD_TYPE_BLOB)) {
+        LOG_WINDOW("Failed allocating %u bytes for blob in column %d", size, column);
+        return FWR_FULL;
+    }
+    return FWR_OK;
+}
+
+// Column excluded by the fill's column mask. The value is never read from the statement.
+static FieldWriteResult writeUnfetchedField(CursorWindow* window, FieldSlot* fieldSlot,
+        sqlite3_stmt* statement, int column) {
+    window->putUnfetchedAt(fieldSlot);
+    return FWR_OK;
+}
+
+// Placeholder for a column whose type has not been seen yet.
+static FieldWriteResult writeUnknownField(CursorWindow* window, FieldSlot* fieldSlot,
+        sqlite3_stmt* statement, int column) {
+    return FWR_MISMATCH;
+}
+
+static FieldWriter fieldWriterForType(int type) {
+    switch (type) {
+        case SQLITE_INTEGER:
+            return writeField<SQLITE_INTEGER>;
+        case SQLITE_FLOAT:
+            return writeField<SQLITE_FLOAT>;
+        case SQLITE_TEXT:
+            return writeField<SQLITE_TEXT>;
+        case SQLITE_BLOB:
+            return writeField<SQLITE_BLOB>;
+        default:
+            return NULL;
+    }
+}
+
+/*
+ * Copies the current row into the window. writers holds one entry per column and is updated in
+ * place as the column types are learned, so it should be kept for the whole fill.
+ */
+static CopyRowResult copyRow(CursorWindow* window, sqlite3_stmt* statement, int numColumns,
+        FieldWriter* writers, int startPos, int addedRows) {
+    // Allocate a new field directory for the row. Every slot starts out NULL.
+    FieldSlot* fieldDir;
+    status_t status = window->allocRow(&fieldDir);
     if (status) {
         LOG_WINDOW("Failed allocating fieldDir at startPos %d row %d, error=%d",
                 startPos, addedRows, status);
@@ -601,75 +1253,29 @@ static CopyRowResult copyRow(CursorWindow* window,
     // Pack the row into the window.
     CopyRowResult result = CPR_OK;
     for (int i = 0; i < numColumns; i++) {
-        int type = sqlite3_column_type(statement, i);
-        if (type == SQLITE_TEXT) {
-            // TEXT data
-            const char* text = reinterpret_cast<const char*>(
-                    sqlite3_column_text(statement, i));
-            // SQLite does not include the NULL terminator in size, but does
-            // ensure all strings are NULL terminated, so increase size by
-            // one to make sure we store the terminator.
-            size_t sizeIncludingNull = sqlite3_column_bytes(statement, i) + 1;
-            status = window->putString(addedRows, i, text, sizeIncludingNull);
-            if (status) {
-                LOG_WINDOW("Failed allocating %u bytes for text at %d,%d, error=%d",
-                        sizeIncludingNull, startPos + addedRows, i, status);
-                result = CPR_FULL;
-                break;
-            }
-            LOG_WINDOW("%d,%d is TEXT with %u bytes",
-                    startPos + addedRows, i, sizeIncludingNull);
-        } else if (type == SQLITE_INTEGER) {
-            // INTEGER data
-            int64_t value = sqlite3_column_int64(statement, i);
-            status = window->putLong(addedRows, i, value);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a long in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
-                break;
-            }
-            LOG_WINDOW("%d,%d is INTEGER 0x%016llx", startPos + addedRows, i, value);
-        } else if (type == SQLITE_FLOAT) {
-            // FLOAT data
-            double value = sqlite3_column_double(statement, i);
-            status = window->putDouble(addedRows, i, value);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a double in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
-                break;
-            }
-            LOG_WINDOW("%d,%d is FLOAT %lf", startPos + addedRows, i, value);
-        } else if (type == SQLITE_BLOB) {
-            // BLOB data
-            const void* blob = sqlite3_column_blob(statement, i);
-            size_t size = sqlite3_column_bytes(statement, i);
-            status = window->putBlob(addedRows, i, blob, size);
-            if (status) {
-                LOG_WINDOW("Failed allocating %u bytes for blob at %d,%d, error=%d",
-                        size, startPos + addedRows, i, status);
-                result = CPR_FULL;
-                break;
+        FieldWriteResult written = writers[i](window, fieldDir + i, statement, i);
+        if (written == FWR_MISMATCH) {
+            int type = sqlite3_column_type(statement, i);
+            if (type == SQLITE_NULL) {
+                // Leave the slot NULL, and keep the writer for the column's usual type.
+                LOG_WINDOW("%d,%d is NULL", startPos + addedRows, i);
+                continue;
             }
-            LOG_WINDOW("%d,%d is Blob with %u bytes",
-                    startPos + addedRows, i, size);
-        } else if (type == SQLITE_NULL) {
-            // NULL field
-            status = window->putNull(addedRows, i);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a null in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
+
+            FieldWriter writer = fieldWriterForType(type);
+            if (writer == NULL) {
+                // Unknown data
+                ALOGE("Unknown column type when filling database window");
+                throw_sqlite3_exception( "Unknown column type when filling window");
+                result = CPR_ERROR;
                 break;
             }
+            writers[i] = writer;
+            written = writer(window, fieldDir + i, statement, i);
+        }
 
-            LOG_WINDOW("%d,%d is NULL", startPos + addedRows, i);
-        } else {
-            // Unknown data
-            ALOGE("Unknown column type when filling database window");
-            throw_sqlite3_exception( "Unknown column type when filling window");
-            result = CPR_ERROR;
+        if (written == FWR_FULL) {
+            result = CPR_FULL;
             break;
         }
     }
@@ -681,18 +1287,118 @@ static CopyRowResult copyRow(CursorWindow* window,
     return result;
 }
 
-static KLong nativeExecuteForCursorWindow(KLong connectionPtr, KLong statementPtr, KLong windowPtr,
-        KInt startPos, KInt requiredPos, KBoolean countAllRows) {
-    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-    auto statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
-    auto window = reinterpret_cast<CursorWindow*>(windowPtr);
-
-    status_t status = window->clear();
-    if (status) {
-        char buff[100];
-        snprintf(buff, sizeof(buff), "Failed to clear the cursor window, status=%d", status);
-        throw_sqlite3_exception( connection->db, const_cast<const char*>(buff));
-        return 0;
+static bool readDataStamp(SQLiteConnection* connection, DataStamp* outStamp) {
+    if (connection->dataStampStatement == NULL && sqlite3_prepare_v2(connection->db,
+            "SELECT data_version, schema_version FROM pragma_data_version, pragma_schema_version",
+            -1, &connection->dataStampStatement, NULL) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_stmt* stamp = connection->dataStampStatement;
+    bool found = sqlite3_step(stamp) == SQLITE_ROW;
+    if (found) {
+        outStamp->dataVersion = sqlite3_column_int64(stamp, 0);
+        outStamp->schemaVersion = sqlite3_column_int64(stamp, 1);
+        outStamp->totalChanges = sqlite3_total_changes(connection->db);
+    }
+    sqlite3_reset(stamp);
+    return found;
+}
+
+/*
+ * Looks up the row count of the statement, as currently bound. outKey is left empty when the
+ * statement can't be cached; otherwise it and outStamp are what storeRowCount needs afterwards.
+ */
+static bool lookupRowCount(SQLiteConnection* connection, sqlite3_stmt* statement,
+        KStdString* outKey, DataStamp* outStamp, int* outRows) {
+    if (!sqlite3_get_autocommit(connection->db) || !readDataStamp(connection, outStamp)) {
+        return false;
+    }
+
+    char* expandedSql = sqlite3_expanded_sql(statement);
+    if (expandedSql == NULL) {
+        return false;
+    }
+    outKey->assign(expandedSql);
+    sqlite3_free(expandedSql);
+
+    auto found = connection->rowCountCache.find(*outKey);
+    if (found == connection->rowCountCache.end()) {
+        return false;
+    }
+    if (!(found->second.stamp == *outStamp)) {
+        connection->rowCountCache.erase(found);
+        return false;
+    }
+    *outRows = found->second.rows;
+    return true;
+}
+
+static void storeRowCount(SQLiteConnection* connection, const KStdString& key,
+        const DataStamp& stamp, int rows) {
+    if (connection->rowCountCache.size() >= connection->rowCountCacheSize) {
+        connection->rowCountCache.clear();
+    }
+    CachedRowCount& entry = connection->rowCountCache[key];
+    entry.stamp = stamp;
+    entry.rows = rows;
+}
+
+/*
+ * The result cache key of a fill: the statement with its arguments expanded, followed by
+ * everything else that decides what ends up in the window.
+ */
+static bool resultCacheKey(sqlite3_stmt* statement, CursorWindow* window, KInt startPos,
+        KInt requiredPos, bool countAllRows, const KBoolean* columnMask, int maskSize,
+        KStdString* outKey) {
+    char* expandedSql = sqlite3_expanded_sql(statement);
+    if (expandedSql == NULL) {
+        return false;
+    }
+    outKey->assign(expandedSql);
+    sqlite3_free(expandedSql);
+
+    KLong fill[] = { startPos, requiredPos, countAllRows, static_cast<KLong>(window->size()) };
+    outKey->push_back('\0');
+    outKey->append(reinterpret_cast<const char*>(fill), sizeof(fill));
+    for (int i = 0; columnMask != NULL && i < maskSize; i++) {
+        outKey->push_back(columnMask[i] ? '1' : '0');
+    }
+    return true;
+}
+
+/*
+ * Fills the window from the statement and resets it. Returns startPos in the high half and the row
+ * count in the low half. Touches no Kotlin objects, so it may run on a native worker thread.
+ * columnMask may be NULL, and columns past maskSize are fetched.
+ */
+static KLong fillWindow(SQLiteConnection* connection, sqlite3_stmt* statement, CursorWindow* window,
+        KInt startPos, KInt requiredPos, bool countAllRows, const KBoolean* columnMask, int maskSize) {
+    PhaseTimer timer(connection->metrics, QUERY_PHASE_FILL, &statement);
+
+    // Inside a transaction the writer sees changes that aren't committed, which the cache can't
+    // tell apart from committed ones.
+    ResultCache* cache = connection->resultCache;
+    KStdString cacheKey;
+    ResultCache::Ticket ticket;
+    ticket.cacheable = false;
+    if (cache != NULL && sqlite3_get_autocommit(connection->db)
+            && resultCacheKey(statement, window, startPos, requiredPos, countAllRows,
+                    columnMask, maskSize, &cacheKey)) {
+        if (!cache->hasDependencies(sqlite3_sql(statement))) {
+            collectDependencies(connection, statement);
+        }
+        KLong cached;
+        if (cache->lookup(cacheKey, sqlite3_sql(statement), window, &cached, &ticket)) {
+            return cached;
+        }
+    }
+
+    status_t status = window->clear();
+    if (status) {
+        char buff[100];
+        snprintf(buff, sizeof(buff), "Failed to clear the cursor window, status=%d", status);
+        throw_sqlite3_exception( connection->db, const_cast<const char*>(buff));
+        return 0;
     }
 
     int numColumns = sqlite3_column_count(statement);
@@ -705,16 +1411,36 @@ static KLong nativeExecuteForCursorWindow(KLong connectionPtr, KLong statementPt
         return 0;
     }
 
-    int retryCount = 0;
+    KStdVector<FieldWriter> writers(numColumns, writeUnknownField);
+    for (int i = 0; columnMask != NULL && i < numColumns && i < maskSize; i++) {
+        if (!columnMask[i]) {
+            writers[i] = writeUnfetchedField;
+        }
+    }
+
+    // When the count is already known, stop stepping as soon as the window is full.
+    KStdString countKey;
+    DataStamp countStamp;
+    int cachedRows = 0;
+    bool countCached = false;
+    bool countFresh = false;
+    if (countAllRows && connection->rowCountCacheSize > 0) {
+        countCached = lookupRowCount(connection, statement, &countKey, &countStamp, &cachedRows);
+        countFresh = !countCached && !countKey.empty();
+        if (countCached) {
+            countAllRows = false;
+        }
+    }
+
     int totalRows = 0;
     int addedRows = 0;
     bool windowFull = false;
     bool gotException = false;
     while (!gotException && (!windowFull || countAllRows)) {
-        int err = sqlite3_step(statement);
+        // Once rows have been handed out, the statement can't be restarted to wait out a lock.
+        int err = totalRows == 0 ? stepFirst(connection, statement) : sqlite3_step(statement);
         if (err == SQLITE_ROW) {
             LOG_WINDOW("Stepped statement %p to row %d", statement, totalRows);
-            retryCount = 0;
             totalRows += 1;
 
             // Skip the row if the window is full or we haven't reached the start position yet.
@@ -722,7 +1448,7 @@ static KLong nativeExecuteForCursorWindow(KLong connectionPtr, KLong statementPt
                 continue;
             }
 
-            CopyRowResult cpr = copyRow(window, statement, numColumns, startPos, addedRows);
+            CopyRowResult cpr = copyRow(window, statement, numColumns, writers.data(), startPos, addedRows);
             if (cpr == CPR_FULL && addedRows && startPos + addedRows <= requiredPos) {
                 // We filled the window before we got to the one row that we really wanted.
                 // Clear the window and start filling it again from here.
@@ -731,7 +1457,7 @@ static KLong nativeExecuteForCursorWindow(KLong connectionPtr, KLong statementPt
                 window->setNumColumns(numColumns);
                 startPos += addedRows;
                 addedRows = 0;
-                cpr = copyRow(window, statement, numColumns, startPos, addedRows);
+                cpr = copyRow(window, statement, numColumns, writers.data(), startPos, addedRows);
             }
 
             if (cpr == CPR_OK) {
@@ -745,19 +1471,9 @@ static KLong nativeExecuteForCursorWindow(KLong connectionPtr, KLong statementPt
             // All rows processed, bail
             LOG_WINDOW("Processed all rows");
             break;
-        } else if (err == SQLITE_LOCKED || err == SQLITE_BUSY) {
-            // The table is locked, retry
-            LOG_WINDOW("Database locked, retrying");
-            if (retryCount > 50) {
-                ALOGE("Bailing on database busy retry");
-                throw_sqlite3_exception( connection->db, "retrycount exceeded");
-                gotException = true;
-            } else {
-                // Sleep to give the thread holding the lock a chance to finish
-                usleep(1000);
-                retryCount++;
-            }
         } else {
+            // Includes SQLITE_BUSY and SQLITE_LOCKED, which have already been waited out as long
+            // as the connection's busy policy allows.
             throw_sqlite3_exception( connection->db);
             gotException = true;
         }
@@ -768,175 +1484,1337 @@ static KLong nativeExecuteForCursorWindow(KLong connectionPtr, KLong statementPt
             statement, totalRows, addedRows, window->size() - window->freeSpace());
     sqlite3_reset(statement);
 
+    if (countCached && windowFull) {
+        totalRows = cachedRows;
+    } else if (countFresh && !gotException) {
+        storeRowCount(connection, countKey, countStamp, totalRows);
+    }
+
     // Report the total number of rows on request.
     if (startPos > totalRows) {
         ALOGE("startPos %d > actual rows %d", startPos, totalRows);
     }
     KLong result = KLong(startPos) << 32 | KLong(totalRows);
+    if (ticket.cacheable && !gotException) {
+        cache->store(cacheKey, ticket, window, result);
+    }
     return result;
 }
 
-static KInt nativeGetDbLookaside(KLong connectionPtr) {
+static KLong nativeExecuteForCursorWindow(KLong connectionPtr, KLong statementPtr, KLong windowPtr,
+        KInt startPos, KInt requiredPos, KBoolean countAllRows, KConstRef columnMaskArray) {
+    const KBoolean* columnMask = NULL;
+    int maskSize = 0;
+    if (columnMaskArray != NULL) {
+        const ArrayHeader* maskHeader = columnMaskArray->array();
+        columnMask = PrimitiveArrayAddressOfElementAt<KBoolean>(maskHeader, 0);
+        maskSize = static_cast<int>(maskHeader->count_);
+    }
+    return fillWindow(reinterpret_cast<SQLiteConnection*>(connectionPtr),
+            reinterpret_cast<sqlite3_stmt*>(statementPtr), reinterpret_cast<CursorWindow*>(windowPtr),
+            startPos, requiredPos, countAllRows, columnMask, maskSize);
+}
+
+/*
+ * Opens readerCount read-only connections next to the writer. The database must already be in
+ * WAL mode, or readers would block the writer and each other.
+ */
+static void nativeOpenReaders(KLong connectionPtr, KInt readerCount) {
     auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    closeReaders(connection);
+    if (readerCount <= 0) {
+        return;
+    }
+
+    ReaderPool* pool = new ReaderPool();
+    for (KInt i = 0; i < readerCount; i++) {
+        sqlite3* db;
+        int err = sqlite3_open_v2(connection->path, &db, SQLITE_OPEN_READONLY, NULL);
+        if (err != SQLITE_OK) {
+            sqlite3_close(db);
+            delete pool;
+            throw_sqlite3_exception_errcode(err, "Could not open reader connection");
+            return;
+        }
+        AddedFunctions addedFunctions;
+        err = installFunctions(db, &addedFunctions);
+        if (err == SQLITE_OK) {
+            err = installUnicodeCollation(db,
+                    !(connection->openFlags & SQLiteConnection::NO_LOCALIZED_COLLATORS));
+        }
+        if (err == SQLITE_OK && connection->pageCacheBytes > 0)
+            err = setPageCacheBudget(db, connection->pageCacheBytes);
+        if (err != SQLITE_OK) {
+            delete pool;
+            closeAndThrow(db, "Could not set up reader connection");
+            return;
+        }
 
-    int cur = -1;
-    int unused;
-    sqlite3_db_status(connection->db, SQLITE_DBSTATUS_LOOKASIDE_USED, &cur, &unused, 0);
-    return cur;
+        auto reader = new SQLiteConnection(db, SQLiteConnection::OPEN_READONLY, NULL, NULL);
+        reader->contention.setBusyPolicy(connection->contention.busyPolicy());
+        reader->rowCountCacheSize = connection->rowCountCacheSize;
+        reader->metrics = connection->metrics;
+        reader->slowQueries = connection->slowQueries;
+        reader->dependencies.setAddedFunctions(addedFunctions);
+        sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, &sqliteTraceCallback, reader);
+        if (connection->resultCache != NULL) {
+            reader->resultCache = connection->resultCache;
+            reader->dependencies.install(db);
+        }
+        pool->add(new ReaderConnection(reader, READER_STATEMENT_CACHE_SIZE));
+    }
+    connection->readers = pool;
+    connection->workers = new WorkerPool(readerCount);
 }
 
-static void nativeCancel(KLong connectionPtr) {
+/*
+ * Moves checkpointing of a WAL database off the writer onto a background thread. Call after
+ * PRAGMA wal_autocheckpoint, which would otherwise turn inline checkpoints back on.
+ */
+static void nativeStartCheckpointer(KLong connectionPtr, KInt walFrames, KInt idleMs) {
     auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-    connection->canceled = true;
+    delete connection->checkpointer;
+    connection->checkpointer = NULL;
+
+    CheckpointPolicy policy = { walFrames, idleMs };
+    auto checkpointer = new WalCheckpointer(connection->db, policy);
+    int err = checkpointer->start(connection->path);
+    if (err != SQLITE_OK) {
+        delete checkpointer;
+        throw_sqlite3_exception_errcode(err, "Could not start checkpointer");
+        return;
+    }
+    connection->checkpointer = checkpointer;
 }
 
-static void nativeResetCancel(KLong connectionPtr,
-        KBoolean cancelable) {
+static void nativeGetCheckpointStats(KLong connectionPtr, KRef outStats) {
     auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
-    connection->canceled = false;
-
-    if (cancelable) {
-        sqlite3_progress_handler(connection->db, 4, sqliteProgressHandlerCallback,
-                connection);
+    ArrayHeader* stats = outStats->array();
+    RuntimeAssert(stats->count_ >= CHECKPOINT_STAT_SIZE, "Stats array too small");
+    KLong* out = PrimitiveArrayAddressOfElementAt<KLong>(stats, 0);
+    if (connection->checkpointer != NULL) {
+        connection->checkpointer->getStats(out);
     } else {
-        sqlite3_progress_handler(connection->db, 0, NULL, NULL);
+        memset(out, 0, sizeof(KLong) * CHECKPOINT_STAT_SIZE);
     }
 }
 
-extern "C"{
-KLong Android_Database_SQLiteConnection_nativeOpen(KRef thiz, KString pathStr, KInt openFlags,
-                                                   KString labelStr, KBoolean enableTrace, KBoolean enableProfile, KInt lookasideSz,
-KInt lookasideCnt)
-{
-    return nativeOpen(pathStr, openFlags,
-                      labelStr, enableTrace, enableProfile, lookasideSz, lookasideCnt);
+static void nativeSetRowCountCacheSize(KLong connectionPtr, KInt cacheSize) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    connection->rowCountCache.clear();
+    connection->rowCountCacheSize = cacheSize > 0 ? static_cast<size_t>(cacheSize) : 0;
 }
 
-void Android_Database_SQLiteConnection_nativeClose(KRef thiz, KLong connectionPtr)
-{
-    nativeClose(connectionPtr);
-}
+/*
+ * Starts the result cache over with room for maxBytes, or turns it off at 0. Only while nothing
+ * runs on the readers, as when the connection is being configured.
+ */
+static void nativeSetResultCacheSize(KLong connectionPtr, KInt maxBytes, KInt maxSqlCacheSize) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    delete connection->resultCache;
+    connection->resultCache = NULL;
 
-KLong Android_Database_SQLiteConnection_nativePrepareStatement(KRef thiz, KLong connectionPtr, KString sqlString)
-{
-    return nativePrepareStatement(connectionPtr, sqlString);
+    KStdVector<SQLiteConnection*> connections(1, connection);
+    if (connection->readers != NULL) {
+        for (auto reader : connection->readers->all()) {
+            connections.push_back(reader->connection);
+        }
+    }
+    size_t maxStatements = static_cast<size_t>(maxSqlCacheSize)
+            + (connections.size() - 1) * READER_STATEMENT_CACHE_SIZE;
+    ResultCache* cache = maxBytes > 0
+            ? new ResultCache(static_cast<size_t>(maxBytes), maxStatements) : NULL;
+    for (auto target : connections) {
+        target->resultCache = cache;
+        int err = cache != NULL ? target->dependencies.install(target->db)
+                : sqlite3_set_authorizer(target->db, NULL, NULL);
+        if (err != SQLITE_OK) {
+            ALOGE("Could not set the authorizer on %p: %d", target->db, err);
+        }
+    }
+    if (cache != NULL) {
+        cache->start(connection->db);
+    }
+    updateWriterHooks(connection);
 }
 
-void Android_Database_SQLiteConnection_nativeFinalizeStatement(KLong connectionPtr, KLong statementPtr)
-{
-    nativeFinalizeStatement(connectionPtr, statementPtr);
+static void nativeClearResultCache(KLong connectionPtr) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    if (connection->resultCache != NULL) {
+        connection->resultCache->clear();
+    }
 }
 
-KInt Android_Database_SQLiteConnection_nativeGetParameterCount(KRef thiz,
-                                                               KLong connectionPtr, KLong statementPtr)
-{
-    return nativeGetParameterCount(connectionPtr, statementPtr);
+static void nativeGetResultCacheStats(KLong connectionPtr, KRef outStats) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    ArrayHeader* stats = outStats->array();
+    RuntimeAssert(stats->count_ >= RESULT_CACHE_STAT_SIZE, "Stats array too small");
+    KLong* out = PrimitiveArrayAddressOfElementAt<KLong>(stats, 0);
+    if (connection->resultCache != NULL) {
+        connection->resultCache->getStats(out);
+    } else {
+        memset(out, 0, sizeof(KLong) * RESULT_CACHE_STAT_SIZE);
+    }
 }
 
-KBoolean Android_Database_SQLiteConnection_nativeIsReadOnly(KRef thiz,
-                                                            KLong connectionPtr, KLong statementPtr)
-{
-    return nativeIsReadOnly(connectionPtr, statementPtr);
+/*
+ * Starts the slow query log over, keeping the last capacity runs that took thresholdMs or more,
+ * or turns it off at 0. Only while nothing runs on the readers, as when the connection is being
+ * configured.
+ */
+static void nativeSetSlowQueryLog(KLong connectionPtr, KInt thresholdMs, KInt capacity) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    delete connection->slowQueries;
+    connection->slowQueries = NULL;
+    if (thresholdMs > 0) {
+        connection->slowQueries = new SlowQueryLog(connection->path,
+                !(connection->openFlags & SQLiteConnection::NO_LOCALIZED_COLLATORS),
+                static_cast<uint64_t>(thresholdMs) * 1000, capacity > 0 ? capacity : 1);
+    }
+    if (connection->readers != NULL) {
+        for (auto reader : connection->readers->all()) {
+            reader->connection->slowQueries = connection->slowQueries;
+        }
+    }
 }
 
-KInt Android_Database_SQLiteConnection_nativeGetColumnCount(KRef thiz,
-                                                            KLong connectionPtr, KLong statementPtr)
-{
-    return nativeGetColumnCount(connectionPtr, statementPtr);
+static void nativeClearSlowQueries(KLong connectionPtr) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    if (connection->slowQueries != NULL) {
+        connection->slowQueries->clear();
+    }
 }
 
-OBJ_GETTER(Android_Database_SQLiteConnection_nativeGetColumnName, KRef thiz, KLong connectionPtr, KLong statementPtr, KInt index){
-    auto * statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+// 0 while the log is off.
+static KLong nativeGetSlowQueries(KLong connectionPtr) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    if (connection->slowQueries == NULL)
+        return 0;
+    return reinterpret_cast<KLong>(connection->slowQueries->snapshot());
+}
 
-    const auto * name = static_cast<const KChar*>(sqlite3_column_name16(statement, index));
-    if (name) {
-        size_t size = lengthOfString(name);
-        ArrayHeader* result = AllocArrayInstance(
-                theStringTypeInfo, size, OBJ_RESULT)->array();
+static void nativeResetQueryMetrics(KLong connectionPtr) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    connection->metrics->reset();
+}
 
-        memcpy(CharArrayAddressOfElementAt(result, 0),
-               name,
-               size * sizeof(KChar));
+static KLong nativeGetQueryMetrics(KLong connectionPtr, KInt order) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    return reinterpret_cast<KLong>(connection->metrics->snapshot(order));
+}
 
-        RETURN_OBJ(result->obj());
+// Starts a subscription to the changes committed through the connection.
+static KLong nativeSubscribeToChanges(KLong connectionPtr, KInt capacity) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    if (connection->changes == NULL) {
+        connection->changes = new ChangeTracker();
+        connection->changes->start(connection->db);
+        updateWriterHooks(connection);
     }
-
-    RETURN_OBJ(nullptr);
+    return reinterpret_cast<KLong>(connection->changes->subscribe(capacity > 0 ? capacity : 1));
 }
 
-void Android_Database_SQLiteConnection_nativeBindNull(KRef thiz,
-                                                      KLong connectionPtr, KLong statementPtr, KInt index)
-{
-    nativeBindNull(connectionPtr, statementPtr, index);
-}
+static void nativeSetBusyPolicy(KLong connectionPtr, KInt timeoutMs, KInt maxBackoffMs) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
 
-void Android_Database_SQLiteConnection_nativeBindLong(KRef thiz,
-                                                      KLong connectionPtr, KLong statementPtr, KInt index, KLong value)
-{
-    nativeBindLong(connectionPtr, statementPtr, index, value);
+    BusyPolicy policy = DEFAULT_BUSY_POLICY;
+    policy.timeoutMs = timeoutMs;
+    policy.maxBackoffUs = maxBackoffMs * 1000;
+    if (policy.maxBackoffUs < policy.initialBackoffUs) {
+        policy.maxBackoffUs = policy.initialBackoffUs;
+    }
+    int err = connection->contention.setBusyPolicy(policy);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception(connection->db, "Could not set busy handler");
+    }
 }
 
-void Android_Database_SQLiteConnection_nativeBindDouble(KRef thiz,
-                                                        KLong connectionPtr, KLong statementPtr, KInt index, KDouble value)
-{
-    nativeBindDouble(connectionPtr, statementPtr, index, value);
+static void nativeGetContentionStats(KLong connectionPtr, KRef outStats) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    ArrayHeader* stats = outStats->array();
+    RuntimeAssert(stats->count_ >= CONTENTION_STAT_SIZE, "Stats array too small");
+    connection->contention.getStats(PrimitiveArrayAddressOfElementAt<KLong>(stats, 0));
 }
 
-void Android_Database_SQLiteConnection_nativeBindString(KRef thiz,
-                                                        KLong connectionPtr, KLong statementPtr, KInt index, KString valueString)
-{
-    nativeBindString(connectionPtr, statementPtr, index, valueString);
-}
+namespace {
+
+// Hands a reader back to its pool, with its statement reset and unbound.
+class ReaderLease {
+public:
+    ReaderLease(ReaderPool* pool, ReaderConnection* reader) :
+        pool_(pool), reader_(reader), statement_(NULL) { }
+
+    ~ReaderLease() {
+        if (statement_ != NULL) {
+            sqlite3_reset(statement_);
+            sqlite3_clear_bindings(statement_);
+        }
+        pool_->release(reader_);
+    }
+
+    void use(sqlite3_stmt* statement) {
+        statement_ = statement;
+    }
+
+private:
+    ReaderPool* pool_;
+    ReaderConnection* reader_;
+    sqlite3_stmt* statement_;
+};
 
-void Android_Database_SQLiteConnection_nativeBindBlob(KRef thiz,
-                                                      KLong connectionPtr, KLong statementPtr, KInt index, KConstRef valueArray)
-{
-    nativeBindBlob(connectionPtr, statementPtr, index, valueArray);
 }
 
-void Android_Database_SQLiteConnection_nativeResetStatementAndClearBindings(KRef thiz,
-                                                                            KLong connectionPtr, KLong statementPtr)
-{
-    nativeResetStatementAndClearBindings(connectionPtr, statementPtr);
+/*
+ * Returns NULL when the reader can't prepare the SQL. Readers don't see the writer's TEMP schema,
+ * ATTACHed databases or connection-only PRAGMAs, so the query is left to the writer, which
+ * reports the error if it really is one.
+ */
+static sqlite3_stmt* prepareOnReader(ReaderConnection* reader, const KStdString& sql) {
+    if (reader->statements.exists(sql)) {
+        return reader->statements.get(sql);
+    }
+
+    sqlite3_stmt* statement;
+    int err = prepareTracked(reader->connection, [&]() {
+        return sqlite3_prepare_v2(reader->connection->db, sql.c_str(), sql.size(), &statement, NULL);
+    }, &statement);
+    if (err != SQLITE_OK) {
+        return NULL;
+    }
+
+    sqlite3_stmt* evicted = reader->statements.put(sql, statement);
+    if (evicted != NULL) {
+        sqlite3_finalize(evicted);
+    }
+    return statement;
 }
 
-void Android_Database_SQLiteConnection_nativeExecute(KRef thiz,
-                                                     KLong connectionPtr, KLong statementPtr)
-{
-    nativeExecute(connectionPtr, statementPtr);
+/*
+ * The error for arguments that don't match the statement's parameters. Callers compare the counts
+ * themselves, so they can give back what they hold before this throws.
+ */
+static void throwBindCountMismatch(int expected, int provided) {
+    char message[96];
+    snprintf(message, sizeof(message), "Expected %d bind arguments but %d were provided.",
+            expected, provided);
+    throw_sqlite3_exception(message);
 }
 
-KInt Android_Database_SQLiteConnection_nativeExecuteForChangedRowCount(KRef thiz,
-                                                                       KLong connectionPtr, KLong statementPtr)
-{
-    return nativeExecuteForChangedRowCount(connectionPtr, statementPtr);
+/*
+ * Fills a window on one of the writer's reader connections, the same way
+ * nativeExecuteForCursorWindow does on the writer itself. Does nothing and returns -1 when the
+ * query has to stay on the writer: there are no readers or none is idle, or the statement can't be
+ * prepared on the reader or isn't read-only. Queries inside a transaction, which must see its uncommitted changes,
+ * are kept on the writer by the caller, which knows under the session lock.
+ */
+static KLong nativeExecuteForCursorWindowOnReader(KLong connectionPtr, KString sqlString,
+        KConstRef typesArray, KConstRef valuesArray, KConstRef objectsArray, KLong windowPtr,
+        KInt startPos, KInt requiredPos, KBoolean countAllRows, KConstRef columnMask) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    ReaderPool* pool = connection->readers;
+    if (pool == NULL) {
+        return -1;
+    }
+
+    ReaderConnection* reader = pool->tryAcquire();
+    if (reader == NULL) {
+        return -1;
+    }
+    ReaderLease lease(pool, reader);
+
+    sqlite3_stmt* statement = prepareOnReader(reader, Utf8StdStringFromKString(sqlString));
+    if (statement == NULL || !sqlite3_stmt_readonly(statement)) {
+        return -1;
+    }
+    lease.use(statement);
+
+    int argumentCount = static_cast<int>(typesArray->array()->count_);
+    int parameterCount = sqlite3_bind_parameter_count(statement);
+    if (argumentCount != parameterCount) {
+        throwBindCountMismatch(parameterCount, argumentCount);
+        return -1;
+    }
+    // The lease clears the bindings before this returns, so nothing needs pinning.
+    bindArgumentArrays(reader->connection, statement, typesArray, valuesArray, objectsArray, false);
+
+    return nativeExecuteForCursorWindow(reinterpret_cast<KLong>(reader->connection),
+            reinterpret_cast<KLong>(statement), windowPtr, startPos, requiredPos, countAllRows,
+            columnMask);
 }
 
-KLong Android_Database_SQLiteConnection_nativeExecuteForLastInsertedRowId(KRef thiz,
-                                                                          KLong connectionPtr, KLong statementPtr)
-{
-    return nativeExecuteForLastInsertedRowId(connectionPtr, statementPtr);
+/*
+ * A bind argument copied out of its Kotlin object, so that it can be bound on a native thread.
+ * Text is kept as UTF-8 under BIND_TYPE_STRING, blobs under BIND_TYPE_BLOB.
+ */
+struct CopiedArgument {
+    KByte type;
+    KLong value;
+    KStdString bytes;
+};
+
+static void copyArgumentArrays(KConstRef typesArray, KConstRef valuesArray, KConstRef objectsArray,
+        KStdVector<CopiedArgument>* outArguments) {
+    const ArrayHeader* typesHeader = typesArray->array();
+    uint32_t count = typesHeader->count_;
+    const KByte* types = ByteArrayAddressOfElementAt(typesHeader, 0);
+    const KLong* values = PrimitiveArrayAddressOfElementAt<KLong>(valuesArray->array(), 0);
+    const KRef* objects = ArrayAddressOfElementAt(objectsArray->array(), 0);
+
+    outArguments->resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        CopiedArgument& argument = (*outArguments)[i];
+        argument.type = types[i];
+        argument.value = values[i];
+        switch (types[i]) {
+            case BIND_TYPE_STRING:
+                argument.bytes = Utf8StdStringFromKString(reinterpret_cast<KString>(objects[i]));
+                break;
+            case BIND_TYPE_STRING_UTF8_STATIC:
+            case BIND_TYPE_BLOB:
+            case BIND_TYPE_BLOB_STATIC: {
+                const ArrayHeader* bytes = objects[i]->array();
+                const KByte* data = ByteArrayAddressOfElementAt(bytes, 0);
+                argument.bytes.assign(reinterpret_cast<const char*>(data), bytes->count_);
+                argument.type = types[i] == BIND_TYPE_STRING_UTF8_STATIC ? BIND_TYPE_STRING : BIND_TYPE_BLOB;
+                break;
+            }
+            default:
+                break;
+        }
+    }
 }
 
-KLong Android_Database_SQLiteConnection_nativeExecuteForLong(KRef thiz,
-                                                             KLong connectionPtr, KLong statementPtr)
-{
-    return nativeExecuteForLong(connectionPtr, statementPtr);
+// The arguments must outlive the bindings, which are made without copying.
+static void bindCopiedArguments(SQLiteConnection* connection, sqlite3_stmt* statement,
+        const KStdVector<CopiedArgument>& arguments) {
+    for (size_t i = 0; i < arguments.size(); i++) {
+        const CopiedArgument& argument = arguments[i];
+        int index = static_cast<int>(i) + 1;
+        int err;
+        if (argument.type == BIND_TYPE_STRING) {
+            err = sqlite3_bind_text(statement, index, argument.bytes.data(), argument.bytes.size(),
+                    SQLITE_STATIC);
+        } else if (argument.type == BIND_TYPE_BLOB) {
+            err = sqlite3_bind_blob(statement, index, argument.bytes.data(), argument.bytes.size(),
+                    SQLITE_STATIC);
+        } else {
+            err = bindValue(statement, index, argument.type, argument.value, NULL, SQLITE_STATIC);
+        }
+        if (err != SQLITE_OK) {
+            char message[64];
+            snprintf(message, sizeof(message), "while binding parameter %d", index);
+            throw_sqlite3_exception(connection->db, message);
+        }
+    }
 }
 
-KLong Android_Database_SQLiteConnection_nativeExecuteForCursorWindow(KRef thiz,
-                                                                     KLong connectionPtr, KLong statementPtr, KLong windowPtr,
-                                                                     KInt startPos, KInt requiredPos, KBoolean countAllRows)
-{
-    return nativeExecuteForCursorWindow(
-            connectionPtr, statementPtr, windowPtr,
-            startPos, requiredPos, countAllRows);
+enum AsyncState {
+    ASYNC_PENDING,
+    ASYNC_DONE,
+    ASYNC_FAILED,
+};
+
+/*
+ * A window fill running on a worker thread against one of the readers. The Kotlin side holds it
+ * by token while the worker runs it; whichever of the two lets go last deletes it. Until it is
+ * done, the window belongs to the worker. The reader and its prepared statement are leased when
+ * the fill is queued and handed back when it finishes or is canceled.
+ */
+class AsyncFill : public WorkerTask {
+public:
+    AsyncFill(ReaderPool* readers, ReaderConnection* reader, sqlite3_stmt* statement,
+            CursorWindow* window, KInt startPos, KInt requiredPos, bool countAllRows) :
+        readers_(readers), reader_(reader), statement_(statement), window_(window),
+        startPos_(startPos), requiredPos_(requiredPos), countAllRows_(countAllRows),
+        state_(ASYNC_PENDING), refs_(2),
+        canceled_(false), running_(NULL), result_(0) {
+        pthread_mutex_init(&mutex_, NULL);
+        pthread_cond_init(&finished_, NULL);
+    }
+
+    ~AsyncFill() {
+        pthread_cond_destroy(&finished_);
+        pthread_mutex_destroy(&mutex_);
+    }
+
+    KStdVector<CopiedArgument> arguments;
+    // One KBoolean per column, kept as bytes since vector<bool> has no data().
+    KStdVector<KByte> columnMask;
+
+    void run() override {
+        try {
+            fill();
+        } catch (const DeferredSQLiteError& error) {
+            finish(ASYNC_FAILED, 0, &error);
+        }
+        release();
+    }
+
+    void cancel() override {
+        {
+            ReaderLease lease(readers_, reader_);
+            lease.use(statement_);
+        }
+        finish(ASYNC_FAILED, 0, &canceledError());
+        release();
+    }
+
+    bool isDone() {
+        pthread_mutex_lock(&mutex_);
+        bool done = state_ != ASYNC_PENDING;
+        pthread_mutex_unlock(&mutex_);
+        return done;
+    }
+
+    // Stops the fill at its next step if it is running, or before it starts.
+    void interrupt() {
+        pthread_mutex_lock(&mutex_);
+        canceled_ = true;
+        if (running_ != NULL) {
+            sqlite3_interrupt(running_);
+        }
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    // Waits for the fill to finish. Returns its result, or copies out the error and returns -1.
+    KLong await(DeferredSQLiteError* outError) {
+        pthread_mutex_lock(&mutex_);
+        while (state_ == ASYNC_PENDING) {
+            pthread_cond_wait(&finished_, &mutex_);
+        }
+        KLong result = result_;
+        if (state_ == ASYNC_FAILED) {
+            *outError = error_;
+            result = -1;
+        }
+        pthread_mutex_unlock(&mutex_);
+        return result;
+    }
+
+    void release() {
+        pthread_mutex_lock(&mutex_);
+        bool last = --refs_ == 0;
+        pthread_mutex_unlock(&mutex_);
+        if (last) {
+            delete this;
+        }
+    }
+
+private:
+    static const DeferredSQLiteError& canceledError() {
+        static const DeferredSQLiteError error = { SQLITE_INTERRUPT, false, "", "Query canceled" };
+        return error;
+    }
+
+    void fill() {
+        ReaderLease lease(readers_, reader_);
+        lease.use(statement_);
+        // Stop interrupts reaching the reader before the lease hands it to someone else.
+        RunningScope running(this, reader_->connection->db);
+        if (running.canceled) {
+            finish(ASYNC_FAILED, 0, &canceledError());
+            return;
+        }
+
+        bindCopiedArguments(reader_->connection, statement_, arguments);
+        KLong result = fillWindow(reader_->connection, statement_, window_, startPos_, requiredPos_,
+                countAllRows_,
+                columnMask.empty() ? NULL : reinterpret_cast<const KBoolean*>(columnMask.data()),
+                static_cast<int>(columnMask.size()));
+        finish(ASYNC_DONE, result, NULL);
+    }
+
+    struct RunningScope {
+        RunningScope(AsyncFill* fill, sqlite3* db) : fill(fill), canceled(fill->setRunning(db)) { }
+        ~RunningScope() {
+            fill->setRunning(NULL);
+        }
+
+        AsyncFill* const fill;
+        const bool canceled;
+    };
+
+    // Returns whether the fill has been canceled.
+    bool setRunning(sqlite3* db) {
+        pthread_mutex_lock(&mutex_);
+        running_ = db;
+        bool canceled = canceled_;
+        pthread_mutex_unlock(&mutex_);
+        return canceled;
+    }
+
+    void finish(AsyncState state, KLong result, const DeferredSQLiteError* error) {
+        pthread_mutex_lock(&mutex_);
+        state_ = state;
+        result_ = result;
+        if (error != NULL) {
+            error_ = *error;
+        }
+        pthread_cond_broadcast(&finished_);
+        pthread_mutex_unlock(&mutex_);
+    }
+
+    ReaderPool* const readers_;
+    ReaderConnection* const reader_;
+    sqlite3_stmt* const statement_;
+    CursorWindow* const window_;
+    const KInt startPos_;
+    const KInt requiredPos_;
+    const bool countAllRows_;
+
+    pthread_mutex_t mutex_;
+    pthread_cond_t finished_;
+    AsyncState state_;
+    int refs_;
+    bool canceled_;
+    sqlite3* running_;
+    KLong result_;
+    DeferredSQLiteError error_;
+};
+
+/*
+ * Queues a window fill on the writer's worker threads and returns a token for it right away.
+ * Returns 0 instead, leaving the query to the writer, for the same reasons
+ * nativeExecuteForCursorWindowOnReader returns -1. The reader is leased here rather than on the
+ * worker, so a fill never waits for one.
+ */
+static KLong nativeExecuteForCursorWindowAsync(KLong connectionPtr, KString sqlString,
+        KConstRef typesArray, KConstRef valuesArray, KConstRef objectsArray, KLong windowPtr,
+        KInt startPos, KInt requiredPos, KBoolean countAllRows, KConstRef columnMaskArray) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    if (connection->workers == NULL) {
+        return 0;
+    }
+    ReaderPool* pool = connection->readers;
+    ReaderConnection* reader = pool->tryAcquire();
+    if (reader == NULL) {
+        return 0;
+    }
+
+    sqlite3_stmt* statement = prepareOnReader(reader, Utf8StdStringFromKString(sqlString));
+    if (statement == NULL || !sqlite3_stmt_readonly(statement)) {
+        pool->release(reader);
+        return 0;
+    }
+    int argumentCount = static_cast<int>(typesArray->array()->count_);
+    int parameterCount = sqlite3_bind_parameter_count(statement);
+    if (argumentCount != parameterCount) {
+        pool->release(reader);
+        throwBindCountMismatch(parameterCount, argumentCount);
+        return 0;
+    }
+
+    auto fill = new AsyncFill(pool, reader, statement, reinterpret_cast<CursorWindow*>(windowPtr),
+            startPos, requiredPos, countAllRows);
+    copyArgumentArrays(typesArray, valuesArray, objectsArray, &fill->arguments);
+    if (columnMaskArray != NULL) {
+        const ArrayHeader* maskHeader = columnMaskArray->array();
+        const KByte* mask = reinterpret_cast<const KByte*>(
+                PrimitiveArrayAddressOfElementAt<KBoolean>(maskHeader, 0));
+        fill->columnMask.assign(mask, mask + maskHeader->count_);
+    }
+    connection->workers->submit(fill);
+    return reinterpret_cast<KLong>(fill);
+}
+
+static KBoolean nativeAsyncIsDone(KLong tokenPtr) {
+    return reinterpret_cast<AsyncFill*>(tokenPtr)->isDone();
+}
+
+static void nativeAsyncInterrupt(KLong tokenPtr) {
+    reinterpret_cast<AsyncFill*>(tokenPtr)->interrupt();
+}
+
+// Waits for the fill and gives up the token, which must not be used again.
+static KLong nativeAsyncAwait(KLong tokenPtr) {
+    auto fill = reinterpret_cast<AsyncFill*>(tokenPtr);
+    DeferredSQLiteError error;
+    KLong result = fill->await(&error);
+    fill->release();
+    if (result < 0) {
+        error.rethrow();
+    }
+    return result;
+}
+
+/*
+ * A query stepped one row at a time for a forward-only cursor, with its rows read straight from
+ * the statement instead of copied into a window. Runs on a reader leased for as long as the
+ * stream is open when the writer has readers and the caller allows it, which it doesn't inside a
+ * transaction, and on the writer otherwise. The caller serializes steps on the writer with the writer's other work.
+ *
+ * Kotlin owns the stream, but closing the writer closes the streams opened from it first. Both
+ * kinds of close go through gStreamsLock, so neither can see the stream half closed.
+ */
+struct SQLiteStream {
+    SQLiteConnection* owner;
+    SQLiteConnection* connection;
+    ReaderConnection* reader;
+    sqlite3_stmt* statement;
+    KStdVector<CopiedArgument> arguments;
+    bool done;
+};
+
+static pthread_mutex_t gStreamsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Call with gStreamsLock held.
+static void finishStream(SQLiteStream* stream) {
+    if (stream->statement == NULL) {
+        return;
+    }
+    if (stream->reader != NULL) {
+        // The statement stays in the reader's cache.
+        sqlite3_reset(stream->statement);
+        sqlite3_clear_bindings(stream->statement);
+        stream->owner->readers->release(stream->reader);
+    } else {
+        sqlite3_finalize(stream->statement);
+    }
+    stream->statement = NULL;
+    stream->reader = NULL;
+    stream->owner = NULL;
+}
+
+static void closeStreams(SQLiteConnection* connection) {
+    pthread_mutex_lock(&gStreamsLock);
+    for (auto stream : connection->streams) {
+        finishStream(stream);
+    }
+    connection->streams.clear();
+    pthread_mutex_unlock(&gStreamsLock);
+}
+
+static sqlite3_stmt* streamStatement(KLong streamPtr) {
+    auto stream = reinterpret_cast<SQLiteStream*>(streamPtr);
+    if (stream->statement == NULL) {
+        throw_sqlite3_exception("The stream has been closed.");
+    }
+    return stream->statement;
+}
+
+static KLong nativeOpenStream(KLong connectionPtr, KString sqlString,
+        KConstRef typesArray, KConstRef valuesArray, KConstRef objectsArray, KBoolean useReaders) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    KStdString sql = Utf8StdStringFromKString(sqlString);
+
+    auto stream = new SQLiteStream();
+    stream->owner = connection;
+    stream->connection = connection;
+    stream->reader = NULL;
+    stream->statement = NULL;
+    stream->done = false;
+    copyArgumentArrays(typesArray, valuesArray, objectsArray, &stream->arguments);
+
+    try {
+        if (connection->readers != NULL && useReaders) {
+            ReaderConnection* reader = connection->readers->tryAcquire();
+            sqlite3_stmt* statement = reader != NULL ? prepareOnReader(reader, sql) : NULL;
+            if (statement != NULL && sqlite3_stmt_readonly(statement)) {
+                stream->connection = reader->connection;
+                stream->reader = reader;
+                stream->statement = statement;
+            } else if (reader != NULL) {
+                connection->readers->release(reader);
+            }
+        }
+
+        if (stream->statement == NULL) {
+            int err = sqlite3_prepare_v2(connection->db, sql.c_str(), sql.size(), &stream->statement, NULL);
+            if (err != SQLITE_OK) {
+                std::string message(", while compiling: ");
+                message.append(sql.c_str(), sql.size());
+                throw_sqlite3_exception(connection->db, message.c_str());
+            }
+        }
+
+        int parameterCount = sqlite3_bind_parameter_count(stream->statement);
+        if (static_cast<size_t>(parameterCount) != stream->arguments.size()) {
+            throwBindCountMismatch(parameterCount, static_cast<int>(stream->arguments.size()));
+        }
+        bindCopiedArguments(stream->connection, stream->statement, stream->arguments);
+    } catch (...) {
+        pthread_mutex_lock(&gStreamsLock);
+        finishStream(stream);
+        pthread_mutex_unlock(&gStreamsLock);
+        delete stream;
+        throw;
+    }
+
+    pthread_mutex_lock(&gStreamsLock);
+    connection->streams.push_back(stream);
+    pthread_mutex_unlock(&gStreamsLock);
+    return reinterpret_cast<KLong>(stream);
+}
+
+static KBoolean nativeStreamIsOnReader(KLong streamPtr) {
+    return reinterpret_cast<SQLiteStream*>(streamPtr)->reader != NULL;
+}
+
+// Advances to the next row. False once there are no more.
+static KBoolean nativeStreamStep(KLong streamPtr) {
+    auto stream = reinterpret_cast<SQLiteStream*>(streamPtr);
+    sqlite3_stmt* statement = streamStatement(streamPtr);
+    if (stream->done) {
+        return false;
+    }
+    int err = sqlite3_stmt_busy(statement) ? sqlite3_step(statement)
+            : stepFirst(stream->connection, statement);
+    if (err == SQLITE_ROW) {
+        return true;
+    }
+    // Stepping again would start the query over.
+    stream->done = true;
+    if (err != SQLITE_DONE) {
+        throw_sqlite3_exception(stream->connection->db);
+    }
+    return false;
+}
+
+static void nativeStreamClose(KLong streamPtr) {
+    auto stream = reinterpret_cast<SQLiteStream*>(streamPtr);
+    pthread_mutex_lock(&gStreamsLock);
+    if (stream->owner != NULL) {
+        KStdVector<SQLiteStream*>& streams = stream->owner->streams;
+        for (auto it = streams.begin(); it != streams.end(); ++it) {
+            if (*it == stream) {
+                streams.erase(it);
+                break;
+            }
+        }
+        finishStream(stream);
+    }
+    pthread_mutex_unlock(&gStreamsLock);
+    delete stream;
+}
+
+/*
+ * Fills outStatus with DB_STATUS_SIZE slots for the connection, then for each of its readers
+ * that isn't leased. Readers in use would be read from a second thread, which multi-thread mode
+ * doesn't allow, so they are left out. Returns the number of connections filled.
+ */
+static KInt nativeGetDbStatus(KLong connectionPtr, KBoolean reset, KRef outStatus) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    ArrayHeader* status = outStatus->array();
+    size_t capacity = status->count_ / DB_STATUS_SIZE;
+    RuntimeAssert(capacity >= 1, "Status array too small");
+    KLong* out = PrimitiveArrayAddressOfElementAt<KLong>(status, 0);
+
+    getDbStatus(connection->db, reset, out);
+    size_t count = 1;
+    if (connection->readers != NULL) {
+        connection->readers->forEachIdle([&](ReaderConnection* reader) {
+            if (count < capacity) {
+                getDbStatus(reader->connection->db, reset, out + count * DB_STATUS_SIZE);
+                count++;
+            }
+        });
+    }
+    return static_cast<KInt>(count);
+}
+
+static void nativeCancel(KLong connectionPtr) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    connection->canceled = true;
+}
+
+static void nativeResetCancel(KLong connectionPtr,
+        KBoolean cancelable) {
+    auto connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+    connection->canceled = false;
+
+    if (cancelable) {
+        sqlite3_progress_handler(connection->db, 4, sqliteProgressHandlerCallback,
+                connection);
+    } else {
+        sqlite3_progress_handler(connection->db, 0, NULL, NULL);
+    }
+}
+
+extern "C"{
+KLong Android_Database_SQLiteConnection_nativeOpen(KRef thiz, KString pathStr, KInt openFlags,
+                                                   KString labelStr, KBoolean enableTrace, KBoolean enableProfile, KInt lookasideSz,
+KInt lookasideCnt, KInt pageCacheBytes)
+{
+    return nativeOpen(pathStr, openFlags,
+                      labelStr, enableTrace, enableProfile, lookasideSz, lookasideCnt,
+                      pageCacheBytes);
+}
+
+void Android_Database_SQLiteConnection_nativeClose(KRef thiz, KLong connectionPtr)
+{
+    nativeClose(connectionPtr);
+}
+
+/**
+ * Prepares the statement and gathers everything SQLiteConnection needs to know about it in one call.
+ * The statement pointer, parameter count and read-only flag are written to outInfo (a LongArray indexed
+ * by the PREPARE_INFO_* slots) and the column names are returned. The statement pointer is written first,
+ * so if building the names fails the caller can still finalize it.
+ */
+OBJ_GETTER(Android_Database_SQLiteConnection_nativePrepareStatementWithInfo, KRef thiz,
+           KLong connectionPtr, KString sqlString, KRef outInfo)
+{
+    RuntimeAssert(outInfo->array()->count_ >= PREPARE_INFO_SIZE, "Statement info array too small");
+
+    KLong statementPtr = nativePrepareStatement(connectionPtr, sqlString);
+    auto statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
+
+    KLong* info = PrimitiveArrayAddressOfElementAt<KLong>(outInfo->array(), 0);
+    info[PREPARE_INFO_STATEMENT_PTR] = statementPtr;
+    info[PREPARE_INFO_NUM_PARAMETERS] = sqlite3_bind_parameter_count(statement);
+    info[PREPARE_INFO_READ_ONLY] = sqlite3_stmt_readonly(statement) != 0 ? 1 : 0;
+
+    int columnCount = sqlite3_column_count(statement);
+    ArrayHeader* names = AllocArrayInstance(theArrayTypeInfo, columnCount, OBJ_RESULT)->array();
+    for (int i = 0; i < columnCount; i++) {
+        const auto * name = static_cast<const KChar*>(sqlite3_column_name16(statement, i));
+        if (!name) {
+            throw_sqlite3_exception_errcode(SQLITE_NOMEM, "Could not read column name");
+        }
+        ObjHolder holder;
+        createStringFromUtf16(name, holder.slot());
+        UpdateRef(ArrayAddressOfElementAt(names, i), holder.obj());
+    }
+
+    RETURN_OBJ(names->obj());
+}
+
+void Android_Database_SQLiteConnection_nativeFinalizeStatement(KLong connectionPtr, KLong statementPtr)
+{
+    nativeFinalizeStatement(connectionPtr, statementPtr);
+}
+
+KBoolean Android_Database_SQLiteConnection_nativeWasReprepared(KRef thiz,
+                                                               KLong connectionPtr, KLong statementPtr)
+{
+    return nativeWasReprepared(connectionPtr, statementPtr);
+}
+
+void Android_Database_SQLiteConnection_nativeBindArguments(KRef thiz,
+                                                           KLong connectionPtr, KLong statementPtr,
+                                                           KConstRef types, KConstRef values, KConstRef objects)
+{
+    nativeBindArguments(connectionPtr, statementPtr, types, values, objects);
+}
+
+void Android_Database_SQLiteConnection_nativeExecuteBatch(KRef thiz,
+                                                         KLong connectionPtr, KLong statementPtr,
+                                                         KConstRef kinds, KConstRef columns, KInt rowCount,
+                                                         KBoolean returnRowIds, KRef outResults)
+{
+    nativeExecuteBatch(connectionPtr, statementPtr, kinds, columns, rowCount, returnRowIds, outResults);
+}
+
+void Android_Database_SQLiteConnection_nativeResetStatementAndClearBindings(KRef thiz,
+                                                                            KLong connectionPtr, KLong statementPtr)
+{
+    nativeResetStatementAndClearBindings(connectionPtr, statementPtr);
+}
+
+void Android_Database_SQLiteConnection_nativeExecute(KRef thiz,
+                                                     KLong connectionPtr, KLong statementPtr)
+{
+    nativeExecute(connectionPtr, statementPtr);
+}
+
+KInt Android_Database_SQLiteConnection_nativeExecuteForChangedRowCount(KRef thiz,
+                                                                       KLong connectionPtr, KLong statementPtr)
+{
+    return nativeExecuteForChangedRowCount(connectionPtr, statementPtr);
+}
+
+KLong Android_Database_SQLiteConnection_nativeExecuteForLastInsertedRowId(KRef thiz,
+                                                                          KLong connectionPtr, KLong statementPtr)
+{
+    return nativeExecuteForLastInsertedRowId(connectionPtr, statementPtr);
+}
+
+KLong Android_Database_SQLiteConnection_nativeExecuteForLong(KRef thiz,
+                                                             KLong connectionPtr, KLong statementPtr)
+{
+    return nativeExecuteForLong(connectionPtr, statementPtr);
+}
+
+KLong Android_Database_SQLiteConnection_nativeExecuteForCursorWindow(KRef thiz,
+                                                                     KLong connectionPtr, KLong statementPtr, KLong windowPtr,
+                                                                     KInt startPos, KInt requiredPos, KBoolean countAllRows,
+                                                                     KConstRef columnMask)
+{
+    return nativeExecuteForCursorWindow(
+            connectionPtr, statementPtr, windowPtr,
+            startPos, requiredPos, countAllRows, columnMask);
+}
+
+void Android_Database_SQLiteConnection_nativeSetRowCountCacheSize(KRef thiz,
+                                                                 KLong connectionPtr, KInt cacheSize)
+{
+    nativeSetRowCountCacheSize(connectionPtr, cacheSize);
+}
+
+void Android_Database_SQLiteConnection_nativeSetResultCacheSize(KRef thiz,
+                                                                KLong connectionPtr, KInt maxBytes,
+                                                                KInt maxSqlCacheSize)
+{
+    nativeSetResultCacheSize(connectionPtr, maxBytes, maxSqlCacheSize);
+}
+
+void Android_Database_SQLiteConnection_nativeClearResultCache(KRef thiz, KLong connectionPtr)
+{
+    nativeClearResultCache(connectionPtr);
+}
+
+void Android_Database_SQLiteConnection_nativeGetResultCacheStats(KRef thiz,
+                                                                KLong connectionPtr, KRef outStats)
+{
+    nativeGetResultCacheStats(connectionPtr, outStats);
+}
+
+void Android_Database_SQLiteConnection_nativeSetSlowQueryLog(KRef thiz, KLong connectionPtr,
+                                                             KInt thresholdMs, KInt capacity)
+{
+    nativeSetSlowQueryLog(connectionPtr, thresholdMs, capacity);
+}
+
+void Android_Database_SQLiteConnection_nativeClearSlowQueries(KRef thiz, KLong connectionPtr)
+{
+    nativeClearSlowQueries(connectionPtr);
+}
+
+// Read entry by entry and released like query metrics snapshots.
+KLong Android_Database_SQLiteConnection_nativeGetSlowQueries(KRef thiz, KLong connectionPtr)
+{
+    return nativeGetSlowQueries(connectionPtr);
+}
+
+KInt Android_Database_SQLiteConnection_nativeSlowQueriesCount(KRef thiz, KLong snapshotPtr)
+{
+    return static_cast<KInt>(reinterpret_cast<KStdVector<SlowQuery>*>(snapshotPtr)->size());
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeSlowQuerySql, KRef thiz, KLong snapshotPtr,
+        KInt index)
+{
+    const KStdString& sql = (*reinterpret_cast<KStdVector<SlowQuery>*>(snapshotPtr))[index].sql;
+    RETURN_RESULT_OF(CreateKStringFromUtf8, sql.data(), sql.size());
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeSlowQueryArgumentTypes, KRef thiz,
+        KLong snapshotPtr, KInt index)
+{
+    const KStdString& types =
+            (*reinterpret_cast<KStdVector<SlowQuery>*>(snapshotPtr))[index].argumentTypes;
+    RETURN_RESULT_OF(CreateKStringFromUtf8, types.data(), types.size());
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeSlowQueryPlan, KRef thiz, KLong snapshotPtr,
+        KInt index)
+{
+    const KStdString& plan = (*reinterpret_cast<KStdVector<SlowQuery>*>(snapshotPtr))[index].plan;
+    RETURN_RESULT_OF(CreateKStringFromUtf8, plan.data(), plan.size());
+}
+
+void Android_Database_SQLiteConnection_nativeSlowQueryTimes(KRef thiz, KLong snapshotPtr,
+                                                            KInt index, KRef outTimes)
+{
+    const SlowQuery& query = (*reinterpret_cast<KStdVector<SlowQuery>*>(snapshotPtr))[index];
+    ArrayHeader* times = outTimes->array();
+    RuntimeAssert(times->count_ >= SLOW_QUERY_TIME_SIZE, "Times array too small");
+    KLong* out = PrimitiveArrayAddressOfElementAt<KLong>(times, 0);
+    out[SLOW_QUERY_TIME_MICROS] = query.micros;
+    out[SLOW_QUERY_TIME_FINISHED_MILLIS] = query.finishedMillis;
+}
+
+void Android_Database_SQLiteConnection_nativeSlowQueriesRelease(KRef thiz, KLong snapshotPtr)
+{
+    delete reinterpret_cast<KStdVector<SlowQuery>*>(snapshotPtr);
+}
+
+void Android_Database_SQLiteConnection_nativeResetQueryMetrics(KRef thiz, KLong connectionPtr)
+{
+    nativeResetQueryMetrics(connectionPtr);
+}
+
+// Snapshots are read query by query and released once copied into Kotlin objects.
+KLong Android_Database_SQLiteConnection_nativeGetQueryMetrics(KRef thiz, KLong connectionPtr,
+                                                              KInt order)
+{
+    return nativeGetQueryMetrics(connectionPtr, order);
+}
+
+KInt Android_Database_SQLiteConnection_nativeMetricsCount(KRef thiz, KLong snapshotPtr)
+{
+    return static_cast<KInt>(reinterpret_cast<KStdVector<QueryStats>*>(snapshotPtr)->size());
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeMetricsSql, KRef thiz, KLong snapshotPtr, KInt index)
+{
+    const KStdString& sql = (*reinterpret_cast<KStdVector<QueryStats>*>(snapshotPtr))[index].sql;
+    RETURN_RESULT_OF(CreateKStringFromUtf8, sql.data(), sql.size());
+}
+
+void Android_Database_SQLiteConnection_nativeMetricsStats(KRef thiz, KLong snapshotPtr, KInt index,
+                                                          KRef outStats)
+{
+    const QueryStats& query = (*reinterpret_cast<KStdVector<QueryStats>*>(snapshotPtr))[index];
+    ArrayHeader* stats = outStats->array();
+    RuntimeAssert(stats->count_ >= QUERY_PHASE_COUNT * LATENCY_STAT_SIZE, "Stats array too small");
+    memcpy(PrimitiveArrayAddressOfElementAt<KLong>(stats, 0), query.latencies,
+            sizeof(query.latencies));
+}
+
+void Android_Database_SQLiteConnection_nativeMetricsCounters(KRef thiz, KLong snapshotPtr,
+                                                             KInt index, KRef outCounters)
+{
+    const QueryStats& query = (*reinterpret_cast<KStdVector<QueryStats>*>(snapshotPtr))[index];
+    ArrayHeader* counters = outCounters->array();
+    RuntimeAssert(counters->count_ >= STATEMENT_STAT_SIZE, "Counters array too small");
+    memcpy(PrimitiveArrayAddressOfElementAt<KLong>(counters, 0), query.counters,
+            sizeof(query.counters));
+}
+
+void Android_Database_SQLiteConnection_nativeMetricsRelease(KRef thiz, KLong snapshotPtr)
+{
+    delete reinterpret_cast<KStdVector<QueryStats>*>(snapshotPtr);
+}
+
+KLong Android_Database_SQLiteConnection_nativeSubscribeToChanges(KRef thiz,
+                                                                 KLong connectionPtr, KInt capacity)
+{
+    return nativeSubscribeToChanges(connectionPtr, capacity);
+}
+
+// Batches are read field by field and released once copied into Kotlin objects.
+KLong Android_Database_SQLiteConnection_nativeChangesPoll(KRef thiz, KLong subscriptionPtr)
+{
+    return reinterpret_cast<KLong>(reinterpret_cast<ChangeSubscription*>(subscriptionPtr)->poll());
+}
+
+KBoolean Android_Database_SQLiteConnection_nativeChangesIsClosed(KRef thiz, KLong subscriptionPtr)
+{
+    return reinterpret_cast<ChangeSubscription*>(subscriptionPtr)->isClosed();
+}
+
+void Android_Database_SQLiteConnection_nativeChangesClose(KRef thiz, KLong subscriptionPtr)
+{
+    auto subscription = reinterpret_cast<ChangeSubscription*>(subscriptionPtr);
+    subscription->close();
+    subscription->release();
+}
+
+KLong Android_Database_SQLiteConnection_nativeBatchSequence(KRef thiz, KLong batchPtr)
+{
+    return reinterpret_cast<ChangeBatch*>(batchPtr)->sequence;
+}
+
+KBoolean Android_Database_SQLiteConnection_nativeBatchIsComplete(KRef thiz, KLong batchPtr)
+{
+    return reinterpret_cast<ChangeBatch*>(batchPtr)->complete;
+}
+
+KInt Android_Database_SQLiteConnection_nativeBatchChangeCount(KRef thiz, KLong batchPtr)
+{
+    return static_cast<KInt>(reinterpret_cast<ChangeBatch*>(batchPtr)->changes.size());
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeBatchDatabase, KRef thiz, KLong batchPtr, KInt index)
+{
+    const KStdString& name = reinterpret_cast<ChangeBatch*>(batchPtr)->changes[index].database;
+    RETURN_RESULT_OF(CreateKStringFromUtf8, name.data(), name.size());
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeBatchTable, KRef thiz, KLong batchPtr, KInt index)
+{
+    const KStdString& name = reinterpret_cast<ChangeBatch*>(batchPtr)->changes[index].table;
+    RETURN_RESULT_OF(CreateKStringFromUtf8, name.data(), name.size());
+}
+
+KInt Android_Database_SQLiteConnection_nativeBatchOperation(KRef thiz, KLong batchPtr, KInt index)
+{
+    return reinterpret_cast<ChangeBatch*>(batchPtr)->changes[index].operation;
+}
+
+KLong Android_Database_SQLiteConnection_nativeBatchRowCount(KRef thiz, KLong batchPtr, KInt index)
+{
+    return reinterpret_cast<ChangeBatch*>(batchPtr)->changes[index].rows;
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeBatchRanges, KRef thiz, KLong batchPtr, KInt index)
+{
+    const KStdVector<KLong>& ranges = reinterpret_cast<ChangeBatch*>(batchPtr)->changes[index].ranges;
+    ArrayHeader* result = AllocArrayInstance(theLongArrayTypeInfo, ranges.size(), OBJ_RESULT)->array();
+    if (!ranges.empty()) {
+        memcpy(PrimitiveArrayAddressOfElementAt<KLong>(result, 0), ranges.data(),
+                ranges.size() * sizeof(KLong));
+    }
+    RETURN_OBJ(result->obj());
+}
+
+void Android_Database_SQLiteConnection_nativeBatchRelease(KRef thiz, KLong batchPtr)
+{
+    reinterpret_cast<ChangeBatch*>(batchPtr)->release();
+}
+
+void Android_Database_SQLiteConnection_nativeSetBusyPolicy(KRef thiz,
+                                                          KLong connectionPtr, KInt timeoutMs, KInt maxBackoffMs)
+{
+    nativeSetBusyPolicy(connectionPtr, timeoutMs, maxBackoffMs);
+}
+
+void Android_Database_SQLiteConnection_nativeGetContentionStats(KRef thiz,
+                                                               KLong connectionPtr, KRef outStats)
+{
+    nativeGetContentionStats(connectionPtr, outStats);
+}
+
+void Android_Database_SQLiteConnection_nativeStartCheckpointer(KRef thiz,
+                                                              KLong connectionPtr, KInt walFrames, KInt idleMs)
+{
+    nativeStartCheckpointer(connectionPtr, walFrames, idleMs);
+}
+
+void Android_Database_SQLiteConnection_nativeGetCheckpointStats(KRef thiz,
+                                                               KLong connectionPtr, KRef outStats)
+{
+    nativeGetCheckpointStats(connectionPtr, outStats);
+}
+
+void Android_Database_SQLiteConnection_nativeOpenReaders(KRef thiz,
+                                                        KLong connectionPtr, KInt readerCount)
+{
+    nativeOpenReaders(connectionPtr, readerCount);
+}
+
+KLong Android_Database_SQLiteConnection_nativeExecuteForCursorWindowOnReader(KRef thiz,
+                                                                             KLong connectionPtr, KString sql,
+                                                                             KConstRef types, KConstRef values, KConstRef objects,
+                                                                             KLong windowPtr, KInt startPos, KInt requiredPos,
+                                                                             KBoolean countAllRows, KConstRef columnMask)
+{
+    return nativeExecuteForCursorWindowOnReader(connectionPtr, sql, types, values, objects,
+            windowPtr, startPos, requiredPos, countAllRows, columnMask);
+}
+
+KLong Android_Database_SQLiteConnection_nativeExecuteForCursorWindowAsync(KRef thiz,
+                                                                           KLong connectionPtr, KString sql,
+                                                                           KConstRef types, KConstRef values, KConstRef objects,
+                                                                           KLong windowPtr, KInt startPos, KInt requiredPos,
+                                                                           KBoolean countAllRows, KConstRef columnMask)
+{
+    return nativeExecuteForCursorWindowAsync(connectionPtr, sql, types, values, objects,
+            windowPtr, startPos, requiredPos, countAllRows, columnMask);
+}
+
+KBoolean Android_Database_SQLiteConnection_nativeAsyncIsDone(KRef thiz, KLong tokenPtr)
+{
+    return nativeAsyncIsDone(tokenPtr);
+}
+
+void Android_Database_SQLiteConnection_nativeAsyncInterrupt(KRef thiz, KLong tokenPtr)
+{
+    nativeAsyncInterrupt(tokenPtr);
+}
+
+KLong Android_Database_SQLiteConnection_nativeAsyncAwait(KRef thiz, KLong tokenPtr)
+{
+    return nativeAsyncAwait(tokenPtr);
+}
+
+KLong Android_Database_SQLiteConnection_nativeOpenStream(KRef thiz,
+                                                         KLong connectionPtr, KString sql,
+                                                         KConstRef types, KConstRef values, KConstRef objects,
+                                                         KBoolean useReaders)
+{
+    return nativeOpenStream(connectionPtr, sql, types, values, objects, useReaders);
+}
+
+KBoolean Android_Database_SQLiteConnection_nativeStreamIsOnReader(KRef thiz, KLong streamPtr)
+{
+    return nativeStreamIsOnReader(streamPtr);
+}
+
+KBoolean Android_Database_SQLiteConnection_nativeStreamStep(KRef thiz, KLong streamPtr)
+{
+    return nativeStreamStep(streamPtr);
+}
+
+void Android_Database_SQLiteConnection_nativeStreamClose(KRef thiz, KLong streamPtr)
+{
+    nativeStreamClose(streamPtr);
+}
+
+KInt Android_Database_SQLiteConnection_nativeStreamGetColumnCount(KRef thiz, KLong streamPtr)
+{
+    return sqlite3_column_count(streamStatement(streamPtr));
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeStreamGetColumnName, KRef thiz, KLong streamPtr, KInt column)
+{
+    const auto * name = static_cast<const KChar*>(sqlite3_column_name16(streamStatement(streamPtr), column));
+    if (name) {
+        RETURN_RESULT_OF(createStringFromUtf16, name);
+    }
+    RETURN_OBJ(nullptr);
+}
+
+// Column getters for the current row. The types follow SQLite's conversions, as
+// SQLiteStatement's simple queries do, rather than CursorWindow's.
+KInt Android_Database_SQLiteConnection_nativeStreamGetType(KRef thiz, KLong streamPtr, KInt column)
+{
+    // SQLITE_INTEGER and the rest are 1 to 5, Cursor.FIELD_TYPE_* 1 to 4 with NULL as 0.
+    int type = sqlite3_column_type(streamStatement(streamPtr), column);
+    return type == SQLITE_NULL ? 0 : type;
+}
+
+KLong Android_Database_SQLiteConnection_nativeStreamGetLong(KRef thiz, KLong streamPtr, KInt column)
+{
+    return sqlite3_column_int64(streamStatement(streamPtr), column);
+}
+
+KDouble Android_Database_SQLiteConnection_nativeStreamGetDouble(KRef thiz, KLong streamPtr, KInt column)
+{
+    return sqlite3_column_double(streamStatement(streamPtr), column);
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeStreamGetString, KRef thiz, KLong streamPtr, KInt column)
+{
+    sqlite3_stmt* statement = streamStatement(streamPtr);
+    const char* text = reinterpret_cast<const char*>(sqlite3_column_text(statement, column));
+    if (text == NULL) {
+        RETURN_OBJ(nullptr);
+    }
+    RETURN_RESULT_OF(CreateKStringFromUtf8, text, sqlite3_column_bytes(statement, column));
+}
+
+OBJ_GETTER(Android_Database_SQLiteConnection_nativeStreamGetBlob, KRef thiz, KLong streamPtr, KInt column)
+{
+    sqlite3_stmt* statement = streamStatement(streamPtr);
+    if (sqlite3_column_type(statement, column) == SQLITE_NULL) {
+        RETURN_OBJ(nullptr);
+    }
+    const void* blob = sqlite3_column_blob(statement, column);
+    int size = sqlite3_column_bytes(statement, column);
+    ArrayHeader* result = AllocArrayInstance(theByteArrayTypeInfo, size, OBJ_RESULT)->array();
+    if (size > 0) {
+        memcpy(PrimitiveArrayAddressOfElementAt<KByte>(result, 0), blob, size);
+    }
+    RETURN_OBJ(result->obj());
+}
+
+// SQLite's own copy of the value as a blob, valid until the stream moves or closes.
+KLong Android_Database_SQLiteConnection_nativeStreamGetBytes(KRef thiz, KLong streamPtr, KInt column)
+{
+    return reinterpret_cast<KLong>(sqlite3_column_blob(streamStatement(streamPtr), column));
+}
+
+KInt Android_Database_SQLiteConnection_nativeStreamGetByteCount(KRef thiz, KLong streamPtr, KInt column)
+{
+    return sqlite3_column_bytes(streamStatement(streamPtr), column);
 }
 
-KInt Android_Database_SQLiteConnection_nativeGetDbLookaside(KRef thiz,
-                                                            KLong connectionPtr)
+KInt Android_Database_SQLiteConnection_nativeGetDbStatus(KRef thiz, KLong connectionPtr,
+                                                         KBoolean reset, KRef outStatus)
 {
-    return nativeGetDbLookaside(connectionPtr);
+    return nativeGetDbStatus(connectionPtr, reset, outStatus);
 }
 
 void Android_Database_SQLiteConnection_nativeCancel(KRef thiz,
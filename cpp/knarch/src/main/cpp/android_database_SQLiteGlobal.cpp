@@ -17,19 +17,23 @@
 #define LOG_TAG "SQLiteGlobal"
 
 #include "Types.h"
+#include "Assert.h"
+#include "Memory.h"
+#include "Natives.h"
 #include <mutex>
 #include <vector>
 #include <sqlite3.h>
 
+#include "SQLiteMemory.h"
 #include "android_database_SQLiteCommon.h"
 
 using namespace std;
 
 namespace android {
 
-// Limit heap to 8MB for now.  This is 4 times the maximum cursor window
-// size, as has been used by the original code in SQLiteDatabase for
-// a long time.
+// Limit heap to 8MB until SQLiteGlobal.setHeapLimits says otherwise.  This is
+// 4 times the maximum cursor window size, as has been used by the original
+// code in SQLiteDatabase for a long time.
 static const int SOFT_HEAP_LIMIT = 8 * 1024 * 1024;
 
 
@@ -66,14 +70,14 @@ static void sqliteInitialize() {
     // The soft heap limit prevents the page cache allocations from growing
     // beyond the given limit, no matter what the max page cache sizes are
     // set to. The limit does not, as of 3.5.0, affect any other allocations.
-    sqlite3_soft_heap_limit(SOFT_HEAP_LIMIT);
+    setDefaultSoftHeapLimit(SOFT_HEAP_LIMIT);
 
     // Initialize SQLite.
     sqlite3_initialize();
 }
 
 static KInt nativeReleaseMemory() {
-    return sqlite3_release_memory(SOFT_HEAP_LIMIT);
+    return sqlite3_release_memory(releasableMemory());
 }
 
 extern "C" KInt Android_Database_SQLiteGlobal_nativeReleaseMemory()
@@ -81,6 +85,28 @@ extern "C" KInt Android_Database_SQLiteGlobal_nativeReleaseMemory()
     return nativeReleaseMemory();
 }
 
+static void nativeSetHeapLimits(KLong softBytes, KLong hardBytes) {
+    setHeapLimits(softBytes, hardBytes);
+}
+
+extern "C" void Android_Database_SQLiteGlobal_nativeSetHeapLimits(KRef thiz, KLong softBytes,
+                                                                 KLong hardBytes)
+{
+    nativeSetHeapLimits(softBytes, hardBytes);
+}
+
+static void nativeGetMemoryStatus(KBoolean reset, KRef outStatus) {
+    ArrayHeader* status = outStatus->array();
+    RuntimeAssert(status->count_ >= MEMORY_STATUS_SIZE, "Status array too small");
+    getMemoryStatus(reset, PrimitiveArrayAddressOfElementAt<KLong>(status, 0));
+}
+
+extern "C" void Android_Database_SQLiteGlobal_nativeGetMemoryStatus(KRef thiz, KBoolean reset,
+                                                                   KRef outStatus)
+{
+    nativeGetMemoryStatus(reset, outStatus);
+}
+
 int register_android_database_SQLiteGlobal()
 {
     sqliteInitialize();
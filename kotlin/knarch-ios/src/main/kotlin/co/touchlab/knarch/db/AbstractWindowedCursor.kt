@@ -51,34 +51,42 @@ abstract class AbstractWindowedCursor:AbstractCursor() {
     
     override fun getBlob(columnIndex:Int):ByteArray {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getBlob(position, columnIndex)
     }
     override fun getString(columnIndex:Int):String {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getString(position, columnIndex)
     }
     override fun getShort(columnIndex:Int):Short {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getShort(position, columnIndex)
     }
     override fun getInt(columnIndex:Int):Int {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getInt(position, columnIndex)
     }
     override fun getLong(columnIndex:Int):Long {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getLong(position, columnIndex)
     }
     override fun getFloat(columnIndex:Int):Float {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getFloat(position, columnIndex)
     }
     override fun getDouble(columnIndex:Int):Double {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getDouble(position, columnIndex)
     }
     override fun isNull(columnIndex:Int):Boolean {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getType(position, columnIndex) == Cursor.FIELD_TYPE_NULL
     }
 /**
@@ -88,8 +96,16 @@ abstract class AbstractWindowedCursor:AbstractCursor() {
 
     override fun getType(columnIndex:Int):Int {
         checkPosition()
+        checkColumn(columnIndex)
         return mWindow!!.getType(position, columnIndex)
     }
+    /**
+     * Called before a column of the current row is read from the window. Subclasses that leave
+     * columns out of the window use this to bring them in.
+     */
+    protected open fun checkColumn(columnIndex:Int) {
+    }
+
     override fun checkPosition() {
         super.checkPosition()
         if (mWindow == null)
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import co.touchlab.knarch.db.CursorWindow
+
+/**
+ * A cursor window being filled on a native worker thread, see [SQLiteDatabase.fillWindowAsync].
+ *
+ * The window belongs to the worker until the fill is done: don't read, fill or close it before
+ * [await] returns. Every fill must be awaited or canceled, which frees what it holds natively.
+ */
+class SQLiteAsyncFill internal constructor(val window:CursorWindow, private var tokenPtr:Long, private var rows:Int,
+                                           private var failure:SQLiteException? = null) {
+
+    /**
+     * True once the fill has finished, so that [await] won't block.
+     */
+    fun isDone():Boolean = tokenPtr == 0L || nativeAsyncIsDone(tokenPtr)
+
+    /**
+     * Waits for the fill to finish.
+     *
+     * @return The number of rows counted, as for SQLiteCursor's window fills. The window's
+     * start position is set as well.
+     * @throws SQLiteException if the query failed or was canceled.
+     */
+    fun await():Int {
+        val token = tokenPtr
+        if (token != 0L)
+        {
+            tokenPtr = 0
+            try
+            {
+                val result = nativeAsyncAwait(token)
+                window.startPosition = (result shr 32).toInt()
+                rows = result.toInt()
+            }
+            catch (ex:SQLiteException) {
+                failure = ex
+            }
+            finally
+            {
+                window.releaseReference()
+            }
+        }
+        failure?.let { throw it }
+        return rows
+    }
+
+    /**
+     * Stops the fill, interrupting the query if it has already started, and waits for the worker
+     * to let go of the window.
+     */
+    fun cancel() {
+        if (tokenPtr != 0L)
+        {
+            nativeAsyncInterrupt(tokenPtr)
+            try
+            {
+                await()
+            }
+            catch (ex:SQLiteException) {
+                // Expected, unless the fill finished first.
+            }
+        }
+    }
+
+    companion object {
+        @SymbolName("Android_Database_SQLiteConnection_nativeAsyncIsDone")
+        private external fun nativeAsyncIsDone(tokenPtr:Long):Boolean
+        @SymbolName("Android_Database_SQLiteConnection_nativeAsyncInterrupt")
+        private external fun nativeAsyncInterrupt(tokenPtr:Long)
+        @SymbolName("Android_Database_SQLiteConnection_nativeAsyncAwait")
+        private external fun nativeAsyncAwait(tokenPtr:Long):Long
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+/**
+ * What one committed transaction changed, as delivered to a [SQLiteChangeSubscription].
+ */
+class SQLiteChangeBatch internal constructor(
+        /**
+         * Counts commits delivered to the database's subscribers, starting at 1. -1 for the
+         * batch standing in for commits a subscriber fell too far behind to receive.
+         */
+        val sequence:Long,
+        /**
+         * False when the changes below are not all there was: the transaction changed rows
+         * that can't be tracked, such as in WITHOUT ROWID tables, or commits were missed.
+         * Assume anything may have changed.
+         */
+        val complete:Boolean,
+        val changes:List<TableChange>) {
+
+    /**
+     * The rows changed in one table with one kind of operation.
+     */
+    class TableChange internal constructor(
+            /** "main", "temp" or the name of an attached database. */
+            val database:String,
+            val table:String,
+            /** One of [OPERATION_INSERT], [OPERATION_UPDATE] or [OPERATION_DELETE]. */
+            val operation:Int,
+            val rowCount:Long,
+            /**
+             * The rowids changed, as pairs of first and last in ascending order. Past 32
+             * ranges they are merged into one, which may then cover rows that didn't change.
+             */
+            val rowIdRanges:LongArray)
+
+    /**
+     * True if the table may have changed.
+     */
+    fun affects(table:String):Boolean =
+            !complete || changes.any { it.table.equals(table, ignoreCase = true) }
+
+    companion object {
+        // The values of SQLITE_INSERT, SQLITE_UPDATE and SQLITE_DELETE.
+        const val OPERATION_INSERT = 18
+        const val OPERATION_UPDATE = 23
+        const val OPERATION_DELETE = 9
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+/**
+ * A stream of the changes committed through a database, one [SQLiteChangeBatch] per
+ * transaction, see [SQLiteDatabase.subscribeToChanges].
+ *
+ * Commits queue up natively until polled, without waiting on the subscriber. Poll from one
+ * thread at a time, and close the subscription when done with it.
+ */
+class SQLiteChangeSubscription internal constructor(private var subscriptionPtr:Long) {
+
+    /**
+     * Returns the oldest batch not yet polled, or null if there is none.
+     */
+    fun poll():SQLiteChangeBatch? {
+        val subscription = subscriptionPtr
+        if (subscription == 0L)
+            return null
+        val batchPtr = nativeChangesPoll(subscription)
+        if (batchPtr == 0L)
+            return null
+        try
+        {
+            val count = nativeBatchChangeCount(batchPtr)
+            val changes = ArrayList<SQLiteChangeBatch.TableChange>(count)
+            for (i in 0 until count)
+            {
+                changes.add(SQLiteChangeBatch.TableChange(
+                        nativeBatchDatabase(batchPtr, i),
+                        nativeBatchTable(batchPtr, i),
+                        nativeBatchOperation(batchPtr, i),
+                        nativeBatchRowCount(batchPtr, i),
+                        nativeBatchRanges(batchPtr, i)))
+            }
+            return SQLiteChangeBatch(nativeBatchSequence(batchPtr), nativeBatchIsComplete(batchPtr), changes)
+        }
+        finally
+        {
+            nativeBatchRelease(batchPtr)
+        }
+    }
+
+    /**
+     * Returns every batch not yet polled, oldest first.
+     */
+    fun pollAll():List<SQLiteChangeBatch> {
+        val batches = ArrayList<SQLiteChangeBatch>()
+        while (true)
+        {
+            batches.add(poll() ?: return batches)
+        }
+    }
+
+    /**
+     * True once the subscription has ended, by [close] or by the database closing. Batches
+     * committed before that can still be polled.
+     */
+    fun isClosed():Boolean = subscriptionPtr == 0L || nativeChangesIsClosed(subscriptionPtr)
+
+    fun close() {
+        val subscription = subscriptionPtr
+        if (subscription != 0L)
+        {
+            subscriptionPtr = 0
+            nativeChangesClose(subscription)
+        }
+    }
+
+    companion object {
+        @SymbolName("Android_Database_SQLiteConnection_nativeChangesPoll")
+        private external fun nativeChangesPoll(subscriptionPtr:Long):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeChangesIsClosed")
+        private external fun nativeChangesIsClosed(subscriptionPtr:Long):Boolean
+        @SymbolName("Android_Database_SQLiteConnection_nativeChangesClose")
+        private external fun nativeChangesClose(subscriptionPtr:Long)
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchSequence")
+        private external fun nativeBatchSequence(batchPtr:Long):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchIsComplete")
+        private external fun nativeBatchIsComplete(batchPtr:Long):Boolean
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchChangeCount")
+        private external fun nativeBatchChangeCount(batchPtr:Long):Int
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchDatabase")
+        private external fun nativeBatchDatabase(batchPtr:Long, index:Int):String
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchTable")
+        private external fun nativeBatchTable(batchPtr:Long, index:Int):String
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchOperation")
+        private external fun nativeBatchOperation(batchPtr:Long, index:Int):Int
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchRowCount")
+        private external fun nativeBatchRowCount(batchPtr:Long, index:Int):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchRanges")
+        private external fun nativeBatchRanges(batchPtr:Long, index:Int):LongArray
+        @SymbolName("Android_Database_SQLiteConnection_nativeBatchRelease")
+        private external fun nativeBatchRelease(batchPtr:Long)
+    }
+}
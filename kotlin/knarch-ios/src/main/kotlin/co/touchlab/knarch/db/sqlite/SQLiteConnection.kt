@@ -38,6 +38,12 @@ class SQLiteConnection() {
 
     private val connectionPtr = kotlin.native.concurrent.AtomicReference<Long>(0L)
 
+    // Set when the statement cache has queued evicted statements for finalization.
+    private val reclaimPending = AtomicInt(0)
+
+    // Bumped by every schema change made on this connection.
+    private val schemaGeneration = AtomicInt(0)
+
     fun getDbConfig():SQLiteDatabaseConfiguration{
         val dbConfig = getDbConfig(nativeDataId)
         if(dbConfig == null)
@@ -74,12 +80,9 @@ class SQLiteConnection() {
     }
 
     //Statement cache methods
-    private fun cacheEvictAll(){
-        evictAll(nativeDataId)
-    }
-
     private fun cacheRemove(sql:String){
-        remove(nativeDataId, sql)
+        if(remove(nativeDataId, sql))
+            reclaimPending.value = 1
     }
 
     private fun cacheGetStatement(sql:String):NativePreparedStatement{
@@ -93,9 +96,19 @@ class SQLiteConnection() {
     private fun cachePutStatement(sql:String, stmt:NativePreparedStatement){
         if(!stmt.mInCache)
             throw IllegalStateException("Only mInCache goes in cache")
-        putStmt(nativeDataId, sql, stmt)
+        if(putStmt(nativeDataId, sql, stmt))
+            reclaimPending.value = 1
     }
 
+    /**
+     * Evicted statements are queued natively rather than finalized while the shared cache lock
+     * is held. This finalizes whatever is queued. Call only at points where no cached statement
+     * is mid-execution on this connection.
+     */
+    private fun cacheDrainReclaimed(){
+        if(reclaimPending.compareAndSet(1, 0))
+            drainReclaimed(nativeDataId)
+    }
     internal fun hasConnection() = getConnectionPtr(nativeDataId) != 0L
 
     // Closes the database closes and releases all of its associated resources.
@@ -108,7 +121,7 @@ class SQLiteConnection() {
         val connectionPtr = nativeOpen(config.path, config.openFlags,
                 config.label,
                 SQLiteDebug.DEBUG_SQL_STATEMENTS, SQLiteDebug.DEBUG_SQL_TIME,
-                config.lookasideSlotSize, config.lookasideSlotCount)
+                config.lookasideSlotSize, config.lookasideSlotCount, config.pageCacheBytes)
 
         createDataStore(nativeDataId, config.maxSqlCacheSize)
         putDbConfig(config)
@@ -119,6 +132,13 @@ class SQLiteConnection() {
         setWalModeFromConfiguration()
         setJournalSizeLimit()
         setAutoCheckpointInterval()
+        nativeSetRowCountCacheSize(connectionPtr, config.rowCountCacheSize)
+        nativeSetBusyPolicy(connectionPtr, config.busyTimeoutMs, config.busyMaxBackoffMs)
+        setReadersFromConfiguration()
+        setCheckpointerFromConfiguration()
+        // After the readers, which share the cache.
+        nativeSetResultCacheSize(connectionPtr, config.resultCacheBytes, config.maxSqlCacheSize)
+        nativeSetSlowQueryLog(connectionPtr, config.slowQueryThresholdMs, config.slowQueryLogSize)
         // setLocaleFromConfiguration();
         // Register custom functions.
     }
@@ -132,11 +152,11 @@ class SQLiteConnection() {
             val cookie = mRecentOperations.beginOperation("close", null, null)
             try
             {
-                cacheEvictAll()
-                nativeClose(connectionPtr)
+                detachConnection(nativeDataId)
                 removeDbConfig(nativeDataId)
-                putConnectionPtr(nativeDataId, 0)
-                removeDataStore(nativeDataId)
+                //Finalizes every cached or evicted statement while the connection is still open
+                removeDataStore(nativeDataId, connectionPtr)
+                nativeClose(connectionPtr)
             }
             finally
             {
@@ -211,6 +231,25 @@ class SQLiteConnection() {
         }
     }
 
+    private fun setReadersFromConfiguration() {
+        val dbConfig = getDbConfig()
+        if (dbConfig.readerConnectionCount > 0 && !dbConfig.isInMemoryDb()
+                && executeForString("PRAGMA journal_mode", null).equals("wal", ignoreCase = true))
+        {
+            nativeOpenReaders(getConnectionPtr(nativeDataId), dbConfig.readerConnectionCount)
+        }
+    }
+
+    private fun setCheckpointerFromConfiguration() {
+        val dbConfig = getDbConfig()
+        if (dbConfig.walCheckpointFrames > 0 && !dbConfig.isInMemoryDb() && !dbConfig.isReadOnlyConnection()
+                && executeForString("PRAGMA journal_mode", null).equals("wal", ignoreCase = true))
+        {
+            nativeStartCheckpointer(getConnectionPtr(nativeDataId),
+                    dbConfig.walCheckpointFrames, dbConfig.walCheckpointIdleMs)
+        }
+    }
+
     private fun setSyncMode(newValue:String) {
         val value = executeForString("PRAGMA synchronous", null)
         if (!canonicalizeSyncMode(value).equals(
@@ -291,21 +330,9 @@ class SQLiteConnection() {
             withPreparedStatement(sql){statement ->
                 if (outStatementInfo != null)
                 {
-                    val connectionPtr = getConnectionPtr(nativeDataId)
                     outStatementInfo.numParameters = statement.mNumParameters
                     outStatementInfo.readOnly = statement.mReadOnly
-                    val columnCount = nativeGetColumnCount(
-                            connectionPtr, statement.mStatementPtr)
-                    if (columnCount == 0)
-                    {
-                        outStatementInfo.columnNames = EMPTY_STRING_ARRAY
-                    }
-                    else
-                    {
-                        outStatementInfo.columnNames = Array(columnCount) { col -> nativeGetColumnName(
-                                connectionPtr, statement.mStatementPtr, col)
-                        }
-                    }
+                    outStatementInfo.columnNames = statement.mColumnNames
                 }
             }
         }
@@ -503,6 +530,8 @@ class SQLiteConnection() {
      * so that it does. Must be greater than or equal to <code>startPos</code>.
      * @param countAllRows True to count all rows that the query would return
      * regagless of whether they fit in the window.
+     * @param columnMask Columns to copy into the window, by index, or null for all of them.
+     * Columns left out take no space in the window and must not be read from it.
      * @return The number of rows that were counted during query execution. Might
      * not be all rows in the result set unless <code>countAllRows</code> is true.
      *
@@ -514,7 +543,8 @@ class SQLiteConnection() {
                                window:CursorWindow,
                                startPos:Int,
                                requiredPos:Int,
-                               countAllRows:Boolean):Int {
+                               countAllRows:Boolean,
+                               columnMask:BooleanArray? = null):Int {
         //CursorWindow exposes some of its internals in this method. Not a huge fan, but it works.
         window.acquireReference()
         try
@@ -531,7 +561,7 @@ class SQLiteConnection() {
 
                     val result = nativeExecuteForCursorWindow(
                             getConnectionPtr(nativeDataId), statement.mStatementPtr, window.getWindowCursorPtr(),
-                            startPos, requiredPos, countAllRows)
+                            startPos, requiredPos, countAllRows, columnMask)
                     actualPos = (result shr 32).toInt()
                     countedRows = result.toInt()
                     filledRows = window.numRows
@@ -575,22 +605,32 @@ class SQLiteConnection() {
     private fun acquirePreparedStatement(sql:String):NativePreparedStatement {
         if (cacheHasStatement(sql))
         {
-            return cacheGetStatement(sql)
+            val cached = cacheGetStatement(sql)
+            // The column names were read when the statement was prepared. Prepare it over if
+            // the schema has changed since, here or on another connection.
+            if (cached.mSchemaGeneration == schemaGeneration.value
+                    && !nativeWasReprepared(getConnectionPtr(nativeDataId), cached.mStatementPtr))
+            {
+                return cached
+            }
+            cacheRemove(sql)
         }
         var statement:NativePreparedStatement? = null
-        val statementPtr = nativePrepareStatement(getConnectionPtr(nativeDataId), sql)
+        // One crossing prepares the statement and reports its parameter count, read-only flag
+        // and column names.
+        val statementInfo = LongArray(PREPARE_INFO_SIZE)
         try
         {
-            val numParameters = nativeGetParameterCount(getConnectionPtr(nativeDataId), statementPtr)
+            val columnNames = nativePrepareStatementWithInfo(getConnectionPtr(nativeDataId), sql, statementInfo)
             val type = DatabaseUtils.getSqlStatementType(sql)
-            val readOnly = nativeIsReadOnly(getConnectionPtr(nativeDataId), statementPtr)
             statement = obtainPreparedStatement(
                     sql,
-                    statementPtr,
-                    numParameters,
+                    statementInfo[PREPARE_INFO_STATEMENT_PTR],
+                    statementInfo[PREPARE_INFO_NUM_PARAMETERS].toInt(),
                     type,
-                    readOnly,
-                    isCacheable(type))
+                    statementInfo[PREPARE_INFO_READ_ONLY] != 0L,
+                    isCacheable(type),
+                    columnNames)
 
             if (statement.mInCache)
             {
@@ -600,7 +640,8 @@ class SQLiteConnection() {
         catch (ex:RuntimeException) {
             // Finalize the statement if an exception occurred and we did not add
             // it to the cache. If it is already in the cache, then leave it there.
-            if (statement == null || !statement.mInCache)
+            val statementPtr = statementInfo[PREPARE_INFO_STATEMENT_PTR]
+            if (statementPtr != 0L && (statement == null || !statement.mInCache))
             {
                 nativeFinalizeStatement(getConnectionPtr(nativeDataId), statementPtr)
             }
@@ -635,7 +676,12 @@ class SQLiteConnection() {
         else
         {
             nativeFinalizeStatement(getConnectionPtr(nativeDataId), statement.mStatementPtr)
+
+            if (statement.mType == DatabaseUtils.STATEMENT_DDL)
+                schemaGeneration.addAndGet(1)
         }
+
+        cacheDrainReclaimed()
     }
 
     /**
@@ -657,39 +703,93 @@ class SQLiteConnection() {
         {
             return
         }
-        val statementPtr = statement.mStatementPtr
-        for (i in 0 until count)
-        {
-            val connectionPtr = getConnectionPtr(nativeDataId)
-            val arg = bindArgs!![i]
-            when (DatabaseUtils.getTypeOfObject(arg)) {
-                Cursor.FIELD_TYPE_NULL -> nativeBindNull(connectionPtr, statementPtr, i + 1)
-                Cursor.FIELD_TYPE_INTEGER -> nativeBindLong(connectionPtr, statementPtr, i + 1,
-                        (arg as Number).toLong())
-                Cursor.FIELD_TYPE_FLOAT -> nativeBindDouble(connectionPtr, statementPtr, i + 1,
-                        (arg as Number).toDouble())
-                Cursor.FIELD_TYPE_BLOB -> nativeBindBlob(connectionPtr, statementPtr, i + 1, arg as ByteArray)
-                Cursor.FIELD_TYPE_STRING -> if (arg is Boolean)
-                {
-                    // Provide compatibility with legacy applications which may pass
-                    // Boolean values in bind args.
-                    nativeBindLong(connectionPtr, statementPtr, i + 1,
-                            (if (arg) 1 else 0).toLong())
-                }
-                else
+
+        // Pack the arguments so they can all be bound in a single native call.
+        val packed = PackedArguments(bindArgs)
+        nativeBindArguments(getConnectionPtr(nativeDataId), statement.mStatementPtr,
+                packed.types, packed.values, packed.objects)
+    }
+
+    /**
+     * Executes a statement once per row of columnar input, natively and inside a single
+     * transaction (a savepoint if one is already open). If any row fails, none of the batch
+     * is kept.
+     *
+     * @param sql The SQL statement to execute, typically an INSERT or UPSERT.
+     * @param columns One column per bind parameter, each a LongArray, DoubleArray or an
+     * Array holding values of the types accepted as bind arguments. All must be the same length.
+     * @param returnRowIds True to return the row id inserted by each row (-1 if none),
+     * false to return the number of rows each one changed.
+     * @return One result per input row.
+     *
+     * @throws SQLiteException if an error occurs, such as a constraint violation. The
+     * message names the failing row.
+     */
+    fun executeBatch(sql:String, columns:Array<out Any>, returnRowIds:Boolean):LongArray {
+        val cookie = mRecentOperations.beginOperation("executeBatch", sql, null)
+        try
+        {
+            return withPreparedStatement(sql){statement ->
+                if (columns.size != statement.mNumParameters)
                 {
-                    nativeBindString(connectionPtr, statementPtr, i + 1, arg.toString())
+                    throw SQLiteException(
+                            ("Expected " + statement.mNumParameters + " batch columns but "
+                                    + columns.size + " were provided."))
                 }
-                else -> if (arg is Boolean)
+                if (columns.isEmpty())
                 {
-                    nativeBindLong(connectionPtr, statementPtr, i + 1, (if (arg) 1 else 0).toLong())
+                    throw SQLiteException("Batch execution needs at least one bind parameter.")
                 }
-                else
+
+                val rowCount = batchColumnSize(columns[0])
+                val kinds = ByteArray(columns.size)
+                val packedColumns = arrayOfNulls<Any>(columns.size)
+                for (c in 0 until columns.size)
                 {
-                    nativeBindString(connectionPtr, statementPtr, i + 1, arg.toString())
+                    val column = columns[c]
+                    if (batchColumnSize(column) != rowCount)
+                    {
+                        throw IllegalArgumentException("Batch column $c has " + batchColumnSize(column)
+                                + " rows, expected $rowCount")
+                    }
+                    when (column) {
+                        is LongArray -> {
+                            kinds[c] = BATCH_COLUMN_LONG
+                            packedColumns[c] = column
+                        }
+                        is DoubleArray -> {
+                            kinds[c] = BATCH_COLUMN_DOUBLE
+                            packedColumns[c] = column
+                        }
+                        else -> {
+                            val cells = column as Array<*>
+                            val types = ByteArray(rowCount)
+                            val values = LongArray(rowCount)
+                            val objects = arrayOfNulls<Any>(rowCount)
+                            for (r in 0 until rowCount)
+                            {
+                                packArgument(cells[r], r, types, values, objects)
+                            }
+                            kinds[c] = BATCH_COLUMN_PACKED
+                            packedColumns[c] = arrayOf<Any?>(types, values, objects)
+                        }
+                    }
                 }
+
+                val results = LongArray(rowCount)
+                nativeExecuteBatch(getConnectionPtr(nativeDataId), statement.mStatementPtr,
+                        kinds, packedColumns, rowCount, returnRowIds, results)
+                results
             }
         }
+        catch (ex:RuntimeException) {
+            mRecentOperations.failOperation(cookie, ex)
+            throw ex
+        }
+        finally
+        {
+            mRecentOperations.endOperation(cookie)
+        }
     }
 
     /**
@@ -716,7 +816,7 @@ class SQLiteConnection() {
      */
     internal fun collectDbStats(dbStatsList:ArrayList<SQLiteDebug.DbStats>) {
         // Get information about the main database.
-        val lookaside = nativeGetDbLookaside(getConnectionPtr(nativeDataId))
+        val memory = getConnectionMemoryStats(false).first()
         var pageCount:Long = 0
         var pageSize:Long = 0
         try
@@ -727,7 +827,8 @@ class SQLiteConnection() {
         catch (ex:SQLiteException) {
             // Ignore.
         }
-        dbStatsList.add(getMainDbStatsUnsafe(lookaside, pageCount, pageSize))
+        dbStatsList.add(getMainDbStatsUnsafe(memory.lookasideUsed.toInt(), pageCount, pageSize,
+                memory))
         // Get information about attached databases.
         // We ignore the first row in the database list because it corresponds to
         // the main database which we have already described.
@@ -765,6 +866,246 @@ class SQLiteConnection() {
             window.close()
         }
     }
+
+    /**
+     * Fills the window on one of the connection's read-only WAL connections, if it has them. Unlike
+     * everything else here, this may be called without the session lock, from any thread. The
+     * caller keeps queries inside a transaction off the readers.
+     *
+     * @return The number of rows counted, as for [executeForCursorWindow], or null if the query
+     * has to run on this connection instead: there are no readers or none is idle, or the readers
+     * can't prepare the statement or it writes.
+     */
+    internal fun executeForCursorWindowOnReader(sql:String,
+                                                bindArgs:Array<Any?>?,
+                                                window:CursorWindow,
+                                                startPos:Int,
+                                                requiredPos:Int,
+                                                countAllRows:Boolean,
+                                                columnMask:BooleanArray?):Int? {
+        val connectionPtr = acquireReaderAccess(nativeDataId)
+        if (connectionPtr == 0L)
+            return null
+
+        window.acquireReference()
+        var actualPos = -1
+        var countedRows = -1
+        var filledRows = -1
+        val cookie = mRecentOperations.beginOperation("executeForCursorWindowOnReader",
+                sql, bindArgs)
+        try
+        {
+            val packed = PackedArguments(bindArgs)
+            val result = nativeExecuteForCursorWindowOnReader(connectionPtr, sql,
+                    packed.types, packed.values, packed.objects, window.getWindowCursorPtr(),
+                    startPos, requiredPos, countAllRows, columnMask)
+            if (result < 0)
+                return null
+            actualPos = (result shr 32).toInt()
+            countedRows = result.toInt()
+            filledRows = window.numRows
+            window.startPosition = actualPos
+            return countedRows
+        }
+        catch (ex:RuntimeException) {
+            mRecentOperations.failOperation(cookie, ex)
+            throw ex
+        }
+        finally
+        {
+            if (mRecentOperations.endOperationDeferLog(cookie))
+            {
+                mRecentOperations.logOperation(cookie, ("window='" + window
+                        + "', startPos=" + startPos
+                        + ", actualPos=" + actualPos
+                        + ", filledRows=" + filledRows
+                        + ", countedRows=" + countedRows))
+            }
+            window.releaseReference()
+            releaseReaderAccess(nativeDataId)
+        }
+    }
+
+    /**
+     * Starts filling the window on a native worker thread, against one of the reader
+     * connections, and returns without waiting for it. Like [executeForCursorWindowOnReader],
+     * may be called without the session lock.
+     *
+     * @return The pending fill, or null if the query has to run on this connection instead, for
+     * the same reasons as [executeForCursorWindowOnReader].
+     */
+    internal fun executeForCursorWindowAsync(sql:String,
+                                             bindArgs:Array<Any?>?,
+                                             window:CursorWindow,
+                                             startPos:Int,
+                                             requiredPos:Int,
+                                             countAllRows:Boolean,
+                                             columnMask:BooleanArray?):SQLiteAsyncFill? {
+        val connectionPtr = acquireReaderAccess(nativeDataId)
+        if (connectionPtr == 0L)
+            return null
+
+        window.acquireReference()
+        var tokenPtr = 0L
+        try
+        {
+            val packed = PackedArguments(bindArgs)
+            tokenPtr = nativeExecuteForCursorWindowAsync(connectionPtr, sql,
+                    packed.types, packed.values, packed.objects, window.getWindowCursorPtr(),
+                    startPos, requiredPos, countAllRows, columnMask)
+        }
+        finally
+        {
+            // The fill keeps its reference to the window until it is awaited.
+            if (tokenPtr == 0L)
+                window.releaseReference()
+            releaseReaderAccess(nativeDataId)
+        }
+        return if (tokenPtr == 0L) null else SQLiteAsyncFill(window, tokenPtr, 0)
+    }
+
+    /**
+     * Opens a stream over the query's rows for [SQLiteStreamCursor], on one of the reader
+     * connections when useReaders is set, one is idle and the query can run there. Call with the
+     * session lock held.
+     */
+    internal fun openStream(sql:String, bindArgs:Array<Any?>?, useReaders:Boolean):Long {
+        val packed = PackedArguments(bindArgs)
+        return nativeOpenStream(getConnectionPtr(nativeDataId), sql,
+                packed.types, packed.values, packed.objects, useReaders)
+    }
+
+    /**
+     * Runs proc with the native connection kept from closing until it returns.
+     *
+     * @throws SQLiteException if the connection has already been closed.
+     */
+    internal fun <T> withConnectionAccess(proc:() -> T):T {
+        if (acquireReaderAccess(nativeDataId) == 0L)
+            throw SQLiteException("The connection has been closed.")
+        try
+        {
+            return proc()
+        }
+        finally
+        {
+            releaseReaderAccess(nativeDataId)
+        }
+    }
+
+    /**
+     * Lock waits on this connection since it was opened.
+     */
+    internal fun getContentionStats():SQLiteDebug.ContentionStats {
+        val stats = LongArray(CONTENTION_STAT_SIZE)
+        nativeGetContentionStats(getConnectionPtr(nativeDataId), stats)
+        return SQLiteDebug.ContentionStats(stats[0], stats[1], stats[2], stats[3], stats[4], stats[5])
+    }
+
+    /**
+     * Background checkpoints of this connection's WAL since it was opened. All zero when the
+     * checkpointer is off.
+     */
+    internal fun getCheckpointStats():SQLiteDebug.CheckpointStats {
+        val stats = LongArray(CHECKPOINT_STAT_SIZE)
+        nativeGetCheckpointStats(getConnectionPtr(nativeDataId), stats)
+        return SQLiteDebug.CheckpointStats(stats[0], stats[1], stats[2], stats[3],
+                stats[4], stats[5], stats[6], stats[7])
+    }
+
+    /**
+     * Drops every window fill kept by the result cache.
+     */
+    internal fun clearResultCache() {
+        nativeClearResultCache(getConnectionPtr(nativeDataId))
+    }
+
+    internal fun subscribeToChanges(capacity:Int):SQLiteChangeSubscription =
+            SQLiteChangeSubscription(nativeSubscribeToChanges(getConnectionPtr(nativeDataId), capacity))
+
+    internal fun getResultCacheStats():SQLiteDebug.ResultCacheStats {
+        val stats = LongArray(RESULT_CACHE_STAT_SIZE)
+        nativeGetResultCacheStats(getConnectionPtr(nativeDataId), stats)
+        return SQLiteDebug.ResultCacheStats(stats[0], stats[1], stats[2], stats[3],
+                stats[4], stats[5], stats[6])
+    }
+
+    internal fun clearSlowQueries() {
+        nativeClearSlowQueries(getConnectionPtr(nativeDataId))
+    }
+
+    internal fun getSlowQueries():List<SQLiteDebug.SlowQuery> {
+        val snapshotPtr = nativeGetSlowQueries(getConnectionPtr(nativeDataId))
+        if (snapshotPtr == 0L) {
+            return emptyList()
+        }
+        try {
+            val times = LongArray(SLOW_QUERY_TIME_SIZE)
+            return (0 until nativeSlowQueriesCount(snapshotPtr)).map { index ->
+                nativeSlowQueryTimes(snapshotPtr, index, times)
+                val argumentTypes = nativeSlowQueryArgumentTypes(snapshotPtr, index)
+                SQLiteDebug.SlowQuery(nativeSlowQuerySql(snapshotPtr, index),
+                        if (argumentTypes.isEmpty()) emptyList() else argumentTypes.split(','),
+                        nativeSlowQueryPlan(snapshotPtr, index), times[0], times[1])
+            }
+        } finally {
+            nativeSlowQueriesRelease(snapshotPtr)
+        }
+    }
+
+    internal fun resetQueryMetrics() {
+        nativeResetQueryMetrics(getConnectionPtr(nativeDataId))
+    }
+
+    internal fun getQueryMetrics():List<SQLiteDebug.QueryMetrics> {
+        val snapshotPtr = nativeGetQueryMetrics(getConnectionPtr(nativeDataId), SNAPSHOT_BY_TIME)
+        try {
+            val stats = LongArray(QUERY_PHASE_COUNT * LATENCY_STAT_SIZE)
+            return (0 until nativeMetricsCount(snapshotPtr)).map { index ->
+                nativeMetricsStats(snapshotPtr, index, stats)
+                val phases = (0 until QUERY_PHASE_COUNT).map { phase ->
+                    val offset = phase * LATENCY_STAT_SIZE
+                    SQLiteDebug.LatencyStats(stats[offset], stats[offset + 1], stats[offset + 2],
+                            stats[offset + 3], stats[offset + 4], stats[offset + 5], stats[offset + 6])
+                }
+                SQLiteDebug.QueryMetrics(nativeMetricsSql(snapshotPtr, index), phases[0], phases[1], phases[2])
+            }
+        } finally {
+            nativeMetricsRelease(snapshotPtr)
+        }
+    }
+
+    internal fun getStatementStats():List<SQLiteDebug.StatementStats> {
+        val snapshotPtr = nativeGetQueryMetrics(getConnectionPtr(nativeDataId), SNAPSHOT_BY_COST)
+        try {
+            val counters = LongArray(STATEMENT_STAT_SIZE)
+            return (0 until nativeMetricsCount(snapshotPtr)).map { index ->
+                nativeMetricsCounters(snapshotPtr, index, counters)
+                SQLiteDebug.StatementStats(nativeMetricsSql(snapshotPtr, index), counters[0],
+                        counters[1], counters[2], counters[3], counters[4], counters[5], counters[6])
+            }
+        } finally {
+            nativeMetricsRelease(snapshotPtr)
+        }
+    }
+
+    /**
+     * Reads sqlite3_db_status for this connection, then for each of its readers that isn't
+     * running a query.
+     */
+    internal fun getConnectionMemoryStats(reset:Boolean):List<SQLiteDebug.ConnectionMemoryStats> {
+        val status = LongArray((1 + getDbConfig().readerConnectionCount) * DB_STATUS_SIZE)
+        val count = nativeGetDbStatus(getConnectionPtr(nativeDataId), reset, status)
+        return (0 until count).map { index ->
+            val offset = index * DB_STATUS_SIZE
+            SQLiteDebug.ConnectionMemoryStats(if (index == 0) "main" else "reader",
+                    status[offset], status[offset + 1], status[offset + 2], status[offset + 3],
+                    status[offset + 4], status[offset + 5], status[offset + 6],
+                    status[offset + 7], status[offset + 8], status[offset + 9],
+                    status[offset + 10], status[offset + 11], status[offset + 12],
+                    status[offset + 13] != 0L)
+        }
+    }
     /**
      * Collects statistics about database connection memory usage, in the case where the
      * caller might not actually own the connection.
@@ -774,7 +1115,8 @@ class SQLiteConnection() {
     internal fun collectDbStatsUnsafe(dbStatsList:ArrayList<SQLiteDebug.DbStats>) {
         dbStatsList.add(getMainDbStatsUnsafe(0, 0, 0))
     }
-    private fun getMainDbStatsUnsafe(lookaside:Int, pageCount:Long, pageSize:Long):SQLiteDebug.DbStats {
+    private fun getMainDbStatsUnsafe(lookaside:Int, pageCount:Long, pageSize:Long,
+                                     memory:SQLiteDebug.ConnectionMemoryStats? = null):SQLiteDebug.DbStats {
         // The prepared statement cache is thread-safe so we can access its statistics
         // even if we do not own the database connection.
         val label = getDbConfig().path
@@ -783,7 +1125,8 @@ class SQLiteConnection() {
         return SQLiteDebug.DbStats(label, pageCount, pageSize, lookaside,
                 -1,
                 -1,
-                -1)
+                -1,
+                memory)
     }
 
     private fun obtainPreparedStatement(sql:String,
@@ -791,13 +1134,16 @@ class SQLiteConnection() {
                                         numParameters:Int,
                                         type:Int,
                                         readOnly:Boolean,
-                                        inCache:Boolean):NativePreparedStatement {
+                                        inCache:Boolean,
+                                        columnNames:Array<String>):NativePreparedStatement {
         return NativePreparedStatement(sql,
                 statementPtr,
                 numParameters,
                 type,
                 readOnly,
-                inCache).freeze()
+                inCache,
+                columnNames,
+                schemaGeneration.value).freeze()
     }
 
     private class OperationLog {
@@ -851,41 +1197,51 @@ class SQLiteConnection() {
         private val DEBUG = true
         private val EMPTY_STRING_ARRAY = arrayOf<String>()
         private val EMPTY_BYTE_ARRAY = ByteArray(0)
+
+        // Slots of the array filled by nativePrepareStatementWithInfo.
+        private const val PREPARE_INFO_STATEMENT_PTR = 0
+        private const val PREPARE_INFO_NUM_PARAMETERS = 1
+        private const val PREPARE_INFO_READ_ONLY = 2
+        private const val PREPARE_INFO_SIZE = 3
+
+        // Size of the array filled by nativeGetContentionStats.
+        private const val CONTENTION_STAT_SIZE = 6
+
+        // Size of the array filled by nativeGetCheckpointStats.
+        private const val CHECKPOINT_STAT_SIZE = 8
+
+        // Size of the array filled by nativeGetResultCacheStats.
+        private const val RESULT_CACHE_STAT_SIZE = 7
+        // Prepare, step and fill, each summarized in LATENCY_STAT_SIZE slots by nativeMetricsStats.
+        private const val QUERY_PHASE_COUNT = 3
+        private const val LATENCY_STAT_SIZE = 7
+        // Size of the array filled by nativeMetricsCounters.
+        private const val STATEMENT_STAT_SIZE = 7
+        // Slots per connection in the array filled by nativeGetDbStatus.
+        private const val DB_STATUS_SIZE = 14
+        // Size of the array filled by nativeSlowQueryTimes.
+        private const val SLOW_QUERY_TIME_SIZE = 2
+        // Orders of nativeGetQueryMetrics.
+        private const val SNAPSHOT_BY_TIME = 0
+        private const val SNAPSHOT_BY_COST = 1
         //        private val TRIM_SQL_PATTERN = Pattern.compile("[\\s]*\\n+[\\s]*")
         @SymbolName("Android_Database_SQLiteConnection_nativeOpen")
         private external fun nativeOpen(path:String, openFlags:Int, label:String,
                                         enableTrace:Boolean, enableProfile:Boolean,
-                                        lookasideSlotSize:Int, lookasideSlotCount:Int):Long
+                                        lookasideSlotSize:Int, lookasideSlotCount:Int,
+                                        pageCacheBytes:Int):Long
         @SymbolName("Android_Database_SQLiteConnection_nativeClose")
         private external fun nativeClose(connectionPtr:Long)
 
-        @SymbolName("Android_Database_SQLiteConnection_nativePrepareStatement")
-        private external fun nativePrepareStatement(connectionPtr:Long, sql:String):Long
-
-        @SymbolName("Android_Database_SQLiteConnection_nativeGetParameterCount")
-        private external fun nativeGetParameterCount(connectionPtr:Long, statementPtr:Long):Int
-        @SymbolName("Android_Database_SQLiteConnection_nativeIsReadOnly")
-        private external fun nativeIsReadOnly(connectionPtr:Long, statementPtr:Long):Boolean
-        @SymbolName("Android_Database_SQLiteConnection_nativeGetColumnCount")
-        private external fun nativeGetColumnCount(connectionPtr:Long, statementPtr:Long):Int
-        @SymbolName("Android_Database_SQLiteConnection_nativeGetColumnName")
-        private external fun nativeGetColumnName(connectionPtr:Long, statementPtr:Long,
-                                                 index:Int):String
-        @SymbolName("Android_Database_SQLiteConnection_nativeBindNull")
-        private external fun nativeBindNull(connectionPtr:Long, statementPtr:Long,
-                                            index:Int)
-        @SymbolName("Android_Database_SQLiteConnection_nativeBindLong")
-        private external fun nativeBindLong(connectionPtr:Long, statementPtr:Long,
-                                            index:Int, value:Long)
-        @SymbolName("Android_Database_SQLiteConnection_nativeBindDouble")
-        private external fun nativeBindDouble(connectionPtr:Long, statementPtr:Long,
-                                              index:Int, value:Double)
-        @SymbolName("Android_Database_SQLiteConnection_nativeBindString")
-        private external fun nativeBindString(connectionPtr:Long, statementPtr:Long,
-                                              index:Int, value:String)
-        @SymbolName("Android_Database_SQLiteConnection_nativeBindBlob")
-        private external fun nativeBindBlob(connectionPtr:Long, statementPtr:Long,
-                                            index:Int, value:ByteArray)
+        @SymbolName("Android_Database_SQLiteConnection_nativePrepareStatementWithInfo")
+        private external fun nativePrepareStatementWithInfo(connectionPtr:Long, sql:String,
+                                                           outInfo:LongArray):Array<String>
+
+        @SymbolName("Android_Database_SQLiteConnection_nativeWasReprepared")
+        private external fun nativeWasReprepared(connectionPtr:Long, statementPtr:Long):Boolean
+        @SymbolName("Android_Database_SQLiteConnection_nativeBindArguments")
+        private external fun nativeBindArguments(connectionPtr:Long, statementPtr:Long,
+                                                 types:ByteArray, values:LongArray, objects:Array<Any?>)
         @SymbolName("Android_Database_SQLiteConnection_nativeResetStatementAndClearBindings")
         private external fun nativeResetStatementAndClearBindings(
                 connectionPtr:Long, statementPtr:Long)
@@ -903,14 +1259,164 @@ class SQLiteConnection() {
         @SymbolName("Android_Database_SQLiteConnection_nativeExecuteForCursorWindow")
         private external fun nativeExecuteForCursorWindow(
                 connectionPtr:Long, statementPtr:Long, windowPtr:Long,
-                startPos:Int, requiredPos:Int, countAllRows:Boolean):Long
-        @SymbolName("Android_Database_SQLiteConnection_nativeGetDbLookaside")
-        private external fun nativeGetDbLookaside(connectionPtr:Long):Int
+                startPos:Int, requiredPos:Int, countAllRows:Boolean, columnMask:BooleanArray?):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeSetRowCountCacheSize")
+        private external fun nativeSetRowCountCacheSize(connectionPtr:Long, cacheSize:Int)
+        @SymbolName("Android_Database_SQLiteConnection_nativeOpenReaders")
+        private external fun nativeOpenReaders(connectionPtr:Long, readerCount:Int)
+        @SymbolName("Android_Database_SQLiteConnection_nativeExecuteForCursorWindowOnReader")
+        private external fun nativeExecuteForCursorWindowOnReader(
+                connectionPtr:Long, sql:String, types:ByteArray, values:LongArray, objects:Array<Any?>,
+                windowPtr:Long, startPos:Int, requiredPos:Int, countAllRows:Boolean,
+                columnMask:BooleanArray?):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeExecuteForCursorWindowAsync")
+        private external fun nativeExecuteForCursorWindowAsync(
+                connectionPtr:Long, sql:String, types:ByteArray, values:LongArray, objects:Array<Any?>,
+                windowPtr:Long, startPos:Int, requiredPos:Int, countAllRows:Boolean,
+                columnMask:BooleanArray?):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeOpenStream")
+        private external fun nativeOpenStream(connectionPtr:Long, sql:String,
+                types:ByteArray, values:LongArray, objects:Array<Any?>, useReaders:Boolean):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeSetBusyPolicy")
+        private external fun nativeSetBusyPolicy(connectionPtr:Long, timeoutMs:Int, maxBackoffMs:Int)
+        @SymbolName("Android_Database_SQLiteConnection_nativeGetContentionStats")
+        private external fun nativeGetContentionStats(connectionPtr:Long, outStats:LongArray)
+        @SymbolName("Android_Database_SQLiteConnection_nativeStartCheckpointer")
+        private external fun nativeStartCheckpointer(connectionPtr:Long, walFrames:Int, idleMs:Int)
+        @SymbolName("Android_Database_SQLiteConnection_nativeGetCheckpointStats")
+        private external fun nativeGetCheckpointStats(connectionPtr:Long, outStats:LongArray)
+        @SymbolName("Android_Database_SQLiteConnection_nativeSetResultCacheSize")
+        private external fun nativeSetResultCacheSize(connectionPtr:Long, maxBytes:Int, maxSqlCacheSize:Int)
+        @SymbolName("Android_Database_SQLiteConnection_nativeClearResultCache")
+        private external fun nativeClearResultCache(connectionPtr:Long)
+        @SymbolName("Android_Database_SQLiteConnection_nativeSubscribeToChanges")
+        private external fun nativeSubscribeToChanges(connectionPtr:Long, capacity:Int):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeGetResultCacheStats")
+        private external fun nativeGetResultCacheStats(connectionPtr:Long, outStats:LongArray)
+        @SymbolName("Android_Database_SQLiteConnection_nativeSetSlowQueryLog")
+        private external fun nativeSetSlowQueryLog(connectionPtr:Long, thresholdMs:Int, capacity:Int)
+        @SymbolName("Android_Database_SQLiteConnection_nativeClearSlowQueries")
+        private external fun nativeClearSlowQueries(connectionPtr:Long)
+        @SymbolName("Android_Database_SQLiteConnection_nativeGetSlowQueries")
+        private external fun nativeGetSlowQueries(connectionPtr:Long):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeSlowQueriesCount")
+        private external fun nativeSlowQueriesCount(snapshotPtr:Long):Int
+        @SymbolName("Android_Database_SQLiteConnection_nativeSlowQuerySql")
+        private external fun nativeSlowQuerySql(snapshotPtr:Long, index:Int):String
+        @SymbolName("Android_Database_SQLiteConnection_nativeSlowQueryArgumentTypes")
+        private external fun nativeSlowQueryArgumentTypes(snapshotPtr:Long, index:Int):String
+        @SymbolName("Android_Database_SQLiteConnection_nativeSlowQueryPlan")
+        private external fun nativeSlowQueryPlan(snapshotPtr:Long, index:Int):String
+        @SymbolName("Android_Database_SQLiteConnection_nativeSlowQueryTimes")
+        private external fun nativeSlowQueryTimes(snapshotPtr:Long, index:Int, outTimes:LongArray)
+        @SymbolName("Android_Database_SQLiteConnection_nativeSlowQueriesRelease")
+        private external fun nativeSlowQueriesRelease(snapshotPtr:Long)
+        @SymbolName("Android_Database_SQLiteConnection_nativeResetQueryMetrics")
+        private external fun nativeResetQueryMetrics(connectionPtr:Long)
+        @SymbolName("Android_Database_SQLiteConnection_nativeGetQueryMetrics")
+        private external fun nativeGetQueryMetrics(connectionPtr:Long, order:Int):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeMetricsCount")
+        private external fun nativeMetricsCount(snapshotPtr:Long):Int
+        @SymbolName("Android_Database_SQLiteConnection_nativeMetricsSql")
+        private external fun nativeMetricsSql(snapshotPtr:Long, index:Int):String
+        @SymbolName("Android_Database_SQLiteConnection_nativeMetricsStats")
+        private external fun nativeMetricsStats(snapshotPtr:Long, index:Int, outStats:LongArray)
+        @SymbolName("Android_Database_SQLiteConnection_nativeMetricsCounters")
+        private external fun nativeMetricsCounters(snapshotPtr:Long, index:Int, outCounters:LongArray)
+        @SymbolName("Android_Database_SQLiteConnection_nativeMetricsRelease")
+        private external fun nativeMetricsRelease(snapshotPtr:Long)
+        @SymbolName("Android_Database_SQLiteConnection_nativeGetDbStatus")
+        private external fun nativeGetDbStatus(connectionPtr:Long, reset:Boolean, outStatus:LongArray):Int
         @SymbolName("Android_Database_SQLiteConnection_nativeCancel")
         private external fun nativeCancel(connectionPtr:Long)
         @SymbolName("Android_Database_SQLiteConnection_nativeResetCancel")
         private external fun nativeResetCancel(connectionPtr:Long, cancelable:Boolean)
 
+        // Column layouts for nativeExecuteBatch.
+        private const val BATCH_COLUMN_LONG:Byte = 0
+        private const val BATCH_COLUMN_DOUBLE:Byte = 1
+        private const val BATCH_COLUMN_PACKED:Byte = 2
+
+        @SymbolName("Android_Database_SQLiteConnection_nativeExecuteBatch")
+        private external fun nativeExecuteBatch(connectionPtr:Long, statementPtr:Long,
+                                                kinds:ByteArray, columns:Array<Any?>, rowCount:Int,
+                                                returnRowIds:Boolean, outResults:LongArray)
+
+        // Packed type tags beyond Cursor.FIELD_TYPE_*. Values at least ZERO_COPY_BIND_THRESHOLD
+        // long are bound natively with SQLITE_STATIC and kept alive until the bindings are cleared,
+        // so SQLite does not copy them. Strings are handed over already encoded as UTF-8.
+        private const val BIND_TYPE_STRING_UTF8_STATIC = 5
+        private const val BIND_TYPE_BLOB_STATIC = 6
+        private const val ZERO_COPY_BIND_THRESHOLD = 8 * 1024
+
+        /**
+         * Stores one bind argument at index in the packed form nativeBindArguments expects.
+         * Integers and the raw bits of doubles go in values, strings and blobs in objects.
+         */
+        /**
+         * Bind arguments packed for a single native call: a type tag for each, integers and the
+         * raw bits of doubles in values, strings and blobs in objects.
+         */
+        private class PackedArguments(bindArgs:Array<Any?>?) {
+            val types:ByteArray
+            val values:LongArray
+            val objects:Array<Any?>
+
+            init {
+                val count = bindArgs?.size ?: 0
+                types = ByteArray(count)
+                values = LongArray(count)
+                objects = arrayOfNulls<Any>(count)
+                for (i in 0 until count)
+                {
+                    packArgument(bindArgs!![i], i, types, values, objects)
+                }
+            }
+        }
+
+        private fun packArgument(arg:Any?, index:Int, types:ByteArray, values:LongArray, objects:Array<Any?>) {
+            var type = DatabaseUtils.getTypeOfObject(arg)
+            when (type) {
+                Cursor.FIELD_TYPE_NULL -> {}
+                Cursor.FIELD_TYPE_INTEGER -> values[index] = (arg as Number).toLong()
+                Cursor.FIELD_TYPE_FLOAT -> values[index] = (arg as Number).toDouble().toRawBits()
+                Cursor.FIELD_TYPE_BLOB -> {
+                    if ((arg as ByteArray).size >= ZERO_COPY_BIND_THRESHOLD)
+                        type = BIND_TYPE_BLOB_STATIC
+                    objects[index] = arg
+                }
+                else -> if (arg is Boolean)
+                {
+                    // Provide compatibility with legacy applications which may pass
+                    // Boolean values in bind args.
+                    type = Cursor.FIELD_TYPE_INTEGER
+                    values[index] = (if (arg) 1 else 0).toLong()
+                }
+                else
+                {
+                    val str = arg.toString()
+                    if (str.length >= ZERO_COPY_BIND_THRESHOLD)
+                    {
+                        type = BIND_TYPE_STRING_UTF8_STATIC
+                        objects[index] = str.toUtf8()
+                    }
+                    else
+                    {
+                        type = Cursor.FIELD_TYPE_STRING
+                        objects[index] = str
+                    }
+                }
+            }
+            types[index] = type.toByte()
+        }
+
+        private fun batchColumnSize(column:Any):Int = when (column) {
+            is LongArray -> column.size
+            is DoubleArray -> column.size
+            is Array<*> -> column.size
+            else -> throw IllegalArgumentException("Unsupported batch column type: $column")
+        }
+
         private fun canonicalizeSyncMode(value:String):String {
             if (value == "0")
             {
@@ -949,7 +1455,7 @@ private external fun nextDataId():Int
 private external fun createDataStore(dataId:Int, maxCacheSize:Int)
 
 @SymbolName("SQLiteSupport_removeDataStore")
-private external fun removeDataStore(dataId:Int)
+private external fun removeDataStore(dataId:Int, connectionPtr:Long)
 
 @SymbolName("SQLiteSupport_getConnectionPtr")
 private external fun getConnectionPtr(dataId:Int):Long
@@ -958,7 +1464,7 @@ private external fun getConnectionPtr(dataId:Int):Long
 private external fun putConnectionPtr(dataId:Int, connectionPtr:Long)
 
 @SymbolName("SQLiteSupport_putStmt")
-private external fun putStmt(dataId:Int, sql:String, ptr:NativePreparedStatement)
+private external fun putStmt(dataId:Int, sql:String, ptr:NativePreparedStatement):Boolean
 
 @SymbolName("SQLiteSupport_getStmt")
 private external fun getStmt(dataId:Int, sql:String):NativePreparedStatement
@@ -984,11 +1490,21 @@ private external fun putDbConfig(dataId:Int, dbConfig:SQLiteDatabaseConfiguratio
 @SymbolName("SQLiteSupport_removeDbConfig")
 private external fun removeDbConfig(dataId:Int)
 
-@SymbolName("SQLiteSupport_evictAll")
-private external fun evictAll(dataId:Int)
 
 @SymbolName("SQLiteSupport_remove")
-private external fun remove(dataId:Int, sql:String)
+private external fun remove(dataId:Int, sql:String):Boolean
+
+@SymbolName("SQLiteSupport_drainReclaimed")
+private external fun drainReclaimed(dataId:Int)
+
+@SymbolName("SQLiteSupport_acquireReaderAccess")
+private external fun acquireReaderAccess(dataId:Int):Long
+
+@SymbolName("SQLiteSupport_releaseReaderAccess")
+private external fun releaseReaderAccess(dataId:Int)
+
+@SymbolName("SQLiteSupport_detachConnection")
+private external fun detachConnection(dataId:Int)
 
 @SymbolName("Android_Database_SQLiteConnection_nativeFinalizeStatement")
 private external fun nativeFinalizeStatement(connectionPtr:Long, statementPtr:Long)
@@ -1010,5 +1526,9 @@ private data class NativePreparedStatement(
         val mType:Int,
         // True if the statement is read-only.
         val mReadOnly:Boolean,
-        val mInCache:Boolean
+        val mInCache:Boolean,
+        // The result column names, read once when the statement was prepared.
+        val mColumnNames:Array<String>,
+        // The connection's schema generation when the statement was prepared.
+        val mSchemaGeneration:Int
 )
\ No newline at end of file
@@ -63,6 +63,27 @@ open class SQLiteCursor
     /** A mapping of column names to column indices, to speed up lookups */
     private var mColumnNameMap:Map<String, Int>? = null
 
+    /** Columns to copy into the window on the next fill, or null for all of them. */
+    private var mColumnMask:BooleanArray? = null
+
+    /** The mask the current window was filled with. */
+    private var mWindowColumnMask:BooleanArray? = null
+
+    /** How far through the window reading gets before the next window is prefetched, or 0 for never. */
+    private var mPrefetchThreshold = DEFAULT_PREFETCH_THRESHOLD
+
+    /** The window after the current one, being filled on a worker thread. */
+    private var mPrefetch:SQLiteAsyncFill? = null
+
+    /** The window swapped out for a prefetched one, kept to prefetch into next time. */
+    private var mSpareWindow:CursorWindow? = null
+
+    /**
+     * Start of the last prefetch that couldn't run in the background, so that every move through
+     * a window doesn't ask again, taking the session lock each time. -1 if none.
+     */
+    private var mPrefetchDeclinedAt = -1
+
     override val count:Int
         get() {
             if (mCount == NO_COUNT)
@@ -77,19 +98,105 @@ open class SQLiteCursor
         if ((mWindow == null || newPosition < mWindow!!.startPosition ||
                         newPosition >= (mWindow!!.startPosition + mWindow!!.numRows)))
         {
-            fillWindow(newPosition)
+            if (!swapInPrefetchedWindow(newPosition))
+                fillWindow(newPosition)
+        }
+        prefetchNextWindow(newPosition)
+        return true
+    }
+
+    /**
+     * Sets how far through the current window reading has to get before the rows after it start
+     * being read into a second window in the background, so that moving past the end swaps that
+     * window in instead of waiting for a fill. Needs reader connections, see
+     * [SQLiteDatabase.setReaderConnectionCount]; without them nothing is prefetched.
+     *
+     * @param threshold a fraction of the window between 0 and 1, or 0 to turn prefetching off.
+     * Default is 0.75.
+     */
+    fun setPrefetchThreshold(threshold:Float) {
+        if (threshold < 0f || threshold > 1f)
+        {
+            throw IllegalArgumentException("threshold must be between 0 and 1")
+        }
+        mPrefetchThreshold = threshold
+        if (threshold == 0f)
+        {
+            discardPrefetch()
+        }
+    }
+
+    private fun prefetchNextWindow(position:Int) {
+        val window = mWindow
+        if (mPrefetchThreshold == 0f || mPrefetch != null || mCount == NO_COUNT || window == null)
+            return
+        val nextStart = window.startPosition + window.numRows
+        if (window.numRows == 0 || nextStart >= mCount || nextStart == mPrefetchDeclinedAt
+                || position - window.startPosition < window.numRows * mPrefetchThreshold)
+            return
+
+        val spare = mSpareWindow ?: CursorWindow()
+        mSpareWindow = null
+        try
+        {
+            mPrefetch = mQuery.fillWindowInBackground(spare, nextStart, nextStart, false, mWindowColumnMask)
+        }
+        catch (ex:RuntimeException) {
+            // Left for the regular fill to run into and report.
+        }
+        if (mPrefetch == null)
+        {
+            mSpareWindow = spare
+            mPrefetchDeclinedAt = nextStart
+        }
+    }
+
+    private fun swapInPrefetchedWindow(requiredPos:Int):Boolean {
+        val prefetch = mPrefetch ?: return false
+        mPrefetch = null
+        val prefetched = prefetch.window
+        try
+        {
+            prefetch.await()
+        }
+        catch (ex:SQLiteException) {
+            mSpareWindow = prefetched
+            return false
         }
+
+        if (requiredPos < prefetched.startPosition || requiredPos >= prefetched.startPosition + prefetched.numRows)
+        {
+            mSpareWindow = prefetched
+            return false
+        }
+        // The prefetch was filled with the current window's column mask.
+        mSpareWindow = mWindow
+        mWindow = prefetched
         return true
     }
 
+    private fun discardPrefetch() {
+        val prefetch = mPrefetch ?: return
+        mPrefetch = null
+        prefetch.cancel()
+        if (mSpareWindow == null)
+            mSpareWindow = prefetch.window
+        else
+            prefetch.window.close()
+    }
+
     private fun fillWindow(requiredPos:Int) {
+        discardPrefetch()
+        mPrefetchDeclinedAt = -1
         clearOrCreateWindow()
+        val columnMask = mColumnMask?.copyOf()
+        mWindowColumnMask = columnMask
         try
         {
             if (mCount == NO_COUNT)
             {
                 val startPos = DatabaseUtils.cursorPickFillWindowStartPosition(requiredPos, 0)
-                mCount = mQuery.fillWindow(mWindow!!, startPos, requiredPos, true)
+                mCount = mQuery.fillWindow(mWindow!!, startPos, requiredPos, true, columnMask)
                 mCursorWindowCapacity = mWindow!!.numRows
                 if (Log.isLoggable(TAG, Log.DEBUG_)) {
                      Log.d(TAG, "received count(*) from native_fill_window: $mCount");
@@ -99,7 +206,7 @@ open class SQLiteCursor
             {
                 val startPos = DatabaseUtils.cursorPickFillWindowStartPosition(requiredPos,
                         mCursorWindowCapacity)
-                mQuery.fillWindow(mWindow!!, startPos, requiredPos, false)
+                mQuery.fillWindow(mWindow!!, startPos, requiredPos, false, columnMask)
             }
         }
         catch (ex:RuntimeException) {
@@ -112,6 +219,34 @@ open class SQLiteCursor
         }
     }
 
+    /**
+     * Limits the columns copied into the cursor window to the ones given, which is worthwhile
+     * when only a few columns of a wide result are read. A column left out is still readable:
+     * the first read adds it to the set and refills the window around the current row.
+     * Takes effect the next time the window is filled.
+     */
+    fun setFetchedColumns(vararg columnIndexes:Int) {
+        val mask = BooleanArray(columnCount)
+        for (columnIndex in columnIndexes)
+        {
+            mask[columnIndex] = true
+        }
+        mColumnMask = mask
+    }
+
+    fun setFetchedColumns(vararg columnNames:String) {
+        setFetchedColumns(*IntArray(columnNames.size) { getColumnIndexOrThrow(columnNames[it]) })
+    }
+
+    override fun checkColumn(columnIndex:Int) {
+        val windowMask = mWindowColumnMask
+        if (windowMask != null && columnIndex >= 0 && columnIndex < windowMask.size && !windowMask[columnIndex])
+        {
+            mColumnMask!![columnIndex] = true
+            fillWindow(position)
+        }
+    }
+
     override fun getColumnIndex(columnName:String):Int {
         var columnNameLocal = columnName
         // Create mColumnNameMap on demand
@@ -143,6 +278,13 @@ open class SQLiteCursor
         mDriver.cursorDeactivated()
     }
 
+    override fun onDeactivateOrClose() {
+        discardPrefetch()
+        mSpareWindow?.close()
+        mSpareWindow = null
+        super.onDeactivateOrClose()
+    }
+
     override fun close() {
         super.close()
         mQuery.close()
@@ -150,7 +292,10 @@ open class SQLiteCursor
     }
 
     fun setWindow(window:CursorWindow) {
+        discardPrefetch()
+        mPrefetchDeclinedAt = -1
         super.window = window
+        mWindowColumnMask = null
         mCount = NO_COUNT
     }
 
@@ -164,5 +309,6 @@ open class SQLiteCursor
     companion object {
         internal val TAG = "SQLiteCursor"
         internal val NO_COUNT = -1
+        internal val DEFAULT_PREFETCH_THRESHOLD = 0.75f
     }
 }
\ No newline at end of file
@@ -801,6 +801,45 @@ class SQLiteDatabase private constructor(cursorFactory: CursorFactory?, errorHan
         return driver.query(cursorFactory ?: mCursorFactory, selectionArgs)
     }
 
+    /**
+     * Runs a query into a cursor window on a native worker thread, returning as soon as it
+     * has been handed off. Use this to keep large reads off threads that must not block.
+     *<p>
+     * Fills run on the reader connections, see {@link #setReaderConnectionCount}. Without
+     * readers, or while a transaction is open, the window is filled before this returns and the
+     * result is already done.
+     *
+     * @param sql a SELECT statement
+     * @param bindArgs the arguments to bind, or null
+     * @param window the window to fill, which must not be used until the fill is done
+     * @param startPos the first row to put in the window
+     * @param countAllRows whether to step through the whole result to count its rows
+     */
+    fun fillWindowAsync(sql:String, bindArgs:Array<Any?>?, window:CursorWindow,
+                        startPos:Int = 0, countAllRows:Boolean = true):SQLiteAsyncFill {
+        throwIfNotOpenLocked()
+        return sqliteSession.executeForCursorWindowAsync(sql, bindArgs, window,
+                startPos, startPos, countAllRows)
+    }
+
+    /**
+     * Runs a query and returns a forward-only cursor over its rows, read straight from the
+     * statement as the cursor moves instead of through a cursor window. Suited to one pass over
+     * a large result, which never has to fit in memory at once.
+     *<p>
+     * The query runs on a reader connection when one is idle and no transaction is open, see
+     * {@link #setReaderConnectionCount}, and holds on to it until the cursor is closed. Otherwise
+     * it runs on the main connection.
+     *
+     * @param sql the SQL query
+     * @param bindArgs the arguments to bind, or null
+     * @return A cursor positioned before the first row, which must be closed.
+     */
+    fun rawQueryStream(sql:String, bindArgs:Array<Any?>? = null):SQLiteStreamCursor {
+        throwIfNotOpenLocked()
+        return sqliteSession.openStream(sql, bindArgs)
+    }
+
 
     /**
      * Convenience method for inserting a row into the database.
@@ -1206,6 +1245,303 @@ class SQLiteDatabase private constructor(cursorFactory: CursorFactory?, errorHan
         reopen()
     }
 
+    /**
+     * Sets how long to wait for a lock held by another connection before failing with
+     * a {@link SQLiteException}. Waiting backs off exponentially, with jitter,
+     * from a fraction of a millisecond up to maxBackoffMs between attempts.
+     *
+     * @param timeoutMs total time to wait, or 0 to fail immediately
+     * @param maxBackoffMs the longest single sleep
+     */
+    fun setBusyTimeout(timeoutMs: Int, maxBackoffMs: Int = 50) {
+        if (timeoutMs < 0 || maxBackoffMs < 0) {
+            throw IllegalStateException("expected non-negative values")
+        }
+        throwIfNotOpenLocked()
+        val config = sqliteSession.getDbConfig()
+        if (config.busyTimeoutMs == timeoutMs && config.busyMaxBackoffMs == maxBackoffMs) {
+            return
+        }
+        sqliteSession.putDbConfig(config.copy(busyTimeoutMs = timeoutMs, busyMaxBackoffMs = maxBackoffMs))
+
+        reopen()
+    }
+
+    /**
+     * Sets how many read-only connections to open next to the main one. Queries outside of
+     * transactions run on these, so several threads can read at once, and read while another
+     * writes, instead of all queueing for the one connection. A query that finds every reader
+     * busy, for instance held by open stream cursors, runs on the main connection instead.
+     *<p>
+     * Takes effect only with write-ahead logging enabled (see {@link #ENABLE_WRITE_AHEAD_LOGGING}),
+     * and not for in-memory databases.
+     *
+     * @param readerCount the number of reader connections, or 0 for none (the default)
+     */
+    fun setReaderConnectionCount(readerCount: Int) {
+        if (readerCount < 0) {
+            throw IllegalStateException("expected a non-negative value")
+        }
+        throwIfNotOpenLocked()
+        val config = sqliteSession.getDbConfig()
+        if (config.readerConnectionCount == readerCount) {
+            return
+        }
+        sqliteSession.putDbConfig(config.copy(readerConnectionCount = readerCount))
+
+        reopen()
+    }
+
+    /**
+     * Moves WAL checkpoints off the writing thread. Normally whichever commit pushes the WAL past
+     * its auto-checkpoint size copies it back into the database before returning, so that one
+     * write takes far longer than the rest. With this set, a background thread with its own
+     * connection checkpoints instead: once walFrames frames are waiting, and once writes have
+     * stopped for idleMs, when it also truncates the WAL file.
+     *<p>
+     * Takes effect only with write-ahead logging enabled (see {@link #ENABLE_WRITE_AHEAD_LOGGING}),
+     * and not for in-memory databases.
+     *
+     * @param walFrames the WAL size in frames that starts a checkpoint, or 0 to leave
+     * checkpointing to SQLite (the default)
+     * @param idleMs how long writes must have stopped before checkpointing what is left
+     */
+    fun setWalCheckpointPolicy(walFrames: Int, idleMs: Int = 1000) {
+        if (walFrames < 0 || idleMs <= 0) {
+            throw IllegalStateException("expected a non-negative frame count and a positive idle time")
+        }
+        throwIfNotOpenLocked()
+        val config = sqliteSession.getDbConfig()
+        if (config.walCheckpointFrames == walFrames && config.walCheckpointIdleMs == idleMs) {
+            return
+        }
+        sqliteSession.putDbConfig(config.copy(walCheckpointFrames = walFrames, walCheckpointIdleMs = idleMs))
+
+        reopen()
+    }
+
+    /**
+     * Returns what the background WAL checkpointer has done, see {@link #setWalCheckpointPolicy}.
+     */
+    fun getCheckpointStats():SQLiteDebug.CheckpointStats {
+        throwIfNotOpenLocked()
+        return sqliteSession.getCheckpointStats()
+    }
+
+    /**
+     * Returns how long this database's connection has waited on locks held elsewhere.
+     */
+    fun getContentionStats():SQLiteDebug.ContentionStats {
+        throwIfNotOpenLocked()
+        return sqliteSession.getContentionStats()
+    }
+
+    /**
+     * Sets how many query row counts each connection remembers.
+     *<p>
+     * A cursor needs the total row count of its query on the first window fill, which means
+     * stepping through every row even when only the first window is read. With this set, the
+     * count is remembered per SQL text and bound arguments, and reused for as long as the
+     * database has not been written to. Queries whose results change without a write, such as
+     * ones using random(), should not be run on a database with this enabled.
+     *
+     * @param cacheSize the number of counts to keep, or 0 to disable (the default)
+     * @throws IllegalStateException if cacheSize is negative.
+     */
+    fun setRowCountCacheSize(cacheSize: Int) {
+        if (cacheSize < 0) {
+            throw IllegalStateException("expected a non-negative value")
+        }
+        throwIfNotOpenLocked()
+        val config = sqliteSession.getDbConfig()
+        if (config.rowCountCacheSize == cacheSize) {
+            return
+        }
+        sqliteSession.putDbConfig(config.copy(rowCountCacheSize = cacheSize))
+
+        reopen()
+    }
+
+    /**
+     * Sets how much memory to keep window fills in, for queries run again with the same SQL and
+     * arguments.
+     *<p>
+     * A repeat query outside of a transaction gets a copy of the window filled the last time,
+     * without running, for as long as none of the tables it reads has been written to. Only
+     * SELECTs are kept, and not ones calling functions such as random() or datetime() whose
+     * results change by themselves, or functions added by native function installers. Writes are only seen when made through this database, so
+     * don't use this on a file that other connections or processes write to, or call
+     * {@link #clearResultCache} after they do.
+     *
+     * @param maxBytes the memory to use, or 0 to disable (the default)
+     * @throws IllegalStateException if maxBytes is negative.
+     */
+    fun setResultCacheSize(maxBytes: Int) {
+        if (maxBytes < 0) {
+            throw IllegalStateException("expected a non-negative value")
+        }
+        throwIfNotOpenLocked()
+        val config = sqliteSession.getDbConfig()
+        if (config.resultCacheBytes == maxBytes) {
+            return
+        }
+        sqliteSession.putDbConfig(config.copy(resultCacheBytes = maxBytes))
+
+        reopen()
+    }
+
+    /**
+     * Sets the most memory the page cache of each connection may hold, readers included.
+     *<p>
+     * Pages past the budget are dropped least recently used first and read again from the file
+     * when next needed. The process-wide limit set with {@link SQLiteGlobal#setHeapLimits} still
+     * applies on top of it.
+     *
+     * @param bytes the budget per connection, or 0 for SQLite's default of about 2 MB
+     * @throws IllegalStateException if bytes is negative.
+     */
+    fun setPageCacheSize(bytes: Int) {
+        if (bytes < 0) {
+            throw IllegalStateException("expected a non-negative value")
+        }
+        throwIfNotOpenLocked()
+        val config = sqliteSession.getDbConfig()
+        if (config.pageCacheBytes == bytes) {
+            return
+        }
+        sqliteSession.putDbConfig(config.copy(pageCacheBytes = bytes))
+
+        reopen()
+    }
+
+    /**
+     * Keeps the last statement runs that took thresholdMs or more, with their SQL, the types of
+     * their arguments and their query plans, for {@link #getSlowQueries}.
+     *<p>
+     * Plans come from EXPLAIN QUERY PLAN on a read-only connection of the log's own, so none are
+     * had for in-memory databases, or for queries on temp tables, attached databases or functions
+     * added after the database was opened. They are taken by {@link #getSlowQueries}, not by the
+     * run that was slow, so keeping the log costs the runs next to nothing. A plan is therefore
+     * the one SQLite would pick when the log is read: if the schema or ANALYZE statistics changed
+     * after the run, it may not be the plan the run used. Argument values are never kept.
+     *
+     * @param thresholdMs the shortest run to keep, or 0 to disable (the default)
+     * @param logSize the number of runs kept, the oldest making room for the newest
+     * @throws IllegalStateException if thresholdMs is negative or logSize isn't positive.
+     */
+    fun setSlowQueryThreshold(thresholdMs:Int, logSize:Int = 32) {
+        if (thresholdMs < 0 || logSize <= 0) {
+            throw IllegalStateException("expected a non-negative threshold and a positive size")
+        }
+        throwIfNotOpenLocked()
+        val config = sqliteSession.getDbConfig()
+        if (config.slowQueryThresholdMs == thresholdMs && config.slowQueryLogSize == logSize) {
+            return
+        }
+        sqliteSession.putDbConfig(config.copy(slowQueryThresholdMs = thresholdMs,
+                slowQueryLogSize = logSize))
+
+        reopen()
+    }
+
+    /**
+     * Subscribes to the changes committed through this database. Each committed transaction
+     * arrives as one batch listing the tables it changed, by operation, with the rowids
+     * changed, so that only what depends on those tables needs refreshing. A batch arrives once
+     * its commit has finished, so a query run on receiving it sees the changes. Rolled back
+     * changes never arrive.
+     *<p>
+     * Batches queue up until polled. A subscriber that lets more than capacity of them pile up
+     * misses the ones after, and gets an incomplete batch in their place. Closing the database,
+     * or changing a setting that reopens it, ends the subscription.
+     *
+     * @param capacity the number of batches that can wait to be polled
+     */
+    fun subscribeToChanges(capacity:Int = 64):SQLiteChangeSubscription {
+        if (capacity <= 0) {
+            throw IllegalStateException("expected a positive capacity")
+        }
+        throwIfNotOpenLocked()
+        return sqliteSession.subscribeToChanges(capacity)
+    }
+
+    /**
+     * Drops every window fill kept by the result cache, see {@link #setResultCacheSize}.
+     */
+    fun clearResultCache() {
+        throwIfNotOpenLocked()
+        sqliteSession.clearResultCache()
+    }
+
+    /**
+     * Returns how well the result cache is doing, see {@link #setResultCacheSize}.
+     */
+    fun getResultCacheStats():SQLiteDebug.ResultCacheStats {
+        throwIfNotOpenLocked()
+        return sqliteSession.getResultCacheStats()
+    }
+
+    /**
+     * Returns latency percentiles for each query run on this database since it was opened, or
+     * since {@link #resetQueryMetrics}, the most time consuming first. Queries count as the same
+     * when they only differ in literals, comments and whitespace. Changing a setting that reopens
+     * the database starts over.
+     */
+    fun getQueryMetrics():List<SQLiteDebug.QueryMetrics> {
+        throwIfNotOpenLocked()
+        return sqliteSession.getQueryMetrics()
+    }
+
+    /**
+     * Returns what SQLite counted for each query run on this database since it was opened, or
+     * since {@link #resetQueryMetrics}: full scan steps, sorts, automatic indexes and the like,
+     * the costliest first by virtual machine steps. Queries are grouped as in
+     * {@link #getQueryMetrics}, and a run is counted when its statement is done or reset. They
+     * cover every statement the writer and its readers run, not only the cached ones.
+     */
+    fun getStatementStats():List<SQLiteDebug.StatementStats> {
+        throwIfNotOpenLocked()
+        return sqliteSession.getStatementStats()
+    }
+
+    /**
+     * Returns the memory and page cache use of the main connection, then of each reader
+     * connection not running a query at the time. The page cache hit rate and the memory split
+     * between cache, schema and statements show whether cache_size and lookaside need tuning.
+     *
+     * @param reset whether to start the counts and maximums over once read
+     */
+    fun getConnectionMemoryStats(reset:Boolean = false):List<SQLiteDebug.ConnectionMemoryStats> {
+        throwIfNotOpenLocked()
+        return sqliteSession.getConnectionMemoryStats(reset)
+    }
+
+    /**
+     * Returns the slow query log, oldest first, see {@link #setSlowQueryThreshold}. Empty while
+     * the log is disabled. Takes the plans of the runs recorded since the last call.
+     */
+    fun getSlowQueries():List<SQLiteDebug.SlowQuery> {
+        throwIfNotOpenLocked()
+        return sqliteSession.getSlowQueries()
+    }
+
+    /**
+     * Empties the slow query log.
+     */
+    fun clearSlowQueries() {
+        throwIfNotOpenLocked()
+        sqliteSession.clearSlowQueries()
+    }
+
+    /**
+     * Clears the latencies returned by {@link #getQueryMetrics} and the counters returned by
+     * {@link #getStatementStats}.
+     */
+    fun resetQueryMetrics() {
+        throwIfNotOpenLocked()
+        sqliteSession.resetQueryMetrics()
+    }
+
     /**
      * Sets whether foreign key constraints are enabled for the database.
      * <p>
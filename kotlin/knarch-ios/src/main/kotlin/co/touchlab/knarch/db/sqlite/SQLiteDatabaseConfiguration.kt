@@ -56,7 +56,76 @@ data class SQLiteDatabaseConfiguration(
          *
          * If negative, the default lookaside configuration will be used
          */
-        val lookasideSlotCount:Int = -1
+        val lookasideSlotCount:Int = -1,
+        /**
+         * The number of query row counts each connection remembers, so that a cursor reopened
+         * over unchanged data knows its count without stepping through every row.
+         *
+         * Default is 0, which disables it.
+         */
+        val rowCountCacheSize:Int = 0,
+        /**
+         * How long to wait for a lock held by another connection before failing with
+         * SQLITE_BUSY, in milliseconds.
+         *
+         * Default is 2500.
+         */
+        val busyTimeoutMs:Int = 2500,
+        /**
+         * The longest single sleep while waiting for a lock, in milliseconds. Sleeps start
+         * short and double up to this.
+         *
+         * Default is 50.
+         */
+        val busyMaxBackoffMs:Int = 50,
+        /**
+         * The number of read-only connections opened next to the main one when write-ahead
+         * logging is enabled. Queries outside of transactions run on them, in parallel with
+         * each other and with writes.
+         *
+         * Default is 0.
+         */
+        val readerConnectionCount:Int = 0,
+        /**
+         * The number of WAL frames that starts a checkpoint on a background thread. While
+         * positive, commits no longer checkpoint the WAL themselves.
+         *
+         * Default is 0, which leaves checkpointing to SQLite.
+         */
+        val walCheckpointFrames:Int = 0,
+        /**
+         * How long writes must have stopped before the background checkpointer copies back
+         * whatever is left in the WAL and truncates it, in milliseconds.
+         *
+         * Default is 1000.
+         */
+        val walCheckpointIdleMs:Int = 1000,
+        /**
+         * The memory set aside for window fills kept for queries run again with the same
+         * arguments, in bytes. Shared by the main connection and its readers.
+         *
+         * Default is 0, which disables it.
+         */
+        val resultCacheBytes:Int = 0,
+        /**
+         * How long a statement must run for to go into the slow query log, in milliseconds.
+         *
+         * Default is 0, which disables the log.
+         */
+        val slowQueryThresholdMs:Int = 0,
+        /**
+         * The number of slow queries kept, the oldest making room for the newest.
+         *
+         * Default is 32.
+         */
+        val slowQueryLogSize:Int = 32,
+        /**
+         * The most memory each connection's page cache may hold, in bytes. Readers get the same
+         * budget each.
+         *
+         * Default is 0, which keeps SQLite's default of about 2 MB.
+         */
+        val pageCacheBytes:Int = 0
 ){
 
     companion object {
@@ -79,7 +148,7 @@ data class SQLiteDatabaseConfiguration(
 //            Pattern.compile("[\\w\\.\\-]+@[\\w\\.\\-]+");
 
     override fun toString(): String {
-        return "path: $path, lable: $label, openFlags: $openFlags, maxSqlCacheSize: $maxSqlCacheSize, foreignKeyConstraintsEnabled: $foreignKeyConstraintsEnabled"
+        return "path: $path, lable: $label, openFlags: $openFlags, maxSqlCacheSize: $maxSqlCacheSize, foreignKeyConstraintsEnabled: $foreignKeyConstraintsEnabled, rowCountCacheSize: $rowCountCacheSize"
     }
 
     /**
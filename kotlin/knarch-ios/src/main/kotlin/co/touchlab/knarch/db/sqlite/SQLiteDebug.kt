@@ -38,7 +38,9 @@ object SQLiteDebug {
      * contains statistics about a database
      */
     class DbStats(dbName:String, pageCount:Long, pageSize:Long, lookaside:Int,
-                  hits:Int, misses:Int, cachesize:Int) {
+                  hits:Int, misses:Int, cachesize:Int,
+                  /** the rest of sqlite3_db_status, for the main database only */
+                  val memory:ConnectionMemoryStats? = null) {
         /** name of the database */
         var dbName:String
         /** the page size for the database */
@@ -57,4 +59,176 @@ object SQLiteDebug {
             this.cache = "$hits/$misses/$cachesize"
         }
     }
+
+    /**
+     * Memory and page cache use of one connection, from sqlite3_db_status. Memory is in bytes.
+     * Counts and maximums are since the connection opened or they were last reset.
+     */
+    class ConnectionMemoryStats(
+            /** "main", or "reader" for the read-only connections queries run on. */
+            val connection:String,
+            /** Lookaside slots in use. */
+            val lookasideUsed:Long,
+            val lookasideUsedMax:Long,
+            /** Allocations served from lookaside. */
+            val lookasideHits:Long,
+            /** Allocations too big for a lookaside slot. */
+            val lookasideMissesSize:Long,
+            /** Allocations that found every lookaside slot taken. */
+            val lookasideMissesFull:Long,
+            val cacheUsedBytes:Long,
+            /** Page cache memory, with a cache shared by connections split evenly among them. */
+            val cacheUsedSharedBytes:Long,
+            val cacheHits:Long,
+            val cacheMisses:Long,
+            val cacheWrites:Long,
+            /** Dirty pages written out before commit because the cache was full. */
+            val cacheSpills:Long,
+            val schemaUsedBytes:Long,
+            val statementsUsedBytes:Long,
+            /** Whether deferred foreign key violations are waiting for the transaction to end. */
+            val deferredForeignKeys:Boolean) {
+
+        /** Share of page lookups found in the cache, or 0 before any. */
+        val cacheHitRate:Double
+            get() = if (cacheHits + cacheMisses == 0L) 0.0
+                    else cacheHits.toDouble() / (cacheHits + cacheMisses)
+    }
+
+    /**
+     * SQLite's memory use across the process, from sqlite3_status64. Maximums are since the
+     * process started or they were last reset.
+     */
+    class MemoryStats(
+            val usedBytes:Long,
+            val usedMaxBytes:Long,
+            /** Allocations outstanding. */
+            val allocations:Long,
+            val largestAllocationBytes:Long,
+            /** Pages in the page cache memory set aside with SQLITE_CONFIG_PAGECACHE, if any. */
+            val pageCacheUsed:Long,
+            /** Page cache memory that didn't fit there and came from the heap. */
+            val pageCacheOverflowBytes:Long,
+            val pageCacheOverflowMaxBytes:Long,
+            val largestPageBytes:Long,
+            /**
+             * Memory held by open cursor windows, which is outside SQLite's heap. Only counted
+             * against the soft limit once one is set with SQLiteGlobal.setHeapLimits.
+             */
+            val cursorWindowBytes:Long,
+            /**
+             * The limits in force, or 0 for none. The soft one is 8 MB until
+             * SQLiteGlobal.setHeapLimits sets another.
+             */
+            val softHeapLimitBytes:Long,
+            val hardHeapLimitBytes:Long)
+
+    /**
+     * Time a connection has spent waiting for locks held by other connections.
+     */
+    class ContentionStats(
+            /** Times a statement found the database locked by another connection. */
+            val busyWaits:Long,
+            /** Backoff sleeps taken while waiting for those locks. */
+            val busyRetries:Long,
+            /** Waits that gave up at the busy timeout. */
+            val busyTimeouts:Long,
+            val busyWaitMicros:Long,
+            /** Waits for a shared cache table lock. */
+            val unlockWaits:Long,
+            val unlockWaitMicros:Long)
+
+    /**
+     * Work done by a connection's background WAL checkpointer.
+     */
+    class CheckpointStats(
+            /** Size of the WAL in frames, each a page plus a 24 byte header, as of the last commit or checkpoint. */
+            val walFrames:Long,
+            val passiveCheckpoints:Long,
+            val truncateCheckpoints:Long,
+            /** Checkpoints that readers or the writer kept from copying back the whole WAL. */
+            val busyCheckpoints:Long,
+            val framesCheckpointed:Long,
+            val totalCheckpointMicros:Long,
+            val maxCheckpointMicros:Long,
+            val lastCheckpointMicros:Long)
+
+    /**
+     * Use of the window fills kept for repeat queries.
+     */
+    class ResultCacheStats(
+            val hits:Long,
+            /** Lookups of cacheable queries that had to run. */
+            val misses:Long,
+            val stores:Long,
+            /** Entries dropped because a table they read, or the schema, had changed. */
+            val invalidated:Long,
+            /** Entries dropped to make room. */
+            val evicted:Long,
+            val entries:Long,
+            val bytes:Long)
+
+    /**
+     * Latencies of one query, as SQL with its literals replaced by ?. Percentiles are within
+     * 12.5% of the true value.
+     */
+    class QueryMetrics(
+            val sql:String,
+            val prepare:LatencyStats,
+            /** Running the statement, as SQLite reports it. */
+            val step:LatencyStats,
+            /** Filling cursor windows, including the steps that takes. */
+            val fill:LatencyStats)
+
+    class LatencyStats(
+            val count:Long,
+            val totalMicros:Long,
+            val maxMicros:Long,
+            val p50Micros:Long,
+            val p90Micros:Long,
+            val p99Micros:Long,
+            val p999Micros:Long)
+
+    /**
+     * What SQLite counted while running one query, as SQL with its literals replaced by ?.
+     */
+    class StatementStats(
+            val sql:String,
+            val runs:Long,
+            /** Virtual machine instructions run, roughly the work the query took. */
+            val vmSteps:Long,
+            /** Rows stepped through in full table scans. A large number may call for an index. */
+            val fullScanSteps:Long,
+            /** Sorts done, for ORDER BY, GROUP BY or DISTINCT without a usable index. */
+            val sorts:Long,
+            /** Rows put into automatic indexes, built for a run and thrown away. */
+            val autoIndexRows:Long,
+            /** Times the statement had to be prepared again after a schema change. */
+            val reprepares:Long,
+            /** Most heap memory one statement for the query used, in bytes. */
+            val maxMemoryBytes:Long)
+
+    /**
+     * A run of a statement that took at least the slow query threshold. toString() gives a
+     * block of text for logs and bug reports.
+     */
+    class SlowQuery(
+            /** The SQL with its literals replaced by ?. */
+            val sql:String,
+            /** The types of the bound arguments, such as INTEGER or TEXT, in parameter order. */
+            val argumentTypes:List<String>,
+            /**
+             * The EXPLAIN QUERY PLAN output for the SQL, one line per step indented under its
+             * parent, or why it couldn't be had. Taken when the log was read, against the schema
+             * and statistics of then, see {@link SQLiteDatabase#setSlowQueryThreshold}.
+             */
+            val plan:String,
+            val micros:Long,
+            /** When the run finished, in milliseconds since the epoch. */
+            val finishedMillis:Long) {
+
+        override fun toString():String =
+                "$sql\n  took ${micros}us at $finishedMillis, arguments $argumentTypes\n" +
+                        plan.lines().joinToString("\n") { "  $it" }
+    }
 }
\ No newline at end of file
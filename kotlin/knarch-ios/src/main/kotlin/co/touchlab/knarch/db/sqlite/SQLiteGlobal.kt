@@ -78,4 +78,45 @@ object SQLiteGlobal {
     fun releaseMemory(): Int {
         return nativeReleaseMemory()
     }
+
+    @SymbolName("Android_Database_SQLiteGlobal_nativeSetHeapLimits")
+    private external fun nativeSetHeapLimits(softBytes: Long, hardBytes: Long)
+
+    /**
+     * Sets the memory SQLite may use across all databases in the process, in place of the
+     * default 8 MB soft limit.
+     *<p>
+     * Past the soft limit SQLite frees page cache before allocating more. Unlike the default,
+     * a limit set here has open cursor windows count against it too, leaving SQLite what they
+     * don't use, but never less than a quarter of it. Past the hard limit allocations fail with
+     * SQLITE_NOMEM. Both are 0 for no limit.
+     *
+     * @param softBytes the soft limit
+     * @param hardBytes the hard limit, ignored before SQLite 3.31
+     * @throws IllegalArgumentException if either is negative.
+     */
+    fun setHeapLimits(softBytes: Long, hardBytes: Long = 0) {
+        if (softBytes < 0 || hardBytes < 0) {
+            throw IllegalArgumentException("expected non-negative limits")
+        }
+        nativeSetHeapLimits(softBytes, hardBytes)
+    }
+
+    @SymbolName("Android_Database_SQLiteGlobal_nativeGetMemoryStatus")
+    private external fun nativeGetMemoryStatus(reset: Boolean, outStatus: LongArray)
+
+    // Size of the array filled by nativeGetMemoryStatus.
+    private const val MEMORY_STATUS_SIZE = 11
+
+    /**
+     * Returns how much memory SQLite uses across all databases in the process.
+     *
+     * @param reset whether to start the maximums over from the current values
+     */
+    fun getMemoryStats(reset: Boolean = false): SQLiteDebug.MemoryStats {
+        val status = LongArray(MEMORY_STATUS_SIZE)
+        nativeGetMemoryStatus(reset, status)
+        return SQLiteDebug.MemoryStats(status[0], status[1], status[2], status[3], status[4],
+                status[5], status[6], status[7], status[8], status[9], status[10])
+    }
 }
\ No newline at end of file
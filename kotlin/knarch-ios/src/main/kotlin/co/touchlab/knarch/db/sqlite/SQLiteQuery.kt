@@ -33,18 +33,20 @@ class SQLiteQuery internal constructor(db:SQLiteDatabase, query:String):SQLitePr
      * If it won't fit, then the query should discard part of what it filled.
      * @param countAllRows True to count all rows that the query would
      * return regardless of whether they fit in the window.
+     * @param columnMask Columns to copy into the window, or null for all of them.
      * @return Number of rows that were enumerated. Might not be all rows
      * unless countAllRows is true.
      *
      * @throws SQLiteException if an error occurs.
      */
-    internal fun fillWindow(window:CursorWindow, startPos:Int, requiredPos:Int, countAllRows:Boolean):Int {
+    internal fun fillWindow(window:CursorWindow, startPos:Int, requiredPos:Int, countAllRows:Boolean,
+                            columnMask:BooleanArray? = null):Int {
         return withRef {
             window.acquireReference()
             try
             {
                 getSession().executeForCursorWindow(getSql(), getBindArgs(),
-                        window, startPos, requiredPos, countAllRows)
+                        window, startPos, requiredPos, countAllRows, columnMask)
             }
             catch (ex:SQLiteDatabaseCorruptException) {
                 onCorruption()
@@ -60,6 +62,22 @@ class SQLiteQuery internal constructor(db:SQLiteDatabase, query:String):SQLitePr
             }
         }
     }
+
+    /**
+     * Starts reading rows into the window on a worker thread, see [fillWindow] for the
+     * parameters. The window must not be used until the returned fill is done.
+     *
+     * @return The pending fill, or null if the query can't run in the background, in which case
+     * nothing has been done.
+     */
+    internal fun fillWindowInBackground(window:CursorWindow, startPos:Int, requiredPos:Int, countAllRows:Boolean,
+                                        columnMask:BooleanArray? = null):SQLiteAsyncFill? {
+        return withRef {
+            getSession().tryExecuteForCursorWindowAsync(getSql(), getBindArgs(),
+                    window, startPos, requiredPos, countAllRows, columnMask)
+        }
+    }
+
     override fun toString():String {
         return "SQLiteQuery: " + getSql()
     }
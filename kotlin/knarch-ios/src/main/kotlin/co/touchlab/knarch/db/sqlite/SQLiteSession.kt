@@ -403,6 +403,21 @@ class SQLiteSession(private val mConnection: SQLiteConnection) {
             }
 
 
+    /**
+     * Executes a statement once per row of columnar input in a single native call.
+     *
+     * @param sql The SQL statement to execute.
+     * @param columns One column of values per bind parameter.
+     * @param returnRowIds True to return inserted row ids, false for changed row counts.
+     * @return One result per input row.
+     *
+     * @throws SQLiteException if an error occurs, such as a constraint violation.
+     */
+    fun executeBatch(sql:String, columns:Array<out Any>, returnRowIds:Boolean):LongArray =
+            withLock {
+                mConnection.executeBatch(sql, columns, returnRowIds) // might throw
+            }
+
     /**
      * Executes a statement and populates the specified {@link CursorWindow}
      * with a range of results. Returns the number of rows that were counted
@@ -417,6 +432,7 @@ class SQLiteSession(private val mConnection: SQLiteConnection) {
      * so that it does. Must be greater than or equal to <code>startPos</code>.
      * @param countAllRows True to count all rows that the query would return
      * regagless of whether they fit in the window.
+     * @param columnMask Columns to copy into the window, or null for all of them.
      *
      * @return The number of rows that were counted during query execution. Might
      * not be all rows in the result set unless <code>countAllRows</code> is true.
@@ -426,20 +442,89 @@ class SQLiteSession(private val mConnection: SQLiteConnection) {
      *
      */
     fun executeForCursorWindow(sql:String, bindArgs:Array<Any?>?,
-                               window:CursorWindow, startPos:Int, requiredPos:Int, countAllRows:Boolean
-                               ):Int =
-            withLock {
-                if (executeSpecial(sql))
-                {
-                    window.clear()
-                    0
-                }
-                else {
-                    mConnection.executeForCursorWindow(sql, bindArgs,
-                            window, startPos, requiredPos, countAllRows) // might throw
-                }
+                               window:CursorWindow, startPos:Int, requiredPos:Int, countAllRows:Boolean,
+                               columnMask:BooleanArray? = null
+                               ):Int {
+        // Routed under the lock. Readers only see what has been committed, so a transaction
+        // keeps its queries here.
+        val onReader = withLock {
+            if (executeSpecial(sql))
+            {
+                window.clear()
+                null
+            }
+            else {
+                DatabaseUtils.getSqlStatementType(sql) == DatabaseUtils.STATEMENT_SELECT
+                        && mConnection.getTransaction() == null
             }
+        } ?: return 0
+
+        if (onReader)
+        {
+            val counted = mConnection.executeForCursorWindowOnReader(sql, bindArgs,
+                    window, startPos, requiredPos, countAllRows, columnMask)
+            if (counted != null)
+                return counted
+        }
+        return withLock {
+            mConnection.executeForCursorWindow(sql, bindArgs,
+                    window, startPos, requiredPos, countAllRows, columnMask) // might throw
+        }
+    }
+
+    /**
+     * Starts filling the window on a worker thread when the query can run on a reader
+     * connection. Otherwise fills it on this thread, and the result is already done. Either way
+     * a failed query is reported by [SQLiteAsyncFill.await].
+     */
+    fun executeForCursorWindowAsync(sql:String, bindArgs:Array<Any?>?,
+                                    window:CursorWindow, startPos:Int, requiredPos:Int, countAllRows:Boolean,
+                                    columnMask:BooleanArray? = null):SQLiteAsyncFill {
+        val pending = tryExecuteForCursorWindowAsync(sql, bindArgs,
+                window, startPos, requiredPos, countAllRows, columnMask)
+        if (pending != null)
+            return pending
+        val counted = try {
+            executeForCursorWindow(sql, bindArgs,
+                    window, startPos, requiredPos, countAllRows, columnMask)
+        }
+        catch (ex:SQLiteException) {
+            return SQLiteAsyncFill(window, 0L, 0, ex)
+        }
+        return SQLiteAsyncFill(window, 0L, counted)
+    }
 
+    /**
+     * Like [executeForCursorWindowAsync], but returns null instead of filling the window on this
+     * thread when the query can't run on a reader connection.
+     */
+    fun tryExecuteForCursorWindowAsync(sql:String, bindArgs:Array<Any?>?,
+                                       window:CursorWindow, startPos:Int, requiredPos:Int, countAllRows:Boolean,
+                                       columnMask:BooleanArray? = null):SQLiteAsyncFill? {
+        if (DatabaseUtils.getSqlStatementType(sql) != DatabaseUtils.STATEMENT_SELECT || hasTransaction())
+            return null
+        return mConnection.executeForCursorWindowAsync(sql, bindArgs,
+                window, startPos, requiredPos, countAllRows, columnMask)
+    }
+
+    /**
+     * Opens a forward-only stream over the query's rows, see [SQLiteStreamCursor].
+     */
+    fun openStream(sql:String, bindArgs:Array<Any?>?):SQLiteStreamCursor {
+        when (DatabaseUtils.getSqlStatementType(sql)) {
+            DatabaseUtils.STATEMENT_BEGIN, DatabaseUtils.STATEMENT_COMMIT, DatabaseUtils.STATEMENT_ABORT ->
+                throw IllegalArgumentException("Transactions can't be run as a stream: $sql")
+        }
+        return withLock {
+            SQLiteStreamCursor(this, mConnection, mConnection.openStream(sql, bindArgs, !hasTransaction()))
+        }
+    }
+
+    /**
+     * Runs proc for a stream, under the session lock unless the stream is on a reader connection.
+     */
+    internal fun <T> withStreamLock(onReader:Boolean, proc:() -> T):T =
+            if (onReader) proc() else withLock(proc)
 
     /**
      * Performs special reinterpretation of certain SQL statements such as "BEGIN",
@@ -481,6 +566,29 @@ class SQLiteSession(private val mConnection: SQLiteConnection) {
         return false
     }
 
+    fun getContentionStats():SQLiteDebug.ContentionStats = withLock { mConnection.getContentionStats() }
+
+    fun getCheckpointStats():SQLiteDebug.CheckpointStats = withLock { mConnection.getCheckpointStats() }
+
+    fun subscribeToChanges(capacity:Int):SQLiteChangeSubscription = withLock { mConnection.subscribeToChanges(capacity) }
+
+    fun clearResultCache() = withLock { mConnection.clearResultCache() }
+
+    fun getResultCacheStats():SQLiteDebug.ResultCacheStats = withLock { mConnection.getResultCacheStats() }
+
+    fun getQueryMetrics():List<SQLiteDebug.QueryMetrics> = withLock { mConnection.getQueryMetrics() }
+
+    fun resetQueryMetrics() = withLock { mConnection.resetQueryMetrics() }
+
+    fun getStatementStats():List<SQLiteDebug.StatementStats> = withLock { mConnection.getStatementStats() }
+
+    fun getConnectionMemoryStats(reset:Boolean):List<SQLiteDebug.ConnectionMemoryStats> =
+            withLock { mConnection.getConnectionMemoryStats(reset) }
+
+    fun getSlowQueries():List<SQLiteDebug.SlowQuery> = withLock { mConnection.getSlowQueries() }
+
+    fun clearSlowQueries() = withLock { mConnection.clearSlowQueries() }
+
     fun closeConnection() {
         withLock {
             mConnection.close()
@@ -61,6 +61,37 @@ class SQLiteStatement internal constructor(db:SQLiteDatabase, sql:String, bindAr
                     getSql(), getBindArgs())
         }
     }
+    /**
+     * Execute this INSERT once for every row of the given columns, in a single transaction.
+     * Any values bound to the statement itself are ignored.
+     *
+     * @param columns one column per bind parameter, each a LongArray, DoubleArray or Array
+     * of bind values, all of the same length.
+     * @return the row ID inserted by each row, or -1 for rows that inserted nothing.
+     *
+     * @throws android.database.SQLException If the SQL string is invalid or any row fails,
+     * in which case none of the rows are inserted.
+     */
+    fun executeInsertBatch(vararg columns:Any):LongArray {
+        return withRefCorrupt {
+            getSession().executeBatch(getSql(), columns, true)
+        }
+    }
+    /**
+     * Execute this UPDATE / DELETE once for every row of the given columns, in a single
+     * transaction. Any values bound to the statement itself are ignored.
+     *
+     * @param columns one column per bind parameter, as for {@link #executeInsertBatch}.
+     * @return the number of rows affected by each row of input.
+     *
+     * @throws android.database.SQLException If the SQL string is invalid or any row fails,
+     * in which case none of the changes are kept.
+     */
+    fun executeUpdateDeleteBatch(vararg columns:Any):LongArray {
+        return withRefCorrupt {
+            getSession().executeBatch(getSql(), columns, false)
+        }
+    }
     /**
      * Execute a statement that returns a 1 by 1 table with a numeric value.
      * For example, SELECT COUNT(*) FROM table;
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import co.touchlab.knarch.db.Cursor
+import co.touchlab.knarch.db.CursorIndexOutOfBoundsException
+import kotlinx.cinterop.*
+
+/**
+ * A forward-only cursor that reads each row straight from the statement as it is stepped,
+ * see [SQLiteDatabase.rawQueryStream]. Nothing is copied into a cursor window, so memory use
+ * doesn't grow with the result, but the cursor can only move to the next row and can't be
+ * requeried.
+ *
+ * The query runs on one of the reader connections when it can, which is kept leased until the
+ * cursor is closed. Otherwise it runs on the database's own connection, and each call waits
+ * for the database's other work. Closing the database closes the cursor, after which every
+ * call but [close] throws. Use it from one thread at a time.
+ */
+class SQLiteStreamCursor internal constructor(private val session:SQLiteSession,
+                                              private val connection:SQLiteConnection,
+                                              private var streamPtr:Long) {
+    private val onReader = nativeStreamIsOnReader(streamPtr)
+    private var positioned = false
+
+    /**
+     * True when the query runs on a reader connection.
+     */
+    fun isOnReader():Boolean = onReader
+
+    /**
+     * Moves to the next row, starting with the first.
+     *
+     * @return False once there are no more rows.
+     */
+    fun moveToNext():Boolean {
+        positioned = access { nativeStreamStep(it) }
+        return positioned
+    }
+
+    fun getColumnCount():Int = access { nativeStreamGetColumnCount(it) }
+
+    fun getColumnName(columnIndex:Int):String? = access { nativeStreamGetColumnName(it, columnIndex) }
+
+    fun getColumnIndex(columnName:String):Int = access {
+        val count = nativeStreamGetColumnCount(it)
+        (0 until count).firstOrNull { i -> columnName.equals(nativeStreamGetColumnName(it, i), ignoreCase = true) } ?: -1
+    }
+
+    /**
+     * The value's type in the current row, one of the Cursor.FIELD_TYPE_* values.
+     */
+    fun getType(columnIndex:Int):Int = row { nativeStreamGetType(it, columnIndex) }
+
+    fun isNull(columnIndex:Int):Boolean = getType(columnIndex) == Cursor.FIELD_TYPE_NULL
+
+    fun getLong(columnIndex:Int):Long = row { nativeStreamGetLong(it, columnIndex) }
+
+    fun getInt(columnIndex:Int):Int = getLong(columnIndex).toInt()
+
+    fun getDouble(columnIndex:Int):Double = row { nativeStreamGetDouble(it, columnIndex) }
+
+    fun getString(columnIndex:Int):String? = row { nativeStreamGetString(it, columnIndex) }
+
+    fun getBlob(columnIndex:Int):ByteArray? = row { nativeStreamGetBlob(it, columnIndex) }
+
+    /**
+     * SQLite's own copy of the value as bytes, without copying it. Only valid until the cursor
+     * moves or is closed, or the database is closed. Null for a NULL or empty value.
+     */
+    fun getBytesPointer(columnIndex:Int):CPointer<ByteVar>? =
+            row { nativeStreamGetBytes(it, columnIndex) }.toCPointer()
+
+    /**
+     * The size in bytes of the value returned by [getBytesPointer].
+     */
+    fun getByteCount(columnIndex:Int):Int = row { nativeStreamGetByteCount(it, columnIndex) }
+
+    fun isClosed():Boolean = streamPtr == 0L
+
+    /**
+     * Finishes the query, giving its reader connection back. Safe to call more than once.
+     */
+    fun close() {
+        val stream = streamPtr
+        if (stream != 0L)
+        {
+            streamPtr = 0
+            nativeStreamClose(stream)
+        }
+    }
+
+    private fun <T> access(proc:(Long) -> T):T {
+        val stream = streamPtr
+        if (stream == 0L)
+            throw IllegalStateException("The cursor has been closed.")
+        // The session lock is taken first, as everywhere else, so that closing the connection
+        // under it can wait for the access to end.
+        return session.withStreamLock(onReader) {
+            connection.withConnectionAccess { proc(stream) }
+        }
+    }
+
+    private fun <T> row(proc:(Long) -> T):T {
+        if (!positioned)
+            throw CursorIndexOutOfBoundsException("The cursor is not on a row.")
+        return access(proc)
+    }
+
+    companion object {
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamIsOnReader")
+        private external fun nativeStreamIsOnReader(streamPtr:Long):Boolean
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamStep")
+        private external fun nativeStreamStep(streamPtr:Long):Boolean
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamClose")
+        private external fun nativeStreamClose(streamPtr:Long)
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetColumnCount")
+        private external fun nativeStreamGetColumnCount(streamPtr:Long):Int
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetColumnName")
+        private external fun nativeStreamGetColumnName(streamPtr:Long, column:Int):String?
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetType")
+        private external fun nativeStreamGetType(streamPtr:Long, column:Int):Int
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetLong")
+        private external fun nativeStreamGetLong(streamPtr:Long, column:Int):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetDouble")
+        private external fun nativeStreamGetDouble(streamPtr:Long, column:Int):Double
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetString")
+        private external fun nativeStreamGetString(streamPtr:Long, column:Int):String?
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetBlob")
+        private external fun nativeStreamGetBlob(streamPtr:Long, column:Int):ByteArray?
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetBytes")
+        private external fun nativeStreamGetBytes(streamPtr:Long, column:Int):Long
+        @SymbolName("Android_Database_SQLiteConnection_nativeStreamGetByteCount")
+        private external fun nativeStreamGetByteCount(streamPtr:Long, column:Int):Int
+    }
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteBindTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testInsertBatch() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER UNIQUE, astr TEXT, dbl REAL);")
+        val stmt = mDatabase.compileStatement("INSERT INTO test (num, astr, dbl) VALUES (?, ?, ?)")
+
+        val count = 1000
+        val nums = LongArray(count) { it.toLong() }
+        val strs = Array<Any?>(count) { if (it % 10 == 0) null else "row $it" }
+        val dbls = DoubleArray(count) { it * 0.5 }
+
+        val rowIds = stmt.executeInsertBatch(nums, strs, dbls)
+        assertEquals(count, rowIds.size)
+        assertEquals(1L, rowIds[0])
+        assertEquals(count.toLong(), rowIds[count - 1])
+        assertEquals(count.toLong(), DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test", null))
+        assertEquals("row 7", DatabaseUtils.stringForQuery(mDatabase, "SELECT astr FROM test WHERE num = 7", null))
+        assertEquals(0L, DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test WHERE num = 10 AND astr IS NOT NULL", null))
+
+        //A duplicate in the middle should leave none of the second batch behind
+        val dupNums = LongArray(10) { (count + it).toLong() }
+        dupNums[5] = 3
+        try {
+            stmt.executeInsertBatch(dupNums, Array<Any?>(10) { "dup" }, DoubleArray(10))
+            fail("Expected constraint failure")
+        } catch (e: SQLiteException) {
+        }
+        assertEquals(count.toLong(), DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test", null))
+
+        val update = mDatabase.compileStatement("UPDATE test SET astr = ? WHERE num < ?")
+        val changes = update.executeUpdateDeleteBatch(arrayOf<Any?>("a", "b"), longArrayOf(5, 0))
+        assertEquals(5L, changes[0])
+        assertEquals(0L, changes[1])
+
+        stmt.close()
+        update.close()
+    }
+
+    @Test
+    fun testLargeBindArgs() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT, ablob BLOB);")
+
+        val sb = StringBuilder()
+        while (sb.length < 100 * 1024) {
+            sb.append("{\"key\":\"välue ${sb.length}\"},")
+        }
+        val bigString = sb.toString()
+        val bigBlob = ByteArray(64 * 1024) { it.toByte() }
+
+        //Run it twice so the cached statement is reused after its bindings are cleared
+        for (i in 0 until 2) {
+            mDatabase.execSQL("INSERT INTO test (num, astr, ablob) VALUES (?, ?, ?)", arrayOf<Any?>(i, bigString, bigBlob))
+        }
+
+        val cursor = mDatabase.rawQuery("SELECT astr, ablob FROM test ORDER BY num", null)
+        assertEquals(2, cursor.getCount())
+        while (cursor.moveToNext()) {
+            assertEquals(bigString, cursor.getString(0))
+            assertTrue(bigBlob.contentEquals(cursor.getBlob(1)))
+        }
+        cursor.close()
+    }
+
+    @Test
+    fun testBindArguments() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, dbl REAL, astr TEXT, ablob BLOB, nothing TEXT);")
+        val session = mDatabase.getThreadSession()
+        val sql = "INSERT INTO test (num, dbl, astr, ablob, nothing) VALUES (?, ?, ?, ?, ?)"
+
+        //Every type goes to native in the one bind call
+        session.execute(sql, arrayOf<Any?>(42L, 1.5, "text \u00e9\ud83d\ude00", byteArrayOf(1, 2, 3), null))
+        session.execute(sql, arrayOf<Any?>(7, 2.5f, "", ByteArray(0), null))
+
+        val cursor = mDatabase.rawQuery("SELECT num, dbl, astr, ablob, nothing FROM test ORDER BY rowid", null)
+        assertTrue(cursor.moveToFirst())
+        assertEquals(Cursor.FIELD_TYPE_INTEGER, cursor.getType(0))
+        assertEquals(42L, cursor.getLong(0))
+        assertEquals(Cursor.FIELD_TYPE_FLOAT, cursor.getType(1))
+        assertEquals(1.5, cursor.getDouble(1))
+        assertEquals("text \u00e9\ud83d\ude00", cursor.getString(2))
+        assertTrue(byteArrayOf(1, 2, 3).contentEquals(cursor.getBlob(3)!!))
+        assertTrue(cursor.isNull(4))
+        assertTrue(cursor.moveToNext())
+        assertEquals(7L, cursor.getLong(0))
+        assertEquals(2.5, cursor.getDouble(1))
+        assertEquals("", cursor.getString(2))
+        assertEquals(0, cursor.getBlob(3)!!.size)
+        cursor.close()
+
+        //The count is checked before anything is bound
+        val tooFew = assertFailsWith<SQLiteException> {
+            session.execute(sql, arrayOf<Any?>(1L, 2.0))
+        }
+        assertEquals("Expected 5 bind arguments but 2 were provided.", tooFew.message)
+        assertFailsWith<SQLiteException> {
+            session.execute(sql, arrayOfNulls<Any?>(6))
+        }
+        assertFailsWith<SQLiteException> {
+            session.execute(sql, null)
+        }
+        assertEquals(2L, DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test", null))
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteBusyTimeoutTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testBusyTimeout() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER);")
+        val other = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        try {
+            other.setBusyTimeout(100, 10)
+            mDatabase.beginTransaction()
+            try {
+                mDatabase.execSQL("INSERT INTO test (num) VALUES (1)")
+                try {
+                    other.execSQL("INSERT INTO test (num) VALUES (2)")
+                    fail("Expected the write to time out")
+                } catch (e: SQLiteException) {
+                }
+            } finally {
+                mDatabase.endTransaction()
+            }
+
+            val stats = other.getContentionStats()
+            assertTrue(stats.busyWaits >= 1)
+            assertTrue(stats.busyTimeouts >= 1)
+            assertTrue(stats.busyRetries >= 1)
+
+            //Free again once the transaction is over
+            other.execSQL("INSERT INTO test (num) VALUES (3)")
+        } finally {
+            other.close()
+        }
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
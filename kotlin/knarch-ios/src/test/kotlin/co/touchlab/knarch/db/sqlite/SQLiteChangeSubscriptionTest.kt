@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteChangeSubscriptionTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testChangeSubscription() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        mDatabase.execSQL("CREATE TABLE other (num INTEGER);")
+        val subscription = mDatabase.subscribeToChanges()
+        assertNull(subscription.poll())
+
+        mDatabase.beginTransaction()
+        try {
+            for (i in 1..5) {
+                mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, "row $i"))
+            }
+            mDatabase.execSQL("UPDATE test SET astr = 'changed' WHERE num IN (2, 4)")
+            mDatabase.setTransactionSuccessful()
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        //Rolled back changes never arrive
+        mDatabase.beginTransaction()
+        try {
+            mDatabase.execSQL("DELETE FROM test")
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        mDatabase.execSQL("INSERT INTO other (num) VALUES (1)")
+
+        val batches = subscription.pollAll()
+        assertEquals(2, batches.size)
+        val first = batches[0]
+        assertEquals(1L, first.sequence)
+        assertTrue(first.complete)
+        assertTrue(first.affects("test"))
+        assertFalse(first.affects("other"))
+        val inserts = first.changes.single { it.operation == SQLiteChangeBatch.OPERATION_INSERT }
+        assertEquals("main", inserts.database)
+        assertEquals("test", inserts.table)
+        assertEquals(5L, inserts.rowCount)
+        assertEquals(listOf(1L, 5L), inserts.rowIdRanges.toList())
+        val updates = first.changes.single { it.operation == SQLiteChangeBatch.OPERATION_UPDATE }
+        assertEquals(listOf(2L, 2L, 4L, 4L), updates.rowIdRanges.toList())
+        assertEquals(2L, batches[1].sequence)
+        assertEquals("other", batches[1].changes.single().table)
+
+        //A subscriber that falls behind is told it missed something
+        val slow = mDatabase.subscribeToChanges(1)
+        mDatabase.execSQL("INSERT INTO other (num) VALUES (2)")
+        mDatabase.execSQL("INSERT INTO other (num) VALUES (3)")
+        assertTrue(slow.poll()!!.complete)
+        assertFalse(slow.poll()!!.complete)
+        assertNull(slow.poll())
+        slow.close()
+
+        mDatabase.close()
+        assertTrue(subscription.isClosed())
+        subscription.close()
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+import platform.Foundation.*
+
+class SQLiteCheckpointTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testBackgroundCheckpoints() {
+        assertTrue(mDatabase.enableWriteAheadLogging())
+        mDatabase.setWalCheckpointPolicy(4, 50)
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (i in 0 until 20) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, "str $i"))
+        }
+
+        //Once writes stop, the checkpointer copies back the rest and truncates the WAL
+        var stats = mDatabase.getCheckpointStats()
+        for (i in 0 until 50) {
+            if (stats.truncateCheckpoints > 0 && stats.walFrames == 0L)
+                break
+            NSThread.sleepForTimeInterval(0.05)
+            stats = mDatabase.getCheckpointStats()
+        }
+        assertTrue(stats.passiveCheckpoints > 0)
+        assertTrue(stats.truncateCheckpoints > 0)
+        assertTrue(stats.framesCheckpointed > 0)
+        assertEquals(0L, stats.walFrames)
+
+        assertEquals(20, DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test", null).toInt())
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
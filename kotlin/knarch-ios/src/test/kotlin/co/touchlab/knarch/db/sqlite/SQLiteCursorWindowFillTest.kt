@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteCursorWindowFillTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testMixedColumnTypes() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, anything);")
+        mDatabase.beginTransaction()
+        try {
+            for (i in 0 until 500) {
+                val value:Any? = when (i % 5) {
+                    0 -> i.toLong()
+                    1 -> "str $i"
+                    2 -> null
+                    3 -> i * 0.25
+                    else -> byteArrayOf(i.toByte())
+                }
+                mDatabase.execSQL("INSERT INTO test (num, anything) VALUES (?, ?)", arrayOf<Any?>(i, value))
+            }
+            mDatabase.setTransactionSuccessful()
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        //Column types change from row to row, so the window fill must follow them
+        val cursor = mDatabase.rawQuery("SELECT num, anything FROM test ORDER BY num", null)
+        var row = 0
+        while (cursor.moveToNext()) {
+            assertEquals(Cursor.FIELD_TYPE_INTEGER, cursor.getType(0))
+            when (row % 5) {
+                0 -> assertEquals(row.toLong(), cursor.getLong(1))
+                1 -> assertEquals("str $row", cursor.getString(1))
+                2 -> assertEquals(Cursor.FIELD_TYPE_NULL, cursor.getType(1))
+                3 -> assertEquals(row * 0.25, cursor.getDouble(1))
+                else -> assertEquals(row.toByte(), cursor.getBlob(1)[0])
+            }
+            row++
+        }
+        assertEquals(500, row)
+        cursor.close()
+    }
+
+    @Test
+    fun testFetchedColumns() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT, other TEXT);")
+        mDatabase.beginTransaction()
+        try {
+            for (i in 0 until 100) {
+                mDatabase.execSQL("INSERT INTO test (num, astr, other) VALUES (?, ?, ?)", arrayOf<Any?>(i, "str $i", "other $i"))
+            }
+            mDatabase.setTransactionSuccessful()
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        val cursor = mDatabase.rawQuery("SELECT * FROM test ORDER BY num", null) as SQLiteCursor
+        cursor.setFetchedColumns("num")
+        var row = 0
+        while (cursor.moveToNext()) {
+            assertEquals(row, cursor.getInt(0))
+            row++
+        }
+        assertEquals(100, row)
+
+        //Reading a column that was left out brings it in
+        assertTrue(cursor.moveToPosition(42))
+        assertEquals("other 42", cursor.getString(2))
+        assertEquals(42, cursor.getInt(0))
+        assertFalse(cursor.isNull(1))
+        assertEquals("str 42", cursor.getString(1))
+        cursor.close()
+    }
+
+    @Test
+    fun testRowCountCache() {
+        mDatabase.setRowCountCacheSize(8)
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (i in 0 until 10) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, "str $i"))
+        }
+
+        fun countFor(max:Int):Int {
+            val cursor = mDatabase.rawQuery("SELECT * FROM test WHERE num < ?", arrayOf(max.toString()))
+            val count = cursor.getCount()
+            cursor.close()
+            return count
+        }
+
+        assertEquals(10, countFor(100))
+        assertEquals(10, countFor(100))
+        assertEquals(5, countFor(5))
+
+        //Any write has to invalidate what was remembered
+        mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(3, "again"))
+        assertEquals(11, countFor(100))
+        assertEquals(6, countFor(5))
+
+        mDatabase.execSQL("DELETE FROM test WHERE num > 7")
+        assertEquals(9, countFor(100))
+
+        //A count taken inside a transaction that rolls back must not outlive it
+        mDatabase.beginTransaction()
+        try {
+            mDatabase.execSQL("DELETE FROM test")
+            assertEquals(0, countFor(100))
+        } finally {
+            mDatabase.endTransaction()
+        }
+        assertEquals(9, countFor(100))
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteMemoryTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testConnectionMemoryStats() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (i in 1..50) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES ($i, 'row $i')")
+        }
+        assertEquals(50L, DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test", null))
+
+        val main = mDatabase.getConnectionMemoryStats().first()
+        assertEquals("main", main.connection)
+        assertTrue(main.cacheUsedBytes > 0L)
+        assertTrue(main.schemaUsedBytes > 0L)
+        assertTrue(main.cacheHits > 0L)
+        assertTrue(main.cacheHitRate > 0.0 && main.cacheHitRate <= 1.0)
+        assertFalse(main.deferredForeignKeys)
+
+        //Counts start over once read with reset, and reading runs no query
+        mDatabase.getConnectionMemoryStats(true)
+        assertEquals(0L, mDatabase.getConnectionMemoryStats().first().cacheHits)
+
+        val process = SQLiteGlobal.getMemoryStats()
+        assertTrue(process.usedBytes > 0L)
+        assertTrue(process.usedMaxBytes >= process.usedBytes)
+    }
+
+    @Test
+    fun testHeapLimits() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (i in 1..50) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES ($i, 'row $i')")
+        }
+
+        SQLiteGlobal.setHeapLimits(16 * 1024 * 1024)
+        try {
+            assertEquals(16L * 1024 * 1024, SQLiteGlobal.getMemoryStats().softHeapLimitBytes)
+            assertEquals(0L, SQLiteGlobal.getMemoryStats().hardHeapLimitBytes)
+
+            //Open windows are counted against the limit
+            val cursor = mDatabase.rawQuery("SELECT * FROM test", null)
+            try {
+                assertTrue(cursor.moveToFirst())
+                assertTrue(SQLiteGlobal.getMemoryStats().cursorWindowBytes > 0L)
+            } finally {
+                cursor.close()
+            }
+        } finally {
+            SQLiteGlobal.setHeapLimits(8 * 1024 * 1024)
+        }
+
+        mDatabase.setPageCacheSize(64 * 1024)
+        assertEquals(-64L, DatabaseUtils.longForQuery(mDatabase, "PRAGMA cache_size", null))
+        assertEquals(50L, DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test", null))
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
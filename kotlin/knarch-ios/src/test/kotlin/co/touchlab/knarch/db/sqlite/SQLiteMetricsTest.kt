@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteMetricsTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testQueryMetrics() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (i in 1..20) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES ($i, 'row $i')")
+        }
+        for (i in 1..5) {
+            val cursor = mDatabase.rawQuery("SELECT * FROM test WHERE num > ?", arrayOf("$i"))
+            assertTrue(cursor.moveToFirst())
+            cursor.close()
+        }
+
+        val metrics = mDatabase.getQueryMetrics()
+        //Literals are normalized away, so the inserts are one query
+        val insert = metrics.single { it.sql == "INSERT INTO test (num, astr) VALUES (?, ?)" }
+        assertEquals(20L, insert.step.count)
+        assertTrue(insert.step.p50Micros <= insert.step.p99Micros)
+        assertTrue(insert.step.p99Micros <= insert.step.maxMicros)
+        val select = metrics.single { it.sql == "SELECT * FROM test WHERE num > ?" }
+        assertEquals(5L, select.fill.count)
+        assertTrue(select.prepare.count >= 1L)
+
+        mDatabase.resetQueryMetrics()
+        assertTrue(mDatabase.getQueryMetrics().none { it.sql == insert.sql })
+    }
+
+    @Test
+    fun testStatementStats() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (i in 1..20) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES ($i, 'row $i')")
+        }
+        for (i in 1..3) {
+            val cursor = mDatabase.rawQuery("SELECT * FROM test WHERE num > ? ORDER BY astr", arrayOf("$i"))
+            assertTrue(cursor.moveToFirst())
+            cursor.close()
+        }
+
+        val stats = mDatabase.getStatementStats()
+        val select = stats.single { it.sql == "SELECT * FROM test WHERE num > ? ORDER BY astr" }
+        assertEquals(3L, select.runs)
+        //No index on num, so every run scans the table, and none on astr to sort by
+        assertTrue(select.fullScanSteps >= 3L * 19)
+        assertEquals(3L, select.sorts)
+        assertTrue(select.vmSteps > 0L)
+        val insert = stats.single { it.sql == "INSERT INTO test (num, astr) VALUES (?, ?)" }
+        assertEquals(20L, insert.runs)
+        assertEquals(0L, insert.fullScanSteps)
+        for (i in 1 until stats.size) {
+            assertTrue(stats[i - 1].vmSteps >= stats[i].vmSteps)
+        }
+
+        mDatabase.resetQueryMetrics()
+        assertTrue(mDatabase.getStatementStats().none { it.sql == select.sql })
+    }
+
+    @Test
+    fun testSlowQueryLog() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (1, 'one')")
+        assertTrue(mDatabase.getSlowQueries().isEmpty())
+        mDatabase.setSlowQueryThreshold(1, 4)
+
+        val sql = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < ?) " +
+                "SELECT count(*) FROM c, test WHERE c.x % 7 = test.num AND test.astr <> ?"
+        val stmt = mDatabase.compileStatement(sql)
+        stmt.bindLong(1, 200000)
+        stmt.bindString(2, "two")
+        assertEquals(28572L, stmt.simpleQueryForLong())
+        stmt.close()
+
+        val slow = mDatabase.getSlowQueries().single { it.sql.startsWith("WITH RECURSIVE") }
+        assertEquals(listOf("INTEGER", "TEXT"), slow.argumentTypes)
+        assertTrue(slow.micros >= 1000L)
+        assertTrue(slow.plan.contains("SCAN"))
+        assertTrue(slow.toString().contains(slow.plan.lines().first()))
+
+        mDatabase.clearSlowQueries()
+        assertTrue(mDatabase.getSlowQueries().isEmpty())
+        mDatabase.setSlowQueryThreshold(0)
+        assertTrue(mDatabase.getSlowQueries().isEmpty())
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
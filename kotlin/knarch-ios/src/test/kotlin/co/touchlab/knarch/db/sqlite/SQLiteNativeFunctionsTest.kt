@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteNativeFunctionsTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testNativeFunctions() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (word in listOf("apple", "Banana", "cherry", "ÄPFEL")) {
+            mDatabase.execSQL("INSERT INTO test (astr) VALUES (?)", arrayOf<Any?>(word))
+        }
+
+        assertEquals(2L, DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test WHERE astr REGEXP '^[a-c].*[ey]$'", null))
+        assertEquals(1L, DatabaseUtils.longForQuery(mDatabase, "SELECT 'abc' REGEXP 'b+'", null))
+        try {
+            DatabaseUtils.longForQuery(mDatabase, "SELECT 'abc' REGEXP '('", null)
+            fail("Bad pattern should fail")
+        } catch (e: SQLiteException) {
+        }
+
+        assertEquals("äpfel", DatabaseUtils.stringForQuery(mDatabase, "SELECT unicode_lower(astr) FROM test WHERE astr LIKE 'Ä%'", null))
+        assertEquals("banana", DatabaseUtils.stringForQuery(mDatabase, "SELECT unicode_lower('Banana')", null))
+
+        //FNV-1a of "a"
+        assertEquals(-5808556873153909620L, DatabaseUtils.longForQuery(mDatabase, "SELECT hash('a')", null))
+        assertEquals(1L, DatabaseUtils.longForQuery(mDatabase, "SELECT hash('a') = hash(x'61')", null))
+        assertNull(DatabaseUtils.stringForQuery(mDatabase, "SELECT hash(NULL)", null))
+
+        //The sum doesn't depend on row order, and works as a window function
+        val sum = DatabaseUtils.longForQuery(mDatabase, "SELECT hash_sum(astr) FROM test", null)
+        assertEquals(sum, DatabaseUtils.longForQuery(mDatabase, "SELECT hash_sum(astr) FROM (SELECT astr FROM test ORDER BY astr DESC)", null))
+        val cursor = mDatabase.rawQuery("SELECT hash(astr), hash_sum(astr) OVER (ORDER BY rowid ROWS BETWEEN 1 PRECEDING AND CURRENT ROW) FROM test ORDER BY rowid", null)
+        var previous = 0L
+        while (cursor.moveToNext()) {
+            assertEquals(previous + cursor.getLong(0), cursor.getLong(1))
+            previous = cursor.getLong(0)
+        }
+        cursor.close()
+    }
+
+    @Test
+    fun testUnicodeCollation() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        val names = listOf("zebra", "Émile", "apple", "Zoë", "emile", "Apple", "10", "9", "_x", "Æon", "aeon")
+        for (name in names) {
+            mDatabase.execSQL("INSERT INTO test (astr) VALUES (?)", arrayOf<Any?>(name))
+        }
+
+        val expected = listOf("_x", "10", "9", "aeon", "Æon", "apple", "Apple", "emile", "Émile", "zebra", "Zoë")
+        fun sorted(sql: String): List<String> {
+            val cursor = mDatabase.rawQuery(sql, null)
+            val result = ArrayList<String>()
+            while (cursor.moveToNext()) {
+                result.add(cursor.getString(0))
+            }
+            cursor.close()
+            return result
+        }
+        assertEquals(expected, sorted("SELECT astr FROM test ORDER BY astr COLLATE UNICODE"))
+        assertEquals(expected, sorted("SELECT astr FROM test ORDER BY astr COLLATE LOCALIZED"))
+
+        //Sort keys give the same order from an index
+        mDatabase.execSQL("CREATE INDEX test_key ON test (unicode_sort_key(astr))")
+        assertEquals(expected, sorted("SELECT astr FROM test ORDER BY unicode_sort_key(astr)"))
+
+        //Decomposed text sorts with composed
+        assertEquals(-1L, DatabaseUtils.longForQuery(mDatabase, "SELECT CASE WHEN 'e' || char(769) < 'f' COLLATE UNICODE THEN -1 ELSE 1 END", null))
+        assertEquals(0L, DatabaseUtils.longForQuery(mDatabase, "SELECT 'abc' = 'ABC' COLLATE UNICODE", null))
+        assertEquals(1L, DatabaseUtils.longForQuery(mDatabase, "SELECT 'abc' = 'abc' COLLATE UNICODE", null))
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
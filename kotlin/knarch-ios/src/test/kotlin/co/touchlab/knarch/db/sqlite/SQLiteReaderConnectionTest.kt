@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteReaderConnectionTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testReaderConnections() {
+        assertTrue(mDatabase.enableWriteAheadLogging())
+        mDatabase.setReaderConnectionCount(2)
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (i in 0 until 10) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, "str $i"))
+        }
+
+        var cursor = mDatabase.rawQuery("SELECT astr FROM test WHERE num = ?", arrayOf("4"))
+        assertTrue(cursor.moveToFirst())
+        assertEquals("str 4", cursor.getString(0))
+        cursor.close()
+
+        //Inside a transaction, queries have to see what it has written so far
+        mDatabase.beginTransaction()
+        try {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(10, "str 10"))
+            cursor = mDatabase.rawQuery("SELECT count(*) FROM test", null)
+            assertTrue(cursor.moveToFirst())
+            assertEquals(11, cursor.getInt(0))
+            cursor.close()
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        cursor = mDatabase.rawQuery("SELECT count(*) FROM test", null)
+        assertTrue(cursor.moveToFirst())
+        assertEquals(10, cursor.getInt(0))
+        cursor.close()
+
+        //Schema changes made on the writer are picked up by the readers
+        mDatabase.execSQL("ALTER TABLE test ADD COLUMN extra TEXT;")
+        cursor = mDatabase.rawQuery("SELECT * FROM test", null)
+        assertEquals(3, cursor.getColumnCount())
+        assertEquals(10, cursor.getCount())
+        cursor.close()
+
+        //Readers can't see the writer's temp tables, so those queries go back to the writer
+        mDatabase.execSQL("CREATE TEMP TABLE scratch (num INTEGER);")
+        mDatabase.execSQL("INSERT INTO scratch (num) VALUES (7)")
+        assertEquals(7L, DatabaseUtils.longForQuery(mDatabase, "SELECT num FROM scratch", null))
+        cursor = mDatabase.rawQuery("SELECT num FROM scratch", null)
+        assertEquals(1, cursor.getCount())
+        cursor.close()
+    }
+
+    @Test
+    fun testAsyncFill() {
+        assertTrue(mDatabase.enableWriteAheadLogging())
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        for (i in 0 until 100) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, "str $i"))
+        }
+
+        //Without readers the window is filled before the call returns
+        var window = CursorWindow()
+        var fill = mDatabase.fillWindowAsync("SELECT num, astr FROM test WHERE num >= ?", arrayOf<Any?>(50), window)
+        assertTrue(fill.isDone())
+        assertEquals(50, fill.await())
+        window.close()
+
+        mDatabase.setReaderConnectionCount(2)
+        window = CursorWindow()
+        fill = mDatabase.fillWindowAsync("SELECT num, astr FROM test WHERE num >= ? ORDER BY num", arrayOf<Any?>(50), window)
+        assertEquals(50, fill.await())
+        assertEquals(50, window.numRows)
+        assertEquals(50L, window.getLong(0, 0))
+        assertEquals("str 99", window.getString(49, 1))
+        window.close()
+
+        window = CursorWindow()
+        fill = mDatabase.fillWindowAsync("SELECT nothere FROM test", null, window)
+        assertFailsWith<SQLiteException> { fill.await() }
+        window.close()
+    }
+
+    @Test
+    fun testPrefetchedWindows() {
+        assertTrue(mDatabase.enableWriteAheadLogging())
+        mDatabase.setReaderConnectionCount(2)
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        //Around 5MB of rows, so the cursor goes through several windows
+        val padding = "x".repeat(1000)
+        mDatabase.beginTransaction()
+        try {
+            for (i in 0 until 5000) {
+                mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, "$i $padding"))
+            }
+            mDatabase.setTransactionSuccessful()
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        val cursor = mDatabase.rawQuery("SELECT num, astr FROM test ORDER BY num", null)
+        assertEquals(5000, cursor.getCount())
+        var expected = 0
+        while (cursor.moveToNext()) {
+            assertEquals(expected.toLong(), cursor.getLong(0))
+            assertEquals("$expected $padding", cursor.getString(1))
+            expected++
+        }
+        assertEquals(5000, expected)
+
+        //Moving back before the prefetched window still works
+        assertTrue(cursor.moveToPosition(10))
+        assertEquals(10L, cursor.getLong(0))
+        cursor.close()
+    }
+
+    @Test
+    fun testPrefetchDeclined() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        val padding = "x".repeat(1000)
+        mDatabase.beginTransaction()
+        try {
+            for (i in 0 until 5000) {
+                mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, "$i $padding"))
+            }
+            mDatabase.setTransactionSuccessful()
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        //No readers, so every window is filled on this thread
+        assertEquals(5000, readAll(padding))
+
+        //With readers, but inside a transaction, which keeps the query on the writer
+        assertTrue(mDatabase.enableWriteAheadLogging())
+        mDatabase.setReaderConnectionCount(2)
+        mDatabase.beginTransaction()
+        try {
+            assertEquals(5000, readAll(padding))
+        } finally {
+            mDatabase.endTransaction()
+        }
+    }
+
+    private fun readAll(padding:String):Int {
+        val cursor = mDatabase.rawQuery("SELECT num, astr FROM test ORDER BY num", null)
+        var expected = 0
+        while (cursor.moveToNext()) {
+            assertEquals(expected.toLong(), cursor.getLong(0))
+            assertEquals("$expected $padding", cursor.getString(1))
+            expected++
+        }
+        cursor.close()
+        return expected
+    }
+
+    @Test
+    fun testStreamingCursor() {
+        assertTrue(mDatabase.enableWriteAheadLogging())
+        mDatabase.setReaderConnectionCount(1)
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT, ablob BLOB);")
+        mDatabase.beginTransaction()
+        try {
+            for (i in 0 until 1000) {
+                mDatabase.execSQL("INSERT INTO test (num, astr, ablob) VALUES (?, ?, ?)",
+                        arrayOf<Any?>(i, "row $i", if (i % 2 == 0) byteArrayOf(i.toByte(), 7) else null))
+            }
+            mDatabase.setTransactionSuccessful()
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        val stream = mDatabase.rawQueryStream("SELECT num, astr, ablob FROM test WHERE num >= ? ORDER BY num", arrayOf<Any?>(10))
+        assertTrue(stream.isOnReader())
+        assertEquals(3, stream.getColumnCount())
+        assertEquals("astr", stream.getColumnName(1))
+        var expected = 10
+        while (stream.moveToNext()) {
+            assertEquals(expected.toLong(), stream.getLong(0))
+            assertEquals("row $expected", stream.getString(1))
+            if (expected % 2 == 0) {
+                assertEquals(Cursor.FIELD_TYPE_BLOB, stream.getType(2))
+                assertEquals(2, stream.getByteCount(2))
+                assertEquals(7.toByte(), stream.getBytesPointer(2)!![1])
+                assertEquals(expected.toByte(), stream.getBlob(2)!![0])
+            } else {
+                assertTrue(stream.isNull(2))
+            }
+            expected++
+        }
+        assertEquals(1000, expected)
+        assertFalse(stream.moveToNext())
+        stream.close()
+        stream.close()
+
+        //Inside a transaction the stream sees uncommitted rows on the writer
+        mDatabase.beginTransaction()
+        try {
+            mDatabase.execSQL("DELETE FROM test WHERE num >= 5")
+            val inTransaction = mDatabase.rawQueryStream("SELECT count(*) FROM test")
+            assertFalse(inTransaction.isOnReader())
+            assertTrue(inTransaction.moveToNext())
+            assertEquals(5, inTransaction.getInt(0))
+            inTransaction.close()
+        } finally {
+            mDatabase.endTransaction()
+        }
+
+        //With the only reader held by a stream, other queries run on the writer instead of waiting
+        val holding = mDatabase.rawQueryStream("SELECT num FROM test")
+        assertTrue(holding.isOnReader())
+        val second = mDatabase.rawQueryStream("SELECT count(*) FROM test")
+        assertFalse(second.isOnReader())
+        assertTrue(second.moveToNext())
+        assertEquals(1000, second.getInt(0))
+        second.close()
+        val cursor = mDatabase.rawQuery("SELECT count(*) FROM test", null)
+        assertTrue(cursor.moveToFirst())
+        assertEquals(1000, cursor.getInt(0))
+        cursor.close()
+        val window = CursorWindow()
+        assertEquals(1000, mDatabase.fillWindowAsync("SELECT num FROM test", null, window).await())
+        window.close()
+        holding.close()
+
+        //Closing the database closes streams left open
+        val leftOpen = mDatabase.rawQueryStream("SELECT num FROM test")
+        assertTrue(leftOpen.moveToNext())
+        mDatabase.close()
+        assertFails { leftOpen.moveToNext() }
+        leftOpen.close()
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteResultCacheTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testResultCache() {
+        mDatabase.setResultCacheSize(1024 * 1024)
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        mDatabase.execSQL("CREATE TABLE other (num INTEGER);")
+        for (i in 0 until 10) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, "row $i"))
+        }
+
+        fun sumOver(min:Int):Long {
+            val cursor = mDatabase.rawQuery("SELECT num, astr FROM test WHERE num >= ?", arrayOf("$min"))
+            var sum = 0L
+            while (cursor.moveToNext()) {
+                sum += cursor.getLong(0)
+                assertEquals("row ${cursor.getLong(0)}", cursor.getString(1))
+            }
+            cursor.close()
+            return sum
+        }
+
+        assertEquals(45L, sumOver(0))
+        assertEquals(45L, sumOver(0))
+        assertEquals(35L, sumOver(5))
+        assertEquals(1L, mDatabase.getResultCacheStats().hits)
+
+        //Writing another table leaves the entries alone
+        mDatabase.execSQL("INSERT INTO other (num) VALUES (1)")
+        assertEquals(45L, sumOver(0))
+        assertEquals(2L, mDatabase.getResultCacheStats().hits)
+
+        //Writing the table they read doesn't
+        mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(10, "row 10"))
+        assertEquals(55L, sumOver(0))
+        val stats = mDatabase.getResultCacheStats()
+        assertEquals(2L, stats.hits)
+        assertEquals(1L, stats.invalidated)
+
+        //Nor is anything read inside a transaction
+        mDatabase.beginTransaction()
+        try {
+            mDatabase.execSQL("DELETE FROM test WHERE num >= 5")
+            assertEquals(10L, sumOver(0))
+        } finally {
+            mDatabase.endTransaction()
+        }
+        assertEquals(55L, sumOver(0))
+
+        //Queries whose results change by themselves aren't kept
+        val before = mDatabase.getResultCacheStats().stores
+        for (i in 0 until 2) {
+            val cursor = mDatabase.rawQuery("SELECT random()", null)
+            assertTrue(cursor.moveToFirst())
+            cursor.close()
+        }
+        assertEquals(before, mDatabase.getResultCacheStats().stores)
+    }
+
+    @Test
+    fun testResultCacheAfterClear() {
+        mDatabase.setResultCacheSize(1024 * 1024)
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER);")
+        mDatabase.execSQL("INSERT INTO test (num) VALUES (1)")
+
+        fun count():Int {
+            val cursor = mDatabase.rawQuery("SELECT num FROM test", null)
+            val rows = cursor.getCount()
+            cursor.close()
+            return rows
+        }
+
+        assertEquals(1, count())
+        assertEquals(1, count())
+        assertEquals(1L, mDatabase.getResultCacheStats().hits)
+
+        //The statement stays prepared, and is cached again once filled
+        mDatabase.clearResultCache()
+        assertEquals(1, count())
+        assertEquals(1, count())
+        assertEquals(2L, mDatabase.getResultCacheStats().hits)
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
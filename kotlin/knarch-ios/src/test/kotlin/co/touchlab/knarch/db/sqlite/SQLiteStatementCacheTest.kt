@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteStatementCacheTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testColumnNamesAfterAlterTable() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+
+        var cursor = mDatabase.rawQuery("SELECT * FROM test", null)
+        assertEquals(2, cursor.getColumnCount())
+        cursor.close()
+
+        //The cached SELECT must not keep reporting the old columns
+        mDatabase.execSQL("ALTER TABLE test ADD COLUMN extra TEXT;")
+
+        cursor = mDatabase.rawQuery("SELECT * FROM test", null)
+        assertEquals(3, cursor.getColumnCount())
+        assertEquals("extra", cursor.getColumnName(2))
+        cursor.close()
+    }
+
+    @Test
+    fun testColumnNamesAfterAlterTableElsewhere() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+
+        var cursor = mDatabase.rawQuery("SELECT * FROM test", null)
+        assertEquals(2, cursor.getColumnCount())
+        cursor.close()
+
+        val other = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        try
+        {
+            other.execSQL("ALTER TABLE test ADD COLUMN extra TEXT;")
+        }
+        finally
+        {
+            other.close()
+        }
+
+        //Running the cached SELECT is what notices the other connection's change
+        cursor = mDatabase.rawQuery("SELECT * FROM test", null)
+        cursor.getCount()
+        cursor.close()
+
+        cursor = mDatabase.rawQuery("SELECT * FROM test", null)
+        assertEquals(3, cursor.getColumnCount())
+        assertEquals("extra", cursor.getColumnName(2))
+        cursor.close()
+    }
+
+    @Test
+    fun testCloseAfterEvictions() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+        mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (1, 'one');")
+
+        //More distinct statements than the default cache of 25 holds, so most get evicted
+        val statements = ArrayList<SQLiteStatement>()
+        for (i in 0 until 60) {
+            val stmt = mDatabase.compileStatement("SELECT count(*) + $i FROM test")
+            assertEquals(1L + i, stmt.simpleQueryForLong())
+            statements.add(stmt)
+        }
+
+        //Closing with statements still cached, queued for finalizing, and never closed
+        mDatabase.close()
+
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertEquals(1L, DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test", null))
+        mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (2, 'two');")
+        assertEquals(2L, DatabaseUtils.longForQuery(mDatabase, "SELECT count(*) FROM test", null))
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2018 Touchlab Inc
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package co.touchlab.knarch.db.sqlite
+
+import kotlin.test.*
+import co.touchlab.knarch.*
+import co.touchlab.knarch.db.*
+import co.touchlab.knarch.io.*
+
+class SQLiteStringTranscodingTest {
+    private lateinit var mDatabase:SQLiteDatabase
+    private var mDatabaseFile:File?=null
+    private var mDatabaseFilePath:String?=null
+
+    private val systemContext = DefaultSystemContext()
+    private fun getContext():SystemContext = systemContext
+
+    @BeforeEach
+    protected fun setUp() {
+        getContext().deleteDatabase(DATABASE_FILE_NAME)
+        mDatabaseFilePath = getContext().getDatabasePath(DATABASE_FILE_NAME).path
+        mDatabaseFile = getContext().getDatabasePath(DATABASE_FILE_NAME)
+        mDatabaseFile?.getParentFile()?.mkdirs() // directory may not exist
+        mDatabase = SQLiteDatabase.openOrCreateDatabase(mDatabaseFilePath!!, null)
+        assertNotNull(mDatabase)
+    }
+
+    @AfterEach
+    protected fun tearDown() {
+        mDatabase.close()
+        SQLiteDatabase.deleteDatabase(mDatabaseFile!!)
+    }
+
+    @Test
+    fun testSurrogatePairs() {
+        mDatabase.execSQL("CREATE TABLE test (astr TEXT);")
+
+        //A pair must survive a block boundary in the vector kernels, so put it everywhere
+        for (length in 2..70) {
+            for (pos in 0..length - 2) {
+                val sb = StringBuilder()
+                for (i in 0 until pos) sb.append('a')
+                sb.append("\ud83d\ude00")
+                for (i in pos + 2 until length) sb.append('b')
+                assertRoundTrip(sb.toString(), length + 2)
+            }
+        }
+    }
+
+    @Test
+    fun testUnpairedSurrogates() {
+        mDatabase.execSQL("CREATE TABLE test (astr TEXT);")
+
+        //Each unpaired surrogate is replaced on the way in
+        assertStored("a\ufffdb", "a\ud800b")
+        assertStored("\ufffd", "\udc00")
+        assertStored("x\ufffd", "x\ud83d")
+        assertStored("\ufffd\ufffd", "\ude00\ud83d")
+        assertStored("\ufffd\ud83d\ude00", "\ud83d\ud83d\ude00")
+        val prefix = "p".repeat(40)
+        assertStored(prefix + "\ufffd" + prefix, prefix + "\udbff" + prefix)
+    }
+
+    @Test
+    fun testMalformedUtf8() {
+        //SQLite keeps whatever bytes it is given, so each read decodes them as they are
+        assertDecoded("\ufffd\ufffd", "C0AF")              //Overlong '/'
+        assertDecoded("\ufffd\ufffd\ufffd", "E080AF")      //Overlong, three bytes
+        assertDecoded("\ufffd\ufffd\ufffd", "EDA080")      //Encoded surrogate
+        assertDecoded("\ufffd\ufffd\ufffd\ufffd", "F4908080") //Past U+10FFFF
+        assertDecoded("a\ufffd\ufffd", "61E282")           //Truncated
+        assertDecoded("\ufffd", "80")                       //Stray continuation
+        assertDecoded("\ud83d\ude00", "F09F9880")           //Valid, for contrast
+
+        val prefix = "61".repeat(40)
+        assertDecoded("a".repeat(40) + "\ufffd\ufffd" + "a".repeat(40), prefix + "C0AF" + prefix)
+    }
+
+    @Test
+    fun testBlockLengths() {
+        mDatabase.execSQL("CREATE TABLE test (astr TEXT);")
+
+        //Just below, at and past the 8, 16 and 32 unit blocks, and the scalar span of 32
+        for (length in listOf(0, 1, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 95, 96, 97)) {
+            assertRoundTrip(textOf(length, -1, 'a'), length)
+
+            //Non-ASCII at the start, the middle and the end of the ASCII run
+            if (length > 0) {
+                for (pos in listOf(0, length / 2, length - 1)) {
+                    assertRoundTrip(textOf(length, pos, '\u00e9'), length + 1)
+                    assertRoundTrip(textOf(length, pos, '\u4e2d'), length + 2)
+                }
+            }
+        }
+    }
+
+    @Test
+    fun testScratchBufferReuse() {
+        mDatabase.execSQL("CREATE TABLE test (num INTEGER, astr TEXT);")
+
+        //Bound strings are encoded into one buffer per thread, which grows, shrinks and is
+        //reused from one bind to the next
+        val lengths = listOf(10, 300, 5000, 20, 8000, 1, 4000, 0, 7000)
+        val values = lengths.mapIndexed { index, length ->
+            val sb = StringBuilder()
+            for (i in 0 until length) sb.append(if (i % 3 == index % 3) '\u4e2d' else 'a' + i % 26)
+            sb.toString()
+        }
+        for (i in values.indices) {
+            mDatabase.execSQL("INSERT INTO test (num, astr) VALUES (?, ?)", arrayOf<Any?>(i, values[i]))
+        }
+
+        val cursor = mDatabase.rawQuery("SELECT astr FROM test ORDER BY num", null)
+        try
+        {
+            for (value in values) {
+                assertTrue(cursor.moveToNext())
+                assertEquals(value, cursor.getString(0))
+            }
+        }
+        finally
+        {
+            cursor.close()
+        }
+
+        //Too large for the worst case guess, so it is measured first
+        val failed = assertFailsWith<SQLiteException> {
+            mDatabase.execSQL("SELECT '" + "\u4e2d".repeat(30000) + "' FROM nowhere")
+        }
+        assertTrue(failed.message!!.endsWith("' FROM nowhere"))
+    }
+
+    private fun textOf(length:Int, pos:Int, special:Char):String {
+        val sb = StringBuilder()
+        for (i in 0 until length) sb.append(if (i == pos) special else 'a' + i % 26)
+        return sb.toString()
+    }
+
+    private fun assertRoundTrip(value:String, utf8Length:Int) {
+        mDatabase.execSQL("DELETE FROM test")
+        mDatabase.execSQL("INSERT INTO test (astr) VALUES (?)", arrayOf<Any?>(value))
+        val cursor = mDatabase.rawQuery("SELECT astr, length(CAST(astr AS BLOB)) FROM test", null)
+        try
+        {
+            assertTrue(cursor.moveToFirst())
+            assertEquals(value, cursor.getString(0))
+            assertEquals(utf8Length, cursor.getInt(1))
+        }
+        finally
+        {
+            cursor.close()
+        }
+    }
+
+    private fun assertStored(expected:String, value:String) {
+        mDatabase.execSQL("DELETE FROM test")
+        mDatabase.execSQL("INSERT INTO test (astr) VALUES (?)", arrayOf<Any?>(value))
+        assertEquals(expected, DatabaseUtils.stringForQuery(mDatabase, "SELECT astr FROM test", null))
+    }
+
+    private fun assertDecoded(expected:String, hex:String) {
+        val cursor = mDatabase.rawQuery("SELECT CAST(X'$hex' AS TEXT)", null)
+        try
+        {
+            assertTrue(cursor.moveToFirst())
+            assertEquals(expected, cursor.getString(0))
+        }
+        finally
+        {
+            cursor.close()
+        }
+    }
+
+    companion object {
+        private val DATABASE_FILE_NAME = "database_test.db"
+    }
+}